@@ -379,13 +379,7 @@ edit_actions(char *app)
 		return FUNC_FAILURE;
 
 	/* Reload PATH commands as well to add new action(s) */
-	if (bin_commands) {
-		size_t i;
-		for (i = 0; bin_commands[i]; i++)
-			free(bin_commands[i]);
-		free(bin_commands);
-		bin_commands = (char **)NULL;
-	}
+	free_bin_commands();
 
 	if (paths) {
 		size_t i;
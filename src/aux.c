@@ -184,6 +184,15 @@ hashme(const char *restrict str, const int case_sensitive)
 	return hash;
 }
 
+/* Generate a hash of the file identified by the device DEV and the inode
+ * number INO (to be used by hash tables keyed by (dev, ino) pairs). */
+inline size_t
+hash_devino(const dev_t dev, const ino_t ino)
+{
+	const size_t h = (size_t)ino * 0x9E3779B1u;
+	return h ^ ((size_t)dev + (h << 6) + (h >> 2));
+}
+
 #if defined(__sun) && defined(ST_BTIME)
 struct timespec
 get_birthtime(const char *filename)
@@ -52,6 +52,7 @@ char *get_cwd(char *buf, const size_t buflen, const int check_workspace);
 mode_t get_dt(const mode_t mode);
 int  get_link_ref(const char *link);
 int  get_rgb(char *hex, int *attr, int *r, int *g, int *b);
+size_t hash_devino(const dev_t dev, const ino_t ino);
 size_t hashme(const char *str, const int case_sensitive);
 char *hex2rgb(char *hex);
 int  is_cmd_in_path(const char *cmd);
@@ -47,6 +47,7 @@
 #include "misc.h" /* xerror(), print_reload_msg() */
 #include "readline.h" /* rl_get_y_or_n() */
 #include "spawn.h" /* launch_execv() */
+#include "xcp.h" /* xcp_move() */
 
 #define BULK_RENAME_TMP_FILE_HEADER "# Clifm - Rename files in bulk\n\
 # Edit filenames, save, and quit the editor (you will be\n\
@@ -111,7 +112,8 @@ rename_file(char *oldpath, char *newpath)
 	}
 
 	char *cmd[] = {"mv", "--", oldpath, npath, NULL};
-	const int ret = launch_execv(cmd, FOREGROUND, E_NOFLAG);
+	const int ret = conf.mv_cmd == MV_BUILTIN ? xcp_move(oldpath, npath, "br")
+		: launch_execv(cmd, FOREGROUND, E_NOFLAG);
 	free(npath);
 	return ret;
 }
@@ -39,6 +39,7 @@
 #endif /* HAVE_FILE_ATTRS */
 
 #include "aux.h"
+#include "init.h" /* load_path_programs() */
 #include "misc.h"
 #include "sanitize.h" /* sanitize_cmd() */
 
@@ -217,9 +218,10 @@ check_third_party_cmds(void)
 	bin_flags |= GNU_DU_BIN_DU;
 #endif /* USE_DU1 && HAVE_GNU_DU */
 
-	if (conf.ext_cmd_ok == 0) {
-		/* We haven't loaded system binaries. Let's run an alternative,
-		 * though slower, check. */
+	/* Either we haven't loaded system binaries, or they are still being
+	 * loaded in the background (see get_path_programs()). Let's run an
+	 * alternative, though slower, check. */
+	if (conf.ext_cmd_ok == 0 || path_progsn == bin_cmds_seg[BIN_CMD_PATH]) {
 		check_third_party_cmds_alt();
 		return;
 	}
@@ -510,6 +512,8 @@ is_bin_cmd(char *str)
 		index++;
 	}
 
+	load_path_programs(1);
+
 	size_t i;
 	for (i = 0; bin_commands[i]; i++) {
 		if (*q == *bin_commands[i] && q[1] == bin_commands[i][1]
@@ -303,18 +303,13 @@ get_regfile_color(const char *filename, const struct stat *a, size_t *is_ext)
 	if (!ext)
 		return color ? color : fi_c;
 
-	size_t color_len = 0;
-	char *extcolor = get_ext_color(ext, &color_len);
-	if (!extcolor || color_len == 0 || color_len + 4 > sizeof(tmp_color))
+	size_t seq_len = 0;
+	char *extcolor = get_ext_color_seq(ext, &seq_len);
+	if (!extcolor || seq_len == 0)
 		return color ? color : fi_c;
 
-	*tmp_color = '\x1b'; tmp_color[1] = '[';
-	memcpy(tmp_color + 2, extcolor, color_len);
-	tmp_color[color_len + 2] = 'm';
-	tmp_color[color_len + 3] = '\0';
-
-	*is_ext = color_len + 3;
-	return tmp_color;
+	*is_ext = seq_len;
+	return extcolor;
 }
 
 /* Retrieve the color corresponding to dir FILENAME whose attributes are A.
@@ -659,27 +654,23 @@ bcomp(const void *a, const void *b)
 }
 
 /* Look for the hash HASH in the hash table for filename extensions.
- * Return a pointer to the corresponding color if found, or NULL.
- * If VAL_LEN isn't NULL, it is updated with the length of the returned value. */
-static char *
-check_ext_hash(const size_t hash, size_t *val_len)
+ * Return a pointer to the corresponding entry if found, or NULL. */
+static struct ext_t *
+check_ext_hash(const size_t hash)
 {
 	struct ext_t *ptr = bsearch(&hash, ext_colors, ext_colors_n,
 		sizeof(struct ext_t), bcomp);
 
 	if (!ptr || !ptr->value || !*ptr->value)
-		return (char *)NULL;
-
-	if (val_len)
-		*val_len = ptr->value_len;
+		return (struct ext_t *)NULL;
 
-	return ptr->value;
+	return ptr;
 }
 
-/* Return the color code associated to the file extension EXT, updating
- * VAL_LEN, if not NULL, to the length of this color code. */
-static char *
-check_ext_string(const char *ext, size_t *val_len)
+/* Return the entry in the extension colors table associated to the file
+ * extension EXT, or NULL if not found. */
+static struct ext_t *
+check_ext_string(const char *ext)
 {
 	/* Hold extension names. NAME_MAX should be enough: no filename should
 	 * go beyond NAME_MAX, so it's pretty safe to assume that no file extension
@@ -715,30 +706,59 @@ check_ext_string(const char *ext, size_t *val_len)
 		if (match == 0 || *q != '\0')
 			continue;
 
-		if (val_len)
-			*val_len = ext_colors[i].value_len;
-
-		return ext_colors[i].value;
+		return &ext_colors[i];
 	}
 
-	return (char *)NULL;
+	return (struct ext_t *)NULL;
 }
 
-/* Returns a pointer to the corresponding color code for the file
- * extension EXT (updating VAL_LEN to the length of this code).
+/* Return the entry in the extension colors table for the file extension EXT.
  * The hash table is checked first if we have no hash conflicts. Otherwise,
  * a regular string comparison is performed to resolve it. */
-char *
-get_ext_color(const char *ext, size_t *val_len)
+static struct ext_t *
+find_ext_color(const char *ext)
 {
 	if (!ext || !*ext || !*(++ext) || ext_colors_n == 0)
-		return (char *)NULL;
+		return (struct ext_t *)NULL;
 
 	/* If the hash field at index 0 is set to zero, we have hash conflicts. */
 	if (ext_colors[0].hash != 0)
-		return check_ext_hash(hashme(ext, 0), val_len);
+		return check_ext_hash(hashme(ext, 0));
+
+	return check_ext_string(ext);
+}
+
+/* Returns a pointer to the corresponding color code for the file
+ * extension EXT (updating VAL_LEN, if not NULL, to the length of this code). */
+char *
+get_ext_color(const char *ext, size_t *val_len)
+{
+	struct ext_t *e = find_ext_color(ext);
+	if (!e)
+		return (char *)NULL;
 
-	return check_ext_string(ext, val_len);
+	if (val_len)
+		*val_len = e->value_len;
+
+	return e->value;
+}
+
+/* Same as get_ext_color(), but return the full escape sequence for the
+ * color of the file extension EXT ("\x1b[CODEm"), updating SEQ_LEN, if not
+ * NULL, to the length of this sequence.
+ * The returned string is interned: it must not be freed by the caller,
+ * and it remains valid until exit. */
+char *
+get_ext_color_seq(const char *ext, size_t *seq_len)
+{
+	struct ext_t *e = find_ext_color(ext);
+	if (!e || !e->seq)
+		return (char *)NULL;
+
+	if (seq_len)
+		*seq_len = e->seq_len;
+
+	return e->seq;
 }
 
 #ifndef CLIFM_SUCKLESS
@@ -1432,6 +1452,49 @@ set_default_size_shades(void)
 	set_shades(tmp, SIZE_SHADES);
 }
 
+/* Escape sequences for extension colors ("\x1b[CODEm"). Each distinct
+ * sequence is stored only once and kept until exit, so that pointers handed
+ * out to the files list (file_info[n].color) remain valid even after the
+ * extension colors table is rebuilt (e.g. when switching color schemes). */
+static char **ext_seqs = (char **)NULL;
+static size_t ext_seqs_n = 0;
+
+/* Return the interned escape sequence for the color code CODE, updating
+ * SEQ_LEN to its length. */
+static char *
+intern_ext_seq(const char *code, size_t *seq_len)
+{
+	const size_t len = strlen(code) + 3;
+	char *seq = xnmalloc(len + 1, sizeof(char));
+	snprintf(seq, len + 1, "\x1b[%sm", code);
+	*seq_len = len;
+
+	size_t i;
+	for (i = 0; i < ext_seqs_n; i++) {
+		if (*ext_seqs[i] == *seq && strcmp(ext_seqs[i], seq) == 0) {
+			free(seq);
+			return ext_seqs[i];
+		}
+	}
+
+	ext_seqs = xnrealloc(ext_seqs, ext_seqs_n + 1, sizeof(char *));
+	ext_seqs[ext_seqs_n] = seq;
+	ext_seqs_n++;
+
+	return seq;
+}
+
+void
+free_ext_color_seqs(void)
+{
+	size_t i;
+	for (i = 0; i < ext_seqs_n; i++)
+		free(ext_seqs[i]);
+	free(ext_seqs);
+	ext_seqs = (char **)NULL;
+	ext_seqs_n = 0;
+}
+
 /* Check if LINE contains a valid color code, and store it in the
  * ext_colors global array.
  * If LINE contains a color variable, expand it, check it, and store it. */
@@ -1487,6 +1550,10 @@ store_extension_line(const char *line)
 	if (xargs.no_bold == 1)
 		remove_bold_attr(ext_colors[ext_colors_n].value);
 
+	ext_colors[ext_colors_n].seq =
+		intern_ext_seq(ext_colors[ext_colors_n].value,
+		&ext_colors[ext_colors_n].seq_len);
+
 	*q = '=';
 	ext_colors_n++;
 
@@ -1560,8 +1627,10 @@ split_extension_colors(char *extcolors)
 	if (ext_colors) {
 		ext_colors[ext_colors_n].name = (char *)NULL;
 		ext_colors[ext_colors_n].value = (char *)NULL;
+		ext_colors[ext_colors_n].seq = (char *)NULL;
 		ext_colors[ext_colors_n].len = 0;
 		ext_colors[ext_colors_n].value_len = 0;
+		ext_colors[ext_colors_n].seq_len = 0;
 
 		ext_colors[ext_colors_n].hash = 0;
 		check_ext_color_hash_conflicts(0);
@@ -55,6 +55,7 @@ __BEGIN_DECLS
 void color_codes(void);
 void colors_list(char *ent, const int eln, const int pad, const int new_line);
 int  cschemes_function(char **args);
+void free_ext_color_seqs(void);
 #ifndef CLIFM_SUCKLESS
 size_t get_colorschemes(void);
 #endif /* CLIFM_SUCKLESS */
@@ -62,6 +63,7 @@ char *get_dir_color(const char *filename, const struct stat *a,
 	const filesn_t count);
 char *get_entry_color(char *ent, const struct stat *a);
 char *get_ext_color(const char *ext, size_t *val_len);
+char *get_ext_color_seq(const char *ext, size_t *seq_len);
 char *get_file_color(const char *filename, const struct stat *a);
 char *get_regfile_color(const char *filename, const struct stat *a,
 	size_t *is_ext);
@@ -41,6 +41,7 @@
 #include "config.h"
 #include "file_operations.h"
 #include "init.h"
+#include "jump.h" /* free_jump_index() */
 #include "listing.h"
 #include "messages.h"
 #include "misc.h"
@@ -344,6 +345,10 @@ dump_config(void)
 		gen_desktop_notif_str(conf.desktop_notifications),
 		gen_desktop_notif_str(DEF_DESKTOP_NOTIFICATIONS), DUMP_CONFIG_STR);
 
+	n = DEF_DIR_SIZE_CACHE;
+	print_config_value("DirSizeCache", &conf.dir_size_cache, &n,
+		DUMP_CONFIG_BOOL);
+
 	s = "";
 	print_config_value("DirhistIgnore", &conf.dirhistignore_regex,
 		s, DUMP_CONFIG_STR);
@@ -362,6 +367,10 @@ dump_config(void)
 	print_config_value("FilesCounter", &conf.files_counter, &n,
 		DUMP_CONFIG_BOOL);
 
+	n = DEF_FILES_COUNTER_MAX;
+	print_config_value("FilesCounterMax", &conf.files_counter_max, &n,
+		DUMP_CONFIG_INT);
+
 	s = "";
 	print_config_value("Filter", filter.str, s, DUMP_CONFIG_STR);
 
@@ -393,6 +402,10 @@ dump_config(void)
 	print_config_value("IconsGap", &conf.icons_gap, &n, DUMP_CONFIG_INT);
 #endif /* !_NO_ICONS */
 
+	n = DEF_INCREMENTAL_REFRESH;
+	print_config_value("IncrementalRefresh", &conf.incremental_refresh, &n,
+		DUMP_CONFIG_BOOL);
+
 	print_config_value("InformAutocmd", get_ia_value_str(conf.autocmd_msg),
 		get_ia_value_str(DEF_AUTOCMD_MSG), DUMP_CONFIG_STR);
 
@@ -413,6 +426,14 @@ dump_config(void)
 	n = DEF_LOG_CMDS;
 	print_config_value("LogCmds", &conf.log_cmds, &n, DUMP_CONFIG_BOOL);
 
+	n = DEF_LOG_FLUSH_COUNT;
+	print_config_value("LogFlushCount", &conf.log_flush_count, &n,
+		DUMP_CONFIG_INT);
+
+	n = DEF_LOG_FLUSH_INTERVAL;
+	print_config_value("LogFlushInterval", &conf.log_flush_interval, &n,
+		DUMP_CONFIG_INT);
+
 	n = DEF_LOG_MSGS;
 	print_config_value("LogMsgs", &conf.log_msgs, &n, DUMP_CONFIG_BOOL);
 
@@ -460,6 +481,10 @@ dump_config(void)
 	print_config_value("Pager", &conf.pager, &n, conf.pager > 1
 		? DUMP_CONFIG_INT : DUMP_CONFIG_BOOL);
 
+	n = DEF_PARALLEL_STAT;
+	print_config_value("ParallelStat", &conf.parallel_stat, &n,
+		DUMP_CONFIG_BOOL);
+
 	n = DEF_PREVIEW_MAX_SIZE;
 	print_config_value("PreviewMaxSize (in KiB)", &conf.preview_max_size, &n,
 		DUMP_CONFIG_INT);
@@ -1691,7 +1716,10 @@ create_main_config_file(char *file)
 ;ColorScheme=%s\n\n"
 
 	    "# Display number of files contained by directories when listing files.\n\
-;FilesCounter=%s\n\n"
+;FilesCounter=%s\n\
+# Stop counting files at this number, displaying \"N+\" for directories\n\
+# containing more files (0 = no limit).\n\
+;FilesCounterMax=%d\n\n"
 
 		"# How to list files: 0 = vertically (like ls(1) would), 1 = horizontally.\n\
 ;ListingMode=%d\n\n"
@@ -1712,12 +1740,13 @@ create_main_config_file(char *file)
 
 	    "# Set the default copy command. Available options are:\n\
 # 0: 'cp -Rp', 1: 'cp -Rp' (force), 2: 'advcp -gRp', 3: 'advcp -gRp' (force),\n\
-# 4: 'wcp', and 5: 'rsync -avP'\n\
+# 4: 'wcp', 5: 'rsync -avP', and 6: built-in (parallel, like 'cp -Rp')\n\
 # Note: 2-5 include a progress bar\n\
 ;cpCmd=%d\n\n"
 
 	    "# Set the default move command. Available options are:\n\
-# 0: 'mv', 1: 'mv' (force), 2: 'advmv -g', and 3: 'advmv -g' (force)\n\
+# 0: 'mv', 1: 'mv' (force), 2: 'advmv -g', 3: 'advmv -g' (force),\n\
+# and 4: built-in (like 'mv')\n\
 # Note: 2 and 3 include a progress bar\n\
 ;mvCmd=%d\n\n"
 
@@ -1729,6 +1758,7 @@ create_main_config_file(char *file)
 
 		DEF_COLOR_SCHEME,
 		DEF_FILES_COUNTER == 1 ? "true" : "false",
+		DEF_FILES_COUNTER_MAX,
 		DEF_LISTING_MODE,
 		DEF_AUTOLS == 1 ? "true" : "false",
 		DEF_DESKTOP_NOTIFICATIONS == DESKTOP_NOTIF_SYSTEM ? "system"
@@ -1794,11 +1824,21 @@ create_main_config_file(char *file)
 # Print files apparent size instead of actual device usage\n\
 ;ApparentSize=%s\n\
 # If running in long view, print directories total size\n\
-;FullDirSize=%s\n\n\
+;FullDirSize=%s\n\
+# Cache directory sizes computed by FullDirSize, so that unchanged\n\
+# subdirectories are not traversed again (sizes might be stale if\n\
+# changed deeper in the tree by other programs)\n\
+;DirSizeCache=%s\n\n\
 # Log errors and warnings\n\
 ;LogMsgs=%s\n\
 # Log commands entered in the command line\n\
-;LogCmds=%s\n\n"
+;LogCmds=%s\n\
+# History and log entries are written to disk in batches: once\n\
+# LogFlushCount entries are pending, or LogFlushInterval seconds after the\n\
+# last write. Pending entries are always written before waiting for user\n\
+# input, and at exit.\n\
+;LogFlushCount=%d\n\
+;LogFlushInterval=%d\n\n"
 
 	    "# Minimum length at which a filename can be truncated in long view mode.\n\
 # If running in long mode, this setting overrides MaxFilenameLen whenever\n\
@@ -1844,8 +1884,11 @@ create_main_config_file(char *file)
 		DEF_PROP_FIELDS_GAP,
 		DEF_APPARENT_SIZE == 1 ? "true" : "false",
 		DEF_FULL_DIR_SIZE == 1 ? "true" : "false",
+		DEF_DIR_SIZE_CACHE == 1 ? "true" : "false",
 		DEF_LOG_MSGS == 1 ? "true" : "false",
 		DEF_LOG_CMDS == 1 ? "true" : "false",
+		DEF_LOG_FLUSH_COUNT,
+		DEF_LOG_FLUSH_INTERVAL,
 		DEF_MIN_NAME_TRUNC,
 		DEF_MIN_JUMP_RANK,
 		DEF_MAX_JUMP_TOTAL_RANK,
@@ -1925,6 +1968,14 @@ create_main_config_file(char *file)
 # ignored as well, so that the color per extension feature is disabled.\n\
 ;LightMode=%s\n\n"
 
+		"# Get file information (stat(2)) for large directories using a pool\n\
+# of worker threads. Useful for slow or remote filesystems (NFS, FUSE).\n\
+;ParallelStat=%s\n\n\
+# When files in the current directory are created, removed, renamed, or\n\
+# have their attributes changed, update only the affected entries instead\n\
+# of reloading the whole list (Linux only)\n\
+;IncrementalRefresh=%s\n\n"
+
 	    "# If running with colors, append directory indicator\n\
 # to directories. If running without colors (via the --no-color option),\n\
 # append file type indicator at the end of filenames.\n\
@@ -1997,6 +2048,8 @@ create_main_config_file(char *file)
 ;TruncateNames=%s\n\n",
 
 		DEF_LIGHT_MODE == 1 ? "true" : "false",
+		DEF_PARALLEL_STAT == 1 ? "true" : "false",
+		DEF_INCREMENTAL_REFRESH == 1 ? "true" : "false",
 		DEF_CLASSIFY == 1 ? "true" : "false",
 		DEF_COLOR_LNK_AS_TARGET == 1 ? "true" : "false",
 		DEF_SHARE_SELBOX == 1 ? "true" : "false",
@@ -3474,6 +3527,11 @@ read_config(void)
 			set_config_bool_value(line + 13, &conf.files_counter);
 		}
 
+		else if (*line == 'F' && strncmp(line, "FilesCounterMax=", 16) == 0) {
+			set_config_int_value(line + 16, &conf.files_counter_max,
+				0, INT_MAX);
+		}
+
 		else if (!filter.str && *line == 'F'
 		&& strncmp(line, "Filter=", 7) == 0) {
 			if (set_files_filter(line) == -1)
@@ -3485,6 +3543,10 @@ read_config(void)
 			set_config_bool_value(line + 12, &conf.full_dir_size);
 		}
 
+		else if (*line == 'D' && strncmp(line, "DirSizeCache=", 13) == 0) {
+			set_config_bool_value(line + 13, &conf.dir_size_cache);
+		}
+
 		else if (xargs.fuzzy_match_algo == UNSET && *line == 'F'
 		&& strncmp(line, "FuzzyAlgorithm=", 15) == 0) {
 			set_config_int_value(line + 15, &conf.fuzzy_match_algo,
@@ -3517,6 +3579,11 @@ read_config(void)
 		}
 #endif /* !_NO_ICONS */
 
+		else if (*line == 'I'
+		&& strncmp(line, "IncrementalRefresh=", 19) == 0) {
+			set_config_bool_value(line + 19, &conf.incremental_refresh);
+		}
+
 		else if (*line == 'I' && strncmp(line, "InformAutocmd=", 14) == 0) {
 			set_autocmd_msg_value(line + 14);
 		}
@@ -3553,6 +3620,15 @@ read_config(void)
 			set_config_bool_value(line + 8, &conf.log_cmds);
 		}
 
+		else if (*line == 'L' && strncmp(line, "LogFlushCount=", 14) == 0) {
+			set_config_int_value(line + 14, &conf.log_flush_count, 1, INT_MAX);
+		}
+
+		else if (*line == 'L' && strncmp(line, "LogFlushInterval=", 17) == 0) {
+			set_config_int_value(line + 17, &conf.log_flush_interval,
+				0, INT_MAX);
+		}
+
 		else if (xargs.max_dirhist == UNSET && *line == 'M'
 		&& strncmp(line, "MaxDirhist=", 11) == 0) {
 			set_config_int_value(line + 11, &conf.max_dirhist, 0, INT_MAX);
@@ -3630,6 +3706,10 @@ read_config(void)
 			set_pager_view_value(line + 10);
 		}
 
+		else if (*line == 'P' && strncmp(line, "ParallelStat=", 13) == 0) {
+			set_config_bool_value(line + 13, &conf.parallel_stat);
+		}
+
 		else if (*line == 'P' && strncmp(line, "PreviewMaxSize=", 15) == 0) {
 			set_preview_max_size(line + 15);
 		}
@@ -4457,6 +4537,7 @@ reload_config(void)
 		jump_db = (struct jump_t *)NULL;
 	}
 	jump_n = 0;
+	free_jump_index();
 
 	i = (int)aliases_n;
 	while (--i >= 0) {
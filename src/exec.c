@@ -29,6 +29,9 @@
 #include <unistd.h>   /* access() */
 #include <sys/wait.h> /* waitpid() */
 #include <time.h>     /* clock_gettime() */
+#ifdef GENERIC_FS_MONITOR
+# include <pthread.h> /* check_fs_changes() */
+#endif /* GENERIC_FS_MONITOR */
 
 #ifdef __OpenBSD__
 typedef char *rl_cpvfunc_t;
@@ -124,13 +127,7 @@ reload_binaries(void)
 	if (check_paths_timestamps() == FUNC_SUCCESS)
 		return;
 
-	if (bin_commands) {
-		int j = (int)path_progsn;
-		while (--j >= 0)
-			free(bin_commands[j]);
-		free(bin_commands);
-		bin_commands = (char **)NULL;
-	}
+	free_bin_commands();
 
 	if (paths) {
 		int j = (int)path_n;
@@ -1547,6 +1544,8 @@ set_cp_cmd(char **cmd, int *cp_force)
 	case CP_WCP: n = DEFAULT_WCP_CMD; break;
 	case CP_RSYNC: n = DEFAULT_RSYNC_CMD; break;
 	case CP_CP_FORCE: n = DEFAULT_CP_CMD_FORCE; *cp_force = 1; break;
+	/* The built-in engine is run by cp_mv_file() in place of cp(1). */
+	case CP_BUILTIN: /* fallthrough */
 	case CP_CP: /* fallthrough */
 	default: n = DEFAULT_CP_CMD; break;
 	}
@@ -1575,6 +1574,8 @@ set_mv_cmd(char **cmd, int *mv_force)
 	case MV_ADVMV: n = DEFAULT_ADVMV_CMD; break;
 	case MV_ADVMV_FORCE: n = DEFAULT_ADVMV_CMD_FORCE; *mv_force = 1; break;
 	case MV_MV_FORCE: n = DEFAULT_MV_CMD_FORCE; *mv_force = 1; break;
+	/* The built-in engine is run by cp_mv_file() in place of mv(1). */
+	case MV_BUILTIN: /* fallthrough */
 	case MV_MV: /* fallthrough */
 	default: n = DEFAULT_MV_CMD; break;
 	}
@@ -1802,12 +1803,128 @@ run_log_cmd(char **args)
 }
 
 #ifdef GENERIC_FS_MONITOR
-/* Update the current list of files if the modification time of the current
- * directory changed and if the number of files differ. Sometimes, processes
- * create temporary files (changing modification time) that are immediately
- * deleted (resulting in the same number of files), in which case there is no
- * need to update the list of files (this happens for example with 'git pull',
- * or with a command along the lines of 'touch file && rm file'). */
+/* Maximum amount of time (in milliseconds) check_fs_changes() waits for a
+ * directory scan to finish before giving the prompt back. */
+# define FS_SCAN_WAIT_MS 50
+
+/* A scan of the current directory run by a background thread. */
+struct fs_scan_t {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t thread;
+	char *path;
+	time_t mtime;   /* Times of the directory when the scan started */
+	time_t ctime;
+	size_t count;   /* Number of files (self and parent excluded) */
+	size_t sum;     /* Checksum of filenames (see FSMON_ADD_NAME()) */
+	int running;    /* A scan was started and not yet collected */
+	int done;       /* The scan finished */
+	int ok;         /* The directory could be read */
+	int pad0;
+};
+
+static struct fs_scan_t fs_scan = {PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, 0, NULL, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static void *
+fs_scan_worker(void *arg)
+{
+	UNUSED(arg);
+	size_t count = 0, sum = 0;
+	int ok = 0;
+
+	DIR *dir = opendir(fs_scan.path);
+	if (dir) {
+		struct dirent *ent;
+		while ((ent = readdir(dir))) {
+			if (SELFORPARENT(ent->d_name))
+				continue;
+			count++;
+			sum += hashme(ent->d_name, 1);
+		}
+
+		closedir(dir);
+		ok = 1;
+	}
+
+	pthread_mutex_lock(&fs_scan.mutex);
+	fs_scan.count = count;
+	fs_scan.sum = sum;
+	fs_scan.ok = ok;
+	fs_scan.done = 1;
+	pthread_cond_signal(&fs_scan.cond);
+	pthread_mutex_unlock(&fs_scan.mutex);
+
+	return NULL;
+}
+
+/* Wait at most FS_SCAN_WAIT_MS for the running scan to finish. Return 1
+ * if it did, or zero otherwise. */
+static int
+wait_fs_scan(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += FS_SCAN_WAIT_MS * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&fs_scan.mutex);
+	while (fs_scan.done == 0) {
+		if (pthread_cond_timedwait(&fs_scan.cond, &fs_scan.mutex, &ts) != 0)
+			break;
+	}
+	const int done = fs_scan.done;
+	pthread_mutex_unlock(&fs_scan.mutex);
+
+	return done;
+}
+
+/* Collect the result of the finished scan, and reload the list of files
+ * if the current directory contents changed. */
+static void
+collect_fs_scan(void)
+{
+	pthread_join(fs_scan.thread, NULL);
+	fs_scan.running = 0;
+
+	/* The scan refers to a directory we are no longer in. */
+	if (fs_scan.ok == 0 || strcmp(fs_scan.path, workspaces[cur_ws].path) != 0
+	|| curdir_mtime == 0) {
+		free(fs_scan.path);
+		fs_scan.path = (char *)NULL;
+		return;
+	}
+
+	free(fs_scan.path);
+	fs_scan.path = (char *)NULL;
+
+	if (fs_scan.count != curdir_count || fs_scan.sum != curdir_sum) {
+		reload_dirlist();
+		return;
+	}
+
+	/* Same files: just remember the new times to skip the scan next time.
+	 * This happens for example with 'git pull', or with a command along
+	 * the lines of 'touch file && rm file'. */
+	curdir_mtime = fs_scan.mtime;
+	curdir_ctime = fs_scan.ctime;
+}
+
+/* Update the current list of files if the contents of the current
+ * directory changed. This is done in stages, from cheapest to most
+ * expensive:
+ * 1. If neither the modification nor the change time of the directory
+ * changed, there is nothing to do.
+ * 2. Otherwise, the directory is read by a background thread to count
+ * its files and compute a checksum of their names. If both match those
+ * of the current list (see FSMON_ADD_NAME()), there is nothing to do.
+ * 3. Otherwise, the list of files is reloaded.
+ * Only one scan is run at a time. If it takes longer than FS_SCAN_WAIT_MS,
+ * we do not block the prompt: the result is collected the next time this
+ * function is called. */
 static void
 check_fs_changes(void)
 {
@@ -1815,13 +1932,33 @@ check_fs_changes(void)
 	|| !workspaces[cur_ws].path)
 		return;
 
-	const filesn_t cur_files = count_dir(workspaces[cur_ws].path, 0) - 2;
+	if (fs_scan.running == 1) {
+		if (wait_fs_scan() == 0)
+			return; /* Still running */
+		collect_fs_scan();
+	}
+
 	struct stat a;
+	if (curdir_mtime == 0 || stat(workspaces[cur_ws].path, &a) == -1
+	|| (a.st_mtime == curdir_mtime && a.st_ctime == curdir_ctime))
+		return;
 
-	if (curdir_mtime != 0 && stat(workspaces[cur_ws].path, &a) != -1
-	&& curdir_mtime != a.st_mtime
-	&& cur_files >= 0 && files != cur_files)
+	fs_scan.path = savestring(workspaces[cur_ws].path,
+		strlen(workspaces[cur_ws].path));
+	fs_scan.mtime = a.st_mtime;
+	fs_scan.ctime = a.st_ctime;
+	fs_scan.done = 0;
+
+	if (pthread_create(&fs_scan.thread, NULL, fs_scan_worker, NULL) != 0) {
+		free(fs_scan.path);
+		fs_scan.path = (char *)NULL;
 		reload_dirlist();
+		return;
+	}
+
+	fs_scan.running = 1;
+	if (wait_fs_scan() == 1)
+		collect_fs_scan();
 }
 #endif /* GENERIC_FS_MONITOR */
 
@@ -1971,6 +2108,10 @@ exec_cmd(char **args)
 		check_zombies();
 	fputs(df_c, stdout);
 
+	/* The output of the command will replace the list of files on the
+	 * screen: do not print it again once the files counters are in. */
+	cancel_files_counter_redraw();
+
 	if (conf.readonly == 1 && is_write_cmd(
 	((*args[0] == 's' && strcmp(args[0] + 1, "udo") == 0)
 	|| (*args[0] == 'd' && strcmp(args[0] + 1, "oas") == 0))
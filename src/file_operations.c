@@ -50,6 +50,7 @@
 #include "readline.h"
 #include "selection.h"
 #include "spawn.h"
+#include "xcp.h" /* xcp_run(), xcp_remove() */
 
 /* Struct to store information about files to be removed via the 'r' command. */
 struct rm_info {
@@ -1631,16 +1632,60 @@ cwd_has_sel_files(void)
 #define IS_MVCMD(s) (*(s) == 'm' || (*(s) == 'a' \
 	&& strncmp((s), "advmv", 5) == 0))
 
+/* Print the number of files copied/moved. If the built-in engine was used
+ * (ST is not NULL), append the amount of data copied and the throughput. */
 static void
-print_cp_mv_summary_msg(const char *c, const size_t n, const int cwd)
+print_cp_mv_summary_msg(const char *c, const size_t n, const int cwd,
+	const struct xcp_stats_t *st)
 {
 	if (conf.autols == 1 && cwd == 1)
 		reload_dirlist();
 
+	if (!st || st->bytes <= 0 || st->secs <= 0) {
+		if (IS_MVCMD(c))
+			print_reload_msg(SET_SUCCESS_PTR, xs_cb, _("%zu file(s) moved\n"), n);
+		else
+			print_reload_msg(SET_SUCCESS_PTR, xs_cb, _("%zu file(s) copied\n"), n);
+		return;
+	}
+
+	/* construct_human_size() returns a pointer to a static buffer. */
+	char size[MAX_HUMAN_SIZE + 1];
+	xstrsncpy(size, construct_human_size(st->bytes), sizeof(size));
+	const char *rate =
+		construct_human_size((off_t)((double)st->bytes / st->secs));
+
 	if (IS_MVCMD(c))
-		print_reload_msg(SET_SUCCESS_PTR, xs_cb, _("%zu file(s) moved\n"), n);
+		print_reload_msg(SET_SUCCESS_PTR, xs_cb,
+			_("%zu file(s) moved (%s in %.2fs, %s/s)\n"), n, size, st->secs, rate);
 	else
-		print_reload_msg(SET_SUCCESS_PTR, xs_cb, _("%zu file(s) copied\n"), n);
+		print_reload_msg(SET_SUCCESS_PTR, xs_cb,
+			_("%zu file(s) copied (%s in %.2fs, %s/s)\n"), n, size, st->secs, rate);
+}
+
+/* Run the cp/mv command TCMD, or, if the built-in engine is enabled
+ * (cpCmd/mvCmd set to CP_BUILTIN/MV_BUILTIN), copy/move files ourselves,
+ * storing transfer statistics in ST. */
+static int
+exec_cp_mv_cmd(char **tcmd, struct xcp_stats_t *st)
+{
+	const int move = IS_MVCMD(tcmd[0]);
+	if ((move == 1 && conf.mv_cmd != MV_BUILTIN)
+	|| (move == 0 && conf.cp_cmd != CP_BUILTIN))
+		return launch_execv(tcmd, FOREGROUND, E_NOFLAG);
+
+	/* Skip the command name and its options: only file operands are
+	 * passed to the engine. */
+	size_t i = 1;
+	while (tcmd[i] && *tcmd[i] == '-') {
+		if (tcmd[i][1] == '-' && !tcmd[i][2]) {
+			i++;
+			break;
+		}
+		i++;
+	}
+
+	return xcp_run(tcmd + i, move, st);
 }
 
 /* Run CMD (either cp(1) or mv(1)) via execv().
@@ -1751,7 +1796,8 @@ run_cp_mv_cmd(char **cmd, const int skip_force, const size_t files_num)
 	}
 
 	tcmd[n] = (char *)NULL;
-	const int ret = launch_execv(tcmd, FOREGROUND, E_NOFLAG);
+	struct xcp_stats_t st = {0};
+	const int ret = exec_cp_mv_cmd(tcmd, &st);
 
 	for (i = 0; i < n; i++)
 		free(tcmd[i]);
@@ -1760,13 +1806,13 @@ run_cp_mv_cmd(char **cmd, const int skip_force, const size_t files_num)
 	if (ret != FUNC_SUCCESS)
 		return ret;
 
-	/* Error messages are printed by launch_execv() itself. */
+	/* Error messages are printed by launch_execv() (or xcp_run()) itself. */
 
 	if (sel_n > 0 && IS_MVCMD(cmd[0]) && cwd_has_sel_files())
 		/* Just in case a selected file in the current dir was renamed. */
 		get_sel_files();
 
-	print_cp_mv_summary_msg(cmd[0], files_num, cwd);
+	print_cp_mv_summary_msg(cmd[0], files_num, cwd, &st);
 
 	return FUNC_SUCCESS;
 }
@@ -1938,7 +1984,8 @@ cp_mv_file(char **args, const int copy_and_rename, const int force)
 
 	tcmd[n] = (char *)NULL;
 
-	ret = launch_execv(tcmd, FOREGROUND, E_NOFLAG);
+	struct xcp_stats_t st = {0};
+	ret = exec_cp_mv_cmd(tcmd, &st);
 
 	for (i = 0; tcmd[i]; i++)
 		free(tcmd[i]);
@@ -1955,7 +2002,7 @@ cp_mv_file(char **args, const int copy_and_rename, const int force)
 	if (is_sel == 1 && sel_n > 0 && IS_MVCMD(args[0]))
 		deselect_all();
 
-	print_cp_mv_summary_msg(args[0], files_num, cwd);
+	print_cp_mv_summary_msg(args[0], files_num, cwd, &st);
 
 	return FUNC_SUCCESS;
 }
@@ -2084,9 +2131,9 @@ remove_files(char **args)
 	const size_t num = i > 0 ? (size_t)i - 1 : (size_t)i;
 
 	struct stat a;
-	char **rm_cmd = xnmalloc(num + 4, sizeof(char *));
+	char **rm_files = xnmalloc(num + 1, sizeof(char *));
 	/* Let's keep information about files to be removed. */
-	struct rm_info *info = xnmalloc(num + 4, sizeof(struct rm_info));
+	struct rm_info *info = xnmalloc(num + 1, sizeof(struct rm_info));
 
 	int j, have_dirs = 0;
 	int rm_force = conf.rm_force == 1 ? 1 : 0;
@@ -2095,15 +2142,12 @@ remove_files(char **args)
 	if (i == 2)
 		rm_force = 1;
 
-	for (j = 3; args[i]; i++) {
-		/* Let's start storing filenames in 3: 0 is for 'rm', and 1
-		 * and 2 for parameters, including end of parameters (--). */
-
+	for (j = 0; args[i]; i++) {
 		/* If we have a symlink to dir ending with a slash, stat(2) takes it
-		 * as a directory, and then rm(1) complains that cannot remove it,
-		 * because "Is a directory". So, let's remove the ending slash:
-		 * stat(2) will take it as the symlink it is and rm(1) will remove
-		 * the symlink (not the target) without complains. */
+		 * as a directory, and then we would remove the contents of the
+		 * target directory. So, let's remove the ending slash: lstat(2)
+		 * will take it as the symlink it is and only the symlink (not the
+		 * target) will be removed. */
 		const size_t len = strlen(args[i]);
 		if (len > 1 && args[i][len - 1] == '/')
 			args[i][len - 1] = '\0';
@@ -2120,8 +2164,8 @@ remove_files(char **args)
 		}
 
 		if (lstat(tmp, &a) != -1) {
-			rm_cmd[j] = savestring(tmp, strlen(tmp));
-			info[j] = fill_rm_info_struct(&rm_cmd[j], &a);
+			rm_files[j] = savestring(tmp, strlen(tmp));
+			info[j] = fill_rm_info_struct(&rm_files[j], &a);
 			if (info[j].dir == 1)
 				have_dirs++;
 			j++;
@@ -2133,30 +2177,28 @@ remove_files(char **args)
 		free(tmp);
 	}
 
-	rm_cmd[j] = info[j].name = (char *)NULL;
+	rm_files[j] = info[j].name = (char *)NULL;
 
-	if (j == 3) { /* No file to be deleted */
-		free(rm_cmd);
+	if (j == 0) { /* No file to be deleted */
+		free(rm_files);
 		free(info);
 		return FUNC_FAILURE;
 	}
 
-	if (rm_force == 1 && errs > 0 && j > 3 && conf.autols == 1)
+	if (rm_force == 1 && errs > 0 && j > 0 && conf.autols == 1)
 		press_any_key_to_continue(0);
 
-	if (rm_force == 0 && rm_confirm(info, 3, have_dirs) == 0)
+	if (rm_force == 0 && rm_confirm(info, 0, have_dirs) == 0)
 		goto END;
 
 	/* Make sure that files to be removed have not changed between the
 	 * beginning of the operation and the user confirmation. */
-	if (check_rm_files(info, 3, err_name) == FUNC_FAILURE)
+	if (check_rm_files(info, 0, err_name) == FUNC_FAILURE)
 		goto END;
 
-	rm_cmd[0] = "rm";
-	rm_cmd[1] = have_dirs >= 1 ? "-rf" : "-f";
-	rm_cmd[2] = "--";
-
-	exit_status = launch_execv(rm_cmd, FOREGROUND, E_NOFLAG);
+	/* Remove files in-process (just as rm -rf would do), removing the
+	 * subtrees of directories in parallel. */
+	exit_status = xcp_remove(rm_files, (size_t)j, NULL, err_name);
 	if (exit_status != FUNC_SUCCESS) {
 #ifndef BSD_KQUEUE
 		if (num > 1 && conf.autols == 1) /* Only if we have multiple files */
@@ -2171,12 +2213,12 @@ remove_files(char **args)
 	if (is_sel && exit_status == FUNC_SUCCESS)
 		deselect_all();
 
-	list_removed_files(info, 3, cwd);
+	list_removed_files(info, 0, cwd);
 
 END:
-	for (i = 3; rm_cmd[i]; i++)
-		free(rm_cmd[i]);
-	free(rm_cmd);
+	for (i = 0; rm_files[i]; i++)
+		free(rm_files[i]);
+	free(rm_files);
 
 	free(info);
 	return exit_status;
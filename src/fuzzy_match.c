@@ -100,6 +100,53 @@ contains_utf8(const char *s)
 	return 0;
 }
 
+/* Return a bitmask of the bytes in the string S (ASCII case folded): one bit
+ * per letter and per digit, and a few more shared by all remaining bytes.
+ * Every byte in a pattern must be present in an item matched by
+ * fuzzy_match_v1(), so that no item lacking any of the bits in the pattern's
+ * mask can be matched by it. The mask of a non-empty string is never zero. */
+unsigned long long
+fuzzy_charset_mask(const char *s)
+{
+	unsigned long long mask = 0;
+	unsigned char c;
+
+	while ((c = (unsigned char)*s++)) {
+		if (c >= 'A' && c <= 'Z')
+			c |= 0x20;
+
+		if (c >= 'a' && c <= 'z')
+			mask |= 1ULL << (c - 'a');
+		else if (c >= '0' && c <= '9')
+			mask |= 1ULL << (26 + (c - '0'));
+		else
+			mask |= 1ULL << (36 + (c % 28));
+	}
+
+	return mask;
+}
+
+/* Return 1 if all chars in S1 appear, in order, in S2, or 0 otherwise.
+ * This is what fuzzy_match_v1() requires to match, but it is way cheaper
+ * than computing the score, so that we can discard most items early. */
+static int
+is_subsequence(const char *s1, const char *s2, const int cs)
+{
+	if (cs == 1) {
+		for (; *s1 && *s2; s2++) {
+			if (*s1 == *s2)
+				s1++;
+		}
+	} else {
+		for (; *s1 && *s2; s2++) {
+			if (TOUPPER(*s1) == TOUPPER(*s2))
+				s1++;
+		}
+	}
+
+	return (*s1 == '\0');
+}
+
 /* Same as fuzzy_match(), but:
  * 1: Not Unicode aware
  * 2: Much faster */
@@ -107,6 +154,9 @@ static int
 fuzzy_match_v1(char *s1, char *s2, const size_t s1_len)
 {
 	const int cs = conf.case_sens_path_comp;
+	if (is_subsequence(s1, s2, cs) == 0)
+		return 0;
+
 	int included = 0;
 	char *p = (char *)NULL;
 
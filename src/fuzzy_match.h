@@ -49,6 +49,7 @@
 __BEGIN_DECLS
 
 int fuzzy_match(char *s1, char *s2, const size_t s1_len, const int type);
+unsigned long long fuzzy_charset_mask(const char *s);
 int contains_utf8(const char *s);
 
 __END_DECLS
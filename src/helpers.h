@@ -447,6 +447,9 @@ extern int watch;
 #else
 # define GENERIC_FS_MONITOR
 extern time_t curdir_mtime;
+extern time_t curdir_ctime;
+extern size_t curdir_count;
+extern size_t curdir_sum;
 #endif /* LINUX_INOTIFY */
 
 /* Do we have arc4random_uniform(3). If not, fallback to random(3). */
@@ -669,13 +672,15 @@ extern time_t curdir_mtime;
 #define CP_ADVCP_FORCE   3 /* advcp -gRp */
 #define CP_WCP           4 /* wcp */
 #define CP_RSYNC         5 /* rsync -avP */
-#define CP_CMD_AVAILABLE 6
+#define CP_BUILTIN       6 /* Built-in engine (xcp.c) */
+#define CP_CMD_AVAILABLE 7
 
 #define MV_MV            0 /* mv -i */
 #define MV_MV_FORCE      1 /* mv */
 #define MV_ADVMV         2 /* advmv -gi */
 #define MV_ADVMV_FORCE   3 /* advmv -g */
-#define MV_CMD_AVAILABLE 4
+#define MV_BUILTIN       4 /* Built-in engine (xcp.c) */
+#define MV_CMD_AVAILABLE 5
 
 /* Macros for LinkCreationMode */
 #define LNK_CREAT_REG 0 /* Like ln -s */
@@ -1023,6 +1028,12 @@ extern time_t curdir_mtime;
 		: ((off_t)(n) < 1000000000000000000) ? 18 \
                                              : 19)
 
+/* If FilesCounterMax is set, directories containing more files than this
+ * value get conf.files_counter_max + 1 as files counter, displayed as
+ * "N+" (see count_dir_files() in listing.c). */
+#define FC_CAPPED(n) (conf.files_counter_max > 0 \
+	&& (n) > (filesn_t)conf.files_counter_max)
+
 #define IS_DIGIT(c)    ((unsigned int)(c) >= '0' && (unsigned int)(c) <= '9')
 #define IS_ALPHA(c)    ((unsigned int)(c) >= 'a' && (unsigned int)(c) <= 'z')
 #define IS_ALPHA_UP(c) ((unsigned int)(c) >= 'A' && (unsigned int)(c) <= 'Z')
@@ -1155,10 +1166,12 @@ struct config_t {
 	int columned;
 	int cp_cmd;
 	int desktop_notifications;
+	int dir_size_cache;
 	int dirhist_map;
 	int disk_usage;
 	int ext_cmd_ok;
 	int files_counter;
+	int files_counter_max;
 	int follow_symlinks;
 	int follow_symlinks_long;
 	int full_dir_size;
@@ -1168,12 +1181,15 @@ struct config_t {
 	int highlight;
 	int icons;
 	int icons_gap;
+	int incremental_refresh;
 	int int_vars;
 	int light_mode;
 	int link_creat_mode;
 	int list_dirs_first;
 	int listing_mode;
 	int log_cmds;
+	int log_flush_count;
+	int log_flush_interval;
 	int log_msgs;
 	int long_view;
 	int max_dirhist;
@@ -1192,6 +1208,7 @@ struct config_t {
 	int pager;
 	int pager_once;
 	int pager_view;
+	int parallel_stat;
 	int purge_jumpdb;
 	int preview_max_size;
 	int print_dir_cmds;
@@ -1336,11 +1353,19 @@ struct groups_t {
 	char *name;
 	size_t namlen;
 	gid_t id;
-	int pad0;
+	int used; /* Cache slot in use (NAME is NULL if ID has no name) */
+};
+
+/* User and group names, resolved on demand and cached by ID (see
+ * get_id_names() in listing.c). */
+struct id_cache_t {
+	struct groups_t *ents;
+	size_t size; /* Always a power of two */
+	size_t n;    /* Number of used slots */
 };
 
-extern struct groups_t *sys_users;
-extern struct groups_t *sys_groups;
+extern struct id_cache_t sys_users;
+extern struct id_cache_t sys_groups;
 
 struct human_size_t {
 	char   str[MAX_HUMAN_SIZE + 6];
@@ -1349,25 +1374,34 @@ struct human_size_t {
 	int    pad0;
 };
 
-/* Struct to store files information */
-struct fileinfo {
+/* Information about a file needed only by the long view, or by some sort
+ * methods. Kept out of struct fileinfo, so that the fields used by every
+ * listing are packed more densely in memory. */
+struct fileinfo_cold {
 	struct human_size_t human_size;
 	struct groups_t uid_i;
 	struct groups_t gid_i;
-	char *color;
-	char *ext_color;
-	char *ext_name;
 	char *icon;
 	char *icon_color;
+	unsigned long long name_mask; /* See fuzzy_charset_mask() (0 if not set) */
+	time_t ltime;  /* For long view mode */
+	blkcnt_t blocks;
+	int xattr;
+	int du_status; /* Exit status of du(1) for dir full sizes */
+};
+
+/* Struct to store files information */
+struct fileinfo {
+	struct fileinfo_cold *cold;
+	char *color;
+	char *ext_name;
 	char *name;
 	filesn_t filesn;
-	blkcnt_t blocks;
 	size_t len;    /* Filename len (columns needed to display filename) */
 	size_t bytes;  /* Bytes consumed by filename */
 #ifdef TIGHT_COLUMNS
 	size_t total_entry_len;
 #endif
-	time_t ltime;  /* For long view mode */
 	time_t time;
 	ino_t inode;
 	off_t size;
@@ -1382,8 +1416,6 @@ struct fileinfo {
 	int user_access; /* Read-exec for dirs and read for files */
 	int symlink;
 	int sel;
-	int xattr;
-	int du_status; /* Exit status of du(1) for dir full sizes */
 	int utf8;      /* Name contains at least one UTF-8 character */
 	int stat_err;  /* stat(2) failed for this entry */
 #if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) \
@@ -1776,8 +1808,10 @@ extern struct paths_t *paths;
 struct ext_t {
 	char  *name;
 	char  *value;
+	char  *seq; /* Full escape sequence ("\x1b[VALUEm"). Not owned: interned */
 	size_t len; /* Name length */
 	size_t value_len;
+	size_t seq_len;
 	size_t hash;
 };
 extern struct ext_t *ext_colors;
@@ -1978,6 +2012,7 @@ extern size_t
 	cschemes_n,
 	current_hist_n,
 	curhistindex,
+	dirlist_gen,
 	ext_colors_n,
 	jump_n,
 	kbinds_n,
@@ -2002,6 +2037,18 @@ extern size_t *dir_icons_hashes;
 extern size_t *ext_icons_hashes;
 #endif /* !_NO_ICONS */
 
+/* The bin_commands array is made of one segment per kind of command name,
+ * in order of precedence. Each segment is sorted (strcmp order) and free of
+ * names already present in a previous segment, so that it can be binary
+ * searched. bin_cmds_seg[N] is the index at which segment N starts
+ * (bin_cmds_seg[BIN_CMD_SEGS] equals path_progsn). */
+#define BIN_CMD_INTERNAL 0
+#define BIN_CMD_ALIAS    1
+#define BIN_CMD_ACTION   2
+#define BIN_CMD_PATH     3
+#define BIN_CMD_SEGS     4
+extern size_t bin_cmds_seg[BIN_CMD_SEGS + 1];
+
 extern pid_t own_pid;
 extern time_t props_now;
 
@@ -25,8 +25,10 @@
 #include "helpers.h"
 
 #include <errno.h>
+#include <signal.h> /* sigprocmask */
 #include <string.h>
 #include <time.h>
+#include <unistd.h> /* close, getpid, write */
 #include <readline/history.h>
 
 #include "aux.h"
@@ -34,11 +36,256 @@
 #include "file_operations.h"
 #include "history.h"
 #include "init.h"
+#include "listing.h" /* flush_list_frame() */
 #include "messages.h"
 #include "misc.h"
 #include "readline.h" /* rl_get_y_or_n */
 #include "spawn.h"
 
+/* Journals: append-only writers for the history and log files.
+ *
+ * Entries are buffered in memory and written in a single write(2), through
+ * a file descriptor kept open between writes, once conf.log_flush_count
+ * entries are pending, or when conf.log_flush_interval seconds have passed
+ * since the last write. Pending entries are also written before waiting
+ * for user input (so that nothing is left pending while idle), on SIGHUP,
+ * at exit, and whenever the files are about to be read or rewritten (see
+ * flush_history_journals()).
+ *
+ * Flushing only uses async-signal-safe functions, so that it can be run
+ * from a signal handler.
+ *
+ * The descriptor is reopened if the file was replaced in the meantime (say,
+ * truncated by another instance, or rewritten by a text editor). */
+struct journal_t {
+	char *file;        /* Target file (a copy of the path) */
+	char *buf;         /* Pending entries */
+	size_t len;
+	size_t cap;
+	size_t pending;    /* Number of pending entries */
+	time_t last_flush;
+	dev_t dev;         /* Device and inode of FILE, if FD is open */
+	ino_t ino;
+	pid_t pid;         /* Process owning the pending entries */
+	int fd;
+	int is_open;
+};
+
+#define HIST_JOURNAL 0
+#define CMDS_JOURNAL 1
+#define MSGS_JOURNAL 2
+#define JOURNALS_N   3
+
+static struct journal_t journals[JOURNALS_N] = {0};
+
+/* Capacity of the history array (see grow_history()). */
+static size_t history_cap = 0;
+
+static void
+close_journal_fd(struct journal_t *j)
+{
+	if (j->is_open == 1)
+		close(j->fd);
+	j->is_open = 0;
+}
+
+/* Make sure the journal J has an open file descriptor for its target file.
+ * Return FUNC_SUCCESS on success, or FUNC_FAILURE on error (errno is set). */
+static int
+open_journal_fd(struct journal_t *j)
+{
+	struct stat a;
+
+	if (j->is_open == 1) {
+		if (stat(j->file, &a) != -1 && a.st_dev == j->dev
+		&& a.st_ino == j->ino)
+			return FUNC_SUCCESS;
+		close_journal_fd(j);
+	}
+
+	const int fd = open(j->file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+		S_IRUSR | S_IWUSR);
+	if (fd == -1)
+		return FUNC_FAILURE;
+
+	if (fstat(fd, &a) == -1) {
+		const int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return FUNC_FAILURE;
+	}
+
+	j->fd = fd;
+	j->dev = a.st_dev;
+	j->ino = a.st_ino;
+	j->is_open = 1;
+	return FUNC_SUCCESS;
+}
+
+/* Write the entries pending in the journal J into its target file.
+ * Return FUNC_SUCCESS on success, or FUNC_FAILURE on error (errno is set).
+ * Pending entries are discarded in either case. */
+static int
+flush_journal(struct journal_t *j)
+{
+	if (j->len == 0)
+		return FUNC_SUCCESS;
+
+	j->last_flush = time(NULL);
+	const size_t len = j->len;
+	j->len = j->pending = 0;
+
+	/* A forked child does not write entries owned by its parent. */
+	if (j->pid != getpid())
+		return FUNC_SUCCESS;
+
+	if (open_journal_fd(j) == FUNC_FAILURE)
+		return FUNC_FAILURE;
+
+	size_t written = 0;
+	while (written < len) {
+		const ssize_t ret = write(j->fd, j->buf + written, len - written);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			return FUNC_FAILURE;
+		}
+		written += (size_t)ret;
+	}
+
+	return FUNC_SUCCESS;
+}
+
+/* Flush and close the journal J. */
+static int
+close_journal(struct journal_t *j)
+{
+	const int ret = flush_journal(j);
+	close_journal_fd(j);
+	free(j->file);
+	j->file = (char *)NULL;
+	return ret;
+}
+
+/* Append the string STR (LEN bytes) to the journal J, targeting the file
+ * FILE. Entries are written in batches (see flush_journal()).
+ * Return FUNC_SUCCESS on success, or FUNC_FAILURE on error (errno is set). */
+static int
+write_journal(struct journal_t *j, const char *file, const char *str,
+	const size_t len)
+{
+	/* The file name changed (e.g., after switching profiles): entries
+	 * pending so far belong to the old file. */
+	if (j->file && strcmp(j->file, file) != 0)
+		close_journal(j);
+
+	if (!j->file) {
+		j->file = savestring(file, strlen(file));
+		j->pid = getpid();
+	}
+
+	if (j->len + len > j->cap) {
+		size_t cap = j->cap == 0 ? 4096 : j->cap;
+		while (cap < j->len + len)
+			cap *= 2;
+
+		/* Do not let the SIGHUP handler see a freed buffer. */
+		sigset_t set, old;
+		sigemptyset(&set);
+		sigaddset(&set, SIGHUP);
+		sigprocmask(SIG_BLOCK, &set, &old);
+		j->buf = xnrealloc(j->buf, cap, sizeof(char));
+		j->cap = cap;
+		sigprocmask(SIG_SETMASK, &old, NULL);
+	}
+
+	memcpy(j->buf + j->len, str, len);
+	j->len += len;
+	j->pending++;
+
+	if (j->pending >= (size_t)conf.log_flush_count
+	|| time(NULL) - j->last_flush >= (time_t)conf.log_flush_interval)
+		return flush_journal(j);
+
+	return FUNC_SUCCESS;
+}
+
+/* Write all pending history and log entries. Call this function before
+ * reading, replacing, or truncating the history or the log files. */
+void
+flush_history_journals(void)
+{
+	size_t i;
+	for (i = 0; i < JOURNALS_N; i++)
+		flush_journal(&journals[i]);
+}
+
+/* Shrink the history and log files to their maximum number of lines. Files
+ * are rewritten into a temporary file, and then renamed over the original
+ * one, so that a crash in the middle does not corrupt them.
+ * Files are normally shrunk at exit. If FORCE is 0 (at startup), only files
+ * bigger than HIST_LINE_BOUND bytes per line are shrunk: they kept growing
+ * because previous sessions did not exit cleanly. */
+#define HIST_LINE_BOUND 256
+
+static int
+needs_shrink(const char *file, const int max, const int force)
+{
+	struct stat a;
+	return (file && (force == 1 || (stat(file, &a) != -1
+		&& a.st_size / HIST_LINE_BOUND > (off_t)max)));
+}
+
+void
+shrink_history_files(const int force)
+{
+	if (config_ok == 0 || xargs.stealth_mode == 1)
+		return;
+
+	if (needs_shrink(msgs_log_file, conf.max_log, force))
+		truncate_file(msgs_log_file, conf.max_log, 0);
+	if (needs_shrink(cmds_log_file, conf.max_log, force))
+		truncate_file(cmds_log_file, conf.max_log, 0);
+	/* History entries take two lines (timestamp and command) */
+	if (needs_shrink(hist_file, conf.max_hist * 2, force))
+		history_truncate_file(hist_file, conf.max_hist);
+}
+
+/* Run at exit: write pending history and log entries, close the journals,
+ * and shrink the history and log files. */
+void
+close_history_journals(void)
+{
+	size_t i;
+	int owner = 1;
+	for (i = 0; i < JOURNALS_N; i++) {
+		if (journals[i].file && journals[i].pid != getpid())
+			owner = 0;
+		close_journal(&journals[i]);
+		free(journals[i].buf);
+		memset(&journals[i], 0, sizeof(struct journal_t));
+	}
+
+	if (owner == 1)
+		shrink_history_files(1);
+}
+
+/* Make room in the history array for N entries (including the terminating
+ * NULL entry). The array grows geometrically. */
+static void
+grow_history(const size_t n)
+{
+	if (n <= history_cap)
+		return;
+
+	size_t cap = history_cap < 16 ? 16 : history_cap;
+	while (cap < n)
+		cap *= 2;
+
+	history = xnrealloc(history, cap, sizeof(struct history_t));
+	history_cap = cap;
+}
+
 /* Return a string with the current date.
  * Used to compose log entries. */
 static char *
@@ -64,6 +311,7 @@ print_logs(const int flag)
 {
 	char *file = flag == MSG_LOGS ? msgs_log_file : cmds_log_file;
 
+	flush_history_journals();
 	FILE *log_fp = fopen(file, "r");
 	if (!log_fp) {
 		err(0, NOPRINT_PROMPT, "log: '%s': %s\n", file, strerror(errno));
@@ -106,6 +354,7 @@ clear_logs(const int flag)
 	if (!file || !*file)
 		return FUNC_SUCCESS;
 
+	close_journal(&journals[flag == MSG_LOGS ? MSGS_JOURNAL : CMDS_JOURNAL]);
 	if (remove(file) == -1) {
 		xerror("log: '%s': %s\n", file, strerror(errno));
 		return errno;
@@ -155,17 +404,15 @@ log_cmd(void)
 	last_cmd = (char *)NULL;
 
 	/* Write the log into LOG_FILE */
-	FILE *log_fp = open_fappend(cmds_log_file);
-	if (!log_fp) {
+	const int ret = write_journal(&journals[CMDS_JOURNAL], cmds_log_file,
+		full_log, strlen(full_log));
+	free(full_log);
+
+	if (ret != FUNC_SUCCESS) {
 		err('e', PRINT_PROMPT, "log: '%s': %s\n", cmds_log_file, strerror(errno));
-		free(full_log);
 		return FUNC_FAILURE;
 	}
 
-	fputs(full_log, log_fp);
-	free(full_log);
-	fclose(log_fp);
-
 	return FUNC_SUCCESS;
 }
 
@@ -176,21 +423,25 @@ write_msg_into_logfile(const char *msg_str)
 	if (!msg_str || !*msg_str || !msgs_log_file || !*msgs_log_file)
 		return;
 
-	FILE *fp = open_fappend(msgs_log_file);
-	if (!fp) {
+	char *date = get_date();
+	const size_t len = strlen(date ? date : "unknown") + strlen(msg_str) + 4;
+	char *buf = xnmalloc(len, sizeof(char));
+	const int n = snprintf(buf, len, "[%s] %s", date ? date : "unknown",
+		msg_str);
+	free(date);
+
+	const int ret = n > 0 ? write_journal(&journals[MSGS_JOURNAL],
+		msgs_log_file, buf, (size_t)n) : FUNC_SUCCESS;
+	free(buf);
+
+	if (ret != FUNC_SUCCESS) {
 		/* Do not log this error: We might enter into an infinite loop
 		 * trying to access a file that cannot be accessed. Just warn the user
 		 * and print the error to STDERR. */
 		fprintf(stderr, "%s: '%s': %s\n", PROGRAM_NAME,
 			msgs_log_file, strerror(errno));
 		press_any_key_to_continue(0);
-		return;
 	}
-
-	char *date = get_date();
-	fprintf(fp, "[%s] %s", date ? date : "unknown", msg_str);
-	fclose(fp);
-	free(date);
 }
 
 static void
@@ -336,6 +587,7 @@ log_msg(char *msg_str, const int print_prompt, const int logme,
 		else
 			print_msg = 1;
 	} else {
+		flush_list_frame(); /* Keep the order of the output */
 		fputs(msg_str, stderr);
 	}
 
@@ -409,6 +661,7 @@ add_to_dirhist(const char *dir_path)
 static int
 reload_history(void)
 {
+	flush_history_journals();
 	clear_history();
 	read_history(hist_file);
 	history_truncate_file(hist_file, conf.max_hist);
@@ -422,6 +675,8 @@ reload_history(void)
 static int
 edit_history(char **args)
 {
+	flush_history_journals();
+
 	struct stat attr;
 	if (stat(hist_file, &attr) == -1) {
 		xerror("history: '%s': %s\n", hist_file, strerror(errno));
@@ -458,6 +713,7 @@ clear_history_func(char **args)
 		return FUNC_SUCCESS;
 
 	/* Let's overwrite whatever was there. */
+	flush_history_journals();
 	int fd = 0;
 	FILE *hist_fp = open_fwrite(hist_file, &fd);
 	if (!hist_fp) {
@@ -593,7 +849,9 @@ get_history(void)
 		history = xnrealloc(history, 1, sizeof(struct history_t));
 		current_hist_n = 0;
 	}
+	history_cap = 1;
 
+	flush_history_journals();
 	FILE *hist_fp = fopen(hist_file, "r");
 	if (!hist_fp) {
 		err('e', PRINT_PROMPT, "history: '%s': %s\n", hist_file, strerror(errno));
@@ -619,8 +877,7 @@ get_history(void)
 			continue;
 		}
 
-		history = xnrealloc(history, current_hist_n + 2,
-			sizeof(struct history_t));
+		grow_history(current_hist_n + 2);
 		history[current_hist_n].cmd = savestring(line_buff, (size_t)line_len);
 		history[current_hist_n].len = (size_t)line_len;
 		history[current_hist_n].date = tdate;
@@ -657,14 +914,23 @@ add_to_cmdhist(char *cmd)
 	/* For readline */
 	add_history(cmd);
 
-	if (config_ok == 1 && hist_status == 1 && hist_file)
-		append_history(1, hist_file);
+	const time_t tdate = time(NULL);
+
+	/* Same format used by append_history(3) when history_write_timestamps
+	 * is set: "#TIMESTAMP\nCMD\n". */
+	if (config_ok == 1 && hist_status == 1 && hist_file) {
+		const size_t len = cmd_len + 32;
+		char *buf = xnmalloc(len, sizeof(char));
+		const int n = snprintf(buf, len, "%c%lld\n%s\n",
+			history_comment_char, (long long)tdate, cmd);
+		if (n > 0)
+			write_journal(&journals[HIST_JOURNAL], hist_file, buf, (size_t)n);
+		free(buf);
+	}
 
 	/* For us */
 	/* Add the new input to the history array */
-	const time_t tdate = time(NULL);
-	history = xnrealloc(history, (size_t)(current_hist_n + 2),
-		sizeof(struct history_t));
+	grow_history(current_hist_n + 2);
 	history[current_hist_n].cmd = savestring(cmd, cmd_len);
 	history[current_hist_n].len = cmd_len;
 	history[current_hist_n].date = tdate;
@@ -38,6 +38,8 @@ __BEGIN_DECLS
 void add_to_cmdhist(char *cmd);
 void add_to_dirhist(const char *dir_path);
 int  clear_logs(const int flag);
+void close_history_journals(void);
+void flush_history_journals(void);
 int  get_history(void);
 int  history_function(char **args);
 int  log_cmd(void);
@@ -45,6 +47,7 @@ void log_msg(char *msg_str, const int print_prompt, const int logme,
 	const int add_to_msgs_list);
 int  print_logs(const int flag);
 int  record_cmd(char *input);
+void shrink_history_files(const int force);
 
 __END_DECLS
 
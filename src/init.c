@@ -25,8 +25,9 @@
 #include "helpers.h"
 
 #include <errno.h>
-#include <grp.h> /* getgrouplist(), getgrent(), setgrent(), endgrent() */
-#include <pwd.h> /* getpwent(), setpwent(), endpwent() */
+#include <grp.h> /* getgrouplist() */
+#include <pthread.h> /* get_path_programs() */
+#include <pwd.h> /* getpwuid() */
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
@@ -54,7 +55,8 @@
 #include "aux.h"
 #include "checks.h" /* truncate_file(), is_number() */
 #include "config.h"
-#include "jump.h" /* add_to_jumpdb() */
+#include "history.h" /* shrink_history_files() */
+#include "jump.h" /* add_to_jumpdb(), get_jump_index(), index_jumpdb() */
 #include "misc.h"
 #include "navigation.h"
 #include "prompt.h" /* set_prompt_options() */
@@ -206,6 +208,7 @@ init_conf_struct(void)
 	conf.disk_usage = UNSET;
 	conf.ext_cmd_ok = UNSET;
 	conf.files_counter = UNSET;
+	conf.files_counter_max = DEF_FILES_COUNTER_MAX;
 	conf.follow_symlinks = DEF_FOLLOW_SYMLINKS;
 	conf.follow_symlinks_long = DEF_FOLLOW_SYMLINKS_LONG;
 	conf.full_dir_size = UNSET;
@@ -229,6 +232,8 @@ init_conf_struct(void)
 	conf.list_dirs_first = UNSET;
 	conf.listing_mode = UNSET;
 	conf.log_cmds = DEF_LOG_CMDS;
+	conf.log_flush_count = DEF_LOG_FLUSH_COUNT;
+	conf.log_flush_interval = DEF_LOG_FLUSH_INTERVAL;
 	conf.log_msgs = DEF_LOG_MSGS;
 	conf.long_view = UNSET;
 	conf.max_dirhist = UNSET;
@@ -247,6 +252,9 @@ init_conf_struct(void)
 	conf.pager = UNSET;
 	conf.pager_once = 0;
 	conf.pager_view = UNSET;
+	conf.parallel_stat = DEF_PARALLEL_STAT;
+	conf.incremental_refresh = DEF_INCREMENTAL_REFRESH;
+	conf.dir_size_cache = DEF_DIR_SIZE_CACHE;
 	conf.preview_max_size = DEF_PREVIEW_MAX_SIZE;
 	conf.print_dir_cmds = DEF_PRINT_DIR_CMDS;
 	conf.print_selfiles = UNSET;
@@ -306,96 +314,6 @@ init_conf_struct(void)
 	init_shades();
 }
 
-static void
-get_sysusers(void)
-{
-	if (sys_users || xargs.stat > 0 || prop_fields.ids != PROP_ID_NAME
-	|| (xargs.list_and_quit == 1 && conf.long_view != 1))
-		return;
-
-#if defined(__ANDROID__)
-	return;
-#else
-	/* It may happen (for example on DragonFly) that the passwd database
-	 * is not properly rewound (for whatever reason). Let's make sure it is. */
-	setpwent();
-	size_t n = 0;
-	while (getpwent())
-		n++;
-
-	if (n == 0) {
-		endpwent();
-		sys_users = (struct groups_t *)NULL;
-		return;
-	}
-
-	setpwent();
-	sys_users = xnmalloc(n + 1, sizeof(struct groups_t));
-
-	struct passwd *p;
-	n = 0;
-	while ((p = getpwent())) {
-#ifndef __HAIKU__
-		/* Some systems (BSD) may have multiple UIDs 0 (e.g.: "root" and "toor").
-		 * This is known as a root alias. Let's always use "root" for UID 0
-		 * (this is what stat(1), ls(1), and most file managers do). */
-		const char *name = p->pw_uid == 0 ? "root" : p->pw_name;
-#else
-		const char *name = p->pw_name;
-#endif /* !__HAIKU__ */
-		const size_t namlen = strlen(name);
-		sys_users[n].name = savestring(name, namlen);
-		sys_users[n].namlen = namlen;
-		sys_users[n].id = p->pw_uid;
-		n++;
-	}
-
-	endpwent();
-	sys_users[n].name = (char *)NULL;
-	sys_users[n].namlen = 0;
-	sys_users[n].id = 0;
-#endif /* __ANDROID__ */
-}
-
-static void
-get_sysgroups(void)
-{
-	if (sys_groups || prop_fields.ids != PROP_ID_NAME
-	|| prop_fields.no_group == 1 || xargs.stat > 0
-	|| (xargs.list_and_quit == 1 && conf.long_view != 1))
-		return;
-
-	setgrent();
-
-	size_t n = 0;
-	while (getgrent())
-		n++;
-
-	if (n == 0) {
-		endgrent();
-		sys_groups = (struct groups_t *)NULL;
-		return;
-	}
-
-	setgrent();
-	sys_groups = xnmalloc(n + 1, sizeof(struct groups_t));
-
-	struct group *g;
-	n = 0;
-	while ((g = getgrent())) {
-		const size_t namlen = strlen(g->gr_name);
-		sys_groups[n].name = savestring(g->gr_name, namlen);
-		sys_groups[n].namlen = namlen;
-		sys_groups[n].id = g->gr_gid;
-		n++;
-	}
-
-	endgrent();
-	sys_groups[n].name = (char *)NULL;
-	sys_groups[n].namlen = 0;
-	sys_groups[n].id = 0;
-}
-
 void
 set_prop_fields(const char *line)
 {
@@ -459,14 +377,11 @@ set_prop_fields(const char *line)
 		prop_fields.len += conf.prop_fields_gap;
 	if (prop_fields.links != 0)
 		prop_fields.len += conf.prop_fields_gap;
-	if (prop_fields.ids != 0) {
+	/* User and group names are resolved on demand (see get_id_names()
+	 * in listing.c). */
+	if (prop_fields.ids != 0)
 		prop_fields.len += conf.prop_fields_gap
 			+ (prop_fields.no_group == 0); /* Space between user and group */
-		if (prop_fields.ids == PROP_ID_NAME) {
-			get_sysusers();
-			get_sysgroups();
-		}
-	}
 	/* The length of the date field is calculated by check_time_str() */
 }
 
@@ -560,11 +475,10 @@ get_home(void)
 int
 init_history(void)
 {
-	/* Shrink the log and the directory history files */
-	if (msgs_log_file)
-		truncate_file(msgs_log_file, conf.max_log, 0);
-	if (cmds_log_file)
-		truncate_file(cmds_log_file, conf.max_log, 0);
+	/* The log and history files are shrunk at exit, by
+	 * close_history_journals(). Make sure they are still bounded in case
+	 * previous sessions did not exit cleanly. */
+	shrink_history_files(0);
 
 	if (!hist_file)
 		return FUNC_FAILURE;
@@ -579,8 +493,6 @@ init_history(void)
 		 * size file, read_history() produces malloc errors */
 		/* Recover history from the history file */
 		read_history(hist_file); /* This line adds more leaks to readline */
-		/* Limit the size of the history file to max_hist lines */
-		history_truncate_file(hist_file, conf.max_hist);
 	} else {
 	/* If the history file doesn't exist, create it */
 		int fd = 0;
@@ -992,16 +904,12 @@ load_tags(void)
 /* Make sure no entry in the directory history is absent in the jump database.
  *
  * Why do we need this?
- * Jump entries are stored IN MEMORY and written to disk ONLY AT EXIT, where
- * the ENTIRE database is rewritten with values taken from this memory, which
- * is private to the current instance. So, whatever jump entry was added from a
- * second instance (provided this second instance was closed before the first
- * one) will be lost.
- *
- * One of the drawbacks of this approach is that IT ONLY RETRIEVES NEW ENTRIES
- * BUT WON'T UPDATE EXISTING ONES with values coming from the second instance:
- * they're lost.
- *
+ * Visits are appended to the jump journal at exit, and the database itself
+ * is rewritten only when compacting the journal (see save_jumpdb()). Entries
+ * forgotten at compaction time (because of their low rank) may still be
+ * present in the directory history, written by a different instance.
+ * Entries added here are recorded in the journal, as any other visit (see
+ * add_to_jumpdb()), so that they survive the next compaction.
 */
 static void
 sync_jumpdb_with_dirhist(void)
@@ -1010,40 +918,20 @@ sync_jumpdb_with_dirhist(void)
 		return;
 
 	int i = dirhist_total_index;
-	size_t j = 0;
 
 	while (--i >= 0) {
 		if (!old_pwd[i] || !*old_pwd[i])
 			continue;
 
-		const size_t old_pwd_len = strlen(old_pwd[i]);
-
-		int found = 0;
-		for (j = 0; j < jump_n; j++) {
-			if (!jump_db[j].path || !*jump_db[j].path
-			|| old_pwd[i][1] != jump_db[j].path[1]
-			|| old_pwd_len != jump_db[j].len
-			|| old_pwd[i][old_pwd_len - 1] != jump_db[j].path[jump_db[j].len - 1])
-				continue;
-
-			if (strcmp(old_pwd[i] + 1, jump_db[j].path + 1) == 0) {
-				found = 1;
-				break;
-			}
-		}
-
-		if (found == 0)
+		if (get_jump_index(old_pwd[i], strlen(old_pwd[i])) == -1)
 			add_to_jumpdb(old_pwd[i]);
 	}
 }
 
-/* Reconstruct the jump database from the database file. */
-void
-load_jumpdb(void)
+/* Load entries from the jump database file into JUMP_DB. */
+static void
+read_jump_file(void)
 {
-	if (xargs.no_dirjump == 1 || config_ok == 0 || !config_dir)
-		return;
-
 	char *jump_file = xnmalloc(config_dir_len + 12, sizeof(char));
 	snprintf(jump_file, config_dir_len + 12, "%s/jump.clifm", config_dir);
 
@@ -1142,8 +1030,10 @@ load_jumpdb(void)
 			continue;
 
 		/* Purge the database from non-existent directories */
-		if (conf.purge_jumpdb == 1 && access(tmpc, F_OK) == -1)
+		if (conf.purge_jumpdb == 1 && access(tmpc, F_OK) == -1) {
+			mark_jumpdb_dirty();
 			continue;
+		}
 
 		jump_db[jump_n].visits = (size_t)visits;
 		jump_db[jump_n].first_visit = first;
@@ -1179,6 +1069,19 @@ load_jumpdb(void)
 	jump_db[jump_n].visits = 0;
 	jump_db[jump_n].first_visit = -1;
 
+	index_jumpdb(jump_lines + 2);
+}
+
+/* Reconstruct the jump database from the database file, plus the visits
+ * recorded in the jump journal since it was last compacted. */
+void
+load_jumpdb(void)
+{
+	if (xargs.no_dirjump == 1 || config_ok == 0 || !config_dir)
+		return;
+
+	read_jump_file();
+	load_jump_journal();
 	sync_jumpdb_with_dirhist();
 }
 
@@ -1909,13 +1812,19 @@ set_sel_devino(void)
 	struct stat a;
 	for (i = 0; i < sel_n; i++) {
 		const char *name = sel_elements[i].name;
-		if (fstatat(XAT_FDCWD, name, &a, AT_SYMLINK_NOFOLLOW) == -1)
+		if (fstatat(XAT_FDCWD, name, &a, AT_SYMLINK_NOFOLLOW) == -1) {
+			/* Not indexed by index_sel_files() */
+			sel_devino[i].ino = 0;
+			sel_devino[i].dev = 0;
 			continue;
+		}
 
 		sel_devino[i].ino = a.st_ino;
 		sel_devino[i].dev = a.st_dev;
 	}
 
+	index_sel_files();
+
 	return FUNC_SUCCESS;
 }
 
@@ -1982,6 +1891,8 @@ get_sel_files(void)
 
 	if (sel_n > 0)
 		set_sel_devino();
+	else
+		index_sel_files();
 
 	/* If previous and current number of sel files don't match (mostly
 	 * because some selected files were removed), recreate the selections
@@ -2298,13 +2209,13 @@ cygwin_exclude_file(char *name)
 }
 #endif /* __CYGWIN__ */
 
-/* Check whether the path NAME is a symbolic link to any other path specified
- * in PATH. Returns 1 if true or 0 otherwise.
+/* Check whether the path NAME is a symbolic link to any other path in DIRS
+ * (N entries). Returns 1 if true or 0 otherwise.
  * Used to avoid scanning paths which are symlinks to another path, for example,
  * /bin and /sbin, which are usually symlinks to /usr/bin and /usr/sbin
  * respectively. */
 static int
-skip_this_path(char *name)
+skip_this_path(char *name, char **dirs, const size_t n)
 {
 	if (!name || !*name)
 		return 1;
@@ -2321,8 +2232,8 @@ skip_this_path(char *name)
 		return 1;
 
 	size_t i;
-	for (i = 0; paths[i].path; i++) {
-		if (*paths[i].path && strcmp(paths[i].path, rpath) == 0) {
+	for (i = 0; i < n; i++) {
+		if (*dirs[i] && strcmp(dirs[i], rpath) == 0) {
 			free(rpath);
 			return 1;
 		}
@@ -2332,49 +2243,333 @@ skip_this_path(char *name)
 	return 0;
 }
 
-/* Get the list of files in PATH, plus CliFM internal commands, aliases, and
- * action names, and store them in an array (bin_commands) to be read by
- * my_rl_completion(). */
-void
-get_path_programs(void)
+/* Return the index of the first name in the segment SEG of bin_commands not
+ * sorting before the first LEN bytes of STR. If no name in the segment starts
+ * with these bytes, the returned index points either to a non-matching name
+ * or to the end of the segment (bin_cmds_seg[SEG + 1]).
+ * Pass strlen(STR) + 1 as LEN to look for an exact match. */
+size_t
+bin_cmds_lower_bound(const int seg, const char *str, const size_t len)
 {
-	if (xargs.list_and_quit == 1)
-		return;
+	size_t lo = bin_cmds_seg[seg];
+	size_t hi = bin_cmds_seg[seg + 1];
+
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) >> 1);
+		if (strncmp(bin_commands[mid], str, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-	int i, l = 0, total_cmd = 0;
-	int *cmd_n = (int *)0;
-	struct dirent ***commands_bin = (struct dirent ***)NULL;
+	return lo;
+}
 
-	if (conf.ext_cmd_ok == 1) {
-		commands_bin = xnmalloc(path_n, sizeof(struct dirent));
-		cmd_n = xnmalloc(path_n, sizeof(int));
+static int
+bin_cmd_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
 
-		i = (int)path_n;
-		while (--i >= 0) {
-			cmd_n[i] = 0;
-			commands_bin[i] = (struct dirent **)NULL;
+/* Return 1 if NAME is found in any segment of bin_commands preceding SEG,
+ * or 0 otherwise. */
+static int
+in_prev_bin_cmds_seg(const int seg, const char *name)
+{
+	const size_t len = strlen(name) + 1;
+	int s;
+
+	for (s = 0; s < seg; s++) {
+		const size_t i = bin_cmds_lower_bound(s, name, len);
+		if (i < bin_cmds_seg[s + 1] && strcmp(bin_commands[i], name) == 0)
+			return 1;
+	}
 
-			if (!paths[i].path || !*paths[i].path
-			|| skip_this_path(paths[i].path) == 1)
+	return 0;
+}
+
+/* Sort the N names in NAMES, dropping (and freeing) duplicates and names
+ * already present in a segment of bin_commands preceding SEG (say, a program
+ * in PATH shadowed by an internal command). Return the number of names
+ * left. */
+static size_t
+sort_cmd_names(char **names, const size_t n, const int seg)
+{
+	if (n > 1)
+		qsort(names, n, sizeof(char *), bin_cmd_cmp);
+
+	size_t i, c = 0;
+	for (i = 0; i < n; i++) {
+		if ((c > 0 && strcmp(names[c - 1], names[i]) == 0)
+		|| in_prev_bin_cmds_seg(seg, names[i]) == 1) {
+			free(names[i]);
+			continue;
+		}
+
+		names[c] = names[i];
+		c++;
+	}
+
+	return c;
+}
+
+/* Sort the segment SEG of bin_commands (from bin_cmds_seg[SEG] up to END)
+ * (see sort_cmd_names()). Return the end of the resulting segment, which
+ * is where the next one starts. */
+static size_t
+seal_bin_cmds_seg(const int seg, const size_t end)
+{
+	const size_t start = bin_cmds_seg[seg];
+	bin_cmds_seg[seg + 1] = start
+		+ sort_cmd_names(bin_commands + start, end - start, seg);
+
+	return bin_cmds_seg[seg + 1];
+}
+
+/* Scanning PATH is the slowest part of get_path_programs() (think of long
+ * PATHs or network mounted directories), so that it is run by a background
+ * thread, and the first prompt is not delayed. The thread works on its own
+ * copy of PATH, and touches no global data: it hands in a sorted list of
+ * names, from which the main thread drops names shadowed by internal
+ * commands, aliases, and actions, appending the rest to bin_commands as the
+ * PATH segment (see load_path_programs()). Until then, this segment is empty.
+ * A scan still running when bin_commands is freed (say, at exit) is not
+ * waited for, since a hung mount may block it indefinitely: it is detached,
+ * and frees itself once finished (see free_bin_commands()). */
+struct path_scan_t {
+	pthread_mutex_t mutex;
+	pthread_t thread;
+	char **dirs;     /* Copy of PATH directories to scan */
+	char **names;    /* Names found in PATH */
+	size_t dirs_n;
+	size_t names_n;
+	int done;        /* The scan finished */
+	int abandoned;   /* Nobody will collect the result */
+};
+
+/* The running scan, if any. */
+static struct path_scan_t *path_scan = (struct path_scan_t *)NULL;
+
+static void
+free_path_scan(struct path_scan_t *scan)
+{
+	size_t i;
+	for (i = 0; i < scan->dirs_n; i++)
+		free(scan->dirs[i]);
+	free(scan->dirs);
+
+	for (i = 0; i < scan->names_n; i++)
+		free(scan->names[i]);
+	free(scan->names);
+
+	pthread_mutex_destroy(&scan->mutex);
+	free(scan);
+}
+
+static void *
+path_scan_worker(void *arg)
+{
+	struct path_scan_t *scan = (struct path_scan_t *)arg;
+	char **names = (char **)NULL;
+	size_t i, n = 0, cap = 0;
+
+	for (i = 0; i < scan->dirs_n; i++) {
+		if (skip_this_path(scan->dirs[i], scan->dirs, scan->dirs_n) == 1)
+			continue;
+
+		/* Fedora, for example, adds HOME/bin and HOME/.local/bin to
+		 * PATH disregarding if they exist or not. */
+		DIR *dir = opendir(scan->dirs[i]);
+		if (!dir)
+			continue;
+
+		struct dirent *ent;
+		while ((ent = readdir(dir))) {
+#ifdef _DIRENT_HAVE_D_TYPE
+			if (SELFORPARENT(ent->d_name)
+			|| (ent->d_type != DT_REG && ent->d_type != DT_LNK))
+#else
+			if (SELFORPARENT(ent->d_name))
+#endif /* _DIRENT_HAVE_D_TYPE */
+				continue;
+#ifdef __CYGWIN__
+			if (cygwin_exclude_file(ent->d_name) == 1)
+				continue;
+#endif /* __CYGWIN__ */
+
+			if (n == cap) {
+				cap = cap == 0 ? 256 : cap * 2;
+				names = xnrealloc(names, cap, sizeof(char *));
+			}
+
+			names[n] = savestring(ent->d_name, strlen(ent->d_name));
+			n++;
+		}
+
+		closedir(dir);
+	}
+
+	/* No segment precedes the first one: just sort and drop duplicates,
+	 * without reading bin_commands. */
+	n = sort_cmd_names(names, n, BIN_CMD_INTERNAL);
+
+	pthread_mutex_lock(&scan->mutex);
+	scan->names = names;
+	scan->names_n = n;
+	scan->done = 1;
+	const int abandoned = scan->abandoned;
+	pthread_mutex_unlock(&scan->mutex);
+
+	if (abandoned == 1)
+		free_path_scan(scan);
+
+	return NULL;
+}
+
+/* Append the names found by the (finished) PATH scan SCAN to bin_commands,
+ * except those found in a preceding segment, and free SCAN. */
+static void
+merge_path_scan(struct path_scan_t *scan)
+{
+	const size_t n = scan->names_n;
+	if (n > 0) {
+		bin_commands = xnrealloc(bin_commands, path_progsn + n + 1,
+			sizeof(char *));
+
+		size_t i, c = 0;
+		for (i = 0; i < n; i++) {
+			if (in_prev_bin_cmds_seg(BIN_CMD_PATH, scan->names[i]) == 1) {
+				free(scan->names[i]);
 				continue;
+			}
+			bin_commands[path_progsn + c] = scan->names[i];
+			c++;
+		}
+
+		path_progsn += c;
+		bin_cmds_seg[BIN_CMD_PATH + 1] = path_progsn;
+		bin_commands[path_progsn] = (char *)NULL;
+		/* Names now belong to bin_commands (or were freed). */
+		scan->names_n = 0;
+	}
+
+	free_path_scan(scan);
+}
+
+/* Load the names found by the running PATH scan, if any, into bin_commands.
+ * If WAIT is set, wait for the scan to finish; otherwise, just return if it
+ * has not finished yet: callers should do fine without commands in PATH.
+ * Return 1 if commands in PATH are still being loaded, or 0 otherwise. */
+int
+load_path_programs(const int wait)
+{
+	if (!path_scan)
+		return 0;
+
+	if (wait == 0) {
+		pthread_mutex_lock(&path_scan->mutex);
+		const int done = path_scan->done;
+		pthread_mutex_unlock(&path_scan->mutex);
+		if (done == 0)
+			return 1;
+	}
+
+	struct path_scan_t *scan = path_scan;
+	path_scan = (struct path_scan_t *)NULL;
+	pthread_join(scan->thread, NULL);
+	merge_path_scan(scan);
+	return 0;
+}
 
-			cmd_n[i] = scandir(paths[i].path, &commands_bin[i], NULL, xalphasort);
+/* Scan PATH directories in a background thread (see path_scan_t above). */
+static void
+start_path_scan(void)
+{
+	struct path_scan_t *scan = xcalloc(1, sizeof(struct path_scan_t));
+	pthread_mutex_init(&scan->mutex, NULL);
+	scan->dirs = xnmalloc(path_n + 1, sizeof(char *));
+
+	size_t i;
+	for (i = 0; i < path_n; i++) {
+		if (!paths[i].path || !*paths[i].path)
+			continue;
+		scan->dirs[scan->dirs_n] = savestring(paths[i].path,
+			strlen(paths[i].path));
+		scan->dirs_n++;
+	}
 
-			/* If paths[i] directory is empty, 2 is returned. If it does not
-			 * exist, scandir returns -1.
-			 * Fedora, for example, adds HOME/bin and HOME/.local/bin to
-			 * PATH disregarding if they exist or not. */
-			if (cmd_n[i] > 2)
-				total_cmd += cmd_n[i] - 2;
+	if (pthread_create(&scan->thread, NULL, path_scan_worker, scan) != 0) {
+		/* No thread: let's do it ourselves. */
+		path_scan_worker(scan);
+		merge_path_scan(scan);
+		return;
+	}
+
+	path_scan = scan;
+}
+
+/* Free the list of command names (bin_commands). A running PATH scan, if
+ * any, is abandoned: if not finished yet, it is detached instead of waited
+ * for, and frees itself (see path_scan_worker()). */
+void
+free_bin_commands(void)
+{
+	if (path_scan) {
+		struct path_scan_t *scan = path_scan;
+		path_scan = (struct path_scan_t *)NULL;
+
+		pthread_mutex_lock(&scan->mutex);
+		const int done = scan->done;
+		const pthread_t thread = scan->thread;
+		scan->abandoned = 1;
+		pthread_mutex_unlock(&scan->mutex);
+
+		if (done == 1) {
+			pthread_join(thread, NULL);
+			free_path_scan(scan);
+		} else {
+			/* SCAN may be freed by the worker from now on. */
+			pthread_detach(thread);
 		}
 	}
 
+	if (bin_commands) {
+		size_t i;
+		for (i = 0; i < path_progsn; i++)
+			free(bin_commands[i]);
+		free(bin_commands);
+		bin_commands = (char **)NULL;
+	}
+
+	path_progsn = 0;
+	memset(bin_cmds_seg, 0, sizeof(bin_cmds_seg));
+}
+
+/* Get the list of files in PATH, plus CliFM internal commands, aliases, and
+ * action names, and store them in an array (bin_commands) to be read by
+ * my_rl_completion() and the suggestions system.
+ * Each kind of name is stored in its own sorted segment (see bin_cmds_seg
+ * in helpers.h), so that looking up a command name (or prefix) takes a few
+ * binary searches instead of a scan of the whole array. The array is only
+ * rebuilt when PATH directories change (see reload_binaries()).
+ * Commands in PATH are loaded in the background (see start_path_scan()). */
+void
+get_path_programs(void)
+{
+	if (xargs.list_and_quit == 1)
+		return;
+
+	int i;
+	size_t l = 0;
+
 	/* Add internal commands */
 	for (internal_cmds_n = 0; internal_cmds[internal_cmds_n].name;
 		internal_cmds_n++);
 
-	bin_commands = xnmalloc((size_t)total_cmd
-		+ internal_cmds_n + aliases_n + actions_n + 2, sizeof(char *));
+	bin_commands = xnmalloc(internal_cmds_n + aliases_n + actions_n + 2,
+		sizeof(char *));
+
+	memset(bin_cmds_seg, 0, sizeof(bin_cmds_seg));
 
 	i = (int)internal_cmds_n;
 	while (--i >= 0) {
@@ -2383,6 +2578,8 @@ get_path_programs(void)
 		l++;
 	}
 
+	l = seal_bin_cmds_seg(BIN_CMD_INTERNAL, l);
+
 	/* Now add aliases, if any */
 	if (aliases_n > 0) {
 		i = (int)aliases_n;
@@ -2393,6 +2590,8 @@ get_path_programs(void)
 		}
 	}
 
+	l = seal_bin_cmds_seg(BIN_CMD_ALIAS, l);
+
 	/* And user defined actions too, if any */
 	if (actions_n > 0) {
 		i = (int)actions_n;
@@ -2403,45 +2602,16 @@ get_path_programs(void)
 		}
 	}
 
-	if (total_cmd > 0) {
-		/* And finally, add commands in PATH */
-		i = (int)path_n;
-		while (--i >= 0) {
-			if (cmd_n[i] <= 0 || !commands_bin[i])
-				continue;
-
-			int j = cmd_n[i];
-			while (--j >= 0) {
-#ifdef _DIRENT_HAVE_D_TYPE
-				if (SELFORPARENT(commands_bin[i][j]->d_name)
-				|| (commands_bin[i][j]->d_type != DT_REG
-				&& commands_bin[i][j]->d_type != DT_LNK)) {
-#else
-				if (SELFORPARENT(commands_bin[i][j]->d_name)) {
-#endif /* _DIRENT_HAVE_D_TYPE */
-					free(commands_bin[i][j]);
-					continue;
-				}
-#ifdef __CYGWIN__
-				if (cygwin_exclude_file(commands_bin[i][j]->d_name) == 1) {
-					free(commands_bin[i][j]);
-					continue;
-				}
-#endif /* __CYGWIN__ */
-				bin_commands[l] = savestring(commands_bin[i][j]->d_name,
-					strlen(commands_bin[i][j]->d_name));
-				l++;
-				free(commands_bin[i][j]);
-			}
+	l = seal_bin_cmds_seg(BIN_CMD_ACTION, l);
 
-			free(commands_bin[i]);
-		}
-	}
+	/* The PATH segment is empty until the scan is loaded. */
+	bin_cmds_seg[BIN_CMD_PATH + 1] = l;
+	path_progsn = l;
+	bin_commands[path_progsn] = (char *)NULL;
 
-	free(commands_bin);
-	free(cmd_n);
-	path_progsn = (size_t)l;
-	bin_commands[l] = (char *)NULL;
+	/* And finally, add commands in PATH */
+	if (conf.ext_cmd_ok == 1 && path_n > 0)
+		start_path_scan();
 }
 
 static void
@@ -28,8 +28,10 @@
 __BEGIN_DECLS
 
 int  backup_argv(const int argc, char **argv);
+size_t bin_cmds_lower_bound(const int seg, const char *str, const size_t len);
 void check_env_filter(void);
 void check_options(void);
+void free_bin_commands(void);
 void get_aliases(void);
 size_t get_cdpath(void);
 #ifdef LINUX_FSINFO
@@ -54,6 +56,7 @@ int  load_bookmarks(void);
 int  load_dirhist(void);
 void load_file_templates(void);
 void load_jumpdb(void);
+int  load_path_programs(const int wait);
 int  load_pinned_dir(void);
 int  load_prompts(void);
 int  load_remotes(void);
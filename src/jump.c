@@ -73,6 +73,71 @@ struct jump_entry_t {
 #define FIRST_SEGMENT (1 << 0)
 #define LAST_SEGMENT  (1 << 1)
 
+/* An open addressing hash index over the jump database, mapping paths to
+ * indices in the JUMP_DB array. Slots hold the index plus one (zero means
+ * empty). The capacity is always a power of two, at least twice the number
+ * of indexed entries. JUMP_IDX_N is the number of JUMP_DB entries indexed
+ * so far. */
+static size_t *jump_idx = (size_t *)NULL;
+static size_t jump_idx_cap = 0;
+static size_t jump_idx_n = 0;
+
+/* Number of entries allocated for JUMP_DB (which grows geometrically). */
+static size_t jump_db_cap = 0;
+
+/* Set whenever the database is modified other than by visiting directories
+ * (purged, edited, or entries dropped at load time), so that it is rewritten
+ * at exit only if needed. */
+static int jump_dirty = 0;
+
+/* Visits are not written back by rewriting the whole database, but appended
+ * at exit to a journal file (JUMP_JOURNAL_FILE, in the config directory) as
+ * "TIME:PATH" lines. The journal is replayed by load_jump_journal() and
+ * compacted into the database by save_jumpdb() once it grows beyond
+ * JUMP_JOURNAL_MAX bytes (or whenever the database needs to be rewritten
+ * anyway). JUMP_VISITS holds the visits made by the current instance, and
+ * JUMP_JOURNAL_SIZE the size of the journal as last replayed. */
+#define JUMP_JOURNAL_FILE "jump_journal.clifm"
+#define JUMP_JOURNAL_MAX  (64 * 1024)
+
+struct jump_visit_t {
+	size_t n; /* Index into JUMP_DB */
+	time_t time;
+};
+
+static struct jump_visit_t *jump_visits = (struct jump_visit_t *)NULL;
+static size_t jump_visits_n = 0;
+static size_t jump_visits_cap = 0;
+static off_t jump_journal_size = 0;
+
+#define JUMP_IDX_MIN_CAP 64
+
+/* Bookmarked, pinned, and workspace directories (the directories getting
+ * bonus credit), indexed by path. The index is rebuilt by
+ * index_jump_bonus() before ranking entries, so that checking whether an
+ * entry gets bonus credit takes a single lookup. */
+#define JBONUS_BOOKMARK  (1 << 0)
+#define JBONUS_PINNED    (1 << 1)
+#define JBONUS_WORKSPACE (1 << 2)
+
+struct jump_bonus_t {
+	const char *path;
+	int flags;
+	int pad0;
+};
+
+static struct jump_bonus_t *jump_bonus = (struct jump_bonus_t *)NULL;
+static size_t jump_bonus_cap = 0;
+
+/* A signature for each entry in the jump database: a bit for each
+ * (case-folded) alphanumeric character present in the path. An entry cannot
+ * match a query string unless its signature contains all the bits in the
+ * signature of the query. JUMP_SIGS_N is the number of JUMP_DB entries
+ * computed so far. */
+static unsigned long long *jump_sigs = (unsigned long long *)NULL;
+static size_t jump_sigs_n = 0;
+static size_t jump_sigs_cap = 0;
+
 /* Getting the total rank of an entry:
  * 1) rank = calculate_base_credit()
  * 2) rank += calculate_bonus_credit() */
@@ -108,9 +173,70 @@ calculate_base_credit(const int days_since_first, const int hours_since_last,
 	return rank;
 }
 
+static void
+add_jump_bonus(const char *path, const int flag)
+{
+	if (!path || !*path)
+		return;
+
+	size_t i = hashme(path, 1) & (jump_bonus_cap - 1);
+	while (jump_bonus[i].path) {
+		if (strcmp(jump_bonus[i].path, path) == 0) {
+			jump_bonus[i].flags |= flag;
+			return;
+		}
+		i = (i + 1) & (jump_bonus_cap - 1);
+	}
+
+	jump_bonus[i].path = path;
+	jump_bonus[i].flags = flag;
+}
+
+/* Rebuild the index of directories getting bonus credit. Since bookmarks,
+ * the pinned directory, and workspaces may change at any time, this
+ * function must be called before ranking entries. */
+static void
+index_jump_bonus(void)
+{
+	size_t cap = 16;
+	while (cap < (bm_n + MAX_WS + 1) * 2)
+		cap <<= 1;
+
+	if (cap != jump_bonus_cap) {
+		free(jump_bonus);
+		jump_bonus = xnmalloc(cap, sizeof(struct jump_bonus_t));
+		jump_bonus_cap = cap;
+	}
+	memset(jump_bonus, 0, cap * sizeof(struct jump_bonus_t));
+
+	size_t i;
+	for (i = 0; i < bm_n; i++)
+		add_jump_bonus(bookmarks[i].path, JBONUS_BOOKMARK);
+
+	add_jump_bonus(pinned_dir, JBONUS_PINNED);
+
+	for (i = 0; i < MAX_WS; i++)
+		add_jump_bonus(workspaces[i].path, JBONUS_WORKSPACE);
+}
+
+static int
+get_jump_bonus_flags(const char *path)
+{
+	size_t i = hashme(path, 1) & (jump_bonus_cap - 1);
+	while (jump_bonus[i].path) {
+		if (jump_bonus[i].path[1] == path[1]
+		&& strcmp(jump_bonus[i].path, path) == 0)
+			return jump_bonus[i].flags;
+		i = (i + 1) & (jump_bonus_cap - 1);
+	}
+
+	return 0;
+}
+
 /* Calculate bonus credit for the entry ENTRY.
  * Matches in directory basename, bookmarked and pinned directories,
- * just as directories currently in a workspace, have bonus credit. */
+ * just as directories currently in a workspace, have bonus credit.
+ * index_jump_bonus() must have been called before. */
 static int
 calculate_bonus_credit(const char *entry, const char *query, int *keep)
 {
@@ -125,33 +251,18 @@ calculate_bonus_credit(const char *entry, const char *query, int *keep)
 			bonus += BASENAME_BONUS;
 	}
 
-	int i = (int)bm_n;
-	while (--i >= 0) {
-		if (bookmarks[i].path && *bookmarks[i].path
-		&& bookmarks[i].path[1] == entry[1]
-		&& strcmp(bookmarks[i].path, entry) == 0) {
-			*keep = 1;
-			bonus += BOOKMARK_BONUS;
-			break;
-		}
-	}
+	const int bonus_flags = get_jump_bonus_flags(entry);
+	if (bonus_flags == 0)
+		return bonus;
 
-	if (pinned_dir && *pinned_dir && pinned_dir[1] == entry[1]
-	&& strcmp(pinned_dir, entry) == 0) {
-		*keep = 1;
-		bonus += PINNED_BONUS;
-	}
+	*keep = 1;
 
-	i = MAX_WS;
-	while (--i >= 0) {
-		if (workspaces[i].path && *workspaces[i].path
-		&& workspaces[i].path[1] == entry[1]
-		&& strcmp(workspaces[i].path, entry) == 0) {
-			*keep = 1;
-			bonus += WORKSPACE_BONUS;
-			break;
-		}
-	}
+	if (bonus_flags & JBONUS_BOOKMARK)
+		bonus += BOOKMARK_BONUS;
+	if (bonus_flags & JBONUS_PINNED)
+		bonus += PINNED_BONUS;
+	if (bonus_flags & JBONUS_WORKSPACE)
+		bonus += WORKSPACE_BONUS;
 
 	return bonus;
 }
@@ -183,6 +294,141 @@ rank_entry(const int i, const time_t now, int *days_since_first,
 	return rank;
 }
 
+static void
+jump_idx_add(const size_t index)
+{
+	size_t i = hashme(jump_db[index].path, 1) & (jump_idx_cap - 1);
+	while (jump_idx[i] != 0)
+		i = (i + 1) & (jump_idx_cap - 1);
+
+	jump_idx[i] = index + 1;
+}
+
+/* Rebuild the jump database index from scratch. CAP is the number of
+ * entries allocated for the JUMP_DB array. */
+void
+index_jumpdb(const size_t cap)
+{
+	jump_db_cap = cap;
+
+	size_t idx_cap = JUMP_IDX_MIN_CAP;
+	while (idx_cap < jump_n * 2)
+		idx_cap <<= 1;
+
+	if (idx_cap != jump_idx_cap) {
+		free(jump_idx);
+		jump_idx = xnmalloc(idx_cap, sizeof(size_t));
+		jump_idx_cap = idx_cap;
+	}
+	memset(jump_idx, 0, idx_cap * sizeof(size_t));
+
+	for (jump_idx_n = 0; jump_idx_n < jump_n; jump_idx_n++) {
+		if (jump_db[jump_idx_n].path)
+			jump_idx_add(jump_idx_n);
+	}
+}
+
+void
+free_jump_index(void)
+{
+	free(jump_idx);
+	jump_idx = (size_t *)NULL;
+	jump_idx_cap = jump_idx_n = jump_db_cap = 0;
+
+	free(jump_sigs);
+	jump_sigs = (unsigned long long *)NULL;
+	jump_sigs_n = jump_sigs_cap = 0;
+
+	free(jump_bonus);
+	jump_bonus = (struct jump_bonus_t *)NULL;
+	jump_bonus_cap = 0;
+}
+
+/* Return the signature of the string STR (see JUMP_SIGS above). */
+unsigned long long
+get_jump_sig(const char *str)
+{
+	unsigned long long sig = 0;
+
+	for (; *str; str++) {
+		const unsigned char c = (unsigned char)*str;
+		if (c >= 'a' && c <= 'z')
+			sig |= 1ULL << (c - 'a');
+		else if (c >= 'A' && c <= 'Z')
+			sig |= 1ULL << (c - 'A');
+		else if (c >= '0' && c <= '9')
+			sig |= 1ULL << (c - '0' + 26);
+		else if (c == '.' || c == '-' || c == '_' || c == ' ')
+			sig |= 1ULL << (36 + (c == '-') + (c == '_') * 2 + (c == ' ') * 3);
+	}
+
+	return sig;
+}
+
+/* Compute signatures for entries added to the jump database since the
+ * last call. */
+static void
+update_jump_sigs(void)
+{
+	if (jump_sigs_n > jump_n) /* The database was reloaded */
+		jump_sigs_n = 0;
+
+	if (jump_n > jump_sigs_cap) {
+		jump_sigs_cap = jump_n * 2;
+		jump_sigs = xnrealloc(jump_sigs, jump_sigs_cap,
+			sizeof(unsigned long long));
+	}
+
+	for (; jump_sigs_n < jump_n; jump_sigs_n++) {
+		jump_sigs[jump_sigs_n] = jump_db[jump_sigs_n].path
+			? get_jump_sig(jump_db[jump_sigs_n].path) : 0;
+	}
+}
+
+/* Return 1 if the path of the jump entry N lacks some of the characters in
+ * a string whose signature is SIG (so that it cannot contain that string),
+ * or 0 otherwise. */
+int
+jump_entry_lacks_sig(const size_t n, const unsigned long long sig)
+{
+	if (n >= jump_sigs_n)
+		update_jump_sigs();
+
+	return (n >= jump_sigs_n || (jump_sigs[n] & sig) != sig);
+}
+
+/* Return the index of the (valid) jump entry for the directory DIR, whose
+ * length is LEN, or -1 if not found. */
+int
+get_jump_index(const char *dir, const size_t len)
+{
+	if (!jump_db || jump_n == 0)
+		return (-1);
+
+	if (jump_idx_n > jump_n || jump_idx_cap < jump_n * 2) {
+		/* The database was reloaded or has grown: rebuild the index. */
+		index_jumpdb(jump_db_cap);
+	} else {
+		for (; jump_idx_n < jump_n; jump_idx_n++) {
+			if (jump_db[jump_idx_n].path)
+				jump_idx_add(jump_idx_n);
+		}
+	}
+
+	size_t i = hashme(dir, 1) & (jump_idx_cap - 1);
+	while (jump_idx[i] != 0) {
+		const size_t n = jump_idx[i] - 1;
+		i = (i + 1) & (jump_idx_cap - 1);
+
+		/* Purged entries may share their path with a newer entry. */
+		if (n < jump_n && IS_VALID_JUMP_ENTRY(n) && jump_db[n].len == len
+		&& strcmp(jump_db[n].path, dir) == 0)
+			return (int)n;
+	}
+
+	return (-1);
+}
+
 static void
 free_jump_database(void)
 {
@@ -194,12 +440,18 @@ free_jump_database(void)
 	free(jump_db);
 	jump_db = (struct jump_t *)NULL;
 	jump_n = 0;
+	free_jump_index();
 }
 
 static int
 add_new_jump_entry(const char *dir, const size_t dir_len)
 {
-	jump_db = xnrealloc(jump_db, jump_n + 2, sizeof(struct jump_t));
+	/* Room for the new entry plus the terminating NULL entry. */
+	if (jump_n + 2 > jump_db_cap) {
+		jump_db_cap = jump_db_cap < 16 ? 16 : jump_db_cap * 2;
+		jump_db = xnrealloc(jump_db, jump_db_cap, sizeof(struct jump_t));
+	}
+
 	jump_db[jump_n].visits = 1;
 	const time_t now = time(NULL);
 	jump_db[jump_n].first_visit = now;
@@ -221,8 +473,33 @@ add_new_jump_entry(const char *dir, const size_t dir_len)
 	return FUNC_SUCCESS;
 }
 
-/* Add DIR to the jump database. If already there, just update the number of
- * visits and the last visit time. */
+/* Apply a visit to DIR (DIR_LEN bytes long) made at time T: if already in
+ * the jump database, just update the number of visits and the last visit
+ * time. Return the index of the entry. */
+static size_t
+apply_jump_visit(const char *dir, const size_t dir_len, const time_t t)
+{
+	if (!jump_db) {
+		jump_db = xnmalloc(1, sizeof(struct jump_t));
+		jump_n = 0;
+		jump_db_cap = 1;
+	}
+
+	const int i = get_jump_index(dir, dir_len);
+	if (i != -1) {
+		jump_db[i].visits++;
+		if (t > jump_db[i].last_visit)
+			jump_db[i].last_visit = t;
+		return (size_t)i;
+	}
+
+	add_new_jump_entry(dir, dir_len);
+	jump_db[jump_n - 1].first_visit = jump_db[jump_n - 1].last_visit = t;
+	return jump_n - 1;
+}
+
+/* Add DIR to the jump database, and remember the visit so that it is
+ * appended to the journal at exit. */
 int
 add_to_jumpdb(char *dir)
 {
@@ -235,41 +512,160 @@ add_to_jumpdb(char *dir)
 		dir_len--;
 	}
 
-	if (!jump_db) {
-		jump_db = xnmalloc(1, sizeof(struct jump_t));
-		jump_n = 0;
+	const time_t now = time(NULL);
+	const size_t n = apply_jump_visit(dir, dir_len, now);
+
+	if (jump_visits_n == jump_visits_cap) {
+		jump_visits_cap = jump_visits_cap < 16 ? 16 : jump_visits_cap * 2;
+		jump_visits = xnrealloc(jump_visits, jump_visits_cap,
+			sizeof(struct jump_visit_t));
 	}
 
-	int i = (int)jump_n, new_entry = 1;
-	while (--i >= 0) {
-		/* Jump entries are all absolute paths, so that they all start with
-		 * a slash. Let's start comparing them from the second char. */
-		if (!IS_VALID_JUMP_ENTRY(i) || dir_len != jump_db[i].len
-		|| dir[1] != jump_db[i].path[1])
-			continue;
+	jump_visits[jump_visits_n].n = n;
+	jump_visits[jump_visits_n].time = now;
+	jump_visits_n++;
+
+	return FUNC_SUCCESS;
+}
+
+/* The database was modified: rewrite it at exit. */
+void
+mark_jumpdb_dirty(void)
+{
+	jump_dirty = 1;
+}
+
+/* Replay the jump journal FILE, starting at byte OFFSET, into the jump
+ * database. Lines not ending with a new line char (partial writes) are
+ * ignored. Return the size of the journal, or -1 in case of error. */
+static off_t
+replay_jump_journal(const char *file, const off_t offset)
+{
+	int fd;
+	FILE *fp = open_fread(file, &fd);
+	if (!fp)
+		return (-1);
+
+	if (offset > 0 && fseeko(fp, offset, SEEK_SET) == -1) {
+		fclose(fp);
+		return (-1);
+	}
+
+	size_t line_size = 0;
+	char *line = (char *)NULL;
+	ssize_t line_len = 0;
 
-		if (strcmp(jump_db[i].path, dir) == 0) {
-			jump_db[i].visits++;
-			jump_db[i].last_visit = time(NULL);
-			new_entry = 0;
+	while ((line_len = getline(&line, &line_size, fp)) > 0) {
+		if (line[line_len - 1] != '\n')
 			break;
-		}
+		line[line_len - 1] = '\0';
+
+		char *p = strchr(line, ':');
+		if (!p || p == line || p[1] != '/')
+			continue;
+
+		*p = '\0';
+		if (!is_number(line))
+			continue;
+
+		const size_t len = (size_t)(line_len - 1) - (size_t)(p + 1 - line);
+		apply_jump_visit(p + 1, len, (time_t)strtoll(line, NULL, 10));
 	}
 
-	if (new_entry == 0)
+	const off_t size = ftello(fp);
+	free(line);
+	fclose(fp);
+
+	return size;
+}
+
+/* Replay the visits recorded in the jump journal into the jump database
+ * (just loaded from disk by load_jumpdb()). */
+void
+load_jump_journal(void)
+{
+	jump_journal_size = 0;
+	if (xargs.no_dirjump == 1 || config_ok == 0 || !config_dir)
+		return;
+
+	char journal[PATH_MAX + 1];
+	snprintf(journal, sizeof(journal), "%s/%s", config_dir, JUMP_JOURNAL_FILE);
+
+	const off_t size = replay_jump_journal(journal, 0);
+	if (size > 0)
+		jump_journal_size = size;
+}
+
+/* Append the visits made by the current instance to the jump journal FILE,
+ * in a single write(2) call, so that lines written concurrently by other
+ * instances are not interleaved. */
+static int
+append_jump_journal(const char *file)
+{
+	size_t i, len = 0;
+	for (i = 0; i < jump_visits_n; i++) {
+		if (IS_VALID_JUMP_ENTRY(jump_visits[i].n))
+			len += jump_db[jump_visits[i].n].len + MAX_INT_STR + 2;
+	}
+
+	if (len == 0)
 		return FUNC_SUCCESS;
 
-	return add_new_jump_entry(dir, dir_len);
+	char *buf = xnmalloc(len + 1, sizeof(char));
+	size_t buf_len = 0;
+
+	for (i = 0; i < jump_visits_n; i++) {
+		const size_t n = jump_visits[i].n;
+		if (!IS_VALID_JUMP_ENTRY(n))
+			continue;
+
+		buf_len += (size_t)snprintf(buf + buf_len, len + 1 - buf_len,
+			"%jd:%s\n", (intmax_t)jump_visits[i].time, jump_db[n].path);
+	}
+
+	int ret = FUNC_FAILURE;
+	const int fd = open(file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+		S_IRUSR | S_IWUSR);
+	if (fd != -1) {
+		if (write(fd, buf, buf_len) == (ssize_t)buf_len)
+			ret = FUNC_SUCCESS;
+		close(fd);
+	}
+
+	free(buf);
+	return ret;
+}
+
+static void
+clear_jump_visits(void)
+{
+	free(jump_visits);
+	jump_visits = (struct jump_visit_t *)NULL;
+	jump_visits_n = jump_visits_cap = 0;
 }
 
-/* Save the jump database into a file. */
+/* Save the jump database. Visits are just appended to the journal, unless
+ * the journal grew too big or the database itself was modified: in this
+ * case the database is rewritten (replaying first the visits journaled by
+ * other instances since we loaded it), and the journal removed. */
 void
 save_jumpdb(void)
 {
 	if (xargs.no_dirjump == 1 || config_ok == 0 || !config_dir || !jump_db
-	|| jump_n == 0)
+	|| jump_n == 0 || (jump_dirty == 0 && jump_visits_n == 0))
 		return;
 
+	char journal[PATH_MAX + 1];
+	snprintf(journal, sizeof(journal), "%s/%s", config_dir, JUMP_JOURNAL_FILE);
+
+	if (jump_dirty == 0 && jump_journal_size < JUMP_JOURNAL_MAX
+	&& append_jump_journal(journal) == FUNC_SUCCESS) {
+		clear_jump_visits();
+		return;
+	}
+
+	replay_jump_journal(journal, jump_journal_size);
+
 	char jump_file[PATH_MAX + 1];
 	snprintf(jump_file, sizeof(jump_file), "%s/jump.clifm", config_dir);
 
@@ -281,6 +677,8 @@ save_jumpdb(void)
 	int i, reduce = 0, total_rank = 0;
 	const time_t now = time(NULL);
 
+	index_jump_bonus();
+
 	/* Calculate both total rank sum, and rank for each entry. */
 	i = (int)jump_n;
 	while (--i >= 0) {
@@ -328,6 +726,11 @@ save_jumpdb(void)
 
 	fprintf(fp, "@%d\n", total_rank);
 	fclose(fp);
+
+	unlink(journal);
+	jump_journal_size = 0;
+	clear_jump_visits();
+	jump_dirty = 0;
 }
 
 int
@@ -338,6 +741,7 @@ edit_jumpdb(char *app)
 		return FUNC_FAILURE;
 	}
 
+	jump_dirty = 1;
 	save_jumpdb();
 
 	char jump_file[PATH_MAX + 1];
@@ -366,6 +770,7 @@ edit_jumpdb(char *app)
 	if (jump_db)
 		free_jump_database();
 
+	clear_jump_visits();
 	load_jumpdb();
 	return FUNC_SUCCESS;
 }
@@ -476,6 +881,7 @@ print_jump_table(const int reduce, const time_t now)
 	const int max_order = DIGINUM(jump_n);
 
 	struct jump_t *tmp_jump = xnmalloc(jump_n + 1, sizeof(struct jump_t));
+	index_jump_bonus();
 
 	for (i = 0; i < jump_n; i++) {
 		if (!IS_VALID_JUMP_ENTRY(i)) {
@@ -584,11 +990,13 @@ purge_invalid_entries(void)
 		}
 	}
 
-	if (c == 0)
+	if (c == 0) {
 		puts(_("jump: No invalid entries"));
-	else
+	} else {
+		jump_dirty = 1;
 		printf(_("\njump: Purged %d invalid %s\n"), c,
 			c == 1 ? _("entry") : _("entries"));
+	}
 
 	return FUNC_SUCCESS;
 }
@@ -600,6 +1008,8 @@ purge_low_ranked_entries(const int limit)
 	int c = 0;
 	time_t now = time(NULL);
 
+	index_jump_bonus();
+
 	while (--i >= 0) {
 		if (!IS_VALID_JUMP_ENTRY(i))
 			continue;
@@ -625,11 +1035,13 @@ purge_low_ranked_entries(const int limit)
 		}
 	}
 
-	if (c == 0)
+	if (c == 0) {
 		printf(_("jump: No entry ranked below %d\n"), limit);
-	else
+	} else {
+		jump_dirty = 1;
 		printf(_("\njump: Purged %d %s\n"),
 			c, c == 1 ? _("entry") : _("entries"));
+	}
 
 	return FUNC_SUCCESS;
 }
@@ -824,6 +1236,16 @@ dirjump(char **args, const int mode)
 	struct jump_entry_t *entry =
 		xnmalloc(jump_n + 1, sizeof(struct jump_entry_t));
 
+	/* Every query string must be found in a matching entry: discard
+	 * entries lacking any of the characters in the query strings before
+	 * running the actual (and more expensive) string search. */
+	unsigned long long query_sig = 0;
+	for (i = 1; args[i]; i++)
+		query_sig |= get_jump_sig(args[i]);
+
+	update_jump_sigs();
+	index_jump_bonus();
+
 	for (i = 1; args[i]; i++) {
 		/* 1) Using the first parameter, get a list of matches in the
 		 * database. */
@@ -837,7 +1259,8 @@ dirjump(char **args, const int mode)
 		if (match == 0) {
 			j = (int)jump_n;
 			while (--j >= 0) {
-				if (!IS_VALID_JUMP_ENTRY(j))
+				if ((jump_sigs[j] & query_sig) != query_sig
+				|| !IS_VALID_JUMP_ENTRY(j))
 					continue;
 
 				/* Exclude CWD */
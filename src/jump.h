@@ -28,6 +28,13 @@
 __BEGIN_DECLS
 
 int  add_to_jumpdb(char *dir);
+void free_jump_index(void);
+int  get_jump_index(const char *dir, const size_t len);
+unsigned long long get_jump_sig(const char *str);
+void index_jumpdb(const size_t cap);
+int  jump_entry_lacks_sig(const size_t n, const unsigned long long sig);
+void load_jump_journal(void);
+void mark_jumpdb_dirty(void);
 void save_jumpdb(void);
 int  dirjump(char **args, int mode);
 
@@ -2283,6 +2283,8 @@ rl_sort_next(int count, int key)
 		free_suggestion();
 #endif /* !_NO_SUGGESTIONS */
 
+	const int old_sort = conf.sort;
+
 #ifndef ST_BTIME
 	if (conf.sort + 1 == SBTIME)
 		conf.sort++;
@@ -2300,7 +2302,7 @@ rl_sort_next(int count, int key)
 		sort_switch = 1;
 		if (conf.clear_screen == 0)
 			putchar('\n');
-		reload_dirlist();
+		resort_dirlist(old_sort, conf.sort_reverse);
 		sort_switch = 0;
 	}
 
@@ -2323,6 +2325,8 @@ rl_sort_previous(int count, int key)
 		free_suggestion();
 #endif /* !_NO_SUGGESTIONS */
 
+	const int old_sort = conf.sort;
+
 #ifndef ST_BTIME
 	if (conf.sort - 1 == SBTIME)
 		conf.sort--;
@@ -2340,7 +2344,7 @@ rl_sort_previous(int count, int key)
 		sort_switch = 1;
 		if (conf.clear_screen == 0)
 			putchar('\n');
-		reload_dirlist();
+		resort_dirlist(old_sort, conf.sort_reverse);
 		sort_switch = 0;
 	}
 
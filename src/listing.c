@@ -25,7 +25,12 @@
 #include "helpers.h"
 
 #include <sys/statvfs.h>
-#include <unistd.h> /* open(2), readlinkat(2) */
+#include <grp.h> /* getgrgid_r() */
+#include <poll.h>
+#include <pthread.h>
+#include <pwd.h> /* getpwuid_r() */
+#include <stdarg.h> /* va_list */
+#include <unistd.h> /* open(2), readlinkat(2), sysconf(3) */
 #include <errno.h>
 #include <string.h>
 #if defined(__OpenBSD__)
@@ -53,14 +58,14 @@
 # include <sys/sysmacros.h> /* major() macro */
 #endif /* LINUX_FSINFO */
 
-#if defined(TOURBIN_QSORT)
-# include "qsort.h"
-# define ENTLESS(i, j) (entrycmp(file_info + (i), file_info + (j)) < 0)
-# define ENTSWAP(i, j) (swap_ent((i), (j)))
-# define ENTSORT(file_info, n, entrycmp) QSORT((n), ENTLESS, ENTSWAP)
+#if defined(GENERIC_FS_MONITOR)
+/* Keep track of the number of files in the current directory and of a
+ * checksum of their names: check_fs_changes() compares them against
+ * a fresh scan of the directory. */
+# define FSMON_ADD_NAME(s) (curdir_count++, curdir_sum += hashme((s), 1))
 #else
-# define ENTSORT(file_info, n, entrycmp) qsort((file_info), (n), sizeof(*(file_info)), (entrycmp))
-#endif /* TOURBIN_QSORT */
+# define FSMON_ADD_NAME(s)
+#endif /* GENERIC_FS_MONITOR */
 
 /* Check for temporary files:
  * 1. "*~"   Gral purpose temp files (mostly used by text editors)
@@ -89,9 +94,10 @@
 #include "properties.h" /* print_analysis_stats() */
 #include "long_view.h"  /* print_entry_props() */
 #include "sanitize.h"
+#include "selection.h" /* is_sel_devino() */
 #include "sort.h"
 #include "spawn.h"
-#include "xdu.h"        /* dir_size() */
+#include "xdu.h"        /* cached_dir_size() */
 
 /* In case we want to try some faster printf implementation */
 /*#if defined(_PALAND_PRINTF)
@@ -100,7 +106,8 @@
 #else
 # define xprintf printf
 #endif // _PALAND_PRINTF */
-#define xprintf printf
+#define xprintf frame_printf
+#define FRAME_MOVE_CURSOR_RIGHT(n) frame_printf("\x1b[%dC", (n)) /* CUF */
 
 /* Macros for run_dir_cmd function */
 #define AUTOCMD_DIR_IN  0
@@ -110,6 +117,34 @@
 
 #define ENTRY_N 64
 
+/* Files list arena (see arena_alloc()) */
+#define LIST_ARENA_BLOCK (64 * 1024)
+#define LIST_ARENA_KEEP  16 /* Blocks kept across listings */
+#define LIST_ARENA_ALIGN 8
+
+/* Slots in the table of file counts per directory (see get_dents_hint()) */
+#define DENTS_HINT_SLOTS 64
+
+/* Initial size of the buffer holding a frame (see begin_frame()) */
+#define FRAME_BUF_SIZE (64 * 1024)
+
+/* Parallel stat (see the ParallelStat option) */
+#define PSTAT_MIN_FILES   256 /* Use parallel stat only above this amount */
+#define PSTAT_MAX_WORKERS 8
+#define PSTAT_CHUNK       64  /* Files handed to a worker at a time */
+
+/* Parallel files counter (see count_dirs_files()) */
+#define FCOUNT_MIN_DIRS   16 /* Count files in parallel only above this amount */
+#define FCOUNT_CHUNK      4  /* Directories handed to a worker at a time */
+#define FCOUNT_WAIT_MS    100 /* Then list with placeholders (see FC_PENDING()) */
+
+/* The files counter of a directory still being counted in the background
+ * is stored as -2 minus its slot in the files counter job (-1 means that
+ * the directory could not be read). */
+#define FC_PENDING(n)    ((n) <= -2)
+#define FC_SLOT_TO_N(s)  (-2 - (filesn_t)(s))
+#define FC_N_TO_SLOT(n)  ((size_t)(-2 - (n)))
+
 #ifdef TIGHT_COLUMNS
 # define COLUMNS_GAP 2
 #endif
@@ -154,8 +189,9 @@ struct wtrunc_t {
 	int diff; /* */
 };
 
-/* Hold default values for the fileinfo struct. */
+/* Hold default values for the fileinfo struct (and its cold data). */
 static struct fileinfo default_file_info;
+static struct fileinfo_cold default_file_info_cold;
 
 static int pager_bk = 0;
 static int dir_out = 0;
@@ -163,6 +199,53 @@ static int pager_quit = 0;
 static int pager_help = 0;
 static int long_view_bk = UNSET;
 
+/* Whether the current file list can be updated incrementally (see
+ * update_dirlist()), and the number of files excluded from it. */
+static int dirlist_updatable = 0;
+static filesn_t dirlist_excluded = 0;
+
+/* Filenames and cold data (file_info[n].name and file_info[n].cold) in the
+ * current list of files are allocated from a chain of fixed size blocks, and
+ * released all at once by free_dirlist(). Blocks are reused by the next
+ * listing. */
+struct arena_block_t {
+	struct arena_block_t *next;
+	size_t used;
+	char data[LIST_ARENA_BLOCK];
+};
+
+static struct arena_block_t *list_arena = (struct arena_block_t *)NULL;
+static struct arena_block_t *list_block = (struct arena_block_t *)NULL;
+/* Bytes handed out by the arena since it was last reset, and bytes among
+ * them belonging to entries dropped by update_dirlist(), which cannot be
+ * released one by one. */
+static size_t list_arena_used = 0;
+static size_t list_arena_dead = 0;
+
+/* Number of files listed the last time a directory was visited (indexed by
+ * the hash of its path). Used to size the file_info array in advance. */
+struct dents_hint_t {
+	size_t hash;
+	size_t n;
+};
+
+static struct dents_hint_t dents_hints[DENTS_HINT_SLOTS];
+
+/* While printing the list of files, output is composed in memory, and
+ * written to the terminal at once (see begin_frame()). */
+static struct {
+	char *buf;
+	size_t len;
+	size_t cap;
+	int active;
+	int pad0;
+} frame = {0};
+#ifdef LIST_SPEED_TEST
+static size_t frame_bytes = 0;  /* Bytes emitted by the list printers */
+static size_t frame_writes = 0; /* write(2) calls made (or, without a
+	frame, lines flushed by the line buffered stdout) */
+#endif /* LIST_SPEED_TEST */
+
 /* A version of the loop-unswitching optimization: move loop-invariant
  * conditions out of the loop to reduce the number of conditions in each
  * loop pass.
@@ -255,18 +338,6 @@ init_icons_hashes(void)
 }
 #endif /* !_NO_ICONS */
 
-#if defined(TOURBIN_QSORT)
-static inline void
-swap_ent(const size_t id1, const size_t id2)
-{
-	struct fileinfo _dent, *pdent1 = &file_info[id1], *pdent2 =  &file_info[id2];
-
-	*(&_dent) = *pdent1;
-	*pdent1 = *pdent2;
-	*pdent2 = *(&_dent);
-}
-#endif /* TOURBIN_QSORT */
-
 /* Return 1 if NAME contains at least one UTF8/control character, or 0
  * otherwise. BYTES is updated to the number of bytes needed to read the
  * entire name (excluding the terminating NUL char).
@@ -535,8 +606,8 @@ get_name_icon(const filesn_t n)
 	while (--i >= 0) {
 		if (nhash != name_icons_hashes[i])
 			continue;
-		file_info[n].icon = icon_filenames[i].icon;
-		file_info[n].icon_color = icon_filenames[i].color;
+		file_info[n].cold->icon = icon_filenames[i].icon;
+		file_info[n].cold->icon_color = icon_filenames[i].color;
 		return 1;
 	}
 
@@ -553,9 +624,9 @@ get_dir_icon(const filesn_t n)
 		return;
 
 	/* Default values for directories */
-	file_info[n].icon = DEF_DIR_ICON;
+	file_info[n].cold->icon = DEF_DIR_ICON;
 	/* DIR_ICO_C is set from the color scheme file */
-	file_info[n].icon_color = *dir_ico_c ? dir_ico_c : DEF_DIR_ICON_COLOR;
+	file_info[n].cold->icon_color = *dir_ico_c ? dir_ico_c : DEF_DIR_ICON_COLOR;
 
 	if (!file_info[n].name)
 		return;
@@ -566,8 +637,8 @@ get_dir_icon(const filesn_t n)
 	while (--i >= 0) {
 		if (dhash != dir_icons_hashes[i])
 			continue;
-		file_info[n].icon = icon_dirnames[i].icon;
-		file_info[n].icon_color = icon_dirnames[i].color;
+		file_info[n].cold->icon = icon_dirnames[i].icon;
+		file_info[n].cold->icon_color = icon_dirnames[i].color;
 		break;
 	}
 }
@@ -577,9 +648,9 @@ get_dir_icon(const filesn_t n)
 static void
 get_ext_icon(const char *restrict ext, const filesn_t n)
 {
-	if (!file_info[n].icon) {
-		file_info[n].icon = DEF_FILE_ICON;
-		file_info[n].icon_color = DEF_FILE_ICON_COLOR;
+	if (!file_info[n].cold->icon) {
+		file_info[n].cold->icon = DEF_FILE_ICON;
+		file_info[n].cold->icon_color = DEF_FILE_ICON_COLOR;
 	}
 
 	if (!ext)
@@ -594,8 +665,8 @@ get_ext_icon(const char *restrict ext, const filesn_t n)
 		if (ehash != ext_icons_hashes[i])
 			continue;
 
-		file_info[n].icon = icon_ext[i].icon;
-		file_info[n].icon_color = icon_ext[i].color;
+		file_info[n].cold->icon = icon_ext[i].icon;
+		file_info[n].cold->icon_color = icon_ext[i].color;
 		break;
 	}
 }
@@ -735,13 +806,164 @@ post_listing(DIR *dir, const int reset_pager, const filesn_t excluded_files,
 	return FUNC_SUCCESS;
 }
 
+/* Make room for N more bytes in the current frame. */
+static void
+grow_frame(const size_t n)
+{
+	if (frame.len + n < frame.cap)
+		return;
+
+	size_t cap = frame.cap > 0 ? frame.cap : FRAME_BUF_SIZE;
+	while (frame.len + n >= cap)
+		cap *= 2;
+
+	frame.buf = xnrealloc(frame.buf, cap, sizeof(char));
+	frame.cap = cap;
+}
+
+/* The list printers (here and in long_view.c) write through these
+ * functions: to the current frame if there is one, or to stdout otherwise. */
+void
+frame_write(const char *s, const size_t n)
+{
+#ifdef LIST_SPEED_TEST
+	frame_bytes += n;
+	if (frame.active == 0)
+		frame_writes += memchr(s, '\n', n) != NULL;
+#endif /* LIST_SPEED_TEST */
+
+	if (frame.active == 0) {
+		fwrite(s, 1, n, stdout);
+		return;
+	}
+
+	grow_frame(n);
+	memcpy(frame.buf + frame.len, s, n);
+	frame.len += n;
+}
+
+void
+frame_puts(const char *s)
+{
+	frame_write(s, strlen(s));
+}
+
+void
+frame_putchar(const int c)
+{
+	const char ch = (char)c;
+	frame_write(&ch, 1);
+}
+
+__attribute__((__format__(__printf__, 1, 2)))
+int
+frame_printf(const char *format, ...)
+{
+	va_list arglist;
+
+	if (frame.active == 0) {
+		va_start(arglist, format);
+		const int ret = vprintf(format, arglist);
+		va_end(arglist);
+#ifdef LIST_SPEED_TEST
+		if (ret > 0)
+			frame_bytes += (size_t)ret;
+#endif /* LIST_SPEED_TEST */
+		return ret;
+	}
+
+	grow_frame(1);
+	va_start(arglist, format);
+	int ret = vsnprintf(frame.buf + frame.len, frame.cap - frame.len,
+		format, arglist);
+	va_end(arglist);
+
+	if (ret < 0)
+		return ret;
+
+	if ((size_t)ret >= frame.cap - frame.len) {
+		grow_frame((size_t)ret + 1);
+		va_start(arglist, format);
+		ret = vsnprintf(frame.buf + frame.len, frame.cap - frame.len,
+			format, arglist);
+		va_end(arglist);
+		if (ret < 0)
+			return ret;
+	}
+
+	frame.len += (size_t)ret;
+#ifdef LIST_SPEED_TEST
+	frame_bytes += (size_t)ret;
+#endif /* LIST_SPEED_TEST */
+	return ret;
+}
+
+/* Write the contents of the current frame (if any) to the terminal, and
+ * empty it. Called before anything else is written to the terminal while
+ * a frame is open (say, the pager's prompt, or an error message), so that
+ * output keeps its order. */
+void
+flush_list_frame(void)
+{
+	if (frame.active == 0 || frame.len == 0)
+		return;
+
+	fflush(stdout);
+
+	size_t off = 0;
+	while (off < frame.len) {
+		const ssize_t ret = write(STDOUT_FILENO, frame.buf + off,
+			frame.len - off);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		off += (size_t)ret;
+#ifdef LIST_SPEED_TEST
+		frame_writes++;
+#endif /* LIST_SPEED_TEST */
+	}
+
+	frame.len = 0;
+}
+
+/* Compose the list of files in memory, so that the whole screen reaches
+ * the terminal in a single write(2) (made by end_frame()), instead of one
+ * per line. This reduces flickering on slow terminals, SSH sessions, and
+ * tmux. Neither stdout nor the standard output descriptor are touched. */
+static void
+begin_frame(void)
+{
+#ifdef LIST_SPEED_TEST
+	frame_bytes = frame_writes = 0;
+	/* Print directly to stdout, as before, to compare (see list_dir()) */
+	if (getenv("CLIFM_LIST_NOFRAME"))
+		return;
+#endif /* LIST_SPEED_TEST */
+
+	fflush(stdout);
+	frame.len = 0;
+	frame.active = 1;
+}
+
+/* Write the current frame to the terminal and close it. */
+static void
+end_frame(void)
+{
+	flush_list_frame();
+	frame.active = 0;
+}
+
 /* A basic pager for directories containing large number of files.
  * What's missing? It only goes downwards. To go backwards, use the
  * terminal scrollback function */
 static int
 run_pager(const int columns_n, int *reset_pager, filesn_t *i, size_t *counter)
 {
+	flush_list_frame(); /* Let the label through in order (see begin_frame()) */
 	fputs(PAGER_LABEL, stdout);
+	fflush(stdout);
 
 	switch (xgetchar()) {
 	/* Advance one line at a time */
@@ -765,6 +987,7 @@ run_pager(const int columns_n, int *reset_pager, filesn_t *i, size_t *counter)
 		int l = (int)term_lines - 6;
 		MOVE_CURSOR_DOWN(l);
 		fputs(PAGER_LABEL, stdout);
+		fflush(stdout);
 
 		xgetchar();
 		CLEAR;
@@ -846,13 +1069,62 @@ set_events_checker(void)
 
 #elif defined(GENERIC_FS_MONITOR)
 	struct stat a;
-	if (stat(workspaces[cur_ws].path, &a) != -1)
+	if (stat(workspaces[cur_ws].path, &a) != -1) {
 		curdir_mtime = a.st_mtime;
-	else
-		curdir_mtime = 0;
+		curdir_ctime = a.st_ctime;
+	} else {
+		curdir_mtime = curdir_ctime = 0;
+	}
+
+	/* Updated by the listing functions via FSMON_ADD_NAME(). */
+	curdir_count = curdir_sum = 0;
 #endif /* LINUX_INOTIFY */
 }
 
+/* Number of columns taken by the files counter N */
+#define FC_LEN(n) (FC_CAPPED(n) ? DIGINUM(conf.files_counter_max) + 1 \
+	: DIGINUM(n))
+
+/* Return the files counter N as a string ("N+" if capped). */
+static const char *
+fc_to_str(const filesn_t n)
+{
+	if (!FC_CAPPED(n))
+		return xitoa(n);
+
+	static char buf[MAX_INT_STR + 1];
+	snprintf(buf, sizeof(buf), "%d+", conf.files_counter_max);
+	return buf;
+}
+
+/* Return the number of files in the directory NAME, relative to DIRFD
+ * (self and parent excluded), or -1 on error. If FilesCounterMax is set,
+ * stop counting at conf.files_counter_max + 1 (see FC_CAPPED()). */
+static filesn_t
+count_dir_files(const int dirfd, const char *name)
+{
+	const int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *p = fd == -1 ? (DIR *)NULL : fdopendir(fd);
+	if (!p) {
+		if (fd != -1)
+			close(fd);
+		return (-1);
+	}
+
+	const filesn_t max = conf.files_counter_max > 0
+		? (filesn_t)conf.files_counter_max + 1 : FILESN_MAX - 1;
+	filesn_t c = 0;
+	struct dirent *ent;
+
+	while (c < max && (ent = readdir(p))) {
+		if (!SELFORPARENT(ent->d_name))
+			c++;
+	}
+
+	closedir(p);
+	return c;
+}
+
 static int
 has_file_type_char(const filesn_t i)
 {
@@ -901,7 +1173,7 @@ get_longest_filename(const filesn_t n, const size_t eln_len)
 
 		if (checks.classify == 1) {
 			if (file_info[i].filesn > 0 && conf.files_counter == 1)
-				total_len += DIGINUM(file_info[i].filesn);
+				total_len += (size_t)FC_LEN(file_info[i].filesn);
 
 			if (file_info[i].dir == 1 || (conf.colorize == 0
 			&& has_file_type_char(i)))
@@ -935,7 +1207,7 @@ get_longest_filename(const filesn_t n, const size_t eln_len)
 	if (conf.max_name_len != UNSET && longest_index != -1
 	&& file_info[longest_index].dir == 1
 	&& file_info[longest_index].filesn > 0 && conf.files_counter == 1) {
-		longest.fc_len = DIGINUM(file_info[longest_index].filesn) + 1;
+		longest.fc_len = FC_LEN(file_info[longest_index].filesn) + 1;
 		const size_t t = eln_len + (size_t)conf.max_name_len
 			+ 1 + longest.fc_len;
 		if (t > longest.name_len)
@@ -951,19 +1223,19 @@ set_long_attribs(const filesn_t n, const struct stat *a)
 {
 	if (conf.light_mode == 1) {
 		switch (prop_fields.time) {
-		case PROP_TIME_ACCESS: file_info[n].ltime = a->st_atime; break;
-		case PROP_TIME_CHANGE: file_info[n].ltime = a->st_ctime; break;
-		case PROP_TIME_MOD: file_info[n].ltime = a->st_mtime; break; /* NOLINT */
+		case PROP_TIME_ACCESS: file_info[n].cold->ltime = a->st_atime; break;
+		case PROP_TIME_CHANGE: file_info[n].cold->ltime = a->st_ctime; break;
+		case PROP_TIME_MOD: file_info[n].cold->ltime = a->st_mtime; break; /* NOLINT */
 		case PROP_TIME_BIRTH:
 #ifdef ST_BTIME_LIGHT
-			file_info[n].ltime = a->ST_BTIME.tv_sec; break;
+			file_info[n].cold->ltime = a->ST_BTIME.tv_sec; break;
 #else
-			file_info[n].ltime = a->st_mtime; break;
+			file_info[n].cold->ltime = a->st_mtime; break;
 #endif /* ST_BTIME_LIGHT */
-		default: file_info[n].ltime = a->st_mtime; break; /* NOLINT */
+		default: file_info[n].cold->ltime = a->st_mtime; break; /* NOLINT */
 		}
 
-		file_info[n].blocks = a->st_blocks;
+		file_info[n].cold->blocks = a->st_blocks;
 		file_info[n].linkn = a->st_nlink;
 		file_info[n].mode = a->st_mode;
 		file_info[n].uid = a->st_uid;
@@ -972,8 +1244,8 @@ set_long_attribs(const filesn_t n, const struct stat *a)
 
 	if (conf.full_dir_size == 1 && file_info[n].dir == 1
 	&& file_info[n].type == DT_DIR) {
-		file_info[n].size = dir_size(file_info[n].name, 1,
-			&file_info[n].du_status);
+		file_info[n].size = cached_dir_size(file_info[n].name, a,
+			&file_info[n].cold->du_status);
 	} else {
 		file_info[n].size = FILE_SIZE_PTR(a);
 	}
@@ -1025,7 +1297,9 @@ compute_maxes(void)
 	while (--i >= 0) {
 		int t = 0;
 		if (file_info[i].dir == 1 && conf.files_counter == 1) {
-			t = DIGINUM_BIG(file_info[i].filesn);
+			t = FC_CAPPED(file_info[i].filesn)
+				? DIGINUM(conf.files_counter_max) + 1
+				: DIGINUM_BIG(file_info[i].filesn);
 			if (t > maxes.files_counter)
 				maxes.files_counter = t;
 		}
@@ -1035,7 +1309,7 @@ compute_maxes(void)
 			if (t > maxes.size)
 				maxes.size = t;
 		} else if (prop_fields.size == PROP_SIZE_HUMAN) {
-			t = (int)file_info[i].human_size.len;
+			t = (int)file_info[i].cold->human_size.len;
 			if (t > maxes.size)
 				maxes.size = t;
 		}
@@ -1048,13 +1322,13 @@ compute_maxes(void)
 			if (u > maxes.id_user)
 				maxes.id_user = u;
 		} else if (prop_fields.ids == PROP_ID_NAME) {
-			const int g = file_info[i].gid_i.name
-				? (int)file_info[i].gid_i.namlen : DIGINUM(file_info[i].gid);
+			const int g = file_info[i].cold->gid_i.name
+				? (int)file_info[i].cold->gid_i.namlen : DIGINUM(file_info[i].gid);
 			if (g > maxes.id_group)
 				maxes.id_group = g;
 
-			const int u = file_info[i].uid_i.name
-				? (int)file_info[i].uid_i.namlen : DIGINUM(file_info[i].uid);
+			const int u = file_info[i].cold->uid_i.name
+				? (int)file_info[i].cold->uid_i.namlen : DIGINUM(file_info[i].uid);
 			if (u > maxes.id_user)
 				maxes.id_user = u;
 		}
@@ -1072,7 +1346,7 @@ compute_maxes(void)
 		}
 
 		if (prop_fields.blocks == 1) {
-			t = DIGINUM_BIG(file_info[i].blocks);
+			t = DIGINUM_BIG(file_info[i].cold->blocks);
 			if (t > maxes.blocks)
 				maxes.blocks = t;
 		}
@@ -1087,12 +1361,12 @@ compute_maxes(void)
 	 * we need to make room for the du error char (!). */
 	i = files;
 	while (--i >= 0) {
-		if (file_info[i].du_status == 0)
+		if (file_info[i].cold->du_status == 0)
 			continue;
 
 		const int t = prop_fields.size == PROP_SIZE_BYTES
 			? DIGINUM_BIG(file_info[i].size)
-			: (int)file_info[i].human_size.len;
+			: (int)file_info[i].cold->human_size.len;
 
 		if (t == maxes.size) {
 			maxes.size++;
@@ -1159,10 +1433,10 @@ print_long_mode(size_t *counter, int *reset_pager, const int eln_len,
 		const char *ind_chr_color = get_ind_char(i, &ind_chr);
 
 		if (conf.no_eln == 0) {
-			printf("%s%*jd%s%s%s%s", el_c, eln_len, (intmax_t)i + 1, df_c,
+			xprintf("%s%*jd%s%s%s%s", el_c, eln_len, (intmax_t)i + 1, df_c,
 				ind_chr_color, ind_chr, df_c);
 		} else {
-			printf("%s%s%s", ind_chr_color, ind_chr, df_c);
+			xprintf("%s%s%s", ind_chr_color, ind_chr, df_c);
 		}
 
 		/* Print the remaining part of the entry. */
@@ -1170,7 +1444,7 @@ print_long_mode(size_t *counter, int *reset_pager, const int eln_len,
 	}
 
 	if (pager_quit == 1)
-		printf("... (%zd/%zd)\n", i, files);
+		xprintf("... (%zd/%zd)\n", i, files);
 }
 
 /* Return the minimal number of columns we can use for the current list
@@ -1337,7 +1611,7 @@ print_entry_color(int *ind_char, const filesn_t i, const int pad,
 		if (wtrunc.type > 0) {
 			xprintf("%s%s%s%s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
 				ind_chr_color, ind_chr, df_c,
-				file_info[i].icon_color, file_info[i].icon,
+				file_info[i].cold->icon_color, file_info[i].cold->icon,
 				checks.icons_gap, file_info[i].color, (wchar_t *)n,
 				trunc_diff, tt_c, TRUNC_FILE_CHR,
 				wtrunc.type == TRUNC_EXT ? file_info[i].color : "",
@@ -1345,7 +1619,7 @@ print_entry_color(int *ind_char, const filesn_t i, const int pad,
 				end_color);
 		} else {
 			xprintf("%s%s%s%s%s%s%s%s%s", ind_chr_color, ind_chr, df_c,
-				file_info[i].icon_color, file_info[i].icon,
+				file_info[i].cold->icon_color, file_info[i].cold->icon,
 				checks.icons_gap, file_info[i].color, n, end_color);
 		}
 		break;
@@ -1353,7 +1627,7 @@ print_entry_color(int *ind_char, const filesn_t i, const int pad,
 		if (wtrunc.type > 0) {
 			xprintf("%s%*jd%s%s%s%s%s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
 				el_c, pad, (intmax_t)i + 1, df_c, ind_chr_color, ind_chr,
-				df_c, file_info[i].icon_color, file_info[i].icon,
+				df_c, file_info[i].cold->icon_color, file_info[i].cold->icon,
 				checks.icons_gap, file_info[i].color, (wchar_t *)n,
 				trunc_diff, tt_c, TRUNC_FILE_CHR,
 				wtrunc.type == TRUNC_EXT ? file_info[i].color : "",
@@ -1362,7 +1636,7 @@ print_entry_color(int *ind_char, const filesn_t i, const int pad,
 		} else {
 			xprintf("%s%*jd%s%s%s%s%s%s%s%s%s%s", el_c, pad,
 				(intmax_t)i + 1, df_c, ind_chr_color, ind_chr, df_c,
-				file_info[i].icon_color, file_info[i].icon,
+				file_info[i].cold->icon_color, file_info[i].cold->icon,
 				checks.icons_gap, file_info[i].color, n, end_color);
 		}
 		break;
@@ -1401,10 +1675,10 @@ print_entry_color(int *ind_char, const filesn_t i, const int pad,
 	if (end_color == fc_c) {
 		/* We have a directory and classification is on: append directory
 		 * indicator and file counter. */
-		putchar(DIR_CHR);
+		frame_putchar(DIR_CHR);
 		if (file_info[i].filesn > 0 && conf.files_counter == 1)
-			fputs(xitoa(file_info[i].filesn), stdout);
-		fputs(df_c, stdout);
+			frame_puts(fc_to_str(file_info[i].filesn));
+		frame_puts(df_c);
 	}
 
 	free(wtrunc.wname);
@@ -1425,24 +1699,24 @@ print_entry_nocolor(int *ind_char, const filesn_t i, const int pad,
 #ifndef _NO_ICONS
 	case ICONS_NO_ELN:
 		if (wtrunc.type > 0) {
-			xprintf("%s%s%s%ls%s%c%s", ind_chr, file_info[i].icon,
+			xprintf("%s%s%s%ls%s%c%s", ind_chr, file_info[i].cold->icon,
 				checks.icons_gap, (wchar_t *)n, trunc_diff,
 				TRUNC_FILE_CHR, wtrunc.type == TRUNC_EXT
 				? file_info[i].ext_name : "");
 		} else {
-			xprintf("%s%s%s%s", ind_chr, file_info[i].icon,
+			xprintf("%s%s%s%s", ind_chr, file_info[i].cold->icon,
 				checks.icons_gap, n);
 		}
 		break;
 	case ICONS_ELN:
 		if (wtrunc.type > 0) {
 			xprintf("%s%*jd%s%s%s%s%ls%s%c%s", el_c, pad, (intmax_t)i + 1,
-				df_c, ind_chr, file_info[i].icon, checks.icons_gap,
+				df_c, ind_chr, file_info[i].cold->icon, checks.icons_gap,
 				(wchar_t *)n, trunc_diff, TRUNC_FILE_CHR,
 				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
 		} else {
 			xprintf("%s%*jd%s%s%s%s%s", el_c, pad, (intmax_t)i + 1, df_c,
-				ind_chr, file_info[i].icon,	checks.icons_gap, n);
+				ind_chr, file_info[i].cold->icon,	checks.icons_gap, n);
 		}
 		break;
 #endif /* !_NO_ICONS */
@@ -1473,43 +1747,43 @@ print_entry_nocolor(int *ind_char, const filesn_t i, const int pad,
 		switch (file_info[i].type) {
 		case DT_DIR:
 			*ind_char = 0;
-			putchar(DIR_CHR);
+			frame_putchar(DIR_CHR);
 			if (file_info[i].filesn > 0 && conf.files_counter == 1)
-				fputs(xitoa(file_info[i].filesn), stdout);
+				frame_puts(fc_to_str(file_info[i].filesn));
 			break;
 
 		case DT_LNK:
 			if (file_info[i].color == or_c) {
-				putchar(BRK_LNK_CHR);
+				frame_putchar(BRK_LNK_CHR);
 			} else if (file_info[i].dir == 1) {
 				*ind_char = 0;
-				putchar(DIR_CHR);
+				frame_putchar(DIR_CHR);
 				if (file_info[i].filesn > 0 && conf.files_counter == 1)
-					fputs(xitoa(file_info[i].filesn), stdout);
+					frame_puts(fc_to_str(file_info[i].filesn));
 			} else {
-				putchar(LINK_CHR);
+				frame_putchar(LINK_CHR);
 			}
 			break;
 
 		case DT_REG:
 			if (file_info[i].exec == 1)
-				putchar(EXEC_CHR);
+				frame_putchar(EXEC_CHR);
 			else
 				*ind_char = 0;
 			break;
 
-		case DT_BLK: putchar(BLK_CHR); break;
-		case DT_CHR: putchar(CHR_CHR); break;
+		case DT_BLK: frame_putchar(BLK_CHR); break;
+		case DT_CHR: frame_putchar(CHR_CHR); break;
 #ifdef SOLARIS_DOORS
-		case DT_DOOR: putchar(DOOR_CHR); break;
+		case DT_DOOR: frame_putchar(DOOR_CHR); break;
 //		case DT_PORT: break;
 #endif /* SOLARIS_DOORS */
-		case DT_FIFO: putchar(FIFO_CHR); break;
-		case DT_SOCK: putchar(SOCK_CHR); break;
+		case DT_FIFO: frame_putchar(FIFO_CHR); break;
+		case DT_SOCK: frame_putchar(SOCK_CHR); break;
 #ifdef S_IFWHT
-		case DT_WHT: putchar(WHT_CHR); break;
+		case DT_WHT: frame_putchar(WHT_CHR); break;
 #endif /* S_IFWHT */
-		case DT_UNKNOWN: putchar(UNK_CHR); break;
+		case DT_UNKNOWN: frame_putchar(UNK_CHR); break;
 		default: *ind_char = 0;
 		}
 	}
@@ -1534,30 +1808,30 @@ print_entry_color_light(int *ind_char, const filesn_t i,
 	case ICONS_NO_ELN:
 		if (wtrunc.type > 0) {
 			xprintf("%s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				file_info[i].icon_color, file_info[i].icon,
+				file_info[i].cold->icon_color, file_info[i].cold->icon,
 				checks.icons_gap, file_info[i].color, (wchar_t *)n,
 				trunc_diff, tt_c, TRUNC_FILE_CHR,
 				wtrunc.type == TRUNC_EXT ? file_info[i].color : "",
 				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "",
 				end_color);
 		} else {
-			xprintf("%s%s%s%s%s%s", file_info[i].icon_color,
-				file_info[i].icon, checks.icons_gap,
+			xprintf("%s%s%s%s%s%s", file_info[i].cold->icon_color,
+				file_info[i].cold->icon, checks.icons_gap,
 				file_info[i].color, n, end_color);
 		}
 		break;
 	case ICONS_ELN:
 		if (wtrunc.type > 0) {
 			xprintf("%s%*jd%s %s%s%s%s%ls%s\x1b[0m%s%c\x1b[0m%s%s%s",
-				el_c, pad, (intmax_t)i + 1, df_c, file_info[i].icon_color,
-				file_info[i].icon, checks.icons_gap, file_info[i].color,
+				el_c, pad, (intmax_t)i + 1, df_c, file_info[i].cold->icon_color,
+				file_info[i].cold->icon, checks.icons_gap, file_info[i].color,
 				(wchar_t *)n, trunc_diff, tt_c, TRUNC_FILE_CHR,
 				wtrunc.type == TRUNC_EXT ? file_info[i].color : "",
 				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "",
 				end_color);
 		} else {
 			xprintf("%s%*jd%s %s%s%s%s%s%s", el_c, pad, (intmax_t)i + 1,
-				df_c, file_info[i].icon_color, file_info[i].icon,
+				df_c, file_info[i].cold->icon_color, file_info[i].cold->icon,
 				checks.icons_gap, file_info[i].color, n, end_color);
 		}
 		break;
@@ -1591,13 +1865,13 @@ print_entry_color_light(int *ind_char, const filesn_t i,
 	}
 
 	if (file_info[i].dir == 1 && conf.classify == 1) {
-		putchar(DIR_CHR);
+		frame_putchar(DIR_CHR);
 		if (file_info[i].filesn > 0 && conf.files_counter == 1)
-			fputs(xitoa(file_info[i].filesn), stdout);
+			frame_puts(fc_to_str(file_info[i].filesn));
 	}
 
 	if (end_color == fc_c)
-		fputs(df_c, stdout);
+		frame_puts(df_c);
 
 	free(wtrunc.wname);
 }
@@ -1615,22 +1889,22 @@ print_entry_nocolor_light(int *ind_char, const filesn_t i,
 #ifndef _NO_ICONS
 	case ICONS_NO_ELN:
 		if (wtrunc.type > 0) {
-			xprintf("%s%s%ls%s%c%s", file_info[i].icon,
+			xprintf("%s%s%ls%s%c%s", file_info[i].cold->icon,
 				checks.icons_gap, (wchar_t *)n, trunc_diff, TRUNC_FILE_CHR,
 				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
 		} else {
-			xprintf("%s%s%s", file_info[i].icon, checks.icons_gap, n);
+			xprintf("%s%s%s", file_info[i].cold->icon, checks.icons_gap, n);
 		}
 		break;
 	case ICONS_ELN:
 		if (wtrunc.type > 0) {
 			xprintf("%s%*jd%s %s%s%ls%s%c%s", el_c, pad, (intmax_t)i + 1,
-				df_c, file_info[i].icon, checks.icons_gap, (wchar_t *)n,
+				df_c, file_info[i].cold->icon, checks.icons_gap, (wchar_t *)n,
 				trunc_diff, TRUNC_FILE_CHR, wtrunc.type == TRUNC_EXT
 				? file_info[i].ext_name : "");
 		} else {
 			xprintf("%s%*jd%s %s%s%s", el_c, pad, (intmax_t)i + 1, df_c,
-				file_info[i].icon, checks.icons_gap, n);
+				file_info[i].cold->icon, checks.icons_gap, n);
 		}
 		break;
 #endif /* !_NO_ICONS */
@@ -1639,7 +1913,7 @@ print_entry_nocolor_light(int *ind_char, const filesn_t i,
 			xprintf("%ls%s%c%s", (wchar_t *)n, trunc_diff, TRUNC_FILE_CHR,
 				wtrunc.type == TRUNC_EXT ? file_info[i].ext_name : "");
 		} else {
-			fputs(file_info[i].name, stdout);
+			frame_puts(file_info[i].name);
 		}
 		break;
 	case NO_ICONS_ELN:
@@ -1658,24 +1932,24 @@ print_entry_nocolor_light(int *ind_char, const filesn_t i,
 		switch (file_info[i].type) {
 		case DT_DIR:
 			*ind_char = 0;
-			putchar(DIR_CHR);
+			frame_putchar(DIR_CHR);
 			if (file_info[i].filesn > 0 && conf.files_counter == 1)
-				fputs(xitoa(file_info[i].filesn), stdout);
+				frame_puts(fc_to_str(file_info[i].filesn));
 			break;
 
-		case DT_BLK: putchar(BLK_CHR); break;
-		case DT_CHR: putchar(CHR_CHR); break;
+		case DT_BLK: frame_putchar(BLK_CHR); break;
+		case DT_CHR: frame_putchar(CHR_CHR); break;
 #ifdef SOLARIS_DOORS
-		case DT_DOOR: putchar(DOOR_CHR); break;
+		case DT_DOOR: frame_putchar(DOOR_CHR); break;
 //		case DT_DOOR: break;
 #endif /* SOLARIS_DOORS */
-		case DT_FIFO: putchar(FIFO_CHR); break;
-		case DT_LNK: putchar(LINK_CHR); break;
-		case DT_SOCK: putchar(SOCK_CHR); break;
+		case DT_FIFO: frame_putchar(FIFO_CHR); break;
+		case DT_LNK: frame_putchar(LINK_CHR); break;
+		case DT_SOCK: frame_putchar(SOCK_CHR); break;
 #ifdef S_IFWHT
-		case DT_WHT: putchar(WHT_CHR); break;
+		case DT_WHT: frame_putchar(WHT_CHR); break;
 #endif /* S_IFWHT */
-		case DT_UNKNOWN: putchar(UNKNOWN_CHR); break;
+		case DT_UNKNOWN: frame_putchar(UNKNOWN_CHR); break;
 		default: *ind_char = 0; break;
 		}
 	}
@@ -1683,6 +1957,18 @@ print_entry_nocolor_light(int *ind_char, const filesn_t i,
 	free(wtrunc.wname);
 }
 
+/* Print N blank characters. */
+static void
+print_blanks(int n)
+{
+	static const char blanks[] = "                                ";
+	while (n > 0) {
+		const int l = n < (int)sizeof(blanks) - 1 ? n : (int)sizeof(blanks) - 1;
+		frame_write(blanks, (size_t)l);
+		n -= l;
+	}
+}
+
 #ifdef TIGHT_COLUMNS
 static int
 calc_item_length(const int eln_len, const int icon_len, const filesn_t i)
@@ -1710,7 +1996,7 @@ calc_item_length(const int eln_len, const int icon_len, const filesn_t i)
 		item_len++;
 		if (file_info[i].filesn > 0 && conf.files_counter == 1
 		&& file_info[i].user_access == 1)
-			item_len += DIGINUM((int)file_info[i].filesn);
+			item_len += FC_LEN(file_info[i].filesn);
 	} else if (conf.colorize == 0 && has_file_type_char(i) == 1) {
 		item_len++;
 	}
@@ -1843,13 +2129,10 @@ pad_filename_new(const filesn_t i, const int termcap_move_right,
 	const int diff = ((int)longest_in_col + COLUMNS_GAP)
 		- ((int)file_info[i].total_entry_len + (conf.no_eln == 1));
 
-	if (termcap_move_right == 1) {
-		MOVE_CURSOR_RIGHT(diff);
-	} else {
-		int j = diff;
-		while (--j >= 0)
-			putchar(' ');
-	}
+	if (termcap_move_right == 1)
+		FRAME_MOVE_CURSOR_RIGHT(diff);
+	else
+		print_blanks(diff);
 }
 #endif /* TIGHT_COLUMNS */
 
@@ -1866,17 +2149,14 @@ pad_filename(const int ind_char, const filesn_t i, const int eln_len,
 		cur_len++;
 		if (file_info[i].filesn > 0 && conf.files_counter == 1
 		&& file_info[i].user_access == 1)
-			cur_len += DIGINUM((int)file_info[i].filesn);
+			cur_len += FC_LEN(file_info[i].filesn);
 	}
 
 	const int diff = (int)longest.name_len - cur_len;
-	if (termcap_move_right == 1) {
-		MOVE_CURSOR_RIGHT(diff + 1);
-	} else {
-		int j = diff + 1;
-		while (--j >= 0)
-			putchar(' ');
-	}
+	if (termcap_move_right == 1)
+		FRAME_MOVE_CURSOR_RIGHT(diff + 1);
+	else
+		print_blanks(diff + 1);
 }
 
 /* List files horizontally:
@@ -1970,7 +2250,7 @@ list_files_horizontal(size_t *counter, int *reset_pager,
 			cur_col++; */
 			pad_filename(ind_char, i, eln_len, termcap_move_right);
 		} else {
-			putchar('\n');
+			frame_putchar('\n');
 //			cur_col = 0;
 		}
 	}
@@ -1978,9 +2258,9 @@ list_files_horizontal(size_t *counter, int *reset_pager,
 END:
 //	free(longest_per_col);
 	if (last_column == 0)
-		putchar('\n');
+		frame_putchar('\n');
 	if (pager_quit == 1)
-		printf("... (%zd/%zd)\n", i, files);
+		xprintf("... (%zd/%zd)\n", i, files);
 }
 
 /* List files vertically, like ls(1) would
@@ -2063,7 +2343,7 @@ list_files_vertical(size_t *counter, int *reset_pager,
 				 * 1 file  3 file3  5 file5
 				 * 2 file2 4 file4  HERE
 				 * ... */
-				putchar('\n');
+				frame_putchar('\n');
 #ifdef TIGHT_COLUMNS
 				cur_col = 0;
 #endif
@@ -2138,7 +2418,7 @@ list_files_vertical(size_t *counter, int *reset_pager,
 			 * 1 file  3 file3  5 file5HERE
 			 * 2 file2 4 file4  6 file6HERE
 			 * ... */
-			putchar('\n');
+			frame_putchar('\n');
 #ifdef TIGHT_COLUMNS
 			cur_col = 0;
 #endif
@@ -2150,9 +2430,9 @@ END:
 	free(longest_per_col);
 #endif
 	if (last_column == 0)
-		putchar('\n');
+		frame_putchar('\n');
 	if (pager_quit == 1)
-		printf("... (%zd/%zd)\n", i, files);
+		xprintf("... (%zd/%zd)\n", i, files);
 }
 
 /* Execute commands in either AUTOCMD_DIR_IN_FILE or AUTOCMD_DIR_OUT_FILE files.
@@ -2324,39 +2604,142 @@ init_default_file_info(void)
 
 	default_file_info = (struct fileinfo){0};
 	default_file_info.color = df_c;
+	default_file_info_cold = (struct fileinfo_cold){0};
 #ifdef _NO_ICONS
-	default_file_info.icon_color = df_c;
+	default_file_info_cold.icon_color = df_c;
 #else
-	default_file_info.icon = DEF_FILE_ICON;
-	default_file_info.icon_color = DEF_FILE_ICON_COLOR;
+	default_file_info_cold.icon = DEF_FILE_ICON;
+	default_file_info_cold.icon_color = DEF_FILE_ICON_COLOR;
 #endif /* _NO_ICONS */
 	default_file_info.linkn = 1;
 	default_file_info.user_access = 1;
 	default_file_info.size = 1;
 }
 
-static inline void
-get_id_names(const filesn_t n)
+#define ID_CACHE_MIN_SIZE 64
+
+/* Return the name of the group (if GROUP is 1) or user whose ID is ID, as
+ * returned by getgrgid_r(3) or getpwuid_r(3), or NULL if not found. */
+static char *
+resolve_id_name(const gid_t id, const int group)
 {
-	size_t i;
+#if defined(__ANDROID__)
+	/* No user names on Android. */
+	if (group == 0)
+		return (char *)NULL;
+#endif /* __ANDROID__ */
+
+	long bufsize = sysconf(group == 1 ? _SC_GETGR_R_SIZE_MAX
+		: _SC_GETPW_R_SIZE_MAX);
+	if (bufsize <= 0)
+		bufsize = 1024;
+
+	char *buf = xnmalloc((size_t)bufsize, sizeof(char));
+	const char *name = (const char *)NULL;
+	struct group g, *gres = (struct group *)NULL;
+	struct passwd p, *pres = (struct passwd *)NULL;
+	int ret;
 
-	if (sys_users) {
-		for (i = 0; sys_users[i].name; i++) {
-			if (file_info[n].uid != sys_users[i].id)
-				continue;
-			file_info[n].uid_i.name = sys_users[i].name;
-			file_info[n].uid_i.namlen = sys_users[i].namlen;
+	while (1) {
+		if (group == 1) {
+			ret = getgrgid_r(id, &g, buf, (size_t)bufsize, &gres);
+			if (ret == 0 && gres)
+				name = gres->gr_name;
+		} else {
+			ret = getpwuid_r((uid_t)id, &p, buf, (size_t)bufsize, &pres);
+#ifndef __HAIKU__
+			/* Some systems (BSD) may have multiple UIDs 0 (e.g.: "root" and
+			 * "toor"). This is known as a root alias. Let's always use "root"
+			 * for UID 0 (this is what stat(1), ls(1), and most file managers
+			 * do). */
+			if (ret == 0 && pres)
+				name = id == 0 ? "root" : pres->pw_name;
+#else
+			if (ret == 0 && pres)
+				name = pres->pw_name;
+#endif /* !__HAIKU__ */
 		}
+
+		if (ret != ERANGE || bufsize > 1024 * 1024)
+			break;
+
+		bufsize *= 2;
+		buf = xnrealloc(buf, (size_t)bufsize, sizeof(char));
 	}
 
-	if (sys_groups) {
-		for (i = 0; sys_groups[i].name; i++) {
-			if (file_info[n].gid != sys_groups[i].id)
-				continue;
-			file_info[n].gid_i.name = sys_groups[i].name;
-			file_info[n].gid_i.namlen = sys_groups[i].namlen;
+	char *ret_name = name ? savestring(name, strlen(name)) : (char *)NULL;
+	free(buf);
+
+	return ret_name;
+}
+
+/* Return the slot for ID in the cache C (either free or in use). */
+static struct groups_t *
+find_id_slot(const struct id_cache_t *c, const gid_t id)
+{
+	size_t i = ((size_t)id * 2654435761U) & (c->size - 1);
+
+	while (c->ents[i].used == 1 && c->ents[i].id != id)
+		i = (i + 1) & (c->size - 1);
+
+	return &c->ents[i];
+}
+
+/* Return the cache entry for the group (if GROUP is 1) or user whose ID is
+ * ID, resolving its name the first time it is requested. Only IDs actually
+ * found in listed directories are resolved, so that we do not depend on the
+ * size of the users/groups database (which might be huge, e.g. LDAP). */
+static const struct groups_t *
+get_id_entry(struct id_cache_t *c, const gid_t id, const int group)
+{
+	if (!c->ents) {
+		c->size = ID_CACHE_MIN_SIZE;
+		c->ents = xcalloc(c->size, sizeof(struct groups_t));
+	}
+
+	struct groups_t *e = find_id_slot(c, id);
+	if (e->used == 1)
+		return e;
+
+	/* Keep the load factor below 0.5. */
+	if ((c->n + 1) * 2 > c->size) {
+		struct groups_t *old = c->ents;
+		const size_t old_size = c->size;
+
+		c->size *= 2;
+		c->ents = xcalloc(c->size, sizeof(struct groups_t));
+		for (size_t i = 0; i < old_size; i++) {
+			if (old[i].used == 1)
+				*find_id_slot(c, old[i].id) = old[i];
 		}
+
+		free(old);
+		e = find_id_slot(c, id);
 	}
+
+	e->name = resolve_id_name(id, group);
+	e->namlen = e->name ? strlen(e->name) : 0;
+	e->id = id;
+	e->used = 1;
+	c->n++;
+
+	return e;
+}
+
+static inline void
+get_id_names(const filesn_t n)
+{
+	const struct groups_t *u = get_id_entry(&sys_users,
+		(gid_t)file_info[n].uid, 0);
+	file_info[n].cold->uid_i.name = u->name;
+	file_info[n].cold->uid_i.namlen = u->namlen;
+
+	if (prop_fields.no_group == 1)
+		return;
+
+	const struct groups_t *g = get_id_entry(&sys_groups, file_info[n].gid, 1);
+	file_info[n].cold->gid_i.name = g->name;
+	file_info[n].cold->gid_i.namlen = g->namlen;
 }
 
 /* Construct human readable sizes for all files in the current directory
@@ -2378,10 +2761,10 @@ construct_human_sizes(void)
 	filesn_t i = files;
 	while (--i >= 0) {
 		if (file_info[i].size < ibase) { /* This includes negative values */
-			const int ret = snprintf(file_info[i].human_size.str,
+			const int ret = snprintf(file_info[i].cold->human_size.str,
 				MAX_HUMAN_SIZE, "%jd", (intmax_t)file_info[i].size);
-			file_info[i].human_size.len = ret > 0 ? (size_t)ret : 0;
-			file_info[i].human_size.unit = 'B';
+			file_info[i].cold->human_size.len = ret > 0 ? (size_t)ret : 0;
+			file_info[i].cold->human_size.unit = 'B';
 			continue;
 		}
 
@@ -2397,14 +2780,14 @@ construct_human_sizes(void)
 		/* If (s == 0 || s - (float)x == 0), then S has no reminder (zero).
 		 * We don't want to print the reminder when it is zero. */
 		const int ret =
-			snprintf(file_info[i].human_size.str, MAX_HUMAN_SIZE, "%.*f",
+			snprintf(file_info[i].cold->human_size.str, MAX_HUMAN_SIZE, "%.*f",
 				(s == 0.00f || s - (float)x == 0.00f) ? 0 : 2,
 				(double)s);
 
-		file_info[i].human_size.len = ret > 0 ? (size_t)ret : 0;
+		file_info[i].cold->human_size.len = ret > 0 ? (size_t)ret : 0;
 		/* Let's follow du(1) in using 'k' (lowercase) instead of 'K'
 		 * (uppercase) when using powers of 1000 (--si). */
-		file_info[i].human_size.unit = (xargs.si == 1 && u[n] == 'K')
+		file_info[i].cold->human_size.unit = (xargs.si == 1 && u[n] == 'K')
 			? 'k' : u[n];
 	}
 }
@@ -2459,6 +2842,114 @@ check_autocmd_files(void)
 		dir_out = 1;
 }
 
+/* Return a pointer to SIZE bytes of memory in the files list arena. If
+ * ALIGN is 1, the pointer is aligned to LIST_ARENA_ALIGN bytes. SIZE must
+ * not exceed LIST_ARENA_BLOCK bytes. */
+static void *
+arena_alloc(const size_t size, const int align)
+{
+	size_t start = list_block ? list_block->used : 0;
+	if (align == 1)
+		start = (start + LIST_ARENA_ALIGN - 1) & ~(size_t)(LIST_ARENA_ALIGN - 1);
+
+	if (!list_block || start + size > LIST_ARENA_BLOCK) {
+		if (list_block && list_block->next) {
+			list_block = list_block->next;
+		} else {
+			struct arena_block_t *b = xnmalloc(1, sizeof(struct arena_block_t));
+			b->next = (struct arena_block_t *)NULL;
+			if (list_block)
+				list_block->next = b;
+			else
+				list_arena = b;
+			list_block = b;
+		}
+		start = 0;
+	}
+
+	list_block->used = start + size;
+	list_arena_used += size;
+	return list_block->data + start;
+}
+
+/* Copy the first LEN bytes of STR into the files list arena, and return a
+ * pointer to the copy (nul terminated). LEN must not exceed NAME_MAX. */
+static char *
+arena_savestring(const char *str, const size_t len)
+{
+	char *p = arena_alloc(len + 1, 0);
+	memcpy(p, str, len);
+	p[len] = '\0';
+	return p;
+}
+
+/* Initialize the entry N in the list of files with default values. */
+static inline void
+init_file_entry(const filesn_t n)
+{
+	file_info[n] = default_file_info;
+	file_info[n].cold = arena_alloc(sizeof(struct fileinfo_cold), 1);
+	*file_info[n].cold = default_file_info_cold;
+}
+
+static void
+free_arena_blocks(struct arena_block_t *b)
+{
+	while (b) {
+		struct arena_block_t *next = b->next;
+		free(b);
+		b = next;
+	}
+}
+
+/* Release everything in the files list arena at once. Up to LIST_ARENA_KEEP
+ * blocks are kept for the next listing. */
+static void
+reset_list_arena(void)
+{
+	struct arena_block_t *b = list_arena;
+	size_t n = 1;
+	while (b && n < LIST_ARENA_KEEP) {
+		b = b->next;
+		n++;
+	}
+
+	if (b) {
+		free_arena_blocks(b->next);
+		b->next = (struct arena_block_t *)NULL;
+	}
+
+	list_block = list_arena;
+	if (list_block)
+		list_block->used = 0;
+	list_arena_used = list_arena_dead = 0;
+}
+
+void
+free_list_arena(void)
+{
+	free_arena_blocks(list_arena);
+	list_arena = list_block = (struct arena_block_t *)NULL;
+	list_arena_used = list_arena_dead = 0;
+}
+
+/* Return the number of files listed the last time the directory whose path
+ * hash is HASH was visited, or ENTRY_N if unknown. */
+static size_t
+get_dents_hint(const size_t hash)
+{
+	const struct dents_hint_t *h = &dents_hints[hash & (DENTS_HINT_SLOTS - 1)];
+	return (h->hash == hash && h->n > ENTRY_N) ? h->n : ENTRY_N;
+}
+
+static void
+set_dents_hint(const size_t hash, const size_t n)
+{
+	struct dents_hint_t *h = &dents_hints[hash & (DENTS_HINT_SLOTS - 1)];
+	h->hash = hash;
+	h->n = n;
+}
+
 /* List files in the current working directory (global variable 'path').
  * Unlike list_dir(), however, this function uses no color and runs
  * neither stat() nor count_dir(), which makes it quite faster. Return
@@ -2512,10 +3003,11 @@ list_dir_light(const int autocmd_ret)
 
 	errno = 0;
 	longest.name_len = 0;
-	filesn_t n = 0, count = 0;
-	size_t total_dents = 0;
+	filesn_t n = 0;
+	const size_t path_hash = hashme(workspaces[cur_ws].path, 1);
+	size_t total_dents = get_dents_hint(path_hash);
 
-	file_info = xnmalloc(ENTRY_N + 2, sizeof(struct fileinfo));
+	file_info = xnmalloc(total_dents + 2, sizeof(struct fileinfo));
 
 	while ((ent = readdir(dir))) {
 		const char *ename = ent->d_name;
@@ -2523,6 +3015,8 @@ list_dir_light(const int autocmd_ret)
 		if (SELFORPARENT(ename))
 			continue;
 
+		FSMON_ADD_NAME(ename);
+
 		/* Skip files according to a regex filter */
 		if (checks.filter_name == 1) {
 			if (regexec(&regex_exp, ename, 0, NULL, 0) == FUNC_SUCCESS) {
@@ -2576,18 +3070,16 @@ list_dir_light(const int autocmd_ret)
 			continue;
 		}
 
-		if (count > ENTRY_N) {
-			count = 0;
-			total_dents = (size_t)n + ENTRY_N;
+		if ((size_t)n >= total_dents) {
+			total_dents *= 2;
 			file_info = xnrealloc(file_info, total_dents + 2,
 				sizeof(struct fileinfo));
 		}
 
-		file_info[n] = default_file_info;
+		init_file_entry(n);
 
 		file_info[n].utf8 = is_utf8_name(ename, &file_info[n].bytes);
-		file_info[n].name = xnmalloc(file_info[n].bytes + 1, sizeof(char));
-		memcpy(file_info[n].name, ename, file_info[n].bytes + 1);
+		file_info[n].name = arena_savestring(ename, file_info[n].bytes);
 		file_info[n].len = (file_info[n].utf8 == 0)
 			? file_info[n].bytes : wc_xstrlen(ename);
 
@@ -2619,17 +3111,17 @@ list_dir_light(const int autocmd_ret)
 		case DT_DIR:
 #ifndef _NO_ICONS
 			if (conf.icons == 1) {
-				file_info[n].icon = DEF_DIR_ICON;
-				file_info[n].icon_color = DEF_DIR_ICON_COLOR;
+				file_info[n].cold->icon = DEF_DIR_ICON;
+				file_info[n].cold->icon_color = DEF_DIR_ICON_COLOR;
 				/* If set from the color scheme file */
 				if (*dir_ico_c)
-					file_info[n].icon_color = dir_ico_c;
+					file_info[n].cold->icon_color = dir_ico_c;
 			}
 #endif /* !_NO_ICONS */
 
 			stats.dir++;
 			if (conf.files_counter == 1)
-				file_info[n].filesn = count_dir(ename, NO_CPOP) - 2;
+				file_info[n].filesn = count_dir_files(XAT_FDCWD, ename);
 			else
 				file_info[n].filesn = 1;
 
@@ -2640,8 +3132,8 @@ list_dir_light(const int autocmd_ret)
 			} else {
 				file_info[n].color = *nd_c ? nd_c : di_c;
 #ifndef _NO_ICONS
-				file_info[n].icon = ICON_LOCK;
-				file_info[n].icon_color = YELLOW;
+				file_info[n].cold->icon = ICON_LOCK;
+				file_info[n].cold->icon_color = YELLOW;
 #endif /* !_NO_ICONS */
 			}
 
@@ -2649,7 +3141,7 @@ list_dir_light(const int autocmd_ret)
 
 		case DT_LNK:
 #ifndef _NO_ICONS
-			file_info[n].icon = ICON_LINK;
+			file_info[n].cold->icon = ICON_LINK;
 #endif /* !_NO_ICONS */
 			file_info[n].color = ln_c;
 			stats.link++;
@@ -2679,7 +3171,7 @@ list_dir_light(const int autocmd_ret)
 
 #ifndef _NO_ICONS
 		if (checks.icons_use_file_color == 1)
-			file_info[n].icon_color = file_info[n].color;
+			file_info[n].cold->icon_color = file_info[n].color;
 #endif /* !_NO_ICONS */
 
 		if (conf.long_view == 1) {
@@ -2707,12 +3199,11 @@ list_dir_light(const int autocmd_ret)
 				"(showing only %jd files)\n"), PROGRAM_NAME, (intmax_t)n);
 			break;
 		}
-
-		count++;
 	}
 
 	file_info[n].name = (char *)NULL;
 	files = n;
+	set_dents_hint(path_hash, (size_t)n);
 
 	if (checks.scanning == 1)
 		erase_scanning_message();
@@ -2728,7 +3219,7 @@ list_dir_light(const int autocmd_ret)
 		? DIGINUM(conf.max_files) : DIGINUM(files));
 
 	if (conf.sort != SNONE)
-		ENTSORT(file_info, (size_t)n, entrycmp);
+		sort_entries(file_info, n);
 
 	size_t counter = 0;
 	size_t columns_n = 1;
@@ -2747,21 +3238,24 @@ list_dir_light(const int autocmd_ret)
 				 * #    LONG VIEW MODE    #
 				 * ######################## */
 
+	begin_frame();
+
 	if (conf.long_view == 1) {
 		if (prop_fields.size == PROP_SIZE_HUMAN)
 			construct_human_sizes();
 		print_long_mode(&counter, &reset_pager, eln_len, have_xattr);
-		goto END;
-	}
-
+	} else {
 				/* ########################
 				 * #   NORMAL VIEW MODE   #
 				 * ######################## */
 
-	if (conf.listing_mode == VERTLIST) /* ls(1)-like listing */
-		list_files_vertical(&counter, &reset_pager, eln_len, columns_n);
-	else
-		list_files_horizontal(&counter, &reset_pager, eln_len, columns_n);
+		if (conf.listing_mode == VERTLIST) /* ls(1)-like listing */
+			list_files_vertical(&counter, &reset_pager, eln_len, columns_n);
+		else
+			list_files_horizontal(&counter, &reset_pager, eln_len, columns_n);
+	}
+
+	end_frame();
 
 END:
 	if (hidden_list)
@@ -2800,24 +3294,10 @@ check_seltag(const dev_t dev, const ino_t ino, const nlink_t links,
 	if (sel_n == 0 || !sel_devino)
 		return 0;
 
-	filesn_t j = (filesn_t)sel_n;
-	while (--j >= 0) {
-		if (sel_devino[j].dev != dev || sel_devino[j].ino != ino)
-			continue;
-		/* Only check hardlinks in case of regular files */
-		if (file_info[index].type != DT_DIR && links > 1) {
-			const char *p = strrchr(sel_elements[j].name, '/');
-			if (!p || !*(++p))
-				continue;
-			if (*p == *file_info[index].name
-			&& strcmp(p, file_info[index].name) == 0)
-				return 1;
-		} else {
-			return 1;
-		}
-	}
-
-	return 0;
+	/* Only check hardlinks in case of regular files */
+	return is_sel_devino(dev, ino,
+		(file_info[index].type != DT_DIR && links > 1)
+		? file_info[index].name : (char *)NULL);
 }
 
 /* Get the color of a link target NAME, whose file attributes are ATTR,
@@ -2853,12 +3333,8 @@ set_link_target_color(const char *name, const struct stat *attr,
 			return;
 		}
 
-		if (clen > 0) { /* We have an extension color */
-			file_info[i].ext_color = savestring(color, clen);
-			file_info[i].color = file_info[i].ext_color;
-		} else {
-			file_info[i].color = color;
-		}
+		/* Extension colors are interned: no need to copy them. */
+		file_info[i].color = color;
 		}
 		break;
 
@@ -2889,8 +3365,8 @@ load_file_gral_info(const struct stat *a, const filesn_t n, int *have_xattr)
 	if (check_file_access(a->st_mode, a->st_uid, a->st_gid) == 0) {
 		file_info[n].user_access = 0;
 #ifndef _NO_ICONS
-		file_info[n].icon = DEF_NOPERM_ICON;
-		file_info[n].icon_color = DEF_NOPERM_ICON_COLOR;
+		file_info[n].cold->icon = DEF_NOPERM_ICON;
+		file_info[n].cold->icon_color = DEF_NOPERM_ICON_COLOR;
 #endif /* !_NO_ICONS */
 	}
 
@@ -2920,7 +3396,7 @@ load_file_gral_info(const struct stat *a, const filesn_t n, int *have_xattr)
 
 	check_extra_file_types(&file_info[n].type, a);
 
-	file_info[n].blocks = a->st_blocks;
+	file_info[n].cold->blocks = a->st_blocks;
 	file_info[n].inode = a->st_ino;
 	file_info[n].linkn = a->st_nlink;
 	file_info[n].mode = a->st_mode;
@@ -2936,7 +3412,7 @@ load_file_gral_info(const struct stat *a, const filesn_t n, int *have_xattr)
 	if (file_info[n].type != DT_LNK
 	&& (checks.xattr == 1 || conf.check_cap == 1)
 	&& listxattr(file_info[n].name, NULL, 0) > 0) {
-		file_info[n].xattr = 1;
+		file_info[n].cold->xattr = 1;
 		*have_xattr = 1;
 	}
 #endif /* LINUX_FILE_XATTRS */
@@ -2961,19 +3437,19 @@ load_file_gral_info(const struct stat *a, const filesn_t n, int *have_xattr)
 	if (conf.long_view == 1) {
 		if (checks.time_follows_sort == 1) {
 			switch (conf.sort) {
-			case SATIME: file_info[n].ltime = a->st_atime; break;
-			case SBTIME: file_info[n].ltime = btime; break;
-			case SCTIME: file_info[n].ltime = a->st_ctime; break;
+			case SATIME: file_info[n].cold->ltime = a->st_atime; break;
+			case SBTIME: file_info[n].cold->ltime = btime; break;
+			case SCTIME: file_info[n].cold->ltime = a->st_ctime; break;
 			case SMTIME: /* fallthrough */
-			default: file_info[n].ltime = a->st_mtime; break;
+			default: file_info[n].cold->ltime = a->st_mtime; break;
 			}
 		} else {
 			switch (prop_fields.time) {
-			case PROP_TIME_ACCESS: file_info[n].ltime = a->st_atime; break;
-			case PROP_TIME_CHANGE: file_info[n].ltime = a->st_ctime; break;
-			case PROP_TIME_MOD: file_info[n].ltime = a->st_mtime; break;
-			case PROP_TIME_BIRTH: file_info[n].ltime = btime; break;
-			default: file_info[n].ltime = a->st_mtime; break;
+			case PROP_TIME_ACCESS: file_info[n].cold->ltime = a->st_atime; break;
+			case PROP_TIME_CHANGE: file_info[n].cold->ltime = a->st_ctime; break;
+			case PROP_TIME_MOD: file_info[n].cold->ltime = a->st_mtime; break;
+			case PROP_TIME_BIRTH: file_info[n].cold->ltime = btime; break;
+			default: file_info[n].cold->ltime = a->st_mtime; break;
 			}
 		}
 	}
@@ -2987,25 +3463,13 @@ load_file_gral_info(const struct stat *a, const filesn_t n, int *have_xattr)
 	}
 }
 
+/* Set the color of the directory whose index in the file list is N
+ * (and whose files counter is already known), and update the stats
+ * struct accordingly. */
 static inline void
-load_dir_info(const mode_t mode, const filesn_t n)
+set_dir_color(const mode_t mode, const filesn_t n)
 {
-	file_info[n].dir = 1;
-
-#ifndef _NO_ICONS
-	if (conf.icons == 1)
-		get_dir_icon(n);
-#endif /* !_NO_ICONS */
-
-	if (checks.files_counter == 1) {
-		/* Avoid count_dir() if we have no access to the current directory. */
-		file_info[n].filesn = file_info[n].user_access == 0 ? -1
-			: count_dir(file_info[n].name, NO_CPOP) - 2;
-	} else {
-		file_info[n].filesn = 1;
-	}
-
-	if (*nd_c && (file_info[n].user_access == 0 || file_info[n].filesn < 0)) {
+	if (*nd_c && (file_info[n].user_access == 0 || file_info[n].filesn == -1)) {
 		file_info[n].color = nd_c;
 	} else {
 		file_info[n].color = mode != 0 ? ((mode & S_ISVTX)
@@ -3029,29 +3493,356 @@ load_dir_info(const mode_t mode, const filesn_t n)
 	}
 }
 
-static inline void
-load_link_info(const int fd, const filesn_t n)
-{
-	file_info[n].symlink = 1;
+/* Directories whose files counter is computed after reading the whole
+ * current directory (see count_dirs_files()). */
+struct fcount_t {
+	filesn_t *ents; /* Indices in the file list. NULL: do not defer. */
+	size_t n;
+	size_t cap;
+};
 
-#ifndef _NO_ICONS
-	file_info[n].icon = DEF_LINK_ICON;
-	file_info[n].icon_color = conf.color_lnk_as_target == 1 ?
-		DEF_LINK_ICON_COLOR : DEF_FILE_ICON_COLOR;
-#endif /* !_NO_ICONS */
+static struct fcount_t fcount = {0};
+
+/* The directories in FCOUNT, counted by a pool of detached workers. The
+ * job owns a copy of the names, so that it can outlive the file list:
+ * a slow (or hung) remote filesystem must not block the listing. */
+struct fcount_job_t {
+	char **names;
+	filesn_t *res;  /* Files counter of each directory in NAMES */
+	size_t n;
+	size_t next;    /* Next entry to be handed to a worker */
+	size_t running; /* Workers still running */
+	size_t refs;    /* Running workers, plus one for the file list */
+	int dirfd;      /* Directory NAMES are relative to */
+	int done;
+	int abandoned;  /* The file list is gone: stop counting */
+	int pad0;
+	pthread_mutex_t mutex;
+};
 
-	if (conf.follow_symlinks == 0) {
-		file_info[n].color = ln_c;
-		return;
-	}
+/* Job whose results are still to be applied to the file list (see
+ * update_files_counters()). */
+static struct fcount_job_t *fcount_job = NULL;
+/* Print the list again once the results of FCOUNT_JOB are in. */
+static int fcount_redraw = 0;
+/* The last worker of a job writes a byte here when done. */
+static int fcount_pipe[2] = {-1, -1};
 
-	struct stat a;
-	if (fstatat(fd, file_info[n].name, &a, 0) == -1) {
-		file_info[n].color = or_c;
-		file_info[n].xattr = 0;
-		stats.broken_link++;
+static void
+release_fcount_job(struct fcount_job_t *job)
+{
+	pthread_mutex_lock(&job->mutex);
+	const size_t refs = --job->refs;
+	pthread_mutex_unlock(&job->mutex);
+
+	if (refs > 0)
 		return;
-	}
+
+	for (size_t i = 0; i < job->n; i++)
+		free(job->names[i]);
+	free(job->names);
+	free(job->res);
+	close(job->dirfd);
+	pthread_mutex_destroy(&job->mutex);
+	free(job);
+}
+
+/* Drop the results of the current files counter job, if any: the file
+ * list they refer to is about to be freed. */
+static void
+abandon_fcount_job(void)
+{
+	if (!fcount_job)
+		return;
+
+	pthread_mutex_lock(&fcount_job->mutex);
+	fcount_job->abandoned = 1;
+	pthread_mutex_unlock(&fcount_job->mutex);
+
+	release_fcount_job(fcount_job);
+	fcount_job = (struct fcount_job_t *)NULL;
+}
+
+static void
+drain_fcount_pipe(void)
+{
+	char buf[64];
+	while (read(fcount_pipe[0], buf, sizeof(buf)) > 0);
+}
+
+static void *
+fcount_worker(void *arg)
+{
+	struct fcount_job_t *job = (struct fcount_job_t *)arg;
+
+	while (1) {
+		pthread_mutex_lock(&job->mutex);
+		const size_t start = job->abandoned == 1 ? job->n : job->next;
+		job->next += FCOUNT_CHUNK;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (start >= job->n)
+			break;
+
+		const size_t end = start + FCOUNT_CHUNK < job->n
+			? start + FCOUNT_CHUNK : job->n;
+		for (size_t i = start; i < end; i++)
+			job->res[i] = count_dir_files(job->dirfd, job->names[i]);
+	}
+
+	pthread_mutex_lock(&job->mutex);
+	if (--job->running == 0) {
+		job->done = 1;
+		if (job->abandoned == 0) {
+			const char c = 0;
+			const ssize_t ret = write(fcount_pipe[1], &c, 1);
+			UNUSED(ret);
+		}
+	}
+	pthread_mutex_unlock(&job->mutex);
+
+	release_fcount_job(job);
+	return NULL;
+}
+
+/* Start counting the files of the directories in FCOUNT via a pool of
+ * detached workers (twice the number of online CPUs, at most
+ * PSTAT_MAX_WORKERS). Return the job, or NULL on error. */
+static struct fcount_job_t *
+start_fcount_job(void)
+{
+	if (fcount_pipe[0] == -1) {
+		if (pipe(fcount_pipe) == -1) {
+			fcount_pipe[0] = fcount_pipe[1] = -1;
+			return (struct fcount_job_t *)NULL;
+		}
+
+		for (size_t i = 0; i < 2; i++) {
+			fcntl(fcount_pipe[i], F_SETFL, O_NONBLOCK);
+			fcntl(fcount_pipe[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+
+	const int dirfd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd == -1)
+		return (struct fcount_job_t *)NULL;
+
+	struct fcount_job_t *job = xcalloc(1, sizeof(struct fcount_job_t));
+	job->n = fcount.n;
+	job->names = xnmalloc(job->n, sizeof(char *));
+	job->res = xnmalloc(job->n, sizeof(filesn_t));
+	job->dirfd = dirfd;
+	job->refs = 1;
+	pthread_mutex_init(&job->mutex, NULL);
+
+	size_t i;
+	for (i = 0; i < job->n; i++) {
+		const filesn_t j = fcount.ents[i];
+		job->names[i] = savestring(file_info[j].name, file_info[j].bytes);
+	}
+
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t workers = cpus > 0 ? (size_t)cpus * 2 : 2;
+	if (workers > PSTAT_MAX_WORKERS)
+		workers = PSTAT_MAX_WORKERS;
+	if (workers > job->n / FCOUNT_CHUNK)
+		workers = job->n / FCOUNT_CHUNK;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	size_t spawned = 0;
+	for (i = 0; i < workers; i++) {
+		pthread_mutex_lock(&job->mutex);
+		job->running++;
+		job->refs++;
+		pthread_mutex_unlock(&job->mutex);
+
+		pthread_t tid;
+		if (pthread_create(&tid, &attr, fcount_worker, job) != 0) {
+			pthread_mutex_lock(&job->mutex);
+			job->running--;
+			job->refs--;
+			pthread_mutex_unlock(&job->mutex);
+			break;
+		}
+		spawned++;
+	}
+
+	pthread_attr_destroy(&attr);
+
+	if (spawned == 0) { /* Do the work ourselves */
+		job->running = 1;
+		job->refs++;
+		fcount_worker(job);
+	}
+
+	return job;
+}
+
+/* Wait up to MS milliseconds (forever if MS is negative) for JOB to be
+ * done. Return 1 if done or 0 otherwise. */
+static int
+wait_fcount_job(struct fcount_job_t *job, const int ms)
+{
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (1) {
+		pthread_mutex_lock(&job->mutex);
+		const int done = job->done;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (done == 1)
+			return 1;
+
+		int timeout = -1;
+		if (ms >= 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			const long elapsed = (long)(now.tv_sec - start.tv_sec) * 1000
+				+ (now.tv_nsec - start.tv_nsec) / 1000000;
+			if (elapsed >= ms)
+				return 0;
+			timeout = ms - (int)elapsed;
+		}
+
+		struct pollfd pfd = {fcount_pipe[0], POLLIN, 0};
+		if (poll(&pfd, 1, timeout) > 0)
+			drain_fcount_pipe();
+	}
+}
+
+/* Set the files counter of the directory whose index in the file list
+ * is N to COUNT, and set its color accordingly. */
+static void
+set_dir_files_counter(const filesn_t n, const filesn_t count)
+{
+	/* A pending directory has been colored already (see set_dir_color()):
+	 * undo its stats before coloring it again. */
+	if (FC_PENDING(file_info[n].filesn)) {
+		const char *c = file_info[n].color;
+		if ((c == tw_c || c == ow_c) && stats.other_writable > 0)
+			stats.other_writable--;
+		if ((c == tw_c || c == st_c) && stats.sticky > 0)
+			stats.sticky--;
+	}
+
+	file_info[n].filesn = count;
+	set_dir_color(file_info[n].mode, n);
+#ifndef _NO_ICONS
+	if (checks.icons_use_file_color == 1)
+		file_info[n].cold->icon_color = file_info[n].color;
+#endif /* !_NO_ICONS */
+}
+
+/* Compute the files counter of the directories deferred by load_dir_info()
+ * and set their colors. Reading directories is I/O bound (especially on
+ * remote filesystems): if there are many of them, they are read by a pool
+ * of detached workers. If these are not done after FCOUNT_WAIT_MS
+ * milliseconds, the directories are listed with a placeholder instead (see
+ * FC_PENDING()), and the list is printed again, once, when all counters are
+ * in (see update_files_counters()). When the list cannot be printed again
+ * (the pager is in use, the screen is not cleared, or we are about to
+ * quit), we wait for the workers. */
+static void
+count_dirs_files(void)
+{
+	const size_t n = fcount.n;
+	struct fcount_job_t *job = n >= FCOUNT_MIN_DIRS
+		? start_fcount_job() : (struct fcount_job_t *)NULL;
+	size_t i;
+
+	if (!job) {
+		for (i = 0; i < n; i++) {
+			const filesn_t j = fcount.ents[i];
+			set_dir_files_counter(j,
+				count_dir_files(XAT_FDCWD, file_info[j].name));
+		}
+		goto END;
+	}
+
+	const int redraw = (xargs.list_and_quit != 1 && conf.clear_screen > 0
+#ifdef RUN_CMD
+		&& !cmd_line_cmd
+#endif /* RUN_CMD */
+		&& (conf.pager == 0
+		|| (conf.pager > 1 && files < (filesn_t)conf.pager)));
+
+	if (wait_fcount_job(job, redraw == 1 ? FCOUNT_WAIT_MS : -1) == 1) {
+		for (i = 0; i < n; i++)
+			set_dir_files_counter(fcount.ents[i], job->res[i]);
+		release_fcount_job(job);
+		goto END;
+	}
+
+	for (i = 0; i < n; i++)
+		set_dir_files_counter(fcount.ents[i], FC_SLOT_TO_N(i));
+
+	fcount_job = job;
+	fcount_redraw = 1;
+
+END:
+	free(fcount.ents);
+	fcount = (struct fcount_t){0};
+}
+
+static inline void
+load_dir_info(const mode_t mode, const filesn_t n)
+{
+	file_info[n].dir = 1;
+
+#ifndef _NO_ICONS
+	if (conf.icons == 1)
+		get_dir_icon(n);
+#endif /* !_NO_ICONS */
+
+	if (checks.files_counter == 1) {
+		/* Avoid counting files if we have no access to the directory. */
+		if (file_info[n].user_access == 0) {
+			file_info[n].filesn = -1;
+		} else if (fcount.ents) {
+			/* Deferred: see count_dirs_files() */
+			if (fcount.n == fcount.cap) {
+				fcount.cap *= 2;
+				fcount.ents = xnrealloc(fcount.ents, fcount.cap,
+					sizeof(filesn_t));
+			}
+			fcount.ents[fcount.n++] = n;
+			return;
+		} else {
+			file_info[n].filesn = count_dir_files(XAT_FDCWD, file_info[n].name);
+		}
+	} else {
+		file_info[n].filesn = 1;
+	}
+
+	set_dir_color(mode, n);
+}
+
+static inline void
+load_link_info(const int fd, const filesn_t n)
+{
+	file_info[n].symlink = 1;
+
+#ifndef _NO_ICONS
+	file_info[n].cold->icon = DEF_LINK_ICON;
+	file_info[n].cold->icon_color = conf.color_lnk_as_target == 1 ?
+		DEF_LINK_ICON_COLOR : DEF_FILE_ICON_COLOR;
+#endif /* !_NO_ICONS */
+
+	if (conf.follow_symlinks == 0) {
+		file_info[n].color = ln_c;
+		return;
+	}
+
+	struct stat a;
+	if (fstatat(fd, file_info[n].name, &a, 0) == -1) {
+		file_info[n].color = or_c;
+		file_info[n].cold->xattr = 0;
+		stats.broken_link++;
+		return;
+	}
 
 	/* We only need the symlink target name provided the target is not a
 	 * directory, because set_link_target_color() will check the filename
@@ -3075,8 +3866,7 @@ load_link_info(const int fd, const filesn_t n)
 		file_info[n].dir = 1;
 
 		file_info[n].filesn = conf.files_counter == 1
-			? count_dir(file_info[n].name, NO_CPOP) - 2
-			: 1;
+			? count_dir_files(XAT_FDCWD, file_info[n].name) : 1;
 
 		const filesn_t files_in_dir = conf.files_counter == 1
 			? (file_info[n].filesn > 0 ? 3 : file_info[n].filesn)
@@ -3117,7 +3907,7 @@ load_regfile_info(const mode_t mode, const filesn_t n)
 #ifdef LINUX_FILE_CAPS
 	/* Capabilities are stored by the system as extended attributes.
 	 * No xattrs, no caps. */
-	else if (file_info[n].xattr == 1
+	else if (file_info[n].cold->xattr == 1
 	&& (cap = cap_get_file(file_info[n].name))) {
 		file_info[n].color = ca_c;
 		stats.caps++;
@@ -3145,8 +3935,8 @@ load_regfile_info(const mode_t mode, const filesn_t n)
 
 #ifndef _NO_ICONS
 	if (file_info[n].exec == 1) {
-		file_info[n].icon = DEF_EXEC_ICON;
-		file_info[n].icon_color = DEF_EXEC_ICON_COLOR;
+		file_info[n].cold->icon = DEF_EXEC_ICON;
+		file_info[n].cold->icon_color = DEF_EXEC_ICON_COLOR;
 	}
 #endif /* !_NO_ICONS */
 
@@ -3183,17 +3973,55 @@ load_regfile_info(const mode_t mode, const filesn_t n)
 		get_ext_icon(ext, n);
 #endif /* !_NO_ICONS */
 
-	size_t color_len = 0;
-	const char *extcolor = get_ext_color(ext, &color_len);
-	if (!extcolor)
-		return;
+	char *extcolor = get_ext_color_seq(ext, NULL);
+	if (extcolor)
+		file_info[n].color = extcolor;
+}
+
+/* Load information about the file whose index in the file list is N, and
+ * whose name, length, and UTF-8 flag have already been set. A is the
+ * stat struct of the file, provided STAT_OK is 1. FD is a file descriptor
+ * for the current directory. */
+static inline void
+load_file_entry(const int fd, const filesn_t n, const struct stat *a,
+	const int stat_ok, int *have_xattr)
+{
+	if (stat_ok == 1) {
+		load_file_gral_info(a, n, have_xattr);
+	} else {
+		file_info[n].type = DT_UNKNOWN;
+		stats.unknown++;
+	}
+
+	switch (file_info[n].type) {
+	case DT_DIR: load_dir_info(stat_ok == 1 ? a->st_mode : 0, n); break;
+	case DT_LNK: load_link_info(fd, n); break;
+	case DT_REG:
+		load_regfile_info(stat_ok == 1 ? a->st_mode : 0, n); break;
+
+	/* For the time being, we have no specific colors for DT_ARCH1,
+	 * DT_ARCH2, and DT_WHT. */
+	case DT_SOCK: file_info[n].color = so_c; break;
+	case DT_FIFO: file_info[n].color = pi_c; break;
+	case DT_BLK: file_info[n].color = bd_c; break;
+	case DT_CHR: file_info[n].color = cd_c; break;
+#ifdef SOLARIS_DOORS
+	case DT_DOOR: file_info[n].color = oo_c; break;
+	case DT_PORT: file_info[n].color = oo_c; break;
+#endif /* SOLARIS_DOORS */
+	case DT_UNKNOWN: file_info[n].color = no_c; break;
+	default: file_info[n].color = df_c; break;
+	}
 
-	char *t = xnmalloc(color_len + 4, sizeof(char));
-	*t = '\x1b'; t[1] = '[';
-	memcpy(t + 2, extcolor, color_len);
-	t[color_len + 2] = 'm';
-	t[color_len + 3] = '\0';
-	file_info[n].ext_color = file_info[n].color = t;
+	if (checks.scanning == 1 && file_info[n].dir == 1)
+		print_scanned_file(file_info[n].name);
+
+#ifndef _NO_ICONS
+	if (checks.icons_use_file_color == 1)
+		file_info[n].cold->icon_color = file_info[n].color;
+#endif /* !_NO_ICONS */
+	if (conf.long_view == 1 && stat_ok == 1)
+		set_long_attribs(n, a);
 }
 
 static int
@@ -3211,170 +4039,474 @@ vt_stat(const int fd, char *restrict path, struct stat *attr)
 	return 0;
 }
 
-/* List files in the current working directory. Uses file type colors
- * and columns. Return 0 on success or 1 on error. */
-int
-list_dir(void)
+/* Return 1 if the file named ENAME must be excluded from the current list
+ * according to the name filter, the ShowHiddenFiles option, or the .hidden
+ * file. Otherwise, return 0. */
+static inline int
+exclude_file_name(const char *ename, struct dothidden_t **hidden_list,
+	filesn_t *excluded_files)
 {
-#ifdef LIST_SPEED_TEST
-	clock_t start = clock();
-#endif /* LIST_SPEED_TEST */
-
-	if (conf.clear_screen > 0) {
-		CLEAR;
-		fflush(stdout);
+	/* Filter files according to a regex filter */
+	if (checks.filter_name == 1) {
+		if (regexec(&regex_exp, ename, 0, NULL, 0) == 0) {
+			if (filter.rev == 1) {
+				(*excluded_files)++;
+				return 1;
+			}
+		} else if (filter.rev == 0) {
+			(*excluded_files)++;
+			return 1;
+		}
 	}
 
-	/* Hide the cursor to minimize flickering: it will be unhidden immediately
-	 * before printing the next prompt (prompt.c) */
-	if (xargs.list_and_quit != 1)
-		HIDE_CURSOR;
-
-	int autocmd_ret = 0;
-	if (autocmds_n > 0 && dir_changed == 1) {
-		if (autocmd_set == 1)
-			revert_autocmd_opts();
-		autocmd_ret = check_autocmds();
+	if (*ename == '.') {
+		stats.hidden++;
+		if (conf.show_hidden == 0) {
+			(*excluded_files)++;
+			return 1;
+		}
 	}
 
-	if (dir_changed == 1 && dir_out == 1) {
-		run_dir_cmd(AUTOCMD_DIR_OUT, NULL);
-		dir_out = 0;
+	if (*hidden_list && check_dothidden(ename, hidden_list) == 1) {
+		stats.hidden++;
+		(*excluded_files)++;
+		return 1;
 	}
 
-	if (conf.clear_screen > 0) {
-		/* For some reason we need to clear the screen twice to prevent
-		 * a garbage first line when scrolling up. */
-		CLEAR;
-		fflush(stdout);
-	}
+	return 0;
+}
 
-	get_term_size();
+/* An entry in the parallel stat batch. */
+struct pstat_ent_t {
+	char *name;
+	struct stat attr;
+	int ret; /* Return value of fstatat(2) */
+	int pad0;
+};
 
-	virtual_dir =
-		(stdin_tmp_dir && strcmp(stdin_tmp_dir, workspaces[cur_ws].path) == 0);
+/* Information shared by parallel stat workers. */
+struct pstat_t {
+	struct pstat_ent_t *ents;
+	size_t n;    /* Number of entries in ENTS */
+	size_t next; /* Next entry to be handed to a worker */
+	pthread_mutex_t mutex;
+	int fd;      /* File descriptor of the current directory */
+	int flag;    /* Flag passed to fstatat(2) */
+};
 
-	stats = (struct stats_t){0}; /* Reset the stats struct */
-	init_checks_struct();
-	init_default_file_info();
+/* Take chunks of PSTAT_CHUNK entries from the batch pointed to by ARG
+ * and stat them until the batch is exhausted. */
+static void *
+pstat_worker(void *arg)
+{
+	struct pstat_t *p = (struct pstat_t *)arg;
 
-	if (checks.scanning == 1)
-		print_scanning_message();
+	while (1) {
+		pthread_mutex_lock(&p->mutex);
+		const size_t start = p->next;
+		p->next += PSTAT_CHUNK;
+		pthread_mutex_unlock(&p->mutex);
 
-	if (conf.long_view == 1)
-		props_now = time(NULL);
+		if (start >= p->n)
+			break;
 
-	if (conf.light_mode == 1)
-		return list_dir_light(autocmd_ret);
+		const size_t end = start + PSTAT_CHUNK < p->n
+			? start + PSTAT_CHUNK : p->n;
+		for (size_t i = start; i < end; i++) {
+			p->ents[i].ret = fstatat(p->fd, p->ents[i].name,
+				&p->ents[i].attr, p->flag);
+		}
+	}
 
-	struct dothidden_t *hidden_list =
-		(conf.read_dothidden == 1 && conf.show_hidden == 0)
-		? load_dothidden() : NULL;
+	return (void *)NULL;
+}
 
-	DIR *dir;
-	struct dirent *ent;
-	struct stat attr;
-	int reset_pager = 0;
-	filesn_t excluded_files = 0;
-	int close_dir = 1;
-	int have_xattr = 0;
+/* Return the number of workers to be used to stat N files. */
+static size_t
+get_pstat_workers(const size_t n)
+{
+#ifdef LIST_SPEED_TEST
+	/* Let benchmarks force the amount of workers, for example 1 to time
+	 * the same code path serially. */
+	const char *env = getenv("CLIFM_PSTAT_WORKERS");
+	const int forced = env ? atoi(env) : 0;
+	if (forced > 0)
+		return forced < PSTAT_MAX_WORKERS ? (size_t)forced : PSTAT_MAX_WORKERS;
+#endif /* LIST_SPEED_TEST */
 
-	/* Let's store information about the largest file in the list for the
-	 * disk usage analyzer mode. */
-	off_t largest_name_size = 0, total_size = 0;
-	char *largest_name = (char *)NULL, *largest_color = (char *)NULL;
+	if (n < PSTAT_MIN_FILES)
+		return 1;
 
-	if ((dir = opendir(workspaces[cur_ws].path)) == NULL) {
-		xerror("%s: %s: %s\n", PROGRAM_NAME, workspaces[cur_ws].path,
-			strerror(errno));
-		close_dir = 0;
-		goto END;
-	}
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	/* Stat calls on remote filesystems are I/O bound: let's use twice as
+	 * many workers as online CPUs. */
+	size_t workers = cpus > 0 ? (size_t)cpus * 2 : 2;
+	if (workers > PSTAT_MAX_WORKERS)
+		workers = PSTAT_MAX_WORKERS;
+	if (workers > n / PSTAT_CHUNK)
+		workers = n / PSTAT_CHUNK;
 
-	set_events_checker();
+	return workers > 0 ? workers : 1;
+}
 
-	const int fd = dirfd(dir);
-	if (fd == -1) {
-		xerror(_("%s: Error getting file descriptor for the current "
-			"directory: %s\n"), PROGRAM_NAME, workspaces[cur_ws].path,
-			strerror(errno));
-		goto END;
-	}
+/* Read all entries in the directory DIR (whose file descriptor is FD),
+ * skipping those excluded by name, and stat them in parallel using
+ * fstatat(2) with the flag STAT_FLAG. Results are stored in P (whose
+ * entries array is initially sized to HINT). Names are allocated in the
+ * files list arena. Return the number of workers used. */
+static size_t
+pstat_dir(DIR *dir, const int fd, const int stat_flag,
+	struct dothidden_t **hidden_list, filesn_t *excluded_files,
+	struct pstat_t *p, const size_t hint)
+{
+	struct dirent *ent;
+	size_t total = hint;
 
-#ifdef POSIX_FADV_SEQUENTIAL
-	/* A hint to the kernel to optimize current dir for reading */
-	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
-#endif /* POSIX_FADV_SEQUENTIAL */
+	p->ents = xnmalloc(total, sizeof(struct pstat_ent_t));
+	p->n = p->next = 0;
+	p->fd = fd;
+	p->flag = stat_flag;
 
-	if (checks.autocmd_files == 1)
-		check_autocmd_files();
+	while ((ent = readdir(dir))) {
+		const char *ename = ent->d_name;
+		if (SELFORPARENT(ename))
+			continue;
 
-		/* ##########################################
-		 * #    GATHER AND STORE FILE INFORMATION   #
-		 * ########################################## */
+		FSMON_ADD_NAME(ename);
 
-	errno = 0;
-	longest.name_len = 0;
-	filesn_t n = 0, count = 0;
-	size_t total_dents = 0;
+		if (exclude_file_name(ename, hidden_list, excluded_files) == 1)
+			continue;
 
-	file_info = xnmalloc(ENTRY_N + 2, sizeof(struct fileinfo));
+		if (p->n == total) {
+			total *= 2;
+			p->ents = xnrealloc(p->ents, total, sizeof(struct pstat_ent_t));
+		}
 
-	/* Cache used values in local variables for faster access. */
-	const int checks_filter_name = checks.filter_name;
+		p->ents[p->n].name = arena_savestring(ename, strlen(ename));
+		p->ents[p->n].ret = -1;
+		p->n++;
+	}
+
+	const size_t workers = get_pstat_workers(p->n);
+	pthread_t tid[PSTAT_MAX_WORKERS];
+	size_t i, spawned = 0;
+
+	pthread_mutex_init(&p->mutex, NULL);
+
+	/* The current thread works as well, so that we need one thread less. */
+	for (i = 1; i < workers; i++) {
+		if (pthread_create(&tid[spawned], NULL, pstat_worker, p) == 0)
+			spawned++;
+	}
+
+	pstat_worker(p);
+
+	for (i = 0; i < spawned; i++)
+		pthread_join(tid[i], NULL);
+
+	pthread_mutex_destroy(&p->mutex);
+
+	return spawned + 1;
+}
+
+/* Print the list of files (FILE_INFO), which must be already sorted,
+ * either in long or normal view. HAVE_XATTR is 1 if at least one file
+ * has extended attributes. */
+static void
+print_file_list(const int have_xattr, int *reset_pager)
+{
+	const int eln_len = conf.no_eln == 1 ? 0
+		: ((conf.max_files != UNSET && files > (filesn_t)conf.max_files)
+		? DIGINUM(conf.max_files) : DIGINUM(files));
+
+		/* ##########################################
+		 * #    GET INFO TO PRINT COLUMNED OUTPUT   #
+		 * ########################################## */
+
+	size_t counter = 0;
+
+	/* Get the longest filename. */
+	if (conf.columned == 1 || conf.long_view == 1
+	|| conf.pager_view != PAGER_AUTO)
+		get_longest_filename(files, (size_t)eln_len);
+
+	/* Get the number of columns required to print all filenames. */
+	const size_t columns_n = (conf.pager_view == PAGER_AUTO
+		&& (conf.columned == 0 || conf.long_view == 1)) ? 1 : get_columns();
+
+	set_pager_view((filesn_t)columns_n);
+
+				/* ########################
+				 * #    LONG VIEW MODE    #
+				 * ######################## */
+
+	begin_frame();
+
+	if (conf.long_view == 1) {
+		if (prop_fields.size == PROP_SIZE_HUMAN)
+			construct_human_sizes();
+		print_long_mode(&counter, reset_pager, eln_len, have_xattr);
+		end_frame();
+		return;
+	}
+
+				/* ########################
+				 * #   NORMAL VIEW MODE   #
+				 * ######################## */
+
+	if (conf.listing_mode == VERTLIST) /* ls(1) like listing */
+		list_files_vertical(&counter, reset_pager, eln_len, columns_n);
+	else
+		list_files_horizontal(&counter, reset_pager, eln_len, columns_n);
+
+	end_frame();
+}
+
+#ifdef LIST_SPEED_TEST
+/* Microbenchmark for the passes walking the whole list of files before
+ * printing it: sorting, getting the longest file name, and (vertical
+ * listing only) getting the longest file name per column. Each pass is run
+ * CLIFM_LIST_BENCH times over the current list (already sorted, so that
+ * the result is unchanged), and the average is reported. */
+static void
+bench_list_passes(void)
+{
+	const char *env = getenv("CLIFM_LIST_BENCH");
+	const int reps = env ? atoi(env) : 0;
+	if (reps <= 0 || files == 0)
+		return;
+
+	const size_t eln_len = (size_t)DIGINUM(files);
+	struct timespec a, b;
+	double sort_time = 0, longest_time = 0, per_col_time = 0;
+
+	for (int r = 0; r < reps; r++) {
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		if (conf.sort != SNONE)
+			sort_entries(file_info, files);
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		sort_time += (double)(b.tv_sec - a.tv_sec)
+			+ (double)(b.tv_nsec - a.tv_nsec) / 1e9;
+
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		get_longest_filename(files, eln_len);
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		longest_time += (double)(b.tv_sec - a.tv_sec)
+			+ (double)(b.tv_nsec - a.tv_nsec) / 1e9;
+
+#ifdef TIGHT_COLUMNS
+		/* Entry lengths are cached by get_longest_per_col(): start from
+		 * scratch, as with a freshly loaded list. */
+		filesn_t i;
+		for (i = 0; i < files; i++)
+			file_info[i].total_entry_len = 0;
+
+		size_t columns_n = get_columns();
+		filesn_t rows = 0;
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		free(get_longest_per_col(&columns_n, &rows, files));
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		per_col_time += (double)(b.tv_sec - a.tv_sec)
+			+ (double)(b.tv_nsec - a.tv_nsec) / 1e9;
+#endif /* TIGHT_COLUMNS */
+	}
+
+	printf("list passes (%jd files, %zu bytes per entry, %zu bytes of cold "
+		"data, %d run(s)): sort %f, longest name %f, longest per column %f\n",
+		(intmax_t)files, sizeof(struct fileinfo),
+		sizeof(struct fileinfo_cold), reps, sort_time / reps,
+		longest_time / reps, per_col_time / reps);
+}
+#endif /* LIST_SPEED_TEST */
+
+/* List files in the current working directory. Uses file type colors
+ * and columns. Return 0 on success or 1 on error. */
+int
+list_dir(void)
+{
+#ifdef LIST_SPEED_TEST
+	clock_t start = clock();
+	struct timespec gather_start = {0}, gather_end = {0};
+	struct timespec print_start = {0}, print_end = {0};
+	size_t stat_workers = 0;
+#endif /* LIST_SPEED_TEST */
+
+	if (conf.clear_screen > 0) {
+		CLEAR;
+		fflush(stdout);
+	}
+
+	/* Hide the cursor to minimize flickering: it will be unhidden immediately
+	 * before printing the next prompt (prompt.c) */
+	if (xargs.list_and_quit != 1)
+		HIDE_CURSOR;
+
+	int autocmd_ret = 0;
+	if (autocmds_n > 0 && dir_changed == 1) {
+		if (autocmd_set == 1)
+			revert_autocmd_opts();
+		autocmd_ret = check_autocmds();
+	}
+
+	if (dir_changed == 1 && dir_out == 1) {
+		run_dir_cmd(AUTOCMD_DIR_OUT, NULL);
+		dir_out = 0;
+	}
+
+	if (conf.clear_screen > 0) {
+		/* For some reason we need to clear the screen twice to prevent
+		 * a garbage first line when scrolling up. */
+		CLEAR;
+		fflush(stdout);
+	}
+
+	get_term_size();
+
+	dirlist_updatable = 0;
+	abandon_fcount_job();
+	virtual_dir =
+		(stdin_tmp_dir && strcmp(stdin_tmp_dir, workspaces[cur_ws].path) == 0);
+
+	stats = (struct stats_t){0}; /* Reset the stats struct */
+	init_checks_struct();
+	init_default_file_info();
+
+	if (checks.scanning == 1)
+		print_scanning_message();
+
+	if (conf.long_view == 1)
+		props_now = time(NULL);
+
+	if (conf.light_mode == 1)
+		return list_dir_light(autocmd_ret);
+
+	struct dothidden_t *hidden_list =
+		(conf.read_dothidden == 1 && conf.show_hidden == 0)
+		? load_dothidden() : NULL;
+
+	DIR *dir;
+	struct dirent *ent;
+	struct stat attr;
+	int reset_pager = 0;
+	filesn_t excluded_files = 0;
+	int close_dir = 1;
+	int have_xattr = 0;
+
+	/* Let's store information about the largest file in the list for the
+	 * disk usage analyzer mode. */
+	off_t largest_name_size = 0, total_size = 0;
+	char *largest_name = (char *)NULL, *largest_color = (char *)NULL;
+
+	if ((dir = opendir(workspaces[cur_ws].path)) == NULL) {
+		xerror("%s: %s: %s\n", PROGRAM_NAME, workspaces[cur_ws].path,
+			strerror(errno));
+		close_dir = 0;
+		goto END;
+	}
+
+	set_events_checker();
+
+	const int fd = dirfd(dir);
+	if (fd == -1) {
+		xerror(_("%s: Error getting file descriptor for the current "
+			"directory: %s\n"), PROGRAM_NAME, workspaces[cur_ws].path,
+			strerror(errno));
+		goto END;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	/* A hint to the kernel to optimize current dir for reading */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif /* POSIX_FADV_SEQUENTIAL */
+
+	if (checks.autocmd_files == 1)
+		check_autocmd_files();
+
+		/* ##########################################
+		 * #    GATHER AND STORE FILE INFORMATION   #
+		 * ########################################## */
+
+	errno = 0;
+	longest.name_len = 0;
+	filesn_t n = 0;
+	const size_t path_hash = hashme(workspaces[cur_ws].path, 1);
+	size_t total_dents = get_dents_hint(path_hash);
+
+	/* Cache used values in local variables for faster access. */
 	const int checks_filter_type = checks.filter_type;
-	const int checks_scanning = checks.scanning;
-#ifndef _NO_ICONS
-	const int checks_icons_use_file_color = checks.icons_use_file_color;
-#endif /* !_NO_ICONS */
 	const int conf_only_dirs = conf.only_dirs;
-	const int conf_show_hidden = conf.show_hidden;
 	const int conf_follow_symlinks = conf.follow_symlinks;
-	const int conf_long_view = conf.long_view;
 	const int xargs_disk_usage_analyzer = xargs.disk_usage_analyzer;
 
 	const int stat_flag =
 		(conf.follow_symlinks == 1 && conf.long_view == 1
 		&& conf.follow_symlinks_long == 1) ? 0 : AT_SYMLINK_NOFOLLOW;
 
-	while ((ent = readdir(dir))) {
-		const char *ename = ent->d_name;
-		/* Skip self and parent directories */
-		if (SELFORPARENT(ename))
-			continue;
+#ifdef LIST_SPEED_TEST
+	clock_gettime(CLOCK_MONOTONIC, &gather_start);
+#endif /* LIST_SPEED_TEST */
 
-		/* Filter files according to a regex filter */
-		if (checks_filter_name == 1) {
-			if (regexec(&regex_exp, ename, 0, NULL, 0) == 0) {
-				if (filter.rev == 1) {
-					excluded_files++;
-					continue;
-				}
-			} else if (filter.rev == 0) {
-				excluded_files++;
-				continue;
-			}
-		}
+	/* If ParallelStat is enabled, read the whole directory first and stat
+	 * all entries at once using a pool of workers. The loop below then
+	 * consumes these results instead of calling readdir(3) and fstatat(2).
+	 * vt_stat() (virtual directories) is not thread safe: skip it. */
+	struct pstat_t pstat = {0};
+	const int parallel_stat = (conf.parallel_stat == 1 && virtual_dir == 0);
+	size_t pstat_i = 0;
 
-		if (*ename == '.') {
-			stats.hidden++;
-			if (conf_show_hidden == 0) {
-				excluded_files++;
+	if (parallel_stat == 1) {
+#ifdef LIST_SPEED_TEST
+		stat_workers =
+#endif /* LIST_SPEED_TEST */
+		pstat_dir(dir, fd, stat_flag, &hidden_list, &excluded_files, &pstat,
+			total_dents);
+		/* We know the exact amount of candidate files: no need to grow
+		 * the file_info array. */
+		if (pstat.n > total_dents)
+			total_dents = pstat.n;
+	}
+
+	file_info = xnmalloc(total_dents + 2, sizeof(struct fileinfo));
+
+	/* Defer files counters until the whole directory has been read, so that
+	 * they can be computed in the background (see count_dirs_files()). The
+	 * disk usage analyzer needs colors right away: do not defer. */
+	if (checks.files_counter == 1 && xargs_disk_usage_analyzer != 1) {
+		fcount.cap = ENTRY_N;
+		fcount.ents = xnmalloc(fcount.cap, sizeof(filesn_t));
+	}
+
+	while (1) {
+		const char *ename;
+		int stat_ok;
+
+		if (parallel_stat == 1) {
+			if (pstat_i >= pstat.n)
+				break;
+			ename = pstat.ents[pstat_i].name;
+			stat_ok = (pstat.ents[pstat_i].ret == 0);
+			if (stat_ok == 1)
+				attr = pstat.ents[pstat_i].attr;
+			pstat_i++;
+			init_file_entry(n);
+		} else {
+			if (!(ent = readdir(dir)))
+				break;
+			ename = ent->d_name;
+			/* Skip self and parent directories */
+			if (SELFORPARENT(ename))
 				continue;
-			}
-		}
 
-		if (hidden_list && check_dothidden(ename, &hidden_list) == 1) {
-			stats.hidden++;
-			excluded_files++;
-			continue;
-		}
+			FSMON_ADD_NAME(ename);
 
-		file_info[n] = default_file_info;
+			if (exclude_file_name(ename, &hidden_list, &excluded_files) == 1)
+				continue;
 
-		const int stat_ok =
-			((virtual_dir == 1 ? vt_stat(fd, ent->d_name, &attr)
-			: fstatat(fd, ename, &attr, stat_flag)) == 0);
+			init_file_entry(n);
+
+			stat_ok = ((virtual_dir == 1 ? vt_stat(fd, ent->d_name, &attr)
+				: fstatat(fd, ename, &attr, stat_flag)) == 0);
+		}
 
 		if (stat_ok == 0) {
 			if (virtual_dir == 1)
@@ -3403,9 +4535,8 @@ list_dir(void)
 			continue;
 		}
 
-		if (count > ENTRY_N) {
-			count = 0;
-			total_dents = (size_t)n + ENTRY_N;
+		if ((size_t)n >= total_dents) {
+			total_dents *= 2;
 			file_info = xnrealloc(file_info, total_dents + 2,
 				sizeof(struct fileinfo));
 		}
@@ -3424,49 +4555,15 @@ list_dir(void)
 		 * names are far more common than UTF-8 names. */
 		file_info[n].utf8 = is_utf8_name(ename, &file_info[n].bytes);
 
-		file_info[n].name = xnmalloc(file_info[n].bytes + 1, sizeof(char));
-		memcpy(file_info[n].name, ename, file_info[n].bytes + 1);
+		/* Names read by pstat_dir() are already in the files list arena. */
+		file_info[n].name = parallel_stat == 1 ? pstat.ents[pstat_i - 1].name
+			: arena_savestring(ename, file_info[n].bytes);
 
 		/* Columns needed to display filename */
 		file_info[n].len = file_info[n].utf8 == 0
 			? file_info[n].bytes : wc_xstrlen(ename);
 
-		if (stat_ok == 1) {
-			load_file_gral_info(&attr, n, &have_xattr);
-		} else {
-			file_info[n].type = DT_UNKNOWN;
-			stats.unknown++;
-		}
-
-		switch (file_info[n].type) {
-		case DT_DIR: load_dir_info(stat_ok == 1 ? attr.st_mode : 0, n); break;
-		case DT_LNK: load_link_info(fd, n); break;
-		case DT_REG:
-			load_regfile_info(stat_ok == 1 ? attr.st_mode : 0, n); break;
-
-		/* For the time being, we have no specific colors for DT_ARCH1,
-		 * DT_ARCH2, and DT_WHT. */
-		case DT_SOCK: file_info[n].color = so_c; break;
-		case DT_FIFO: file_info[n].color = pi_c; break;
-		case DT_BLK: file_info[n].color = bd_c; break;
-		case DT_CHR: file_info[n].color = cd_c; break;
-#ifdef SOLARIS_DOORS
-		case DT_DOOR: file_info[n].color = oo_c; break;
-		case DT_PORT: file_info[n].color = oo_c; break;
-#endif /* SOLARIS_DOORS */
-		case DT_UNKNOWN: file_info[n].color = no_c; break;
-		default: file_info[n].color = df_c; break;
-		}
-
-		if (checks_scanning == 1 && file_info[n].dir == 1)
-			print_scanned_file(file_info[n].name);
-
-#ifndef _NO_ICONS
-		if (checks_icons_use_file_color == 1)
-			file_info[n].icon_color = file_info[n].color;
-#endif /* !_NO_ICONS */
-		if (conf_long_view == 1 && stat_ok == 1)
-			set_long_attribs(n, &attr);
+		load_file_entry(fd, n, &attr, stat_ok, &have_xattr);
 
 		if (xargs_disk_usage_analyzer == 1) {
 			get_largest_file_info(n, &largest_name_size, &largest_name,
@@ -3479,8 +4576,6 @@ list_dir(void)
 				"(showing only %jd files)\n"), PROGRAM_NAME, (intmax_t)n);
 			break;
 		}
-
-		count++;
 	}
 
 	/* Since we allocate memory by chunks, we might have allocated more
@@ -3494,6 +4589,17 @@ list_dir(void)
 
 	file_info[n].name = (char *)NULL;
 	files = n;
+	set_dents_hint(path_hash, (size_t)n);
+
+	if (parallel_stat == 1)
+		free(pstat.ents);
+
+	if (fcount.ents)
+		count_dirs_files();
+
+#ifdef LIST_SPEED_TEST
+	clock_gettime(CLOCK_MONOTONIC, &gather_end);
+#endif /* LIST_SPEED_TEST */
 
 	if (checks.scanning == 1)
 		erase_scanning_message();
@@ -3504,53 +4610,28 @@ list_dir(void)
 		goto END;
 	}
 
-	const int eln_len = conf.no_eln == 1 ? 0
-		: ((conf.max_files != UNSET && files > (filesn_t)conf.max_files)
-		? DIGINUM(conf.max_files) : DIGINUM(files));
-
 		/* #############################################
 		 * #    SORT FILES ACCORDING TO SORT METHOD    #
 		 * ############################################# */
 
 	if (conf.sort != SNONE)
-		ENTSORT(file_info, (size_t)n, entrycmp);
-
-		/* ##########################################
-		 * #    GET INFO TO PRINT COLUMNED OUTPUT   #
-		 * ########################################## */
-
-	size_t counter = 0;
+		sort_entries(file_info, n);
 
-	/* Get the longest filename. */
-	if (conf.columned == 1 || conf.long_view == 1
-	|| conf.pager_view != PAGER_AUTO)
-		get_longest_filename(n, (size_t)eln_len);
-
-	/* Get the number of columns required to print all filenames. */
-	const size_t columns_n = (conf.pager_view == PAGER_AUTO
-		&& (conf.columned == 0 || conf.long_view == 1)) ? 1 : get_columns();
-
-	set_pager_view((filesn_t)columns_n);
-
-				/* ########################
-				 * #    LONG VIEW MODE    #
-				 * ######################## */
+#ifdef LIST_SPEED_TEST
+	clock_gettime(CLOCK_MONOTONIC, &print_start);
+#endif /* LIST_SPEED_TEST */
 
-	if (conf.long_view == 1) {
-		if (prop_fields.size == PROP_SIZE_HUMAN)
-			construct_human_sizes();
-		print_long_mode(&counter, &reset_pager, eln_len, have_xattr);
-		goto END;
-	}
+	print_file_list(have_xattr, &reset_pager);
 
-				/* ########################
-				 * #   NORMAL VIEW MODE   #
-				 * ######################## */
+#ifdef LIST_SPEED_TEST
+	clock_gettime(CLOCK_MONOTONIC, &print_end);
+#endif /* LIST_SPEED_TEST */
 
-	if (conf.listing_mode == VERTLIST) /* ls(1) like listing */
-		list_files_vertical(&counter, &reset_pager, eln_len, columns_n);
-	else
-		list_files_horizontal(&counter, &reset_pager, eln_len, columns_n);
+	/* From now on, the list can be updated incrementally (see
+	 * update_dirlist()). */
+	dirlist_excluded = excluded_files;
+	dirlist_updatable = (virtual_dir == 0 && xargs_disk_usage_analyzer != 1
+		&& checks_filter_type == 0 && conf_only_dirs != 1);
 
 				/* #########################
 				 * #   POST LISTING STUFF  #
@@ -3573,23 +4654,407 @@ END:
 #ifdef LIST_SPEED_TEST
 	clock_t end = clock();
 	printf("list_dir time: %f\n", (double)(end - start) / CLOCKS_PER_SEC);
+	if (close_dir == 1) {
+		/* Wall clock time: CPU time is meaningless for parallel workers. */
+		printf("gather time (%s, %zu worker(s)): %f\n",
+			stat_workers > 0 ? "ParallelStat" : "serial",
+			stat_workers > 0 ? stat_workers : 1,
+			(double)(gather_end.tv_sec - gather_start.tv_sec)
+			+ (double)(gather_end.tv_nsec - gather_start.tv_nsec) / 1e9);
+		/* Time to paint. Run with CLIFM_LIST_NOFRAME set to get the
+		 * figures of the previous, line buffered, path (see begin_frame()) */
+		printf("print time (%s): %f (%zu bytes, %zu write(s))\n",
+			getenv("CLIFM_LIST_NOFRAME") ? "no frame" : "frame",
+			(double)(print_end.tv_sec - print_start.tv_sec)
+			+ (double)(print_end.tv_nsec - print_start.tv_nsec) / 1e9,
+			frame_bytes, frame_writes);
+		bench_list_passes();
+	}
 #endif /* LIST_SPEED_TEST */
 
 	return exit_code;
 }
 
-void
-free_dirlist(void)
+/* Undo the changes made to the stats struct when loading the file whose
+ * index in the file list is N (see load_file_entry()). The hidden files
+ * counter is handled by the caller. */
+static void
+uncount_file_stats(const filesn_t n)
 {
-	if (!file_info || files == 0)
+#define STAT_DEC(s) do { if ((s) > 0) (s)--; } while (0)
+
+	if (file_info[n].stat_err == 1) {
+		STAT_DEC(stats.unstat);
+		STAT_DEC(stats.unknown);
 		return;
+	}
+
+	switch (file_info[n].mode & S_IFMT) {
+	case S_IFREG: STAT_DEC(stats.reg); break;
+	case S_IFDIR: STAT_DEC(stats.dir); break;
+	case S_IFLNK: STAT_DEC(stats.link); break;
+	case S_IFIFO: STAT_DEC(stats.fifo); break;
+	case S_IFSOCK: STAT_DEC(stats.socket); break;
+	case S_IFBLK: STAT_DEC(stats.block_dev); break;
+	case S_IFCHR: STAT_DEC(stats.char_dev); break;
+#ifndef _BE_POSIX
+# ifdef SOLARIS_DOORS
+	case S_IFDOOR: STAT_DEC(stats.door); break;
+	case S_IFPORT: STAT_DEC(stats.port); break;
+# endif /* SOLARIS_DOORS */
+# ifdef S_ARCH1
+	case S_ARCH1: STAT_DEC(stats.arch1); break;
+	case S_ARCH2: STAT_DEC(stats.arch2); break;
+# endif /* S_ARCH1 */
+# ifdef S_IFWHT
+	case S_IFWHT: STAT_DEC(stats.whiteout); break;
+# endif /* S_IFWHT */
+#endif /* !_BE_POSIX */
+	default: STAT_DEC(stats.unknown); break;
+	}
+
+	const char *color = file_info[n].color;
+
+	if (file_info[n].type == DT_DIR) {
+		if (file_info[n].filesn == 0)
+			STAT_DEC(stats.empty_dir);
+		if (color == tw_c || color == ow_c)
+			STAT_DEC(stats.other_writable);
+		if (color == tw_c || color == st_c)
+			STAT_DEC(stats.sticky);
+	} else if (file_info[n].type == DT_LNK) {
+		if (color == or_c)
+			STAT_DEC(stats.broken_link);
+	} else if (file_info[n].type == DT_REG) {
+		if (file_info[n].exec == 1)
+			STAT_DEC(stats.exec);
+		if (color == su_c)
+			STAT_DEC(stats.suid);
+		else if (color == sg_c)
+			STAT_DEC(stats.sgid);
+		else if (color == ca_c)
+			STAT_DEC(stats.caps);
+		else if (color == mh_c)
+			STAT_DEC(stats.multi_link);
+		else if (color == ef_c)
+			STAT_DEC(stats.empty_reg);
+	}
+
+#undef STAT_DEC
+}
 
+/* Return the index in the file list of the file named NAME, or -1 if
+ * not found. Entries already removed (NULL name) are skipped. */
+static filesn_t
+find_dirlist_entry(const char *name)
+{
 	filesn_t i = files;
 	while (--i >= 0) {
-		free(file_info[i].name);
-		free(file_info[i].ext_color);
+		if (file_info[i].name && *file_info[i].name == *name
+		&& strcmp(file_info[i].name, name) == 0)
+			return i;
+	}
+
+	return (-1);
+}
+
+/* Insert the file at index N (the last one in the file list) in its
+ * sorted position among the first N files. */
+static void
+insert_sorted_entry(const filesn_t n)
+{
+	filesn_t lo = 0, hi = n;
+	while (lo < hi) {
+		const filesn_t mid = lo + (hi - lo) / 2;
+		if (entrycmp(&file_info[mid], &file_info[n]) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == n)
+		return;
+
+	const struct fileinfo tmp = file_info[n];
+	memmove(file_info + lo + 1, file_info + lo,
+		(size_t)(n - lo) * sizeof(struct fileinfo));
+	file_info[lo] = tmp;
+}
+
+/* Print the current list of files again (e.g. after being updated or
+ * sorted in place). */
+static void
+print_dirlist_again(void)
+{
+	int have_xattr = 0;
+	for (filesn_t j = 0; j < files && have_xattr == 0; j++)
+		have_xattr = file_info[j].cold->xattr;
+
+	if (conf.clear_screen > 0) {
+		CLEAR;
+		fflush(stdout);
+	}
+
+	if (xargs.list_and_quit != 1)
+		HIDE_CURSOR;
+
+	get_term_size();
+	longest.name_len = 0;
+
+	int reset_pager = 0;
+	print_file_list(have_xattr, &reset_pager);
+
+	post_listing(NULL, reset_pager, dirlist_excluded, 0);
+}
+
+/* Return the file descriptor to be polled for the results of the files
+ * counter workers, or -1 if there are none pending. */
+int
+files_counter_fd(void)
+{
+	return fcount_job ? fcount_pipe[0] : -1;
+}
+
+/* The list is no longer on the screen (a command was run): once the files
+ * counter workers are done, apply their results, but do not print the
+ * list again. */
+void
+cancel_files_counter_redraw(void)
+{
+	fcount_redraw = 0;
+}
+
+/* Apply the results of the files counter workers to the directories
+ * listed with a placeholder (see count_dirs_files()), if they are done.
+ * Return 1 if the list was printed again, or 0 otherwise. */
+int
+update_files_counters(void)
+{
+	drain_fcount_pipe();
+
+	if (!fcount_job)
+		return 0;
+
+	pthread_mutex_lock(&fcount_job->mutex);
+	const int done = fcount_job->done;
+	pthread_mutex_unlock(&fcount_job->mutex);
+
+	if (done == 0)
+		return 0;
+
+	struct fcount_job_t *job = fcount_job;
+	fcount_job = (struct fcount_job_t *)NULL;
+
+	/* The list might have been sorted or updated in the meantime: find
+	 * pending directories by their slot in the job, and check the name. */
+	filesn_t updated = 0;
+	for (filesn_t j = 0; j < files; j++) {
+		if (!file_info[j].name || !FC_PENDING(file_info[j].filesn))
+			continue;
+
+		const size_t slot = FC_N_TO_SLOT(file_info[j].filesn);
+		if (slot >= job->n || *job->names[slot] != *file_info[j].name
+		|| strcmp(job->names[slot], file_info[j].name) != 0)
+			continue;
+
+		set_dir_files_counter(j, job->res[slot]);
+		updated++;
+	}
+
+	release_fcount_job(job);
+
+	if (updated == 0 || fcount_redraw == 0 || kbind_busy == 1
+	|| alt_prompt != 0)
+		return 0;
+
+	print_dirlist_again();
+	return 1;
+}
+
+/* Apply changes to the files in NAMES (N names, all of them in the current
+ * directory) to the current file list, without reloading the whole
+ * directory: removed files are dropped from the list, new files are
+ * inserted in their sorted position, and modified files are reloaded.
+ * EXISTED[i] tells whether NAMES[i] existed before the changes took place
+ * (1), did not exist (0), or is unknown (-1).
+ * The list is then printed as list_dir() does.
+ * Returns FUNC_SUCCESS, or FUNC_FAILURE if the list cannot be updated
+ * incrementally, in which case it is left untouched and the caller
+ * should reload it via reload_dirlist(). */
+int
+update_dirlist(char **names, const int *existed, const size_t n)
+{
+#ifdef RUN_CMD
+	if (cmd_line_cmd)
+		return FUNC_SUCCESS;
+#endif /* RUN_CMD */
+
+	if (dirlist_updatable == 0 || conf.light_mode == 1 || !file_info
+	|| files == 0 || n == 0)
+		return FUNC_FAILURE;
+
+	/* Names and cold data of dropped entries stay in the files list arena.
+	 * Once they take up most of it, reload the whole list to reclaim them,
+	 * so that the arena does not grow without bound. */
+	if (list_arena_dead > LIST_ARENA_BLOCK
+	&& list_arena_dead > list_arena_used / 2)
+		return FUNC_FAILURE;
+
+	dirlist_gen++;
+
+	struct dothidden_t *hidden_list =
+		(conf.read_dothidden == 1 && conf.show_hidden == 0)
+		? load_dothidden() : NULL;
+
+	init_checks_struct();
+	checks.scanning = 0;
+
+	/* Check whether we know the previous state of each excluded file (we
+	 * have no way to know it from the file list). */
+	int *excluded = xnmalloc(n, sizeof(int));
+	size_t *hidden = xnmalloc(n, sizeof(size_t));
+	filesn_t scratch = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (strcmp(names[i], ".hidden") == 0)
+			break;
+		const size_t hidden_bk = stats.hidden;
+		excluded[i] = exclude_file_name(names[i], &hidden_list, &scratch);
+		hidden[i] = stats.hidden - hidden_bk;
+		stats.hidden = hidden_bk;
+		if (excluded[i] == 1 && existed[i] == -1)
+			break;
+	}
+
+	if (i < n) {
+		if (hidden_list)
+			free_dothidden(&hidden_list);
+		free(excluded);
+		free(hidden);
+		return FUNC_FAILURE;
+	}
+
+	if (conf.long_view == 1)
+		props_now = time(NULL);
+
+	const int stat_flag =
+		(conf.follow_symlinks == 1 && conf.long_view == 1
+		&& conf.follow_symlinks_long == 1) ? 0 : AT_SYMLINK_NOFOLLOW;
+
+	/* Remove the old entries. */
+	filesn_t removed = 0;
+	for (i = 0; i < n; i++) {
+		const filesn_t j = excluded[i] == 1 ? -1 : find_dirlist_entry(names[i]);
+		if (j == -1) {
+			if (excluded[i] == 1 && existed[i] == 1) {
+				if (dirlist_excluded > 0)
+					dirlist_excluded--;
+				stats.hidden -= stats.hidden >= hidden[i] ? hidden[i] : 0;
+			}
+			continue;
+		}
+
+		uncount_file_stats(j);
+		stats.hidden -= stats.hidden >= hidden[i] ? hidden[i] : 0;
+		/* The name stays in the files list arena until the next reload. */
+		list_arena_dead += file_info[j].bytes + 1
+			+ sizeof(struct fileinfo_cold);
+		file_info[j].name = (char *)NULL;
+		removed++;
+	}
+
+	if (removed > 0) {
+		filesn_t k = 0;
+		for (filesn_t j = 0; j < files; j++) {
+			if (file_info[j].name)
+				file_info[k++] = file_info[j];
+		}
+		files = k;
+	}
+
+	file_info = xnrealloc(file_info, (size_t)files + n + 2,
+		sizeof(struct fileinfo));
+
+	/* Load the new (or modified) entries. */
+	init_default_file_info();
+	const filesn_t sorted_n = files;
+	struct stat attr;
+	int have_xattr = 0;
+
+	for (i = 0; i < n; i++) {
+		errno = 0;
+		const int stat_ok = (fstatat(XAT_FDCWD, names[i], &attr,
+			stat_flag) == 0);
+		if (stat_ok == 0 && errno == ENOENT)
+			continue;
+
+		stats.hidden += hidden[i];
+		if (excluded[i] == 1) {
+			dirlist_excluded++;
+			continue;
+		}
+
+		const filesn_t j = files;
+		init_file_entry(j);
+		if (stat_ok == 0) {
+			stats.unstat++;
+			file_info[j].stat_err = 1;
+		}
+
+		file_info[j].utf8 = is_utf8_name(names[i], &file_info[j].bytes);
+		file_info[j].name = arena_savestring(names[i], file_info[j].bytes);
+		file_info[j].len = file_info[j].utf8 == 0
+			? file_info[j].bytes : wc_xstrlen(names[i]);
+
+		load_file_entry(XAT_FDCWD, j, &attr, stat_ok, &have_xattr);
+		files++;
 	}
 
+	if (hidden_list)
+		free_dothidden(&hidden_list);
+	free(excluded);
+	free(hidden);
+
+	file_info[files].name = (char *)NULL;
+
+	if (files == 0) {
+		/* Let list_dir() handle the empty directory case. */
+		free(file_info);
+		file_info = (struct fileinfo *)NULL;
+		reset_list_arena();
+		list_dir();
+		return FUNC_SUCCESS;
+	}
+
+	/* Insert new entries in their sorted position. If too many files were
+	 * added, just sort the whole list. */
+	if (conf.sort != SNONE && files > sorted_n) {
+		if (files - sorted_n > 32) {
+			sort_entries(file_info, files);
+		} else {
+			for (filesn_t j = sorted_n; j < files; j++)
+				insert_sorted_entry(j);
+		}
+	}
+
+	print_dirlist_again();
+	return FUNC_SUCCESS;
+}
+
+void
+free_dirlist(void)
+{
+	dirlist_gen++;
+	abandon_fcount_job();
+
+	/* Names and cold data live in the files list arena: release them all at
+	 * once. */
+	reset_list_arena();
+
+	if (!file_info || files == 0)
+		return;
+
 	free(file_info);
 	file_info = (struct fileinfo *)NULL;
 }
@@ -3608,6 +5073,65 @@ reload_dirlist(void)
 	exit_code = bk;
 }
 
+/* Return 1 if the current list of files lacks information needed to sort it
+ * by the current sort method, having been loaded for the sort method
+ * OLD_SORT. Otherwise, return 0. */
+static int
+resort_needs_reload(const int old_sort)
+{
+	const int st = conf.sort;
+
+	/* Unsorted: we need the original order. */
+	if (st == SNONE)
+		return 1;
+
+	if (st == old_sort)
+		return 0;
+
+	/* The time field only holds the time used by the previous sort method,
+	 * and so does the time displayed in long view, if TimeFollowsSort. */
+	if ((st >= SATIME && st <= SMTIME) || checks.time_follows_sort == 1
+	|| checks.birthtime == 1)
+		return 1;
+
+	/* User and group names are only loaded if needed. */
+	if ((st == SOWN || st == SGRP) && checks.id_names == 0
+	&& prop_fields.ids == PROP_ID_NAME)
+		return 1;
+
+	return 0;
+}
+
+/* Sort the current list of files again after a change in the sort method
+ * (from OLD_SORT) or order (from OLD_REV), and print it, without reading the
+ * directory again. If only the order changed, the list is just reversed.
+ * If the current list lacks information needed by the new sort method,
+ * the directory is reloaded instead. */
+int
+resort_dirlist(const int old_sort, const int old_rev)
+{
+#ifdef RUN_CMD
+	if (cmd_line_cmd)
+		return FUNC_SUCCESS;
+#endif /* RUN_CMD */
+
+	if (dirlist_updatable == 0 || conf.light_mode == 1 || !file_info
+	|| files == 0 || resort_needs_reload(old_sort) == 1) {
+		free_dirlist();
+		return list_dir();
+	}
+
+	dirlist_gen++;
+
+	if (conf.sort != old_sort)
+		sort_entries(file_info, files);
+	else if (conf.sort_reverse != old_rev)
+		reverse_entries(file_info, files);
+
+	print_dirlist_again();
+	return FUNC_SUCCESS;
+}
+
 void
 refresh_screen(void)
 {
@@ -27,10 +27,21 @@
 
 __BEGIN_DECLS
 
+void cancel_files_counter_redraw(void);
+int  files_counter_fd(void);
+void flush_list_frame(void);
+int  frame_printf(const char *format, ...);
+void frame_putchar(const int c);
+void frame_puts(const char *s);
+void frame_write(const char *s, const size_t n);
 void free_dirlist(void);
+void free_list_arena(void);
 int  list_dir(void);
 void reload_dirlist(void);
 void refresh_screen(void);
+int  resort_dirlist(const int old_sort, const int old_rev);
+int  update_dirlist(char **names, const int *existed, const size_t n);
+int  update_files_counters(void);
 
 #ifndef _NO_ICONS
 void init_icons_hashes(void);
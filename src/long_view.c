@@ -30,6 +30,7 @@
 #include "aux.h"    /* xitoa() */
 #include "checks.h" /* check_file_access() */
 #include "colors.h" /* remove_bold_attr() */
+#include "listing.h" /* frame_printf(), frame_puts(), frame_putchar() */
 #include "long_view.h" /* macros */
 #include "misc.h"   /* gen_diff_str() */
 #include "properties.h" /* get_color_age, get_color_size, get_file_perms */
@@ -163,9 +164,9 @@ construct_and_print_filename(const struct fileinfo *props,
 	static char trunc_s[2] = {0};
 	*trunc_s = trunc > 0 ? TRUNC_FILE_CHR : 0;
 
-	printf("%s%s%s%s%s%ls%s%s%-*s%s\x1b[0m%s%s\x1b[0m%s%s%s  ",
-		(conf.colorize == 1 && conf.icons == 1) ? props->icon_color : "",
-		conf.icons == 1 ? props->icon : "", conf.icons == 1 ? " " : "", df_c,
+	frame_printf("%s%s%s%s%s%ls%s%s%-*s%s\x1b[0m%s%s\x1b[0m%s%s%s  ",
+		(conf.colorize == 1 && conf.icons == 1) ? props->cold->icon_color : "",
+		conf.icons == 1 ? props->cold->icon : "", conf.icons == 1 ? " " : "", df_c,
 
 		conf.colorize == 1 ? props->color : "",
 		(wchar_t *)name_buf, trunc_diff,
@@ -216,22 +217,22 @@ construct_file_size(const struct fileinfo *props, char *size_str,
 
 	if (prop_fields.size != PROP_SIZE_HUMAN) {
 		snprintf(size_str, SIZE_STR_LEN, "%s%*jd%s%c", csize,
-			(props->du_status != 0 && size_max > 0) ? size_max - 1 : size_max,
+			(props->cold->du_status != 0 && size_max > 0) ? size_max - 1 : size_max,
 			(intmax_t)size, df_c,
-			props->du_status != 0 ? DU_ERR_CHAR : 0);
+			props->cold->du_status != 0 ? DU_ERR_CHAR : 0);
 		return;
 	}
 
 	const int du_err = (props->dir == 1 && conf.full_dir_size == 1
-		&& props->du_status != 0);
+		&& props->cold->du_status != 0);
 	const char *unit_color = conf.colorize == 0
 		? (du_err == 1 ? "\x1b[1m" : "")
 		: (du_err == 1 ? xf_cb : dim_c);
 
 	snprintf(size_str, SIZE_STR_LEN, "%s%*s%s%c\x1b[0m%s",
 		csize, size_max,
-		*props->human_size.str ? props->human_size.str : UNKNOWN_STR,
-		unit_color, props->human_size.unit, df_c);
+		*props->cold->human_size.str ? props->cold->human_size.str : UNKNOWN_STR,
+		unit_color, props->cold->human_size.unit, df_c);
 }
 
 static void
@@ -288,7 +289,7 @@ get_time_char(void)
 static void
 construct_timestamp(char *time_str, const struct fileinfo *props)
 {
-	const time_t t = props->ltime;
+	const time_t t = props->cold->ltime;
 
 	/* Let's construct the color for the current timestamp. */
 	char *cdate = dd_c;
@@ -347,9 +348,9 @@ construct_id_field(const struct fileinfo *props, char *id_str,
 	const char *uid_color =
 		(file_perm == 1 && conf.colorize == 1) ? du_c : df_c;
 
-#define USER_NAME props->uid_i.name ? props->uid_i.name \
+#define USER_NAME props->cold->uid_i.name ? props->cold->uid_i.name \
 		: (props->stat_err == 1 ? UNKNOWN_STR : xitoa(props->uid))
-#define GROUP_NAME props->gid_i.name ? props->gid_i.name \
+#define GROUP_NAME props->cold->gid_i.name ? props->cold->gid_i.name \
 		: (props->stat_err == 1 ? UNKNOWN_STR : xitoa(props->gid))
 
 	if (prop_fields.no_group == 1) {
@@ -397,7 +398,10 @@ static void
 construct_files_counter(const struct fileinfo *props, char *fc_str,
 	const int max)
 {
-	if (props->filesn > 0) {
+	if (FC_CAPPED(props->filesn)) {
+		snprintf(fc_str, FC_STR_LEN, "%s%*d+%s", fc_c, max - 1,
+			conf.files_counter_max, df_c);
+	} else if (props->filesn > 0) {
 		snprintf(fc_str, FC_STR_LEN, "%s%*d%s", fc_c, max,
 			(int)props->filesn, df_c);
 	} else {
@@ -482,7 +486,7 @@ construct_blocks_str(const struct fileinfo *props, char *blk_str, const int max)
 	}
 
 	snprintf(blk_str, BLK_STR_LEN, "\x1b[0m%s%*jd%s",
-		db_c, max, (intmax_t)props->blocks, df_c);
+		db_c, max, (intmax_t)props->cold->blocks, df_c);
 }
 
 /* Compose the properties line for the current filename.
@@ -547,29 +551,29 @@ print_entry_props(const struct fileinfo *props, const struct maxes_t *maxes,
 	 * as a space, which is not what we want here. To fix this, let's
 	 * construct this char as a string. */
 	static char xattr_str[2] = {0};
-	*xattr_str = have_xattr == 1 ? (props->xattr == 1 ? XATTR_CHAR : ' ') : 0;
+	*xattr_str = have_xattr == 1 ? (props->cold->xattr == 1 ? XATTR_CHAR : ' ') : 0;
 
 	/* Print stuff */
 	for (size_t i = 0; i < PROP_FIELDS_SIZE && prop_fields_str[i]; i++) {
 		int print_space = prop_fields_str[i + 1] ? 1 : 0;
 
 		switch (prop_fields_str[i]) {
-		case 'B': if (*blocks_str) fputs(blocks_str, stdout); break;
-		case 'f': fputs(fc_str, stdout); break;
-		case 'd': if (*ino_str) fputs(ino_str, stdout); break;
+		case 'B': if (*blocks_str) frame_puts(blocks_str); break;
+		case 'f': frame_puts(fc_str); break;
+		case 'd': if (*ino_str) frame_puts(ino_str); break;
 		case 'p': /* fallthrough */
-		case 'n': fputs(perm_str, stdout);
-			if (*xattr_str) fputs(xattr_str, stdout);
+		case 'n': frame_puts(perm_str);
+			if (*xattr_str) frame_puts(xattr_str);
 			break;
 		case 'i': /* fallthrough */
-		case 'I': fputs(id_str, stdout); break;
-		case 'l': if (*links_str) fputs(links_str, stdout); break;
+		case 'I': frame_puts(id_str); break;
+		case 'l': if (*links_str) frame_puts(links_str); break;
 		case 'a': /* fallthrough */
 		case 'b': /* fallthrough */
 		case 'm': /* fallthrough */
-		case 'c': fputs(time_str, stdout); break;
+		case 'c': frame_puts(time_str); break;
 		case 's': /* fallthrough */
-		case 'S': fputs(size_str, stdout); break;
+		case 'S': frame_puts(size_str); break;
 		default: print_space = 0; break;
 		}
 
@@ -577,11 +581,11 @@ print_entry_props(const struct fileinfo *props, const struct maxes_t *maxes,
 			continue;
 
 		if (conf.prop_fields_gap <= 1)
-			putchar(' ');
+			frame_putchar(' ');
 		else
-			MOVE_CURSOR_RIGHT(conf.prop_fields_gap);
+			frame_printf("\x1b[%dC", conf.prop_fields_gap); /* CUF */
 	}
-	putchar('\n');
+	frame_putchar('\n');
 
 	return FUNC_SUCCESS;
 }
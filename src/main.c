@@ -91,8 +91,8 @@ struct ext_t *ext_colors = (struct ext_t *)NULL;
 #ifdef LINUX_FSINFO
 struct ext_mnt_t *ext_mnt = (struct ext_mnt_t *)NULL;
 #endif /* LINUX_FSINFO */
-struct groups_t *sys_users = (struct groups_t *)NULL;
-struct groups_t *sys_groups = (struct groups_t *)NULL;
+struct id_cache_t sys_users = {0};
+struct id_cache_t sys_groups = {0};
 struct dircmds_t dir_cmds = {UNSET, 0};
 struct pmsgs_t *messages = (struct pmsgs_t *)NULL;
 struct mime_t *user_mimetypes = (struct mime_t *)NULL;
@@ -212,6 +212,7 @@ size_t
 	cschemes_n = 0,
 	current_hist_n = 0,
 	curhistindex = 0,
+	dirlist_gen = 0,
 	ext_colors_n = 0,
 	jump_n = 0,
 	kbinds_n = 0,
@@ -236,6 +237,8 @@ size_t *dir_icons_hashes = (size_t *)0;
 size_t *ext_icons_hashes = (size_t *)0;
 #endif /* !_NO_ICONS */
 
+size_t bin_cmds_seg[BIN_CMD_SEGS + 1] = {0};
+
 char
 	cur_prompt_name[NAME_MAX + 1] = "",
 	div_line[NAME_MAX + 1],
@@ -925,6 +928,9 @@ unsigned int KQUEUE_FFLAGS = NOTE_DELETE | NOTE_EXTEND | NOTE_LINK
 struct timespec timeout;
 #elif defined(GENERIC_FS_MONITOR)
 time_t curdir_mtime = 0;
+time_t curdir_ctime = 0;
+size_t curdir_count = 0;
+size_t curdir_sum = 0;
 #endif /* LINUX_INOTIFY */
 
 #ifdef RUN_CMD
@@ -92,36 +92,183 @@ check_user_mimetypes(const char *file)
 	return (char *)NULL;
 }
 
+/* A cached MIME type. Entries are identified by device and inode number,
+ * and validated using modification time and size. */
+struct mime_cache_t {
+	char *mime;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+	int ref; /* Used since the clock hand last passed (see evict_mime_entry()) */
+};
+
+/* MIME_CACHE_SIZE must be a power of two. Once MIME_CACHE_MAX entries are
+ * in use, a single entry is evicted for each new one (CLOCK replacement),
+ * so that memory usage stays bounded. */
+#define MIME_CACHE_SIZE 8192
+#define MIME_CACHE_MAX  (MIME_CACHE_SIZE / 4 * 3)
+
+static struct mime_cache_t *mime_cache = (struct mime_cache_t *)NULL;
+static size_t mime_cache_n = 0;
+static size_t mime_cache_hand = 0;
+
+static inline size_t
+mime_cache_slot(const dev_t dev, const ino_t ino)
+{
+	return hash_devino(dev, ino) & (MIME_CACHE_SIZE - 1);
+}
+
+/* Return the cached MIME type for the file whose attributes are A, or NULL
+ * if not found. If found, but outdated, the entry is skipped (it will be
+ * updated in place by cache_mime()). */
+static const char *
+get_cached_mime(const struct stat *a)
+{
+	if (!mime_cache)
+		return (const char *)NULL;
+
+	size_t i = mime_cache_slot(a->st_dev, a->st_ino);
+	while (mime_cache[i].mime) {
+		struct mime_cache_t *e = &mime_cache[i];
+		if (e->dev == a->st_dev && e->ino == a->st_ino) {
+			if (e->mtime == a->st_mtime && e->size == a->st_size) {
+				e->ref = 1;
+				return e->mime;
+			}
+			return (const char *)NULL;
+		}
+		i = (i + 1) & (MIME_CACHE_SIZE - 1);
+	}
+
+	return (const char *)NULL;
+}
+
+/* Remove the entry in slot I. Since the table uses linear probing,
+ * entries following I in the same probe sequence are shifted back, so that
+ * they can still be found. */
+static void
+remove_mime_entry(size_t i)
+{
+	free(mime_cache[i].mime);
+
+	size_t j = i;
+	while (1) {
+		j = (j + 1) & (MIME_CACHE_SIZE - 1);
+		if (!mime_cache[j].mime)
+			break;
+
+		/* Leave the entry in place if its home slot is cyclically
+		 * in (I, J]. */
+		const size_t k = mime_cache_slot(mime_cache[j].dev, mime_cache[j].ino);
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		mime_cache[i] = mime_cache[j];
+		i = j;
+	}
+
+	memset(&mime_cache[i], 0, sizeof(struct mime_cache_t));
+	mime_cache_n--;
+}
+
+/* Evict one entry using the CLOCK algorithm: entries used since the hand
+ * last passed get a second chance. */
+static void
+evict_mime_entry(void)
+{
+	while (1) {
+		struct mime_cache_t *e = &mime_cache[mime_cache_hand];
+		if (e->mime) {
+			if (e->ref == 0) {
+				/* The slot may be refilled by a shifted entry: the hand
+				 * stays here, so that it is checked next time. */
+				remove_mime_entry(mime_cache_hand);
+				return;
+			}
+			e->ref = 0;
+		}
+		mime_cache_hand = (mime_cache_hand + 1) & (MIME_CACHE_SIZE - 1);
+	}
+}
+
+/* Store the MIME type MIME for the file whose attributes are A. */
+static void
+cache_mime(const struct stat *a, const char *mime)
+{
+	if (!mime_cache)
+		mime_cache = xcalloc(MIME_CACHE_SIZE, sizeof(struct mime_cache_t));
+
+	size_t i = mime_cache_slot(a->st_dev, a->st_ino);
+	while (mime_cache[i].mime) {
+		if (mime_cache[i].dev == a->st_dev && mime_cache[i].ino == a->st_ino)
+			break;
+		i = (i + 1) & (MIME_CACHE_SIZE - 1);
+	}
+
+	if (!mime_cache[i].mime && mime_cache_n >= MIME_CACHE_MAX) {
+		/* Eviction may shift entries around: look for a free slot again. */
+		evict_mime_entry();
+		i = mime_cache_slot(a->st_dev, a->st_ino);
+		while (mime_cache[i].mime)
+			i = (i + 1) & (MIME_CACHE_SIZE - 1);
+	}
+
+	struct mime_cache_t *e = &mime_cache[i];
+	if (e->mime)
+		free(e->mime);
+	else
+		mime_cache_n++;
+
+	e->mime = savestring(mime, strlen(mime));
+	e->dev = a->st_dev;
+	e->ino = a->st_ino;
+	e->mtime = a->st_mtime;
+	e->size = a->st_size;
+	e->ref = 1;
+}
+
 #ifndef _NO_MAGIC
+/* Magic cookies are opened (and the magic database loaded) only once, and
+ * kept open until the program exits. */
+static magic_t magic_cookies[2] = {NULL, NULL};
+
+void
+close_magic_cookies(void)
+{
+	for (size_t i = 0; i < 2; i++) {
+		if (magic_cookies[i]) {
+			magic_close(magic_cookies[i]);
+			magic_cookies[i] = (magic_t)NULL;
+		}
+	}
+}
+
 /* Get FILE's type using the libmagic library.
  * Return the MIME type if QUERY_MIME is set to 1, or a text description
  * otherwise.
  * NULL is returned in case of error. */
-char *
-xmagic(const char *file, const int query_mime)
+static char *
+get_magic(const char *file, const int query_mime)
 {
-	if (!file || !*file)
-		return (char *)NULL;
-
-	if (query_mime == 1 && user_mimetypes) {
-		const char *mime = check_user_mimetypes(file);
-		if (mime)
-			return strdup(mime);
-	}
+	magic_t *cookie = &magic_cookies[query_mime == 1];
 
-	magic_t cookie = magic_open(query_mime ? (MAGIC_MIME_TYPE | MAGIC_ERROR)
-		: MAGIC_ERROR);
-	if (!cookie)
-		return (char *)NULL;
-
-	magic_load(cookie, NULL);
+	if (!*cookie) {
+		*cookie = magic_open(query_mime ? (MAGIC_MIME_TYPE | MAGIC_ERROR)
+			: MAGIC_ERROR);
+		if (!*cookie)
+			return (char *)NULL;
 
-	const char *mime = magic_file(cookie, file);
+		if (magic_load(*cookie, NULL) == -1) {
+			magic_close(*cookie);
+			*cookie = (magic_t)NULL;
+			return (char *)NULL;
+		}
+	}
 
-	char *str = mime ? savestring(mime, strlen(mime)) : (char *)NULL;
-	magic_close(cookie);
+	const char *mime = magic_file(*cookie, file);
 
-	return str;
+	return mime ? savestring(mime, strlen(mime)) : (char *)NULL;
 }
 
 #else /* _NO_MAGIC */
@@ -129,19 +276,9 @@ xmagic(const char *file, const int query_mime)
  * Return the MIME type if QUERY_MIME is set to 1, or a text description
  * otherwise.
  * NULL is returned in case of error. */
-char *
-xmagic(const char *file, const int query_mime)
+static char *
+get_magic(const char *file, const int query_mime)
 {
-	if (!file || !*file)
-		return (char *)NULL;
-
-	if (query_mime == 1 && user_mimetypes
-	&& user_mimetypes[0].ext_hash != (size_t)-1) {
-		const char *mime = check_user_mimetypes(file);
-		if (mime)
-			return strdup(mime);
-	}
-
 	char *mime_type = (char *)NULL;
 	char *rand_ext = gen_rand_str(RAND_SUFFIX_LEN);
 
@@ -234,6 +371,60 @@ ERROR:
 }
 #endif /* !_NO_MAGIC */
 
+/* Free the MIME cache and close magic cookies. */
+void
+free_mime_cache(void)
+{
+#ifndef _NO_MAGIC
+	close_magic_cookies();
+#endif /* !_NO_MAGIC */
+
+	if (!mime_cache)
+		return;
+
+	for (size_t i = 0; i < MIME_CACHE_SIZE; i++)
+		free(mime_cache[i].mime);
+
+	free(mime_cache);
+	mime_cache = (struct mime_cache_t *)NULL;
+	mime_cache_n = 0;
+	mime_cache_hand = 0;
+}
+
+/* Get FILE's type.
+ * Return the MIME type if QUERY_MIME is set to 1, or a text description
+ * otherwise.
+ * MIME types are cached (see get_cached_mime()), so that querying the same
+ * file again costs no more than a lstat(2) call.
+ * NULL is returned in case of error. */
+char *
+xmagic(const char *file, const int query_mime)
+{
+	if (!file || !*file)
+		return (char *)NULL;
+
+	if (query_mime == 1 && user_mimetypes
+	&& user_mimetypes[0].ext_hash != (size_t)-1) {
+		const char *mime = check_user_mimetypes(file);
+		if (mime)
+			return strdup(mime);
+	}
+
+	struct stat a;
+	if (query_mime != 1 || lstat(file, &a) == -1)
+		return get_magic(file, query_mime);
+
+	const char *cached = get_cached_mime(&a);
+	if (cached)
+		return savestring(cached, strlen(cached));
+
+	char *mime = get_magic(file, query_mime);
+	if (mime)
+		cache_mime(&a, mime);
+
+	return mime;
+}
+
 #ifndef _NO_LIRA
 /* Expand all environment variables in the string S.
  * Returns the expanded string or NULL on error. */
@@ -27,6 +27,10 @@
 
 __BEGIN_DECLS
 
+#ifndef _NO_MAGIC
+void close_magic_cookies(void);
+#endif /* !_NO_MAGIC */
+void free_mime_cache(void);
 int  mime_open(char **args);
 int  mime_open_url(char *url);
 int  mime_open_with(char *filename, char **args);
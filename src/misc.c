@@ -62,16 +62,24 @@ typedef char *rl_cpvfunc_t;
 #include "autocmds.h" /* update_autocmd_opts() */
 #include "bookmarks.h"
 #include "checks.h"
+#include "colors.h" /* free_ext_color_seqs() */
 #include "file_operations.h"
 #include "history.h"
 #include "init.h"
 #include "jump.h"
 #include "listing.h"
 #include "messages.h"
+#include "mime.h" /* free_mime_cache() */
 #include "navigation.h"
 #include "readline.h"
 #include "remotes.h"
+#include "selection.h" /* free_sel_index() */
 #include "spawn.h"
+#ifndef _NO_SUGGESTIONS
+# include "suggestions.h" /* free_fuzzy_memo() */
+#endif /* !_NO_SUGGESTIONS */
+#include "trash.h" /* free_trash_index() */
+#include "xdu.h" /* free_dir_size_cache(), invalidate_dir_size_cache() */
 
 char *
 gen_diff_str(const int diff)
@@ -318,11 +326,23 @@ print_reload_msg(const char *ptr, const char *color, const char *msg, ...)
 }
 
 #ifdef LINUX_INOTIFY
+/* The directory being watched (the one in which events happened when the
+ * watch is reset: the current directory might have changed already). */
+static char inotify_dir[PATH_MAX + 1] = "";
+
 void
 reset_inotify(void)
 {
 	watch = 0;
 
+	/* Events not read yet are discarded along with the old watch, but the
+	 * directory sizes cache must still know that the directory changed. */
+	if (inotify_fd != UNSET && inotify_wd >= 0 && *inotify_dir) {
+		char buf[EVENT_BUF_LEN];
+		if (read(inotify_fd, buf, sizeof(buf)) > 0) /* flawfinder: ignore */
+			invalidate_dir_size_cache(inotify_dir);
+	}
+
 	if (inotify_wd >= 0) {
 		inotify_rm_watch(inotify_fd, inotify_wd);
 		inotify_wd = -1;
@@ -342,20 +362,143 @@ reset_inotify(void)
 	char rpath[PATH_MAX + 1];
 	snprintf(rpath, sizeof(rpath), "%s/", workspaces[cur_ws].path);
 
-	inotify_wd = inotify_add_watch(inotify_fd, rpath, INOTIFY_MASK);
-	if (inotify_wd > 0)
+	/* Files modified in place do not update the modification time of the
+	 * current directory: watch them as well to keep the directory sizes
+	 * cache up to date (see invalidate_dir_size_cache()). */
+	unsigned int mask = (conf.full_dir_size == 1
+		&& conf.dir_size_cache == 1) ? (INOTIFY_MASK | IN_CLOSE_WRITE)
+		: INOTIFY_MASK;
+	/* Incremental updates are cheap: reflect attribute changes as well. */
+	if (conf.incremental_refresh == 1)
+		mask |= IN_ATTRIB;
+
+	inotify_wd = inotify_add_watch(inotify_fd, rpath, mask);
+	if (inotify_wd > 0) {
 		watch = 1;
+		xstrsncpy(inotify_dir, workspaces[cur_ws].path, sizeof(inotify_dir));
+	}
 	else
 		err('w', PRINT_PROMPT, "%s: inotify: '%s': %s\n",
 			PROGRAM_NAME, rpath, strerror(errno));
 }
 
+/* Maximum number of distinct filenames applied incrementally to the file
+ * list in one go. Above this, we just reload the whole list. */
+#define INOTIFY_MAX_NAMES 256
+
+struct inotify_name_t {
+	char *name;
+	size_t hash;
+	int existed; /* See update_dirlist() */
+	int pad0;
+};
+
+/* Collect the names of the files affected by the pending inotify events,
+ * and apply the changes to the current file list via update_dirlist().
+ * Fall back to a full reload if the event queue overflowed, the current
+ * directory itself was removed or moved, or too many files changed. */
+static void
+read_inotify_incremental(void)
+{
+	union {
+		struct inotify_event event;
+		char buf[EVENT_SIZE * 256];
+	} inotify_buf;
+
+	struct inotify_name_t *names = (struct inotify_name_t *)NULL;
+	size_t n = 0;
+	int full_reload = 0;
+	int got_events = 0;
+	ssize_t len;
+
+	/* The file descriptor is non-blocking: read until the queue is empty. */
+	while ((len = read(inotify_fd, inotify_buf.buf, /* flawfinder: ignore */
+	sizeof(inotify_buf.buf))) > 0) {
+		got_events = 1;
+		const struct inotify_event *event;
+
+		for (char *ptr = inotify_buf.buf; ptr < inotify_buf.buf + len;
+		ptr += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *)ptr;
+
+			if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF
+			| IN_IGNORED)) {
+				full_reload = 1;
+				continue;
+			}
+
+			if (full_reload == 1 || event->len == 0 || !*event->name
+			|| !(event->mask & (INOTIFY_MASK | IN_ATTRIB)))
+				continue;
+
+			const size_t hash = hashme(event->name, 1);
+			size_t i;
+			for (i = 0; i < n; i++) {
+				if (names[i].hash == hash
+				&& strcmp(names[i].name, event->name) == 0)
+					break;
+			}
+
+			if (i < n) /* Already collected */
+				continue;
+
+			if (n == INOTIFY_MAX_NAMES) {
+				full_reload = 1;
+				continue;
+			}
+
+			if (!names)
+				names = xnmalloc(INOTIFY_MAX_NAMES, sizeof(struct inotify_name_t));
+
+			names[n].name = savestring(event->name, strlen(event->name));
+			names[n].hash = hash;
+			/* The first event tells whether the file existed before. */
+			names[n].existed = (event->mask & IN_CREATE) ? 0
+				: ((event->mask & IN_MOVED_TO) ? -1 : 1);
+			n++;
+		}
+	}
+
+	if (got_events == 0)
+		return;
+
+	invalidate_dir_size_cache(inotify_dir);
+
+	if (exit_code != FUNC_SUCCESS) {
+		reset_inotify();
+	} else if (full_reload == 1) {
+		reload_dirlist();
+	} else if (n > 0) {
+		char **list = xnmalloc(n, sizeof(char *));
+		int *existed = xnmalloc(n, sizeof(int));
+		for (size_t i = 0; i < n; i++) {
+			list[i] = names[i].name;
+			existed[i] = names[i].existed;
+		}
+
+		if (update_dirlist(list, existed, n) != FUNC_SUCCESS)
+			reload_dirlist();
+
+		free(list);
+		free(existed);
+	}
+
+	for (size_t i = 0; i < n; i++)
+		free(names[i].name);
+	free(names);
+}
+
 void
 read_inotify(void)
 {
 	if (inotify_fd == UNSET)
 		return;
 
+	if (conf.incremental_refresh == 1) {
+		read_inotify_incremental();
+		return;
+	}
+
 	int i;
 	struct inotify_event *event;
 	char inotify_buf[EVENT_BUF_LEN];
@@ -428,6 +571,11 @@ read_inotify(void)
 				ignore_event = 1;
 		}
 
+# ifdef INOTIFY_DEBUG
+		if (event->mask & IN_CLOSE_WRITE)
+			puts("IN_CLOSE_WRITE");
+# endif /* INOTIFY_DEBUG */
+
 # ifdef INOTIFY_DEBUG
 		if (event->mask & IN_DELETE_SELF)
 			puts("IN_DELETE_SELF");
@@ -445,6 +593,9 @@ read_inotify(void)
 			refresh = 1;
 	}
 
+	/* Whatever happened, the size of the current directory changed. */
+	invalidate_dir_size_cache(inotify_dir);
+
 	if (refresh == 1 && exit_code == FUNC_SUCCESS) {
 # ifdef INOTIFY_DEBUG
 		puts("INOTIFY_REFRESH");
@@ -985,12 +1136,7 @@ alias_import(char *file)
 	get_aliases();
 
 	/* Add new aliases to the commands list for tab completion. */
-	if (bin_commands) {
-		for (i = 0; bin_commands[i]; i++)
-			free(bin_commands[i]);
-		free(bin_commands);
-		bin_commands = (char **)NULL;
-	}
+	free_bin_commands();
 	get_path_programs();
 
 	return FUNC_SUCCESS;
@@ -1392,16 +1538,13 @@ free_stuff(void)
 		free(user_mimetypes);
 	}
 
-	if (sys_users) {
-		for (i = 0; sys_users[i].name; i++)
-			free(sys_users[i].name);
-		free(sys_users);
-	}
-	if (sys_groups) {
-		for (i = 0; sys_groups[i].name; i++)
-			free(sys_groups[i].name);
-		free(sys_groups);
-	}
+	size_t j;
+	for (j = 0; j < sys_users.size; j++)
+		free(sys_users.ents[j].name);
+	free(sys_users.ents);
+	for (j = 0; j < sys_groups.size; j++)
+		free(sys_groups.ents[j].name);
+	free(sys_groups.ents);
 
 #ifdef LINUX_FSINFO
 	if (ext_mnt) {
@@ -1444,6 +1587,8 @@ free_stuff(void)
 	free_tags();
 	free_remotes(1);
 	free_file_templates();
+	free_mime_cache();
+	free_dir_size_cache();
 
 	if (xargs.stealth_mode != 1)
 		save_jumpdb();
@@ -1453,6 +1598,10 @@ free_stuff(void)
 	free_bookmarks();
 	free(conf.encoded_prompt);
 	free_dirlist();
+	free_list_arena();
+#ifndef _NO_SUGGESTIONS
+	free_fuzzy_memo();
+#endif /* !_NO_SUGGESTIONS */
 	free(conf.opener);
 	free(conf.rprompt_str);
 	free(conf.wprompt_str);
@@ -1473,6 +1622,7 @@ free_stuff(void)
 			free(jump_db[i].path);
 		free(jump_db);
 	}
+	free_jump_index();
 
 	free(pinned_dir);
 
@@ -1507,13 +1657,9 @@ free_stuff(void)
 		free(sel_elements);
 	}
 	free(sel_devino);
+	free_sel_index();
 
-	if (bin_commands) {
-		i = (int)path_progsn;
-		while (--i >= 0)
-			free(bin_commands[i]);
-		free(bin_commands);
-	}
+	free_bin_commands();
 
 	if (paths) {
 		i = (int)path_n;
@@ -1591,6 +1737,7 @@ free_stuff(void)
 		}
 		free(ext_colors);
 	}
+	free_ext_color_seqs();
 
 	if (workspaces && workspaces[0].path) {
 		i = MAX_WS;
@@ -1601,6 +1748,9 @@ free_stuff(void)
 		free(workspaces);
 	}
 
+	/* Write pending history and log entries before freeing file names */
+	close_history_journals();
+
 	free(actions_file);
 	free(bm_file);
 	free(data_dir);
@@ -1637,6 +1787,7 @@ free_stuff(void)
 	free(user.groups);
 
 #ifndef _NO_TRASH
+	free_trash_index();
 	free(trash_dir);
 	free(trash_files_dir);
 	free(trash_info_dir);
@@ -173,6 +173,9 @@ profile_set(const char *prof)
 	}
 	cur_ws = UNSET;
 
+	/* Pending history and log entries belong to the current profile */
+	flush_history_journals();
+
 	/* Reset everything */
 	reload_config();
 
@@ -222,12 +225,7 @@ profile_set(const char *prof)
 	load_actions();
 
 	/* Reload PATH commands (actions are profile specific) */
-	if (bin_commands) {
-		for (i = 0; bin_commands[i]; i++)
-			free(bin_commands[i]);
-		free(bin_commands);
-		bin_commands = (char **)NULL;
-	}
+	free_bin_commands();
 
 	if (paths) {
 		i = (int)path_n;
@@ -54,6 +54,7 @@
 #ifndef _NO_SUGGESTIONS
 # include "suggestions.h"
 #endif /* !_NO_SUGGESTIONS */
+#include "trash.h" /* get_trash_index_count() */
 
 #if defined(__HAIKU__) || defined(__OpenBSD__) || defined(__ANDROID__)
 # define NO_WORDEXP
@@ -1318,6 +1319,10 @@ update_trash_indicator(void)
 
 	trash_files_dir_mtime = a.st_mtime;
 
+	/* Avoid counting files if the trash index is up to date. */
+	if (get_trash_index_count(&a, &trash_n) == 1)
+		return;
+
 	const filesn_t n = count_dir(trash_files_dir, NO_CPOP);
 	trash_n = n <= 2 ? 0 : (size_t)n - 2;
 }
@@ -1693,6 +1698,10 @@ prompt(const int prompt_flag, const int screen_refresh)
 
 	UNHIDE_CURSOR;
 
+	/* Do not leave history and log entries pending while waiting for
+	 * user input. */
+	flush_history_journals();
+
 	/* Print the prompt and get user input */
 	char *input = readline(the_prompt);
 	free(the_prompt);
@@ -38,6 +38,7 @@
 #include <errno.h>
 #include <pwd.h>
 #include <grp.h> /* Needed by groups_generator(): getgrent(3) */
+#include <poll.h>
 
 #ifdef __OpenBSD__
 typedef char *rl_cpvfunc_t;
@@ -53,9 +54,12 @@ typedef char *rl_cpvfunc_t;
 #ifndef _NO_HIGHLIGHT
 # include "highlight.h"
 #endif /* !_NO_HIGHLIGHT */
+#include "init.h" /* load_path_programs() */
 #include "keybinds.h"
+#include "listing.h" /* files_counter_fd(), update_files_counters() */
 #include "mime.h" /* xmagic() */
 #include "navigation.h"
+#include "prompt.h"
 #include "readline.h"
 #include "sort.h" /* compare_strings() */
 #include "spawn.h"
@@ -524,6 +528,40 @@ fix_rl_point(const unsigned char c)
 	rl_point += mlen > 0 ? mlen - 1 : 0;
 }
 
+/* Wait until there is input available in FD. Meanwhile, apply the files
+ * counters computed in the background (see count_dirs_files() in
+ * listing.c), and print the prompt again if the list of files was
+ * printed again. */
+static void
+wait_for_input(const int fd)
+{
+	int cfd;
+	while ((cfd = files_counter_fd()) != -1) {
+		struct pollfd pfd[2] = {{fd, POLLIN, 0}, {cfd, POLLIN, 0}};
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+
+		if (pfd[0].revents != 0)
+			return;
+
+		if (update_files_counters() == 0)
+			continue;
+
+		prompt(PROMPT_UPDATE, PROMPT_NO_SCREEN_REFRESH);
+		rl_reset_line_state();
+		rl_redisplay();
+#ifndef _NO_SUGGESTIONS
+		if (suggestion.printed == 1 && suggestion_buf)
+			clear_suggestion(CS_FREEBUF);
+#endif /* !_NO_SUGGESTIONS */
+		UNHIDE_CURSOR;
+		fflush(stdout);
+	}
+}
+
 /* Custom implementation of readline's rl_getc() hacked to introduce
  * suggestions, alternative tab completion, and syntax highlighting.
  * This function is automatically called by readline() to handle input. */
@@ -538,6 +576,7 @@ my_rl_getc(FILE *stream)
 		prompt_offset = get_prompt_offset(rl_prompt);
 
 	while (1) {
+		wait_for_input(fileno(stream));
 		result = (int)read(fileno(stream), &c, sizeof(unsigned char)); /* flawfinder: ignore */
 		if (result == sizeof(unsigned char)) {
 			/* Ctrl+d (empty command line only). Let's check that the previous
@@ -1993,6 +2032,7 @@ bin_cmd_generator_ext(const char *text, int state)
 	char *name;
 
 	if (!state) {
+		load_path_programs(1);
 		i = 0;
 		len = strlen(text);
 	}
@@ -2020,6 +2060,7 @@ bin_cmd_generator(const char *text, int state)
 	char *name;
 
 	if (!state) {
+		load_path_programs(1);
 		i = 0;
 		len = strlen(text);
 	}
@@ -531,8 +531,8 @@ print_glob_matches(struct search_t *matches, const char *search_path)
 
 			printf("%s%*d%s%s%c%s%s%s%s%c", el_c, eln_pad, matches[i].eln, df_c,
 				ind_chr_color, ind_chr, df_c,
-				conf.icons == 1 ? file_info[index].icon_color : "",
-				conf.icons == 1 ? file_info[index].icon : "",
+				conf.icons == 1 ? file_info[index].cold->icon_color : "",
+				conf.icons == 1 ? file_info[index].cold->icon : "",
 				df_c, conf.icons == 1 ? ' ' : 0);
 		}
 
@@ -812,8 +812,8 @@ print_regex_entry(struct search_t list, const int namepad, const int elnpad,
 
 		printf("%s%*d%s%s%c%s%s%s%s%c", el_c, elnpad,
 			list.eln, df_c, ind_chr_color, ind_chr, df_c,
-			conf.icons == 1 ? file_info[index].icon_color : "",
-			conf.icons == 1 ? file_info[index].icon : "",
+			conf.icons == 1 ? file_info[index].cold->icon_color : "",
+			conf.icons == 1 ? file_info[index].cold->icon : "",
 			df_c, conf.icons == 1 ? ' ' : 0);
 	}
 
@@ -56,6 +56,145 @@
 #include "sort.h"
 #include "xdu.h" /* dir_size() */
 
+/* Hash sets indexing the Selection Box: one by path (sel_elements) and
+ * another one by device and inode number (sel_devino).
+ * Both are open addressing tables whose slots hold an index into the
+ * corresponding array plus one (zero meaning empty slot). Since the arrays
+ * may be modified elsewhere (e.g. 'tr sel'), every index is validated on
+ * lookup: a stale slot never produces a false positive. */
+static size_t *sel_path_idx = (size_t *)NULL;
+static size_t sel_path_cap = 0;  /* Always a power of two */
+static size_t sel_path_used = 0; /* Used slots (including stale ones) */
+
+static size_t *sel_devino_idx = (size_t *)NULL;
+static size_t sel_devino_cap = 0;
+
+#define SEL_IDX_MIN_CAP 64
+
+static inline size_t
+sel_idx_capacity(const size_t n)
+{
+	size_t cap = SEL_IDX_MIN_CAP;
+	while (cap < n * 2)
+		cap <<= 1;
+	return cap;
+}
+
+static void
+sel_path_idx_add(const size_t index)
+{
+	size_t i = hashme(sel_elements[index].name, 1) & (sel_path_cap - 1);
+	while (sel_path_idx[i] != 0)
+		i = (i + 1) & (sel_path_cap - 1);
+
+	sel_path_idx[i] = index + 1;
+	sel_path_used++;
+}
+
+/* Rebuild both Selection Box indices from scratch. */
+void
+index_sel_files(void)
+{
+	size_t i;
+	const size_t cap = sel_idx_capacity(sel_n);
+
+	if (cap != sel_path_cap) {
+		free(sel_path_idx);
+		sel_path_idx = xnmalloc(cap, sizeof(size_t));
+		sel_path_cap = cap;
+	}
+	memset(sel_path_idx, 0, cap * sizeof(size_t));
+	sel_path_used = 0;
+
+	for (i = 0; i < sel_n; i++)
+		sel_path_idx_add(i);
+
+	if (cap != sel_devino_cap) {
+		free(sel_devino_idx);
+		sel_devino_idx = xnmalloc(cap, sizeof(size_t));
+		sel_devino_cap = cap;
+	}
+	memset(sel_devino_idx, 0, cap * sizeof(size_t));
+
+	if (!sel_devino)
+		return;
+
+	for (i = 0; i < sel_n; i++) {
+		if (sel_devino[i].ino == 0 && sel_devino[i].dev == 0)
+			continue; /* Cannot stat file */
+
+		size_t j = hash_devino(sel_devino[i].dev, sel_devino[i].ino)
+			& (cap - 1);
+		while (sel_devino_idx[j] != 0)
+			j = (j + 1) & (cap - 1);
+		sel_devino_idx[j] = i + 1;
+	}
+}
+
+void
+free_sel_index(void)
+{
+	free(sel_path_idx);
+	sel_path_idx = (size_t *)NULL;
+	sel_path_cap = sel_path_used = 0;
+
+	free(sel_devino_idx);
+	sel_devino_idx = (size_t *)NULL;
+	sel_devino_cap = 0;
+}
+
+/* Return the index of the file whose path is PATH in the sel_elements
+ * array, or -1 if the file is not selected. */
+static filesn_t
+get_sel_index(const char *path)
+{
+	if (!sel_path_idx || sel_n == 0)
+		return (-1);
+
+	size_t i = hashme(path, 1) & (sel_path_cap - 1);
+	while (sel_path_idx[i] != 0) {
+		const size_t n = sel_path_idx[i] - 1;
+		if (n < sel_n && sel_elements[n].name
+		&& *sel_elements[n].name == *path
+		&& strcmp(sel_elements[n].name, path) == 0)
+			return (filesn_t)n;
+		i = (i + 1) & (sel_path_cap - 1);
+	}
+
+	return (-1);
+}
+
+/* Return 1 if the file in the device DEV with inode INO is selected, or
+ * zero otherwise. If NAME is not NULL (hardlinks), the basename of the
+ * selected file must also match NAME. */
+int
+is_sel_devino(const dev_t dev, const ino_t ino, const char *name)
+{
+	if (!sel_devino_idx || sel_n == 0 || !sel_devino)
+		return 0;
+
+	size_t i = hash_devino(dev, ino) & (sel_devino_cap - 1);
+	while (sel_devino_idx[i] != 0) {
+		const size_t n = sel_devino_idx[i] - 1;
+		i = (i + 1) & (sel_devino_cap - 1);
+
+		if (n >= sel_n || sel_devino[n].dev != dev || sel_devino[n].ino != ino)
+			continue;
+
+		if (!name)
+			return 1;
+
+		const char *p = sel_elements[n].name
+			? strrchr(sel_elements[n].name, '/') : (char *)NULL;
+		if (!p || !*(++p))
+			continue;
+		if (*p == *name && strcmp(p, name) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
 /* Save selected elements into a tmp file. Returns 1 on success or 0
  * on error. This function allows the user to work with multiple
  * instances of the program: they can select some files in the
@@ -126,20 +265,24 @@ select_file(char *file)
 	}
 
 	/* Check if FILE is already in the selection box */
-	filesn_t j = (filesn_t)sel_n;
-	while (--j >= 0) {
-		if (*tfile == *sel_elements[j].name
-		&& strcmp(sel_elements[j].name, tfile) == 0) {
-			exists = 1;
-			break;
-		}
-	}
+	if (!sel_path_idx)
+		index_sel_files();
+	exists = (get_sel_index(tfile) != -1);
 
 	if (exists == 0) {
 		sel_elements = xnrealloc(sel_elements, sel_n + 2, sizeof(struct sel_t));
 		sel_elements[sel_n].name = savestring(tfile, strlen(tfile));
 		sel_elements[sel_n].size = (off_t)UNSET;
-		sel_n++;
+
+		/* Keep the load factor of the path index under 3/4 */
+		if ((sel_path_used + 1) * 4 >= sel_path_cap * 3) {
+			sel_n++;
+			index_sel_files();
+		} else {
+			sel_path_idx_add(sel_n);
+			sel_n++;
+		}
+
 		sel_elements[sel_n].name = (char *)NULL;
 		sel_elements[sel_n].size = (off_t)UNSET;
 
@@ -969,24 +1112,17 @@ deselect_entries(char **desel_path, const size_t desel_n, int *error,
 	const int desel_screen)
 {
 	int dn = (int)desel_n;
-	int i = (int)desel_n;
+	size_t i;
 
-	while (--i >= 0) {
-		int j, k, desel_index = -1;
+	if (!sel_path_idx)
+		index_sel_files();
 
+	/* Free (and mark as NULL) the deselected entries in the sel array. */
+	for (i = 0; i < desel_n; i++) {
 		if (!desel_path[i])
 			continue;
 
-		/* Search the sel array for the path of the entry to be deselected and
-		 * store its index. */
-		k = (int)sel_n;
-		while (--k >= 0) {
-			if (strcmp(sel_elements[k].name, desel_path[i]) == 0) {
-				desel_index = k;
-				break;
-			}
-		}
-
+		const filesn_t desel_index = get_sel_index(desel_path[i]);
 		if (desel_index == -1) {
 			dn--;
 			*error = 1;
@@ -997,29 +1133,27 @@ deselect_entries(char **desel_path, const size_t desel_n, int *error,
 			continue;
 		}
 
-		/* Once the index was found, rearrange the sel array removing the
-		 * deselected element (actually, moving each string after it to
-		 * the previous position). */
-		for (j = desel_index; j < (int)(sel_n - 1); j++) {
-			const size_t len = strlen(sel_elements[j + 1].name);
-			sel_elements[j].name =
-				xnrealloc(sel_elements[j].name, len + 1, sizeof(char));
+		free(sel_elements[desel_index].name);
+		sel_elements[desel_index].name = (char *)NULL;
+	}
 
-			xstrsncpy(sel_elements[j].name, sel_elements[j + 1].name, len + 1);
-			sel_elements[j].size = sel_elements[j + 1].size;
+	/* Now compact the array in a single pass, preserving the order of
+	 * remaining entries. */
+	size_t j = 0;
+	for (i = 0; i < sel_n; i++) {
+		if (!sel_elements[i].name)
+			continue;
+		if (i != j) {
+			sel_elements[j] = sel_elements[i];
+			if (sel_devino)
+				sel_devino[j] = sel_devino[i];
 		}
+		j++;
 	}
 
-	/* Free the last DN entries from the old sel array. They won't
-	 * be used anymore, since they contain the same value as the last
-	 * non-deselected element due to the above array rearrangement. */
-	for (i = 1; i <= dn; i++) {
-		const int sel_index = (int)sel_n - i;
-
-		if (sel_index >= 0 && sel_elements[sel_index].name) {
-			free(sel_elements[sel_index].name);
-			sel_elements[sel_index].size = (off_t)UNSET;
-		}
+	for (i = j; i < sel_n; i++) {
+		sel_elements[i].name = (char *)NULL;
+		sel_elements[i].size = (off_t)UNSET;
 	}
 
 	return dn;
@@ -1060,6 +1194,8 @@ desel_entries(char **desel_elements, const size_t desel_n, const int desel_scree
 	if (sel_n > 0)
 		sel_elements = xnrealloc(sel_elements, sel_n, sizeof(struct sel_t));
 
+	index_sel_files();
+
 	/* Deallocate local arrays. */
 	i = (int)desel_n;
 	while (--i >= 0) {
@@ -1096,6 +1232,7 @@ deselect_all(void)
 	}
 
 	sel_n = 0;
+	index_sel_files();
 
 	return save_sel();
 }
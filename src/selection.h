@@ -33,6 +33,9 @@
 __BEGIN_DECLS
 
 int  deselect(char **args);
+void free_sel_index(void);
+void index_sel_files(void);
+int  is_sel_devino(const dev_t dev, const ino_t ino, const char *name);
 void list_selected_files(void);
 int  sel_function(char **args);
 int  select_file(char *file);
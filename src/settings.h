@@ -512,9 +512,11 @@ ws2=31:ws3=38;5;228:ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_QUOTING_STYLE QUOTING_STYLE_BACKSLASH
 #define DEF_EXT_CMD_OK 1
 #define DEF_FILES_COUNTER 1
+#define DEF_FILES_COUNTER_MAX 0 /* No limit */
 #define DEF_FOLLOW_SYMLINKS 1
 #define DEF_FOLLOW_SYMLINKS_LONG 0
 #define DEF_FULL_DIR_SIZE 0
+#define DEF_DIR_SIZE_CACHE 0
 #define DEF_FUZZY_MATCH 0
 #define DEF_FUZZY_MATCH_ALGO 2 /* 1 or 2. 2 is Unicode aware, but slower than 1 */
 #define DEF_FZF_WIN_HEIGHT 40 /* Max screen percentage taken by FZF */
@@ -533,6 +535,8 @@ ws2=31:ws3=38;5;228:ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_LISTING_MODE VERTLIST
 #define DEF_LOG_MSGS 0
 #define DEF_LOG_CMDS 0
+#define DEF_LOG_FLUSH_COUNT 16
+#define DEF_LOG_FLUSH_INTERVAL 5 /* Seconds */
 #define DEF_LONG_VIEW 0
 #define DEF_MAX_DIRHIST 100
 #define DEF_MAX_FILES UNSET
@@ -550,6 +554,8 @@ ws2=31:ws3=38;5;228:ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_PAGER 0
 /* Possible values: PAGER_AUTO, PAGER_LONG, and PAGER_SHORT */
 #define DEF_PAGER_VIEW PAGER_AUTO
+#define DEF_PARALLEL_STAT 0
+#define DEF_INCREMENTAL_REFRESH 0
 #define DEF_PREVIEW_MAX_SIZE -1 /* Max size in KiB. -1 == unlimited */
 #define DEF_PRINT_DIR_CMDS 0
 #define DEF_PRINTSEL 0
@@ -24,6 +24,8 @@
 
 #include "helpers.h"
 
+#include <locale.h> /* setlocale() */
+#include <stdint.h> /* uint64_t */
 #include <string.h>
 #include <unistd.h>
 #include <strings.h> /* str(n)casecmp() */
@@ -34,9 +36,45 @@
 #include "listing.h"
 #include "messages.h" /* SORT_USAGE */
 
+#if defined(TOURBIN_QSORT)
+# include "qsort.h"
+#endif /* TOURBIN_QSORT */
+
 #define F_SORT(a, b)      ((a) == (b) ? 0 : ((a) > (b) ? 1 : -1))
 #define F_SORT_DIRS(a, b) ((a) == (b) ? 0 : ((a) < (b) ? 1 : -1))
 
+/* Precompute sort keys only for lists larger than this */
+#define SORT_KEYS_MIN 32
+/* Use a radix sort for integer sort methods only for lists larger than this */
+#define RADIX_SORT_MIN 256
+
+/* An entry in the index array used to sort the list of files (see
+ * sort_entries()). */
+struct sort_idx_t {
+	uint64_t key;   /* Integer sort key (radix sort only) */
+	size_t idx;     /* Index of the entry in the list of files */
+	unsigned group; /* See get_sort_group() */
+	int pad0;
+};
+
+/* List of files being sorted by sort_idx_range() */
+static struct fileinfo *sort_base = (struct fileinfo *)NULL;
+
+/* Keys of the entry whose index in SORT_BASE is the same as in this array
+ * (see load_sort_keys()). Kept aside from the list of files: they are only
+ * needed while sorting. */
+struct sort_key_t {
+	char *name; /* Name without skipped prefixes */
+	char *key;  /* Collation key of NAME */
+	char *ext;  /* File extension (see get_sort_ext()) */
+};
+
+/* Set to 1 while SORT_KEYS_V is valid (see load_sort_keys()). */
+static int sort_keys = 0;
+static struct sort_key_t *sort_keys_v = (struct sort_key_t *)NULL;
+/* Buffer holding collation keys (strxfrm(3)) */
+static char *sort_keys_buf = (char *)NULL;
+
 int
 skip_files(const struct dirent *ent)
 {
@@ -161,32 +199,58 @@ namecmp(char *s1, char *s2)
 	return strcmp(s1, s2);
 }
 
-static inline int
-sort_by_extension(struct fileinfo *pa, struct fileinfo *pb)
+/* Same as namecmp(), but using the keys computed by load_sort_keys():
+ * prefixes were already skipped, and collation keys are compared using
+ * strcmp(3) instead of strcoll(3). */
+static int
+namecmp_keys(const struct fileinfo *pa, const struct fileinfo *pb)
 {
-	char *e1 = (char *)NULL;
-	char *e2 = (char *)NULL;
+	const struct sort_key_t *ka = &sort_keys_v[pa - sort_base];
+	const struct sort_key_t *kb = &sort_keys_v[pb - sort_base];
+	const char *s1 = ka->name;
+	const char *s2 = kb->name;
 
-	if (pa->dir == 0) {
-		if (pa->ext_name) {
-			e1 = pa->ext_name + (pa->ext_name[1] != '\0');
-		} else {
-			char *p = strrchr(pa->name, '.');
-			if (p && p != pa->name && p[1])
-				e1 = p + 1;
-		}
-	}
+	if (!IS_UTF8_LEAD_BYTE(*s1) && !IS_UTF8_LEAD_BYTE(*s2)) {
+		char ac = *s1, bc = *s2;
 
-	if (pb->dir == 0) {
-		if (pb->ext_name) {
-			e2 = pb->ext_name + (pb->ext_name[1] != '\0');
-		} else {
-			char *p = strrchr(pb->name, '.');
-			if (p && p != pb->name && p[1])
-				e2 = p + 1;
+		if (conf.case_sens_list == 0) {
+			ac = (char)TOLOWER(*s1);
+			bc = (char)TOLOWER(*s2);
 		}
+
+		if (bc > ac)
+			return -1;
+
+		if (bc < ac)
+			return 1;
 	}
 
+	return strcmp(ka->key, kb->key);
+}
+
+/* Return a pointer to the extension (without the leading dot) of the file
+ * F, or NULL if it has none. Directories have no extension. */
+static char *
+get_sort_ext(const struct fileinfo *f)
+{
+	if (f->dir == 1)
+		return (char *)NULL;
+
+	if (f->ext_name)
+		return f->ext_name + (f->ext_name[1] != '\0');
+
+	char *p = strrchr(f->name, '.');
+	return (p && p != f->name && p[1]) ? p + 1 : (char *)NULL;
+}
+
+static inline int
+sort_by_extension(struct fileinfo *pa, struct fileinfo *pb)
+{
+	const char *e1 = sort_keys == 1
+		? sort_keys_v[pa - sort_base].ext : get_sort_ext(pa);
+	const char *e2 = sort_keys == 1
+		? sort_keys_v[pb - sort_base].ext : get_sort_ext(pb);
+
 	if (e1 || e2) {
 		if (!e1)
 			return (-1);
@@ -203,8 +267,8 @@ sort_by_extension(struct fileinfo *pa, struct fileinfo *pb)
 static inline int
 sort_by_owner(struct fileinfo *pa, struct fileinfo *pb)
 {
-	if (pa->uid_i.name && pb->uid_i.name)
-		return namecmp(pa->uid_i.name, pb->uid_i.name);
+	if (pa->cold->uid_i.name && pb->cold->uid_i.name)
+		return namecmp(pa->cold->uid_i.name, pb->cold->uid_i.name);
 
 	return F_SORT(pa->uid, pb->uid);
 }
@@ -212,8 +276,8 @@ sort_by_owner(struct fileinfo *pa, struct fileinfo *pb)
 static inline int
 sort_by_group(struct fileinfo *pa, struct fileinfo *pb)
 {
-	if (pa->gid_i.name && pb->gid_i.name)
-		return namecmp(pa->gid_i.name, pb->gid_i.name);
+	if (pa->cold->gid_i.name && pb->cold->gid_i.name)
+		return namecmp(pa->cold->gid_i.name, pb->cold->gid_i.name);
 
 	return F_SORT(pa->gid, pb->gid);
 }
@@ -283,18 +347,325 @@ entrycmp(const void *a, const void *b)
 	case SINO: ret = F_SORT(pa->inode, pb->inode); break;
 	case SOWN: ret = sort_by_owner(pa, pb); break;
 	case SGRP: ret = sort_by_group(pa, pb); break;
-	case SBLK: ret = F_SORT(pa->blocks, pb->blocks); break;
+	case SBLK: ret = F_SORT(pa->cold->blocks, pb->cold->blocks); break;
 	case SLNK: ret = F_SORT(pa->linkn, pb->linkn); break;
 	case STYPE: ret = sort_by_type(pa, pb); break;
 	default: break;
 	}
 
 	if (ret == 0)
-		ret = namecmp(pa->name, pb->name);
+		ret = sort_keys == 1 ? namecmp_keys(pa, pb)
+			: namecmp(pa->name, pb->name);
 
 	return conf.sort_reverse == 0 ? ret : -ret;
 }
 
+/* Return 1 if strcmp(3) sorts strings the same way as strcoll(3) in the
+ * current locale. */
+static int
+is_c_collation(void)
+{
+	const char *l = setlocale(LC_COLLATE, NULL);
+	return (!l || (*l == 'C' && (!l[1] || l[1] == '.'))
+		|| strcmp(l, "POSIX") == 0);
+}
+
+/* Before sorting the N entries in the list of files FI, compute, once per
+ * entry, what entrycmp() would otherwise compute on every comparison: the
+ * name without skipped prefixes, its collation key, and the file extension
+ * (stored in SORT_KEYS_V). Collation keys are generated with strxfrm(3), so
+ * that they can be compared with strcmp(3), which is much faster than
+ * strcoll(3). FI must be SORT_BASE.
+ * Call unload_sort_keys() once sorted. */
+static void
+load_sort_keys(struct fileinfo *fi, const filesn_t n)
+{
+	int st = conf.sort;
+	if (conf.light_mode == 1 && !ST_IN_LIGHT_MODE(st))
+		st = SNAME;
+
+	/* Keys are used to compare names and extensions only. */
+	if (n < SORT_KEYS_MIN || (st != SNAME && st != SEXT && st != STYPE))
+		return;
+
+	const int xfrm = (conf.case_sens_list == 0 && is_c_collation() == 0);
+	const int ext = (st == SEXT || st == STYPE);
+	size_t *offs = (size_t *)NULL;
+	size_t cap = 0, used = 0;
+	filesn_t i;
+
+	sort_keys_v = xnmalloc((size_t)n, sizeof(struct sort_key_t));
+
+	if (xfrm == 1) {
+		offs = xnmalloc((size_t)n, sizeof(size_t));
+		cap = (size_t)n * 32;
+		sort_keys_buf = xnmalloc(cap, sizeof(char));
+	}
+
+	for (i = 0; i < n; i++) {
+		char *name = fi[i].name;
+		if (conf.skip_non_alnum_prefix == 1)
+			skip_name_prefixes(&name);
+
+		sort_keys_v[i].name = sort_keys_v[i].key = name;
+		sort_keys_v[i].ext = ext == 1 ? get_sort_ext(&fi[i]) : (char *)NULL;
+
+		if (xfrm == 0)
+			continue;
+
+		size_t len = strxfrm(sort_keys_buf + used, name, cap - used);
+		if (len >= cap - used) {
+			cap = (cap * 2) + len + 1;
+			sort_keys_buf = xnrealloc(sort_keys_buf, cap, sizeof(char));
+			len = strxfrm(sort_keys_buf + used, name, cap - used);
+		}
+
+		offs[i] = used;
+		used += len + 1;
+	}
+
+	/* The buffer might have been moved by realloc: set pointers now. */
+	for (i = 0; xfrm == 1 && i < n; i++)
+		sort_keys_v[i].key = sort_keys_buf + offs[i];
+
+	free(offs);
+	sort_keys = 1;
+}
+
+static void
+unload_sort_keys(void)
+{
+	free(sort_keys_buf);
+	sort_keys_buf = (char *)NULL;
+	free(sort_keys_v);
+	sort_keys_v = (struct sort_key_t *)NULL;
+	sort_keys = 0;
+}
+
+/* Return the rank of the file F according to the criteria applied by
+ * entrycmp() before the sort method itself, and not affected by the
+ * reverse order: directories first, priority sort chars, and hidden files
+ * first/last. Files are sorted by rank first. */
+static unsigned
+get_sort_group(const struct fileinfo *f)
+{
+	unsigned g = 0;
+
+	if (conf.list_dirs_first == 1)
+		g = f->dir == 1 ? 0 : 1;
+
+	const char *psch = conf.priority_sort_char;
+	if (psch && *psch) {
+		const size_t l = strlen(psch);
+		const char *p = strchr(psch, *f->name);
+		g = (g * (unsigned)(l + 1)) + (unsigned)(p ? (size_t)(p - psch) : l);
+	}
+
+	if (conf.show_hidden > 1) { /* HIDDEN_FIRST or HIDDEN_LAST */
+		const unsigned h = *f->name == '.';
+		g = (g * 2) + (conf.show_hidden == HIDDEN_FIRST ? !h : h);
+	}
+
+	return g;
+}
+
+/* Map the integer used by the sort method ST for the file F to an unsigned
+ * key preserving its order (reversed if sorting in reverse order). */
+static uint64_t
+get_int_sort_key(const struct fileinfo *f, const int st)
+{
+	const uint64_t sign = (uint64_t)1 << 63;
+	uint64_t k = 0;
+
+	switch (st) {
+	case STSIZE: k = (uint64_t)(int64_t)f->size ^ sign; break;
+	case SATIME: /* fallthrough */
+	case SBTIME: /* fallthrough */
+	case SCTIME: /* fallthrough */
+	case SMTIME: k = (uint64_t)(int64_t)f->time ^ sign; break;
+	case SINO: k = (uint64_t)f->inode; break;
+	case SBLK: k = (uint64_t)(int64_t)f->cold->blocks ^ sign; break;
+	case SLNK: k = (uint64_t)f->linkn; break;
+	default: break;
+	}
+
+	return conf.sort_reverse == 1 ? ~k : k;
+}
+
+static int
+idxcmp(const void *a, const void *b)
+{
+	return entrycmp(sort_base + ((const struct sort_idx_t *)a)->idx,
+		sort_base + ((const struct sort_idx_t *)b)->idx);
+}
+
+/* Sort the N index entries in IDS using entrycmp(). */
+static void
+sort_idx_range(struct sort_idx_t *ids, const size_t n)
+{
+#if defined(TOURBIN_QSORT)
+# define IDXLESS(i, j) (entrycmp(sort_base + ids[(i)].idx, \
+	sort_base + ids[(j)].idx) < 0)
+# define IDXSWAP(i, j) do { struct sort_idx_t t_ = ids[(i)]; \
+	ids[(i)] = ids[(j)]; ids[(j)] = t_; } while (0)
+	QSORT(n, IDXLESS, IDXSWAP);
+# undef IDXLESS
+# undef IDXSWAP
+#else
+	qsort(ids, n, sizeof(struct sort_idx_t), idxcmp);
+#endif /* TOURBIN_QSORT */
+}
+
+/* Stable LSD radix sort of the N entries in IDS by group and key (see
+ * get_sort_group() and get_int_sort_key()). TMP is scratch space for N
+ * entries. */
+static void
+radix_sort_idx(struct sort_idx_t *ids, struct sort_idx_t *tmp, const size_t n,
+	const unsigned groups)
+{
+	static size_t count[8][256];
+	struct sort_idx_t *src = ids, *dst = tmp;
+	size_t i, b;
+
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < n; i++) {
+		for (b = 0; b < 8; b++)
+			count[b][(ids[i].key >> (b * 8)) & 0xff]++;
+	}
+
+	for (b = 0; b < 8; b++) {
+		const size_t shift = b * 8;
+		/* All keys share this byte: nothing to do. */
+		if (count[b][(ids[0].key >> shift) & 0xff] == n)
+			continue;
+
+		size_t off = 0;
+		for (i = 0; i < 256; i++) {
+			const size_t c = count[b][i];
+			count[b][i] = off;
+			off += c;
+		}
+
+		for (i = 0; i < n; i++)
+			dst[count[b][(src[i].key >> shift) & 0xff]++] = src[i];
+
+		struct sort_idx_t *t = src; src = dst; dst = t;
+	}
+
+	/* Most significant digit: the group. */
+	if (groups > 1) {
+		size_t *gcount = xcalloc(groups + 1, sizeof(size_t));
+		for (i = 0; i < n; i++)
+			gcount[src[i].group + 1]++;
+		for (i = 1; i <= groups; i++)
+			gcount[i] += gcount[i - 1];
+		for (i = 0; i < n; i++)
+			dst[gcount[src[i].group]++] = src[i];
+		free(gcount);
+
+		struct sort_idx_t *t = src; src = dst; dst = t;
+	}
+
+	if (src != ids)
+		memcpy(ids, src, n * sizeof(struct sort_idx_t));
+}
+
+/* Sort the N entries of the list of files FI according to the current sort
+ * method and order.
+ * Instead of moving whole fileinfo structs around, an array of indices is
+ * sorted, and the resulting permutation is applied once at the end. Integer
+ * sort methods (size, time, inode, blocks, and links) use a radix sort on
+ * their keys: only entries with equal keys are compared using entrycmp()
+ * afterwards. */
+void
+sort_entries(struct fileinfo *fi, const filesn_t n)
+{
+	if (!fi || n < 2)
+		return;
+
+	int st = conf.sort;
+	if (conf.light_mode == 1 && !ST_IN_LIGHT_MODE(st))
+		st = SNAME;
+
+	const size_t count = (size_t)n;
+	struct sort_idx_t *ids = xnmalloc(count, sizeof(struct sort_idx_t));
+	size_t i;
+
+	sort_base = fi;
+	load_sort_keys(fi, n);
+
+	const int radix = (count >= RADIX_SORT_MIN && (st == STSIZE
+		|| (st >= SATIME && st <= SMTIME) || st == SINO || st == SBLK
+		|| st == SLNK));
+
+	if (radix == 1) {
+		unsigned groups = 0;
+		for (i = 0; i < count; i++) {
+			ids[i].idx = i;
+			ids[i].key = get_int_sort_key(&fi[i], st);
+			ids[i].group = get_sort_group(&fi[i]);
+			if (ids[i].group >= groups)
+				groups = ids[i].group + 1;
+		}
+
+		struct sort_idx_t *tmp = xnmalloc(count, sizeof(struct sort_idx_t));
+		radix_sort_idx(ids, tmp, count, groups);
+		free(tmp);
+
+		/* Break ties (same group and key) by name. */
+		size_t start = 0;
+		for (i = 1; i <= count; i++) {
+			if (i < count && ids[i].key == ids[start].key
+			&& ids[i].group == ids[start].group)
+				continue;
+			if (i - start > 1)
+				sort_idx_range(ids + start, i - start);
+			start = i;
+		}
+	} else {
+		for (i = 0; i < count; i++)
+			ids[i].idx = i;
+		sort_idx_range(ids, count);
+	}
+
+	/* Apply the permutation. */
+	struct fileinfo *sorted = xnmalloc(count, sizeof(struct fileinfo));
+	for (i = 0; i < count; i++)
+		sorted[i] = fi[ids[i].idx];
+	memcpy(fi, sorted, count * sizeof(struct fileinfo));
+
+	free(sorted);
+	free(ids);
+	sort_base = (struct fileinfo *)NULL;
+	unload_sort_keys();
+}
+
+/* Reverse the order of the N entries of the already sorted list of files
+ * FI, as if it had been sorted with the opposite order. Directories first,
+ * priority sort chars, and hidden first/last are not affected by the sort
+ * order: only runs of files sharing these attributes are reversed. */
+void
+reverse_entries(struct fileinfo *fi, const filesn_t n)
+{
+	filesn_t start = 0, i;
+
+	for (i = 1; i <= n; i++) {
+		if (i < n && get_sort_group(&fi[i]) == get_sort_group(&fi[start]))
+			continue;
+
+		filesn_t a = start, b = i - 1;
+		while (a < b) {
+			struct fileinfo t = fi[a];
+			fi[a] = fi[b];
+			fi[b] = t;
+			a++;
+			b--;
+		}
+
+		start = i;
+	}
+}
+
 /* Same as alphasort, but is uses strcmp instead of sctroll, which is
  * slower. However, bear in mind that, unlike strcmp(), strcoll() is locale
  * aware. Use only with C and english locales */
@@ -373,8 +744,10 @@ toggle_sort_reverse(void)
 	conf.sort_reverse = !conf.sort_reverse;
 }
 
+/* Sort the current list of files again, after switching from the sort
+ * method OLD_SORT and order OLD_REV. */
 static inline int
-re_sort_files_list(void)
+re_sort_files_list(const int old_sort, const int old_rev)
 {
 	if (conf.autols == 0)
 		return FUNC_SUCCESS;
@@ -382,8 +755,7 @@ re_sort_files_list(void)
 	/* sort_switch just tells list_dir() to print a line with the current
 	 * sort order at the end of the file list. */
 	sort_switch = 1;
-	free_dirlist();
-	const int ret = list_dir();
+	const int ret = resort_dirlist(old_sort, old_rev);
 	sort_switch = 0;
 
 	return ret;
@@ -426,11 +798,14 @@ sort_function(char **arg)
 		return FUNC_SUCCESS;
 	}
 
+	const int old_sort = conf.sort;
+	const int old_rev = conf.sort_reverse;
+
 	/* Argument is an alphanumerical string */
 	if (!is_number(arg[1])) {
 		if (*arg[1] == 'r' && strcmp(arg[1], "rev") == 0) {
 			toggle_sort_reverse();
-			return re_sort_files_list();
+			return re_sort_files_list(old_sort, old_rev);
 		}
 
 		if (set_sort_by_name(&arg[1]) == FUNC_FAILURE)
@@ -461,7 +836,7 @@ sort_function(char **arg)
 
 		update_autocmd_opts(AC_SORT);
 
-		return re_sort_files_list();
+		return re_sort_files_list(old_sort, old_rev);
 	}
 
 	/* If arg1 is a number but is not in the range 0-SORT_TYPES, err. */
@@ -35,7 +35,9 @@ int  compare_strings(char **s1, char **s2);
 int  entrycmp(const void *a, const void *b);
 char *num_to_sort_name(const int n, const int abbrev);
 void print_sort_method(void);
+void reverse_entries(struct fileinfo *fi, const filesn_t n);
 int  skip_files(const struct dirent *ent);
+void sort_entries(struct fileinfo *fi, const filesn_t n);
 int  sort_function(char **arg);
 int  xalphasort(const struct dirent **a, const struct dirent **b);
 
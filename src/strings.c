@@ -3004,8 +3004,11 @@ parse_input_str(char *str)
 		if ((*substr[i] == '.' && (!substr[i][1] || (substr[i][1] == '.'
 		&& (!substr[i][2] || substr[i][2] == '/'))))
 		|| strstr(substr[i], "/..")) {
+			/* Exclude 'l' and 'r' commands. 'r' must see "." and ".." as
+			 * typed, so that it can refuse to remove them. */
 			char *tmp = (is_int_cmd == 1
-			&& (*substr[0] != 'l' || substr[0][1])) /* Exclude 'l' command. */
+			&& (*substr[0] != 'l' || substr[0][1])
+			&& (*substr[0] != 'r' || substr[0][1]))
 				? normalize_path(substr[i], strlen(substr[i])) : NULL;
 			if (tmp) {
 				free(substr[i]);
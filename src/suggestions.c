@@ -50,6 +50,7 @@ typedef char *rl_cpvfunc_t;
 #ifndef _NO_HIGHLIGHT
 # include "highlight.h"
 #endif /* !_NO_HIGHLIGHT */
+#include "init.h" /* bin_cmds_lower_bound() */
 #include "jump.h"
 #include "messages.h"
 #include "navigation.h" /* fastback() */
@@ -633,8 +634,7 @@ print_suggestion(const char *str, size_t offset, char *color)
 }
 
 static inline char *
-get_reg_file_color(const char *filename, const struct stat *attr,
-	int *free_color)
+get_reg_file_color(const char *filename, const struct stat *attr)
 {
 	if (conf.light_mode == 1) return fi_c;
 	if (*nf_c && access(filename, R_OK) == -1) return nf_c;
@@ -659,23 +659,14 @@ get_reg_file_color(const char *filename, const struct stat *attr,
 	if (!ext || ext == filename)
 		return fi_c;
 
-	size_t color_len = 0;
-	char *extcolor = get_ext_color(ext, &color_len);
-	if (!extcolor)
-		return fi_c;
-
-	color_len += 4;
-	char *ext_color = xnmalloc(color_len, sizeof(char));
-	snprintf(ext_color, color_len, "\x1b[%sm", extcolor);
-
-	*free_color = 1;
-	return ext_color;
+	char *extcolor = get_ext_color_seq(ext, NULL);
+	return extcolor ? extcolor : fi_c;
 }
 
 /* Used by the check_completions function to get filenames color
  * according to file type. */
 static char *
-get_comp_color(const char *filename, const struct stat *attr, int *free_color)
+get_comp_color(const char *filename, const struct stat *attr)
 {
 	switch (attr->st_mode & S_IFMT) {
 	case S_IFDIR:
@@ -683,7 +674,7 @@ get_comp_color(const char *filename, const struct stat *attr, int *free_color)
 			: get_dir_color(filename, attr, -1);
 
 	case S_IFREG:
-		return get_reg_file_color(filename, attr, free_color);
+		return get_reg_file_color(filename, attr);
 
 	case S_IFLNK: {
 		if (conf.light_mode == 1) return ln_c;
@@ -781,7 +772,7 @@ match_print(char *match, const size_t len, char *color, const int append_slash)
 static inline int
 print_match(char *match, const size_t len)
 {
-	int append_slash = 0, free_color = 0;
+	int append_slash = 0;
 
 	char *p = (char *)NULL, *_color = (char *)NULL;
 	char *color = (conf.suggest_filetype_color == 1) ? no_c : sf_c;
@@ -799,11 +790,9 @@ print_match(char *match, const size_t len)
 		}
 
 		if (conf.suggest_filetype_color == 1) {
-			_color = get_comp_color(p ? p : match, &attr, &free_color);
+			_color = get_comp_color(p ? p : match, &attr);
 			if (_color)
 				color = _color;
-			else
-				free_color = 0;
 		}
 	} else {
 		suggestion.filetype = DT_DIR;
@@ -813,8 +802,6 @@ print_match(char *match, const size_t len)
 	suggestion.type = COMP_SUG;
 	match_print(match, len, color, append_slash);
 
-	if (free_color)
-		free(color);
 	return PARTIAL_MATCH;
 }
 
@@ -945,6 +932,66 @@ print_reg_file_suggestion(char *str, const filesn_t i, size_t len,
 	print_suggestion(file_info[i].name, len, color);
 }
 
+/* Candidates left by the last fuzzy filename query (see check_filenames()).
+ * A name matching a fuzzy query contains all of its chars, in order, so that
+ * once a char is appended to the query, only names matching the previous
+ * query need to be checked again (plus those from SCANNED onwards, not
+ * checked at all because the previous search stopped early). */
+struct fuzzy_memo_t {
+	filesn_t *idx;  /* Indices into file_info, in ascending order */
+	filesn_t n;
+	filesn_t cap;
+	filesn_t scanned;
+	size_t gen;     /* Value of dirlist_gen when the memo was stored */
+	size_t query_len;
+	int ctx;        /* Filters applied to the list (see check_filenames()) */
+	int valid;
+	char query[NAME_MAX + 1];
+};
+
+static struct fuzzy_memo_t fz_memo = {0};
+
+void
+free_fuzzy_memo(void)
+{
+	free(fz_memo.idx);
+	memset(&fz_memo, 0, sizeof(struct fuzzy_memo_t));
+}
+
+/* Return the number of candidates (in fz_memo.idx) left by the previous fuzzy
+ * query, provided STR (LEN bytes) extends it, the filters in CTX are the
+ * same, and the list of files has not changed since then. Otherwise, reset
+ * the memo, so that the whole list is checked, and return 0. */
+static filesn_t
+load_fuzzy_memo(const char *str, const size_t len, const int ctx)
+{
+	if (fz_memo.cap < files) {
+		fz_memo.idx = xnrealloc(fz_memo.idx, (size_t)files, sizeof(filesn_t));
+		fz_memo.cap = files;
+	}
+
+	if (fz_memo.valid == 1 && fz_memo.gen == dirlist_gen
+	&& fz_memo.ctx == ctx && fz_memo.query_len <= len
+	&& memcmp(fz_memo.query, str, fz_memo.query_len) == 0)
+		return fz_memo.n;
+
+	fz_memo.n = fz_memo.scanned = 0;
+	return 0;
+}
+
+static void
+store_fuzzy_memo(const char *str, const size_t len, const int ctx,
+	const filesn_t n, const filesn_t scanned)
+{
+	fz_memo.n = n;
+	fz_memo.scanned = scanned;
+	fz_memo.gen = dirlist_gen;
+	fz_memo.ctx = ctx;
+	fz_memo.query_len = len;
+	memcpy(fz_memo.query, str, len);
+	fz_memo.valid = 1;
+}
+
 static int
 check_filenames(char *str, size_t len, const int first_word,
 	const size_t full_word)
@@ -960,10 +1007,42 @@ check_filenames(char *str, size_t len, const int first_word,
 	int fuzzy_str_type = (conf.fuzzy_match == 1 && contains_utf8(str) == 1)
 		? FUZZY_FILES_UTF8 : FUZZY_FILES_ASCII;
 	int best_fz_score = 0;
+	int beginning_match = 0;
+
+	/* No fuzzy matching if not at the end of the line. */
+	const int fuzzy = (conf.fuzzy_match == 1 && rl_point >= rl_end);
+	const int dirs_only = (words_num > 1 && rl_line_buffer
+		&& *rl_line_buffer == 'c' && rl_line_buffer[1] == 'd'
+		&& rl_line_buffer[2] == ' ');
+
+	/* The byte oriented matcher (fuzzy_match_v1()) cannot match a name
+	 * lacking any of the chars in the query: check their charset masks
+	 * first. */
+	const unsigned long long query_mask = (fuzzy == 1
+		&& (fuzzy_str_type == FUZZY_FILES_ASCII || conf.fuzzy_match_algo == 1))
+		? fuzzy_charset_mask(str) : 0;
+
+	/* Reuse the candidates of the previous query, if possible. */
+	const int memo = (fuzzy == 1 && full_word == 0 && len > 0
+		&& len <= NAME_MAX && removed_slash == 0);
+	const int ctx = first_word | (dirs_only << 1) | (conf.autocd << 2)
+		| (conf.auto_open << 3) | (conf.case_sens_path_comp << 4)
+		| (conf.fuzzy_match_algo << 5) | (fuzzy_str_type << 8);
+	const filesn_t memo_n = memo == 1 ? load_fuzzy_memo(str, len, ctx) : 0;
+	const filesn_t scan_from = memo == 1 ? fz_memo.scanned : 0;
+	filesn_t cands_n = 0;
+
+	filesn_t i = scan_from, k;
+
+	for (k = 0; ; k++) {
+		if (k < memo_n) {
+			i = fz_memo.idx[k];
+		} else {
+			i = scan_from + (k - memo_n);
+			if (i >= files)
+				break;
+		}
 
-	filesn_t i;
-
-	for (i = 0; i < files; i++) {
 		if (!file_info[i].name)	continue;
 
 		if (removed_slash == 1 && (file_info[i].dir != 1
@@ -982,13 +1061,10 @@ check_filenames(char *str, size_t len, const int first_word,
 		|| (file_info[i].dir == 0 && conf.auto_open == 0) ) )
 			continue;
 
-		if (words_num > 1 && rl_line_buffer && *rl_line_buffer == 'c'
-		&& rl_line_buffer[1] == 'd' && rl_line_buffer[2] == ' '
-		&& file_info[i].dir == 0)
+		if (dirs_only == 1 && file_info[i].dir == 0)
 			continue;
 
-		/* No fuzzy matching if not at the end of the line. */
-		if (conf.fuzzy_match == 0 || rl_point < rl_end) {
+		if (fuzzy == 0) {
 			if (conf.case_sens_path_comp ? (*str == *file_info[i].name
 			&& strncmp(str, file_info[i].name, len) == 0)
 			: (TOUPPER(*str) == TOUPPER(*file_info[i].name)
@@ -1008,21 +1084,53 @@ check_filenames(char *str, size_t len, const int first_word,
 
 		/* ############### FUZZY MATCHING ################## */
 		else {
+			if (query_mask != 0) {
+				if (file_info[i].cold->name_mask == 0)
+					file_info[i].cold->name_mask =
+						fuzzy_charset_mask(file_info[i].name);
+				if ((query_mask & ~file_info[i].cold->name_mask) != 0)
+					continue;
+			}
+
 			int s = fuzzy_match(str, file_info[i].name, len, fuzzy_str_type);
+			if (s <= 0)
+				continue;
+
+			if (memo == 1) {
+				fz_memo.idx[cands_n] = i;
+				cands_n++;
+			}
+
 			if (s > best_fz_score) {
 				fuzzy_index = i;
-				if (s == TARGET_BEGINNING_BONUS)
+				if (s == TARGET_BEGINNING_BONUS) {
+					beginning_match = 1;
 					break;
+				}
 				best_fz_score = s;
 			}
 		}
 	}
 
+	if (memo == 1) {
+		if (beginning_match == 0) {
+			store_fuzzy_memo(str, len, ctx, cands_n, files);
+		} else if (k < memo_n) {
+			/* Stopped while checking the old candidates: keep the unchecked
+			 * ones, along with the unchecked part of the list. */
+			const filesn_t rest = memo_n - (k + 1);
+			memmove(fz_memo.idx + cands_n, fz_memo.idx + k + 1,
+				(size_t)rest * sizeof(filesn_t));
+			store_fuzzy_memo(str, len, ctx, cands_n + rest, scan_from);
+		} else {
+			store_fuzzy_memo(str, len, ctx, cands_n, i + 1);
+		}
+	}
+
 	if (fuzzy_index > -1) { /* We have a fuzzy match. */
 		cur_comp_type = TCMP_PATH;
 
-		/* i < files == we have a full match (TARGET_BEGINNING_BONUS). */
-		suggestion.type = i < files ? FILE_SUG : FUZZY_FILENAME;
+		suggestion.type = beginning_match == 1 ? FILE_SUG : FUZZY_FILENAME;
 
 		if (file_info[fuzzy_index].dir)
 			print_directory_suggestion(fuzzy_index, len, color);
@@ -1156,7 +1264,10 @@ print_internal_cmd_suggestion(char *str, const size_t len, const int print)
 	return FULL_MATCH;
 }
 
-/* Check STR against a list of command names, both internal and in PATH. */
+/* Check STR against a list of command names, both internal and in PATH.
+ * bin_commands is made of sorted segments (internal commands, aliases,
+ * actions, and commands in PATH, in this order of precedence): binary search
+ * each of them for the first name starting with STR. */
 static int
 check_cmds(char *str, size_t len, const int print)
 {
@@ -1169,29 +1280,24 @@ check_cmds(char *str, size_t len, const int print)
 		len--;
 	}
 
-	size_t i;
-	for (i = 0; bin_commands[i]; i++) {
-		if (!bin_commands[i] || *cmd != *bin_commands[i])
-			continue;
+	/* Commands in PATH may still be loading: use them only if ready. */
+	load_path_programs(0);
 
-		if (!print) {
-			if (strcmp(cmd, bin_commands[i]) == 0)
-				return FULL_MATCH;
-			continue;
-		}
+	const size_t cmd_len = print ? len : strlen(cmd) + 1;
+	int s;
 
-		/* Let's check the 2nd char as well before calling strcmp(). */
-		if (len > 1 && *(bin_commands[i] + 1)
-		&& *(cmd + 1) != *(bin_commands[i] + 1))
+	for (s = 0; s < BIN_CMD_SEGS; s++) {
+		const size_t i = bin_cmds_lower_bound(s, cmd, cmd_len);
+		if (i >= bin_cmds_seg[s + 1]
+		|| strncmp(bin_commands[i], cmd, cmd_len) != 0)
 			continue;
 
-		if (strncmp(cmd, bin_commands[i], len) != 0)
-			continue;
+		if (!print)
+			return FULL_MATCH;
 
 		const int ret = print_cmd_suggestion(i, len);
-		if (ret == NO_MATCH)
-			continue;
-		return ret;
+		if (ret != NO_MATCH)
+			return ret;
 	}
 
 	return print_internal_cmd_suggestion(cmd, len, print);
@@ -1202,9 +1308,13 @@ check_jumpdb(const char *str, const size_t len, const int print)
 {
 	char *color = (conf.suggest_filetype_color == 1) ? di_c : sf_c;
 
+	/* Skip entries lacking any of the characters in STR (see jump.c). */
+	const unsigned long long sig = get_jump_sig(str);
+
 	int i = (int)jump_n;
 	while (--i >= 0) {
-		if (!jump_db[i].path || TOUPPER(*str) != TOUPPER(*jump_db[i].path)
+		if (jump_entry_lacks_sig((size_t)i, sig) == 1
+		|| !jump_db[i].path || TOUPPER(*str) != TOUPPER(*jump_db[i].path)
 		|| jump_db[i].rank == JUMP_ENTRY_PURGED)
 			continue;
 		if (len > 1 && *(jump_db[i].path + 1)
@@ -1510,6 +1620,10 @@ print_warning_prompt(const char fc, const unsigned char lc)
 	|| fc == '$' || fc == '\'' || fc == '"')
 		return;
 
+	/* We cannot tell yet whether this is a command in PATH. */
+	if (load_path_programs(0) == 1)
+		return;
+
 	if (suggestion.printed || suggestion_buf)
 		clear_suggestion(CS_FREEBUF);
 
@@ -28,6 +28,7 @@
 __BEGIN_DECLS
 
 void clear_suggestion(const int sflag);
+void free_fuzzy_memo(void);
 void free_suggestion(void);
 void print_suggestion(char *str, size_t offset, char *color);
 int  recover_from_wrong_cmd(void);
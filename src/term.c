@@ -38,6 +38,7 @@
 #include <errno.h>
 
 #include "aux.h" /* xatoi */
+#include "history.h" /* flush_history_journals */
 #include "misc.h" /* set_signals_to_ignore, handle_stdin */
 #include "term_info.h"
 
@@ -135,6 +136,16 @@ sigwinch_handler(int sig)
 }
 #endif /* !_BE_POSIX */
 
+/* The terminal was closed: write pending history and log entries, and
+ * then terminate as the default action would do. */
+static void
+sighup_handler(int sig)
+{
+	flush_history_journals();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
 static void
 set_signals_to_ignore(void)
 {
@@ -152,6 +163,9 @@ set_signals_to_ignore(void)
 //	sigaction(SIGTTIN, &sa, NULL);
 //	sigaction(SIGTTOU, &sa, NULL);
 
+	sa.sa_handler = sighup_handler;
+	sigaction(SIGHUP, &sa, NULL);
+
 #ifndef _BE_POSIX
 	sa.sa_handler = sigwinch_handler;
 	sigaction(SIGWINCH, &sa, NULL);
@@ -46,7 +46,557 @@ xatoi, url_encode, xnmalloc, print_file_name */
 #include "readline.h"   /* rl_no_hist, rl_get_y_or_n */
 #include "sort.h"       /* skip_files, xalphasort, alphasort_insensitive */
 #include "spawn.h"      /* launch_execv */
-#include "xdu.h"        /* dir_size */
+#include "xcp.h"        /* xcp_move, xcp_remove */
+#include "xdu.h"        /* dir_info, dir_size */
+
+/* The trash index (TRASH_INDEX_FILE, in the trash directory) records, for
+ * each trashed file, its name, original path (URL encoded, as in the info
+ * file), deletion date, and size. It is stamped with the modification times
+ * of the trash files and info directories: if they do not match (the trash
+ * can was modified by someone else), the index is rebuilt.
+ *
+ * Every change we make to the trash directories is bracketed by
+ * begin_trash_change() and end_trash_change(): the stamps follow our own
+ * changes only, and if the directories were modified by someone else in
+ * the meanwhile, the index is discarded (and rebuilt when next needed).
+ * Trash and untrash commands bracket the whole batch instead (see
+ * begin_trash_batch()).
+ *
+ * The index is updated incrementally by trash, untrash, and del operations,
+ * so that listing trashed files, computing the trash size, and looking up
+ * original paths do not need to scan the trash can.
+ *
+ * Format: a header line, "clifm-trash-index VERSION FILES_MTIME INFO_MTIME"
+ * (each time as SECONDS NANOSECONDS), followed by one line per trashed file:
+ * "SIZE BLOCKS DATE NAME PATH" (NAME URL encoded, and a dash for missing
+ * fields). SIZE is -1 if the size of the file was not computed yet: sizes
+ * are computed lazily, when the size of the trash can is requested. */
+#define TRASH_INDEX_FILE    "clifm_index"
+#define TRASH_INDEX_VERSION 1
+#define TRASH_INDEX_HEADER  "clifm-trash-index"
+
+struct trash_entry_t {
+	char *name;
+	char *path;     /* Original path (URL encoded) */
+	off_t size;     /* Apparent size, or -1 if not computed yet */
+	blkcnt_t blocks;
+	char date[20];  /* Deletion date (YYYY-MM-DDThh:mm:ss) */
+	int deleted;
+};
+
+struct trash_index_t {
+	struct trash_entry_t *ent;
+	size_t n;
+	size_t cap;
+	size_t deleted;     /* Number of entries marked as deleted */
+	time_t files_sec;   /* Modification time of trash_files_dir */
+	long files_nsec;
+	time_t info_sec;    /* Modification time of trash_info_dir */
+	long info_nsec;
+	int loaded;
+	int dirty;          /* In-memory index differs from the on-disk one */
+	int sorted;         /* Entries are sorted by name */
+	int locked;         /* Trust the in-memory index (see trash_function()) */
+	int batch;          /* Inside a batch (see begin_trash_batch()) */
+	int pad0;
+};
+
+static struct trash_index_t tindex = {0};
+
+static long
+get_mtime_nsec(const struct stat *a)
+{
+#ifdef CLIFM_LEGACY
+	UNUSED(a);
+	return 0;
+#elif defined(__NetBSD__) || defined(__APPLE__)
+	return (long)a->st_mtimespec.tv_nsec;
+#else
+	return (long)a->st_mtim.tv_nsec;
+#endif /* CLIFM_LEGACY */
+}
+
+/* Store the modification times of the trash directories in FILES_ST and
+ * INFO_ST. Return FUNC_SUCCESS on success, or FUNC_FAILURE on error. */
+static int
+stat_trash_dirs(struct stat *files_st, struct stat *info_st)
+{
+	if (!trash_dir || !trash_files_dir || !trash_info_dir)
+		return FUNC_FAILURE;
+
+	return (stat(trash_files_dir, files_st) == -1
+		|| stat(trash_info_dir, info_st) == -1) ? FUNC_FAILURE : FUNC_SUCCESS;
+}
+
+static int
+trash_index_matches(const struct stat *files_st, const struct stat *info_st)
+{
+	return (tindex.files_sec == files_st->st_mtime
+		&& tindex.files_nsec == get_mtime_nsec(files_st)
+		&& tindex.info_sec == info_st->st_mtime
+		&& tindex.info_nsec == get_mtime_nsec(info_st));
+}
+
+static void
+stamp_trash_index(const struct stat *files_st, const struct stat *info_st)
+{
+	tindex.files_sec = files_st->st_mtime;
+	tindex.files_nsec = get_mtime_nsec(files_st);
+	tindex.info_sec = info_st->st_mtime;
+	tindex.info_nsec = get_mtime_nsec(info_st);
+}
+
+static void
+clear_trash_index_data(struct trash_index_t *t)
+{
+	size_t i;
+	for (i = 0; i < t->n; i++) {
+		free(t->ent[i].name);
+		free(t->ent[i].path);
+	}
+
+	free(t->ent);
+	memset(t, 0, sizeof(struct trash_index_t));
+}
+
+static void
+clear_trash_index(void)
+{
+	clear_trash_index_data(&tindex);
+}
+
+void
+free_trash_index(void)
+{
+	clear_trash_index();
+}
+
+static char *
+get_trash_index_path(void)
+{
+	const size_t len = strlen(trash_dir) + sizeof(TRASH_INDEX_FILE) + 1;
+	char *p = xnmalloc(len, sizeof(char));
+	snprintf(p, len, "%s/%s", trash_dir, TRASH_INDEX_FILE);
+	return p;
+}
+
+/* Discard the trash index (both in memory and on disk). Used whenever we
+ * cannot tell what the state of the trash can is. */
+static void
+invalidate_trash_index(void)
+{
+	if (!trash_dir)
+		return;
+
+	const int locked = tindex.locked;
+	clear_trash_index();
+	tindex.locked = locked;
+
+	char *p = get_trash_index_path();
+	unlink(p);
+	free(p);
+}
+
+/* Call this right before modifying the trash directories: if they were
+ * modified since the index was last stamped (i.e., by someone else), the
+ * index cannot be trusted anymore. */
+static void
+begin_trash_change(void)
+{
+	if (tindex.loaded == 0 || tindex.batch == 1)
+		return;
+
+	struct stat files_st, info_st;
+	if (stat_trash_dirs(&files_st, &info_st) == FUNC_FAILURE
+	|| trash_index_matches(&files_st, &info_st) == 0)
+		invalidate_trash_index();
+}
+
+/* Call this right after modifying the trash directories (and updating the
+ * in-memory index accordingly): stamp the index with the resulting
+ * modification times, which are the product of our own change. */
+static void
+end_trash_change(void)
+{
+	if (tindex.loaded == 0 || tindex.batch == 1)
+		return;
+
+	struct stat files_st, info_st;
+	if (stat_trash_dirs(&files_st, &info_st) == FUNC_FAILURE)
+		invalidate_trash_index();
+	else
+		stamp_trash_index(&files_st, &info_st);
+}
+
+/* Bracket a whole trash or untrash command, so that the trash directories
+ * are checked once before the first change, and the index stamped once
+ * after the last one, instead of around each trashed or restored file.
+ * Partial failures still invalidate the index as they happen (which also
+ * ends the batch: see clear_trash_index_data()). */
+static void
+begin_trash_batch(void)
+{
+	begin_trash_change();
+	tindex.batch = tindex.loaded;
+}
+
+static void
+end_trash_batch(void)
+{
+	tindex.batch = 0;
+	end_trash_change();
+}
+
+/* Add a new entry to the index. NAME and PATH are copied. */
+static void
+add_trash_entry(const char *name, const char *path, const char *date,
+	const off_t size, const blkcnt_t blocks)
+{
+	if (tindex.n == tindex.cap) {
+		tindex.cap = tindex.cap == 0 ? 64 : tindex.cap * 2;
+		tindex.ent = xnrealloc(tindex.ent, tindex.cap,
+			sizeof(struct trash_entry_t));
+	}
+
+	struct trash_entry_t *e = &tindex.ent[tindex.n];
+	e->name = savestring(name, strlen(name));
+	e->path = path ? savestring(path, strlen(path)) : (char *)NULL;
+	e->size = size;
+	e->blocks = blocks;
+	e->deleted = 0;
+	xstrsncpy(e->date, date ? date : "", sizeof(e->date));
+
+	tindex.n++;
+	tindex.sorted = 0;
+	tindex.dirty = 1;
+}
+
+static int
+trash_entry_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct trash_entry_t *)a)->name,
+		((const struct trash_entry_t *)b)->name);
+}
+
+/* Remove entries marked as deleted and sort the remaining ones by name. */
+static void
+normalize_trash_index(void)
+{
+	if (tindex.deleted > 0) {
+		size_t i, j = 0;
+		for (i = 0; i < tindex.n; i++) {
+			if (tindex.ent[i].deleted == 1) {
+				free(tindex.ent[i].name);
+				free(tindex.ent[i].path);
+				continue;
+			}
+			tindex.ent[j++] = tindex.ent[i];
+		}
+		tindex.n = j;
+		tindex.deleted = 0;
+	}
+
+	if (tindex.sorted == 0) {
+		if (tindex.n > 1)
+			qsort(tindex.ent, tindex.n, sizeof(struct trash_entry_t),
+				trash_entry_cmp);
+		tindex.sorted = 1;
+	}
+}
+
+static struct trash_entry_t *
+search_trash_entry(const struct trash_index_t *t, const char *name)
+{
+	struct trash_entry_t key = {0};
+	key.name = (char *)name;
+	struct trash_entry_t *e = bsearch(&key, t->ent, t->n,
+		sizeof(struct trash_entry_t), trash_entry_cmp);
+
+	return (e && e->deleted == 0) ? e : (struct trash_entry_t *)NULL;
+}
+
+static struct trash_entry_t *
+find_trash_entry(const char *name)
+{
+	if (tindex.loaded == 0 || !name)
+		return (struct trash_entry_t *)NULL;
+
+	/* Entries marked as deleted do not break the ordering. But, since
+	 * a name may be reused once deleted, compact the array after
+	 * insertions. */
+	if (tindex.sorted == 0)
+		normalize_trash_index();
+
+	return search_trash_entry(&tindex, name);
+}
+
+static void
+remove_trash_entry(const char *name)
+{
+	struct trash_entry_t *e = find_trash_entry(name);
+	if (!e)
+		return;
+
+	/* Do not compact the array here: removing many entries would be
+	 * quadratic. Deleted entries are dropped by normalize_trash_index(). */
+	e->deleted = 1;
+	tindex.deleted++;
+	tindex.dirty = 1;
+}
+
+/* Read the original path (still URL encoded) and the deletion date from
+ * the info file of the trashed file NAME. */
+static void
+read_trashinfo_fields(const char *name, char **path, char *date,
+	const size_t date_size)
+{
+	*path = (char *)NULL;
+	*date = '\0';
+
+	const size_t len = strlen(trash_info_dir) + strlen(name) + 12;
+	char *info_file = xnmalloc(len, sizeof(char));
+	snprintf(info_file, len, "%s/%s.trashinfo", trash_info_dir, name);
+
+	int fd = 0;
+	FILE *fp = open_fread(info_file, &fd);
+	free(info_file);
+	if (!fp)
+		return;
+
+	/* The max length for line is: Path=(5) + PATH_MAX + \n(1) */
+	char line[PATH_MAX + 6];
+	while (fgets(line, (int)sizeof(line), fp)) {
+		size_t l = strlen(line);
+		if (l > 0 && line[l - 1] == '\n')
+			line[--l] = '\0';
+
+		if (*line == 'P' && strncmp(line, "Path=", 5) == 0 && !*path)
+			*path = savestring(line + 5, l - 5);
+		else if (*line == 'D' && strncmp(line, "DeletionDate=", 13) == 0)
+			xstrsncpy(date, line + 13, date_size);
+	}
+
+	fclose(fp);
+}
+
+/* Rebuild the index from the trash can. Sizes already computed by the
+ * current (stale) index are reused; the remaining ones are computed lazily. */
+static int
+rebuild_trash_index(void)
+{
+	struct trash_index_t old = tindex;
+	memset(&tindex, 0, sizeof(struct trash_index_t));
+	tindex.locked = old.locked;
+
+	DIR *dir = opendir(trash_files_dir);
+	if (!dir) {
+		clear_trash_index_data(&old);
+		return FUNC_FAILURE;
+	}
+
+	struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		char *path = (char *)NULL;
+		char date[20];
+		read_trashinfo_fields(ent->d_name, &path, date, sizeof(date));
+
+		const struct trash_entry_t *e = old.sorted == 1
+			? search_trash_entry(&old, ent->d_name) : NULL;
+		if (e && strcmp(e->date, date) == 0)
+			add_trash_entry(ent->d_name, path, date, e->size, e->blocks);
+		else
+			add_trash_entry(ent->d_name, path, date, -1, 0);
+
+		free(path);
+	}
+
+	closedir(dir);
+	clear_trash_index_data(&old);
+
+	tindex.loaded = 1;
+	normalize_trash_index();
+	return FUNC_SUCCESS;
+}
+
+/* Load the on-disk index. Return FUNC_FAILURE if it does not match the
+ * trash directories (FILES_ST and INFO_ST). */
+static int
+read_trash_index(const struct stat *files_st, const struct stat *info_st)
+{
+	char *index_file = get_trash_index_path();
+	int fd = 0;
+	FILE *fp = open_fread(index_file, &fd);
+	free(index_file);
+	if (!fp)
+		return FUNC_FAILURE;
+
+	char *line = (char *)NULL;
+	size_t line_size = 0;
+	ssize_t len = getline(&line, &line_size, fp);
+
+	long long fs = 0, is = 0;
+	long fns = 0, ins = 0;
+	int version = 0;
+	if (len <= 0 || sscanf(line, TRASH_INDEX_HEADER " %d %lld %ld %lld %ld",
+	&version, &fs, &fns, &is, &ins) != 5 || version != TRASH_INDEX_VERSION) {
+		free(line);
+		fclose(fp);
+		return FUNC_FAILURE;
+	}
+
+	tindex.files_sec = (time_t)fs;
+	tindex.files_nsec = fns;
+	tindex.info_sec = (time_t)is;
+	tindex.info_nsec = ins;
+
+	/* If the index is stale, entries are still loaded, so that
+	 * rebuild_trash_index() can reuse sizes. */
+	const int match = trash_index_matches(files_st, info_st);
+
+	while ((len = getline(&line, &line_size, fp)) > 0) {
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		long long size = 0, blocks = 0;
+		char date[20];
+		int name_start = 0, name_end = 0;
+		if (sscanf(line, "%lld %lld %19s %n%*s%n", &size, &blocks, date,
+		&name_start, &name_end) != 3 || name_end <= name_start)
+			continue;
+
+		line[name_end] = '\0';
+		char *path = line + name_end + 1 < line + len
+			? line + name_end + 1 : (char *)NULL;
+		char *name = url_decode(line + name_start);
+		if (name) {
+			add_trash_entry(name, path && *path != '-' ? path : NULL,
+				*date != '-' ? date : NULL, (off_t)size, (blkcnt_t)blocks);
+			free(name);
+		}
+	}
+
+	free(line);
+	fclose(fp);
+
+	normalize_trash_index();
+	if (match == 0)
+		return FUNC_FAILURE;
+
+	tindex.loaded = 1;
+	tindex.dirty = 0;
+	return FUNC_SUCCESS;
+}
+
+/* Make sure the in-memory index reflects the current state of the trash
+ * can, loading it from disk or rebuilding it if needed.
+ * Return 1 if the index is usable, or 0 otherwise. */
+static int
+load_trash_index(void)
+{
+	if (tindex.loaded == 1 && tindex.locked == 1)
+		return 1;
+
+	struct stat files_st, info_st;
+	if (stat_trash_dirs(&files_st, &info_st) == FUNC_FAILURE)
+		return 0;
+
+	if (tindex.loaded == 1 && trash_index_matches(&files_st, &info_st) == 1)
+		return 1;
+
+	const int locked = tindex.locked;
+	clear_trash_index();
+	tindex.locked = locked;
+
+	if (read_trash_index(&files_st, &info_st) == FUNC_SUCCESS)
+		return 1;
+
+	if (rebuild_trash_index() == FUNC_FAILURE)
+		return 0;
+
+	stamp_trash_index(&files_st, &info_st);
+	tindex.dirty = 1;
+	return 1;
+}
+
+/* Write the index to disk (if modified). The index is written into a
+ * temporary file, which is then renamed over the old one.
+ * If the trash directories do not match the stamps produced by our own
+ * changes (see end_trash_change()), someone else modified them: the index
+ * is discarded instead. */
+static void
+save_trash_index(void)
+{
+	if (tindex.loaded == 0)
+		return;
+
+	struct stat files_st, info_st;
+	if (stat_trash_dirs(&files_st, &info_st) == FUNC_FAILURE
+	|| trash_index_matches(&files_st, &info_st) == 0) {
+		invalidate_trash_index();
+		return;
+	}
+
+	if (tindex.dirty == 0)
+		return;
+
+	normalize_trash_index();
+
+	char *index_file = get_trash_index_path();
+	const size_t tmp_len = strlen(index_file) + 5;
+	char *tmp_file = xnmalloc(tmp_len, sizeof(char));
+	snprintf(tmp_file, tmp_len, "%s.tmp", index_file);
+
+	int fd = 0;
+	FILE *fp = open_fwrite(tmp_file, &fd);
+	if (!fp) {
+		free(tmp_file);
+		free(index_file);
+		return;
+	}
+
+	fprintf(fp, "%s %d %lld %ld %lld %ld\n", TRASH_INDEX_HEADER,
+		TRASH_INDEX_VERSION, (long long)tindex.files_sec, tindex.files_nsec,
+		(long long)tindex.info_sec, tindex.info_nsec);
+
+	size_t i;
+	for (i = 0; i < tindex.n; i++) {
+		const struct trash_entry_t *e = &tindex.ent[i];
+		char *name = url_encode(e->name, 0);
+		if (!name)
+			continue;
+		fprintf(fp, "%lld %lld %s %s %s\n", (long long)e->size,
+			(long long)e->blocks, *e->date ? e->date : "-", name,
+			e->path ? e->path : "-");
+		free(name);
+	}
+
+	const int write_err = ferror(fp);
+	if (fclose(fp) != 0 || write_err != 0 || rename(tmp_file, index_file) == -1)
+		unlink(tmp_file);
+	else
+		tindex.dirty = 0;
+
+	free(tmp_file);
+	free(index_file);
+}
+
+/* Set N to the number of trashed files, as recorded by the index, provided
+ * the in-memory index is up to date with the trash directories (FILES_ST is
+ * the stat of trash_files_dir).
+ * Return 1 if N was set, or 0 otherwise. */
+int
+get_trash_index_count(const struct stat *files_st, size_t *n)
+{
+	if (tindex.loaded == 0 || tindex.files_sec != files_st->st_mtime
+	|| tindex.files_nsec != get_mtime_nsec(files_st))
+		return 0;
+
+	*n = tindex.n - tindex.deleted;
+	return 1;
+}
 
 /* Return the number of currently trashed files. */
 static size_t
@@ -54,6 +604,9 @@ count_trashed_files(void)
 {
 	size_t n = 0;
 	if (trash_ok == 1 && trash_files_dir != NULL) {
+		if (tindex.loaded == 1)
+			return tindex.n - tindex.deleted;
+
 		filesn_t ret = count_dir(trash_files_dir, NO_CPOP);
 		n = ret <= 2 ? 0 : (size_t)ret - 2;
 	}
@@ -94,32 +647,98 @@ print_removal_result(const size_t n)
 	}
 }
 
-/* Remove the file named NAME and the corresponding .trashinfo file from
- * the trash can.
- * Returns 0 on success or >0 on error. */
+/* Sort pointers to names by name, and names given more than once by
+ * position. */
 static int
-remove_file_from_trash(const char *name)
+trash_name_ref_cmp(const void *a, const void *b)
 {
-	size_t len = strlen(name) + 11;
-	char *info_file = xnmalloc(len, sizeof(char));
-	snprintf(info_file, len, "%s.trashinfo", name);
+	char *const *pa = *(char *const *const *)a;
+	char *const *pb = *(char *const *const *)b;
 
-	len = strlen(trash_files_dir) + strlen(name) + 2;
-	char *file1 = xnmalloc(len, sizeof(char));
-	snprintf(file1, len, "%s/%s", trash_files_dir, name);
+	const int ret = strcmp(*pa, *pb);
+	if (ret != 0)
+		return ret;
 
-	len = strlen(trash_info_dir) + strlen(info_file) + 2;
-	char *file2 = xnmalloc(len, sizeof(char));
-	snprintf(file2, len, "%s/%s", trash_info_dir, info_file);
+	return pa < pb ? -1 : (pa > pb);
+}
 
-	char *cmd[] = {"rm", "-rf", "--", file1, file2, NULL};
-	int ret = launch_execv(cmd, FOREGROUND, E_NOFLAG);
+/* Remove the N trashed files NAMES (names relative to the trash files
+ * directory), together with their info files, in a single batch.
+ * Return the number of files actually removed, and set STATUS to
+ * FUNC_FAILURE if some file could not be removed. If not NULL, ERRS (an
+ * array of N ints) is set to nonzero for each file not removed. */
+static size_t
+remove_files_from_trash(char **names, const size_t n, int *status, int *errs)
+{
+	if (n == 0)
+		return 0;
 
-	free(file1);
-	free(file2);
-	free(info_file);
+	/* Trashed files go in TARGETS[0..N-1], and their info files in
+	 * TARGETS[N..2N-1]. */
+	char **targets = xnmalloc(n * 2, sizeof(char *));
+	int *failed = xnmalloc(n * 2, sizeof(int));
+	const size_t files_dir_len = strlen(trash_files_dir);
+	const size_t info_dir_len = strlen(trash_info_dir);
+	size_t i;
 
-	return ret;
+	for (i = 0; i < n; i++) {
+		const size_t name_len = strlen(names[i]);
+
+		size_t len = files_dir_len + name_len + 2;
+		targets[i] = xnmalloc(len, sizeof(char));
+		snprintf(targets[i], len, "%s/%s", trash_files_dir, names[i]);
+
+		len = info_dir_len + name_len + 12;
+		targets[n + i] = xnmalloc(len, sizeof(char));
+		snprintf(targets[n + i], len, "%s/%s.trashinfo", trash_info_dir,
+			names[i]);
+	}
+
+	begin_trash_change();
+	if (xcp_remove(targets, n * 2, failed, "trash") != FUNC_SUCCESS)
+		*status = FUNC_FAILURE;
+
+	/* The same name may be given more than once (say, 't del 1 1'): count
+	 * it only once. DUP[I] is nonzero if NAMES[I] was already given. */
+	char ***sorted = xnmalloc(n, sizeof(char **));
+	char *dup = xcalloc(n, sizeof(char));
+	for (i = 0; i < n; i++)
+		sorted[i] = &names[i];
+
+	qsort(sorted, n, sizeof(char **), trash_name_ref_cmp);
+	for (i = 1; i < n; i++) {
+		if (strcmp(*sorted[i], *sorted[i - 1]) == 0)
+			dup[sorted[i] - names] = 1;
+	}
+	free(sorted);
+
+	size_t removed = 0;
+	int partial = 0;
+	for (i = 0; i < n; i++) {
+		const int err = (failed[i] != 0 || failed[n + i] != 0);
+		if (errs)
+			errs[i] = err;
+		if (err == 0) {
+			remove_trash_entry(names[i]);
+			if (dup[i] == 0)
+				removed++;
+		} else {
+			partial = 1;
+		}
+	}
+
+	if (partial == 1)
+		invalidate_trash_index();
+	else
+		end_trash_change();
+
+	for (i = 0; i < n * 2; i++)
+		free(targets[i]);
+	free(targets);
+	free(failed);
+	free(dup);
+
+	return removed;
 }
 
 /* Empty the trash can. */
@@ -140,26 +759,33 @@ trash_clear(void)
 		return errno;
 	}
 
-	int exit_status = FUNC_SUCCESS;
-	size_t n = 0;
-	size_t removed = 0;
+	/* Collect all names first: files are then removed in a single batch. */
+	char **names = (char **)NULL;
+	size_t n = 0, cap = 0;
 	struct dirent *ent;
 
 	while ((ent = readdir(dir))) {
 		if (SELFORPARENT(ent->d_name))
 			continue;
 
-		const int ret = remove_file_from_trash(ent->d_name);
-		if (ret != FUNC_SUCCESS)
-			exit_status = ret;
-		else
-			removed++;
-
+		if (n == cap) {
+			cap = cap == 0 ? 64 : cap * 2;
+			names = xnrealloc(names, cap, sizeof(char *));
+		}
+		names[n] = savestring(ent->d_name, strlen(ent->d_name));
 		n++;
 	}
 
 	closedir(dir);
 
+	int exit_status = FUNC_SUCCESS;
+	const size_t removed = remove_files_from_trash(names, n, &exit_status, NULL);
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		free(names[i]);
+	free(names);
+
 	if (n == 0) {
 		puts(_("trash: No trashed files"));
 	} else {
@@ -171,81 +797,228 @@ trash_clear(void)
 	return exit_status;
 }
 
+/* In-memory snapshot of the names in the trash files directory, used to
+ * generate unique names for trashed files without probing the filesystem
+ * for each candidate name. */
+struct trash_names_t {
+	char **names; /* Open addressing hash table (CAP is a power of two) */
+	size_t cap;
+	size_t n;
+};
+
+/* A file to be moved into the trash can across filesystems. */
+struct trash_xdev_t {
+	char *src;
+	char *name;  /* Name of the file in the trash can */
+	dev_t dev;   /* Filesystem the file lives in */
+	size_t arg;  /* Index of the file in the list of arguments */
+};
+
+/* State of a batch trash operation (see trash_files_args()). */
+struct trash_batch_t {
+	struct trash_names_t names;
+	struct trash_xdev_t *xdev;
+	size_t xdev_n;
+	size_t xdev_cap;
+	int files_fd; /* File descriptor of trash_files_dir */
+	int info_fd;  /* File descriptor of trash_info_dir */
+};
+
+/* trash_file() queued the file to be moved across filesystems. */
+#define TRASH_PENDING (-1)
+
+static int
+has_trash_name(const struct trash_names_t *t, const char *name)
+{
+	if (t->cap == 0)
+		return 0;
+
+	size_t i = hashme(name, 1) & (t->cap - 1);
+	while (t->names[i]) {
+		if (*t->names[i] == *name && strcmp(t->names[i], name) == 0)
+			return 1;
+		i = (i + 1) & (t->cap - 1);
+	}
+
+	return 0;
+}
+
+/* Add NAME (already allocated) to the set of names in the trash can. */
+static void
+add_trash_name(struct trash_names_t *t, char *name)
+{
+	if ((t->n + 1) * 2 > t->cap) {
+		const size_t old_cap = t->cap;
+		char **old = t->names;
+
+		t->cap = old_cap == 0 ? 64 : old_cap * 2;
+		t->names = xcalloc(t->cap, sizeof(char *));
+
+		size_t i;
+		for (i = 0; i < old_cap; i++) {
+			if (!old[i])
+				continue;
+			size_t j = hashme(old[i], 1) & (t->cap - 1);
+			while (t->names[j])
+				j = (j + 1) & (t->cap - 1);
+			t->names[j] = old[i];
+		}
+
+		free(old);
+	}
+
+	size_t i = hashme(name, 1) & (t->cap - 1);
+	while (t->names[i])
+		i = (i + 1) & (t->cap - 1);
+
+	t->names[i] = name;
+	t->n++;
+}
+
+static void
+free_trash_batch(struct trash_batch_t *b)
+{
+	size_t i;
+	for (i = 0; i < b->names.cap; i++)
+		free(b->names.names[i]);
+	free(b->names.names);
+
+	for (i = 0; i < b->xdev_n; i++) {
+		free(b->xdev[i].src);
+		free(b->xdev[i].name);
+	}
+	free(b->xdev);
+
+	if (b->files_fd != -1)
+		close(b->files_fd);
+	if (b->info_fd != -1)
+		close(b->info_fd);
+}
+
+/* Open the trash directories and load the names of trashed files.
+ * Return FUNC_SUCCESS on success, or FUNC_FAILURE on error. */
 static int
-gen_trashinfo_file(char *file, const char *suffix, const struct tm *tm)
+init_trash_batch(struct trash_batch_t *b)
+{
+	b->files_fd = open(trash_files_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	b->info_fd = open(trash_info_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	const int fd = b->files_fd == -1 ? -1 : dup(b->files_fd);
+	DIR *dir = (b->info_fd == -1 || fd == -1) ? NULL : fdopendir(fd);
+	if (!dir) {
+		xerror("trash: '%s': %s\n", b->files_fd == -1 ? trash_files_dir
+			: trash_info_dir, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return FUNC_FAILURE;
+	}
+
+	struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		if (!SELFORPARENT(ent->d_name))
+			add_trash_name(&b->names,
+				savestring(ent->d_name, strlen(ent->d_name)));
+	}
+
+	closedir(dir);
+	return FUNC_SUCCESS;
+}
+
+/* Create the info file for the file FILE (absolute path), to be trashed as
+ * NAME, in the trash info directory. The file is created exclusively, so
+ * that NAME is reserved for us.
+ * Return FUNC_SUCCESS on success, or an errno value on error. */
+static int
+gen_trashinfo_file(const struct trash_batch_t *b, char *file,
+	const char *name, const struct tm *tm)
 {
 	/* Encode path to URL format (RF 2396) */
 	char *url_str = url_encode(file, 0);
 	if (!url_str) {
 		xerror(_("trash: '%s': Error encoding path\n"), file);
-		return FUNC_FAILURE;
+		return EINVAL;
 	}
 
-	const size_t len = strlen(trash_info_dir) + strlen(suffix) + 12;
-	char *info_file = xnmalloc(len, sizeof(char));
-	snprintf(info_file, len, "%s/%s.trashinfo", trash_info_dir, suffix);
+	char info_file[NAME_MAX + 32];
+	snprintf(info_file, sizeof(info_file), "%s.trashinfo", name);
 
-	int fd = open(info_file, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
-	FILE *fp;
-	if (fd == -1 || !(fp = fdopen(fd, "w"))) {
+	begin_trash_change();
+	const int fd = openat(b->info_fd, info_file,
+		O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+	if (fd == -1) {
 		const int saved_errno = errno;
-		if (fd != -1) close(fd);
-		xerror("trash: '%s': %s\n", info_file, strerror(saved_errno));
-		free(info_file);
 		free(url_str);
 		return saved_errno;
 	}
 
-	fprintf(fp,
+	const size_t len = strlen(url_str) + 64;
+	char *buf = xnmalloc(len, sizeof(char));
+	const int n = snprintf(buf, len,
 	    "[Trash Info]\nPath=%s\nDeletionDate=%d-%02d-%02dT%02d:%02d:%02d\n",
 	    url_str, tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
 	    tm->tm_hour, tm->tm_min, tm->tm_sec);
 
-	free(url_str);
-	free(info_file);
-	fclose(fp);
+	int ret = FUNC_SUCCESS;
+	if (n < 0 || write(fd, buf, (size_t)n) != (ssize_t)n)
+		ret = errno != 0 ? errno : EIO;
 
-	return FUNC_SUCCESS;
+	if (close(fd) == -1 && ret == FUNC_SUCCESS)
+		ret = errno;
+
+	if (ret != FUNC_SUCCESS) {
+		unlinkat(b->info_fd, info_file, 0);
+	} else if (tindex.loaded == 1) {
+		/* BUF is "...DeletionDate=DATE\n" */
+		buf[n - 1] = '\0';
+		add_trash_entry(name, url_str, strrchr(buf, '=') + 1, -1, 0);
+	}
+
+	end_trash_change();
+	free(buf);
+	free(url_str);
+	return ret;
 }
 
 static void
-remove_trashinfo_file(const char *name)
+remove_trashinfo_file(const struct trash_batch_t *b, const char *name)
 {
-	const size_t len = strlen(trash_info_dir) + strlen(name) + 12;
-	char *info_file = xnmalloc(len, sizeof(char));
-	snprintf(info_file, len, "%s/%s.trashinfo", trash_info_dir, name);
+	char info_file[NAME_MAX + 32];
+	snprintf(info_file, sizeof(info_file), "%s.trashinfo", name);
 
-	if (unlink(info_file) == -1) {
-		err('w', PRINT_PROMPT, "trash: Cannot remove info file '%s': %s\n",
-			info_file, strerror(errno));
+	begin_trash_change();
+	remove_trash_entry(name);
+	if (unlinkat(b->info_fd, info_file, 0) == -1) {
+		err('w', PRINT_PROMPT, "trash: Cannot remove info file '%s/%s': %s\n",
+			trash_info_dir, info_file, strerror(errno));
 	}
-
-	free(info_file);
+	end_trash_change();
 }
 
-/* Create the trashed filename: orig_filename.suffix, where SUFFIX is
- * the current date and time (plus an integer in case of dups).
- * Returns the absolute path to this file and updates FILE_SUFFIX to
- * its basename. */
+/* Generate a unique name in the trash can for the file FILE (absolute
+ * path), and create its info file. Return the new name, or NULL on error. */
 static char *
-gen_dest_file(const char *file, const char *suffix, char **file_suffix)
+gen_dest_file(struct trash_batch_t *b, char *file, const char *suffix,
+	const struct tm *tm)
 {
-	char *filename = strrchr(file, '/');
-	if (!filename || !*(++filename)) {
+	const char *p = strrchr(file, '/');
+	if (!p || !*(++p)) {
 		xerror(_("trash: '%s': Error getting file base name\n"), file);
 		return (char *)NULL;
 	}
 
+	char filename[NAME_MAX + 1];
+	xstrsncpy(filename, p, sizeof(filename));
+
 	/* If the length of the trashed filename (orig_filename.suffix) is
 	 * longer than NAME_MAX (255), trim the original filename, so that
 	 * (original_filename_len + 1 (dot) + suffix_len) won't be longer
 	 * than NAME_MAX. */
 	const size_t filename_len = strlen(filename);
 	const size_t suffix_len = strlen(suffix);
-	const int size = (int)(filename_len + suffix_len + 11) - NAME_MAX;
 	/* len = filename.suffix.trashinfo */
+	const int size = (int)(filename_len + suffix_len + 11) - NAME_MAX;
 
-	if (size > 0) {
+	if (size > 0 && (size_t)size < filename_len) {
 		/* THIS IS NOT UNICODE AWARE */
 		/* If SIZE is a positive value, that is, the trashed filename
 		 * exceeds NAME_MAX by SIZE bytes, reduce the original filename
@@ -255,31 +1028,66 @@ gen_dest_file(const char *file, const char *suffix, char **file_suffix)
 		filename[filename_len - (size_t)size] = '\0';
 	}
 
-	const size_t slen = filename_len + suffix_len + 2 + 16;
-	*file_suffix = xnmalloc(slen, sizeof(char));
-	snprintf(*file_suffix, slen, "%s.%s", filename, suffix);
+	const size_t slen = strlen(filename) + suffix_len + 2 + 16;
+	char *name = xnmalloc(slen, sizeof(char));
+	snprintf(name, slen, "%s.%s", filename, suffix);
 
-	/* NOTE: It is guaranteed (by check_trash_file(), called before from
-	 * trash_file_args()) that FILE does not end with a slash. */
-	const size_t dlen = strlen(trash_files_dir) + strlen(*file_suffix) + 2 + 16;
-	char *dest = xnmalloc(dlen, sizeof(char));
-	snprintf(dest, dlen, "%s/%s", trash_files_dir, *file_suffix);
-
-	/* If the destination file exists (there's already a trashed file with
-	 * this name), append an integer until it is made unique. */
-	struct stat a;
+	/* If there's already a trashed file with this name, append an integer
+	 * until it is made unique. Names are checked against the snapshot of
+	 * the trash can, and the info file, created exclusively, reserves the
+	 * name for us. */
 	int inc = 1;
-	while (lstat(dest, &a) == 0 && inc > 0) {
-		snprintf(*file_suffix, slen, "%s.%s-%d", filename, suffix, inc);
-		snprintf(dest, dlen, "%s/%s", trash_files_dir, *file_suffix);
+	while (inc > 0) {
+		if (has_trash_name(&b->names, name) == 0) {
+			const int ret = gen_trashinfo_file(b, file, name, tm);
+			if (ret == FUNC_SUCCESS) {
+				add_trash_name(&b->names, savestring(name, strlen(name)));
+				return name;
+			}
+
+			if (ret != EEXIST) {
+				xerror("trash: '%s/%s.trashinfo': %s\n", trash_info_dir,
+					name, strerror(ret));
+				free(name);
+				return (char *)NULL;
+			}
+
+			/* Created by someone else in the meanwhile */
+			add_trash_name(&b->names, savestring(name, strlen(name)));
+		}
+
+		snprintf(name, slen, "%s.%s-%d", filename, suffix, inc);
 		inc++;
 	}
 
-	return dest;
+	free(name);
+	return (char *)NULL;
 }
 
+/* Queue FILE (trashed as NAME) to be moved into the trash can across
+ * filesystems (see move_xdev_files()). */
+static void
+queue_xdev_file(struct trash_batch_t *b, const char *file, char *name,
+	const dev_t dev, const size_t arg)
+{
+	if (b->xdev_n == b->xdev_cap) {
+		b->xdev_cap = b->xdev_cap == 0 ? 16 : b->xdev_cap * 2;
+		b->xdev = xnrealloc(b->xdev, b->xdev_cap, sizeof(struct trash_xdev_t));
+	}
+
+	b->xdev[b->xdev_n].src = savestring(file, strlen(file));
+	b->xdev[b->xdev_n].name = name;
+	b->xdev[b->xdev_n].dev = dev;
+	b->xdev[b->xdev_n].arg = arg;
+	b->xdev_n++;
+}
+
+/* Trash the file FILE (the ARG-th argument). Return FUNC_SUCCESS if the
+ * file was trashed, TRASH_PENDING if it must be moved across filesystems
+ * (see move_xdev_files()), or an error code otherwise. */
 static int
-trash_file(const char *suffix, const struct tm *tm, char *file)
+trash_file(struct trash_batch_t *b, const char *suffix, const struct tm *tm,
+	char *file, const size_t arg)
 {
 	struct stat attr;
 	if (lstat(file, &attr) == -1) {
@@ -304,40 +1112,112 @@ trash_file(const char *suffix, const struct tm *tm, char *file)
 		tmpfile = full_path;
 	}
 
-	char *file_suffix = (char *)NULL;
-	char *dest = gen_dest_file(tmpfile, suffix, &file_suffix);
-
 	/* As per the FreeDesktop specification, generate the info file first. */
-	if (!dest || !file_suffix
-	|| gen_trashinfo_file(tmpfile, file_suffix, tm) != FUNC_SUCCESS) {
-		free(dest);
-		free(file_suffix);
+	char *name = gen_dest_file(b, tmpfile, suffix, tm);
+	if (!name)
 		return FUNC_FAILURE;
-	}
 
 	/* Move the original file into the trash directory. */
-	int mvcmd = 0;
-	int ret = renameat(XAT_FDCWD, file, XAT_FDCWD, dest);
-	if (ret != FUNC_SUCCESS && errno == EXDEV) {
+	begin_trash_change();
+	const int ret = renameat(XAT_FDCWD, file, b->files_fd, name);
+	end_trash_change();
+	if (ret == 0) {
+		free(name);
+		return FUNC_SUCCESS;
+	}
+
+	if (errno == EXDEV) {
 		/* Destination file is on a different filesystem, which is why
-		 * renameat(2) fails: let's try with mv(1). */
-		char *tmp_cmd[] = {"mv", "--", file, dest, NULL};
-		ret = launch_execv(tmp_cmd, FOREGROUND, E_NOFLAG);
-		mvcmd = 1;
+		 * renameat(2) fails: files are moved later, grouped by source
+		 * filesystem. */
+		queue_xdev_file(b, file, name, attr.st_dev, arg);
+		return TRASH_PENDING;
 	}
 
-	free(dest);
+	const int saved_errno = errno;
+	xerror(_("trash: Cannot trash '%s': %s\n"), file, strerror(saved_errno));
+	remove_trashinfo_file(b, name);
+	free(name);
+	return saved_errno;
+}
 
-	if (ret != FUNC_SUCCESS) {
-		remove_trashinfo_file(file_suffix);
-		free(file_suffix);
-		if (mvcmd == 0)
-			xerror(_("trash: Cannot trash '%s': %s\n"), file, strerror(errno));
-		return (mvcmd == 1 ? ret : errno);
+static int
+xdev_cmp(const void *a, const void *b)
+{
+	const struct trash_xdev_t *pa = (const struct trash_xdev_t *)a;
+	const struct trash_xdev_t *pb = (const struct trash_xdev_t *)b;
+
+	if (pa->dev != pb->dev)
+		return pa->dev < pb->dev ? -1 : 1;
+
+	return pa->arg < pb->arg ? -1 : (pa->arg > pb->arg);
+}
+
+/* Move files queued by trash_file() into the trash can, one source
+ * filesystem at a time: with the built-in engine (mvCmd=MV_BUILTIN), all
+ * files in a filesystem are moved in a single pass; otherwise, mv(1) is
+ * run for each file. STATUS (an array indexed by argument number) is set to
+ * FUNC_SUCCESS for each successfully moved file. */
+static void
+move_xdev_files(struct trash_batch_t *b, int *status)
+{
+	if (b->xdev_n == 0)
+		return;
+
+	qsort(b->xdev, b->xdev_n, sizeof(struct trash_xdev_t), xdev_cmp);
+
+	char **srcs = xnmalloc(b->xdev_n + 1, sizeof(char *));
+	char **dsts = xnmalloc(b->xdev_n + 1, sizeof(char *));
+	int *failed = xnmalloc(b->xdev_n + 1, sizeof(int));
+	size_t i, j, start = 0;
+	int partial = 0;
+
+	for (i = 0; i < b->xdev_n; i++) {
+		const size_t len = strlen(trash_files_dir) + strlen(b->xdev[i].name) + 2;
+		srcs[i] = b->xdev[i].src;
+		dsts[i] = xnmalloc(len, sizeof(char));
+		snprintf(dsts[i], len, "%s/%s", trash_files_dir, b->xdev[i].name);
 	}
 
-	free(file_suffix);
-	return ret;
+	while (start < b->xdev_n) {
+		size_t end = start + 1;
+		while (end < b->xdev_n && b->xdev[end].dev == b->xdev[start].dev)
+			end++;
+
+		begin_trash_change();
+		if (conf.mv_cmd == MV_BUILTIN) {
+			xcp_move_files(srcs + start, dsts + start, end - start,
+				failed + start, "trash");
+		} else {
+			for (j = start; j < end; j++) {
+				char *cmd[] = {"mv", "--", srcs[j], dsts[j], NULL};
+				failed[j] = launch_execv(cmd, FOREGROUND, E_NOFLAG);
+			}
+		}
+		end_trash_change();
+
+		for (j = start; j < end; j++) {
+			if (failed[j] != 0) {
+				remove_trashinfo_file(b, b->xdev[j].name);
+				partial = 1;
+			} else {
+				status[b->xdev[j].arg] = FUNC_SUCCESS;
+			}
+		}
+
+		start = end;
+	}
+
+	/* A failed cross-device move may leave a partial copy behind, in
+	 * which case the index cannot be trusted anymore. */
+	if (partial == 1)
+		invalidate_trash_index();
+
+	for (i = 0; i < b->xdev_n; i++)
+		free(dsts[i]);
+	free(dsts);
+	free(srcs);
+	free(failed);
 }
 
 /* 't del FILE...' */
@@ -363,19 +1243,20 @@ remove_from_trash_params(char **args)
 		return FUNC_SUCCESS;
 
 
-	for (i = 0; args[i]; i++) {
+	const size_t n = i;
+	char **names = xnmalloc(n + 1, sizeof(char *));
+	for (i = 0; i < n; i++) {
 		char *d = (char *)NULL;
 		if (strchr(args[i], '\\'))
 			d = unescape_str(args[i], 0);
+		names[i] = d ? d : savestring(args[i], strlen(args[i]));
+	}
 
-		const int ret = remove_file_from_trash(d ? d : args[i]);
-		if (ret != FUNC_SUCCESS)
-			exit_status = ret;
-		else
-			rem_files++;
+	rem_files = remove_files_from_trash(names, n, &exit_status, NULL);
 
-		free(d);
-	}
+	for (i = 0; i < n; i++)
+		free(names[i]);
+	free(names);
 
 	if (exit_status != FUNC_SUCCESS && conf.autols == 1)
 		press_any_key_to_continue(0);
@@ -476,13 +1357,12 @@ remove_from_trash_all(struct dirent ***tfiles, const int tfiles_n,
 		return (-1);
 	}
 
-	for (i = 0; i < (size_t)tfiles_n; i++) {
-		int ret = remove_file_from_trash((*tfiles)[i]->d_name);
-		if (ret != FUNC_SUCCESS)
-			*status = FUNC_FAILURE;
-		else
-			n++;
-	}
+	char **names = xnmalloc((size_t)tfiles_n + 1, sizeof(char *));
+	for (i = 0; i < (size_t)tfiles_n; i++)
+		names[i] = (*tfiles)[i]->d_name;
+
+	n = (int)remove_files_from_trash(names, (size_t)tfiles_n, status, NULL);
+	free(names);
 
 	if (*status != FUNC_SUCCESS && conf.autols == 1)
 		press_any_key_to_continue(0);
@@ -491,15 +1371,60 @@ remove_from_trash_all(struct dirent ***tfiles, const int tfiles_n,
 	return n;
 }
 
+static int
+trashed_files_cmp(const void *a, const void *b)
+{
+	return conf.case_sens_list == 1
+		? xalphasort((const struct dirent **)a, (const struct dirent **)b)
+		: alphasort_insensitive((const struct dirent **)a,
+			(const struct dirent **)b);
+}
+
+/* Store the list of trashed files into ENTS, as scandir(3) would do, but
+ * taking names from the trash index, if available, instead of reading the
+ * trash directory. Return the number of files or -1 on error. */
+static int
+scan_trashed_files(struct dirent ***ents)
+{
+	if (load_trash_index() == 0)
+		return scandir(trash_files_dir, ents, skip_files,
+			conf.case_sens_list == 1 ? xalphasort : alphasort_insensitive);
+
+	normalize_trash_index();
+
+	struct dirent **list = xnmalloc(tindex.n + 1, sizeof(struct dirent *));
+	size_t i;
+	int n = 0;
+
+	for (i = 0; i < tindex.n; i++) {
+		struct dirent *ent = xcalloc(1, sizeof(struct dirent));
+		xstrsncpy(ent->d_name, tindex.ent[i].name, sizeof(ent->d_name));
+		if (skip_files(ent) == 0) {
+			free(ent);
+			continue;
+		}
+		list[n] = ent;
+		n++;
+	}
+
+	if (n == 0) {
+		free(list);
+		list = (struct dirent **)NULL;
+	} else {
+		qsort(list, (size_t)n, sizeof(struct dirent *), trashed_files_cmp);
+	}
+
+	*ents = list;
+	return n;
+}
+
 static struct dirent **
 load_trashed_files(int *n, int *status)
 {
 	*status = FUNC_SUCCESS;
 
 	struct dirent **tfiles = (struct dirent **)NULL;
-	*n = scandir(trash_files_dir, &tfiles,
-		skip_files, conf.case_sens_list == 1 ? xalphasort
-		: alphasort_insensitive);
+	*n = scan_trashed_files(&tfiles);
 
 	if (*n <= -1) {
 		*status = errno;
@@ -581,33 +1506,48 @@ remove_from_trash(char **args)
 	}
 
 	/* At this point we now all input fields are valid ELNs. */
-	size_t removed = 0;
-	for (i = 0; input[i]; i++) {
-		const int num = atoi(input[i]);
+	const size_t n = i;
+	char **names = xnmalloc(n + 1, sizeof(char *));
+	int *errs = xnmalloc(n + 1, sizeof(int));
+	for (i = 0; i < n; i++)
+		names[i] = trash_files[atoi(input[i]) - 1]->d_name;
+
+	const size_t removed =
+		remove_files_from_trash(names, n, &exit_status, errs);
 
-		const int ret = remove_file_from_trash(trash_files[num - 1]->d_name);
-		if (ret != FUNC_SUCCESS) {
+	for (i = 0; i < n; i++) {
+		if (errs[i] != 0)
 			xerror(_("trash: '%s': Cannot remove file from the trash can\n"),
-				trash_files[num - 1]->d_name);
-			if (conf.autols == 1) press_any_key_to_continue(0);
-			exit_status = ret;
-		} else {
-			removed++;
-		}
+				names[i]);
 	}
 
+	if (exit_status != FUNC_SUCCESS && conf.autols == 1)
+		press_any_key_to_continue(0);
+
+	free(names);
+	free(errs);
+
 	free_files_and_input(&input, &trash_files, files_n);
 	print_removal_result(removed);
 	return exit_status;
 }
 
 /* Read original path from the trashinfo file FILE for the trashed file SRC.
+ * The trash index is checked first, so that the info file is only read
+ * if SRC is not indexed.
  * STATUS is updated to reflect success (0) or error. */
 static char *
 read_original_path(const char *file, const char *src, int *status)
 {
 	*status = FUNC_SUCCESS;
 
+	const struct trash_entry_t *e = find_trash_entry(src);
+	if (e && e->path) {
+		char *decoded = url_decode(e->path);
+		if (decoded)
+			return decoded;
+	}
+
 	int fd = 0;
 	FILE *fp = open_fread(file, &fd);
 	if (!fp) {
@@ -735,33 +1675,46 @@ untrash_file(char *file)
 		return ret;
 	}
 
+	begin_trash_change();
 	ret = renameat(XAT_FDCWD, untrash_file, XAT_FDCWD, orig_path);
 	if (ret == -1) {
 		if (errno == EXDEV) {
 			/* Destination file is on a different filesystem, which is why
-			 * rename(3) doesn't work: let's try with mv(1). */
+			 * rename(3) doesn't work: let's try with mv(1) (or the built-in
+			 * engine). */
 			char *cmd[] = {"mv", "--", untrash_file, orig_path, NULL};
-			ret = launch_execv(cmd, FOREGROUND, E_NOFLAG);
+			ret = conf.mv_cmd == MV_BUILTIN
+				? xcp_move(untrash_file, orig_path, "untrash")
+				: launch_execv(cmd, FOREGROUND, E_NOFLAG);
 			if (ret != FUNC_SUCCESS) {
+				/* A failed cross-device move may leave the trashed
+				 * file half removed. */
+				invalidate_trash_index();
 				if (conf.autols == 1)
 					press_any_key_to_continue(0);
 				free(orig_path);
 				return ret;
 			}
 		} else {
-			xerror("untrash: '%s': %s\n", untrash_file, strerror(errno));
+			const int saved_errno = errno;
+			end_trash_change();
+			xerror("untrash: '%s': %s\n", untrash_file, strerror(saved_errno));
 			if (conf.autols == 1)
 				press_any_key_to_continue(0);
 			free(orig_path);
-			return errno;
+			return saved_errno;
 		}
 	}
 
 	free(orig_path);
+	remove_trash_entry(file);
 
-	if (unlinkat(XAT_FDCWD, untrash_info, 0) == -1) {
-		xerror(_("untrash: '%s': %s\n"), untrash_info, strerror(errno));
-		return errno;
+	ret = unlinkat(XAT_FDCWD, untrash_info, 0);
+	const int saved_errno = errno;
+	end_trash_change();
+	if (ret == -1) {
+		xerror(_("untrash: '%s': %s\n"), untrash_info, strerror(saved_errno));
+		return saved_errno;
 	}
 
 	return FUNC_SUCCESS;
@@ -832,8 +1785,8 @@ untrash_files(char **args)
 	return status;
 }
 
-int
-untrash_function(char **args)
+static int
+run_untrash_function(char **args)
 {
 	if (!args)
 		return FUNC_FAILURE;
@@ -916,7 +1869,7 @@ untrash_function(char **args)
 	const size_t n = count_trashed_files();
 	if (n > 0) {
 		if (conf.clear_screen > 0) CLEAR;
-		untrash_function(args);
+		run_untrash_function(args);
 	} else {
 		if (conf.autols == 1)
 			reload_dirlist();
@@ -926,6 +1879,77 @@ untrash_function(char **args)
 	return exit_status;
 }
 
+/* Compute (and store in the trash index) the size of the trashed file E.
+ * Return zero on success or an errno value on error. */
+static int
+get_trash_entry_size(struct trash_entry_t *e)
+{
+	char path[PATH_MAX + 1];
+	snprintf(path, sizeof(path), "%s/%s", trash_files_dir, e->name);
+
+	struct stat a;
+	if (lstat(path, &a) == -1)
+		return errno;
+
+	e->size = a.st_size;
+	e->blocks = a.st_blocks;
+
+	if (S_ISDIR(a.st_mode)) {
+		struct dir_info_t info = {0};
+		dir_info(path, 1, &info);
+		if (info.status != 0)
+			return info.status;
+		e->size = info.size;
+		e->blocks = info.blocks;
+	}
+
+	tindex.dirty = 1;
+	return 0;
+}
+
+/* Return the size of the trash can. Sizes of trashed files are taken
+ * from the trash index; only files not yet indexed are actually
+ * measured. STATUS is set to nonzero if some file could not be measured. */
+static off_t
+get_trash_size(int *status)
+{
+	if (load_trash_index() == 0)
+		return dir_size(trash_files_dir, 0, status);
+
+	off_t size = 0;
+	size_t i;
+	for (i = 0; i < tindex.n; i++) {
+		struct trash_entry_t *e = &tindex.ent[i];
+		if (e->deleted == 1)
+			continue;
+
+		if (e->size == -1) {
+			const int ret = get_trash_entry_size(e);
+			if (ret != 0) {
+				*status = ret;
+				continue;
+			}
+		}
+
+		size += conf.apparent_size == 1 ? e->size
+			: (off_t)e->blocks * S_BLKSIZE;
+	}
+
+	return size;
+}
+
+int
+untrash_function(char **args)
+{
+	tindex.locked = load_trash_index();
+	begin_trash_batch();
+	const int ret = run_untrash_function(args);
+	end_trash_batch();
+	tindex.locked = 0;
+	save_trash_index();
+	return ret;
+}
+
 static void
 print_trashdir_size(void)
 {
@@ -935,7 +1959,7 @@ print_trashdir_size(void)
 	if (term_caps.suggestions == 1)
 		{fputs("Calculating...", stdout); fflush(stdout);}
 
-	const off_t full_size = dir_size(trash_files_dir, 0, &status);
+	const off_t full_size = get_trash_size(&status);
 	char *human_size = construct_human_size(full_size);
 
 	char err[sizeof(xf_cb) + 6]; *err = '\0';
@@ -962,9 +1986,7 @@ list_trashed_files(void)
 	}
 
 	struct dirent **trash_files = (struct dirent **)NULL;
-	const int files_n = scandir(trash_files_dir, &trash_files,
-		skip_files, conf.case_sens_list == 1
-		? xalphasort : alphasort_insensitive);
+	const int files_n = scan_trashed_files(&trash_files);
 
 	if (files_n == -1) {
 		xerror("trash: %s\n", strerror(errno));
@@ -1137,10 +2159,29 @@ trash_files_args(char **args)
 	if (!suffix)
 		return FUNC_FAILURE;
 
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* All files are trashed in a single batch: names are checked against
+	 * a snapshot of the trash can, info files are written via a directory
+	 * file descriptor, and the trash directories are synced only once. */
+	struct trash_batch_t batch = {0};
+	if (init_trash_batch(&batch) != FUNC_SUCCESS) {
+		free_trash_batch(&batch);
+		free(suffix);
+		return FUNC_FAILURE;
+	}
+
 	int *successfully_trashed = xnmalloc(i + 1, sizeof(int));
+	/* Result of each argument, indexed by argument number. */
+	int *status = xnmalloc(i + 1, sizeof(int));
+	const size_t args_num = i;
+
+	for (i = 0; i < args_num; i++)
+		status[i] = FUNC_FAILURE;
 
 	for (i = 1; args[i]; i++) {
-		if (trash_n + trashed_files >= MAX_TRASH) {
+		if (trash_n + trashed_files + batch.xdev_n >= MAX_TRASH) {
 			xerror("%s\n", _("trash: Cannot trash any more files"));
 			exit_status = FUNC_FAILURE;
 			break;
@@ -1163,14 +2204,11 @@ trash_files_args(char **args)
 			cwd = is_file_in_cwd(deq_file);
 
 		/* Once here, everything is fine: trash the file */
-		if (trash_file(suffix, &t, deq_file) == FUNC_SUCCESS) {
+		const int ret = trash_file(&batch, suffix, &t, deq_file, i);
+		if (ret == FUNC_SUCCESS) {
+			status[i] = FUNC_SUCCESS;
 			trashed_files++;
-			if (print_removed_files == 1) {
-				/* Store indices of successfully trashed files */
-				successfully_trashed[n] = (int)i;
-				n++;
-			}
-		} else {
+		} else if (ret != TRASH_PENDING) {
 			cwd = 0;
 			exit_status = FUNC_FAILURE;
 		}
@@ -1178,8 +2216,35 @@ trash_files_args(char **args)
 		free(deq_file);
 	}
 
+	if (batch.xdev_n > 0) {
+		move_xdev_files(&batch, status);
+		for (i = 0; i < batch.xdev_n; i++) {
+			if (status[batch.xdev[i].arg] == FUNC_SUCCESS)
+				trashed_files++;
+			else
+				exit_status = FUNC_FAILURE;
+		}
+	}
+
+	/* Make trashed files and their info files persistent. */
+	fsync(batch.files_fd);
+	fsync(batch.info_fd);
+	free_trash_batch(&batch);
 	free(suffix);
 
+	for (i = 1; i < args_num && args[i]; i++) {
+		/* Store indices of successfully trashed files */
+		if (print_removed_files == 1 && status[i] == FUNC_SUCCESS) {
+			successfully_trashed[n] = (int)i;
+			n++;
+		}
+	}
+	free(status);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	const double secs = (double)(end.tv_sec - start.tv_sec)
+		+ (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
 	if (exit_status == FUNC_SUCCESS) {
 		if (conf.autols == 1 && cwd == 1)
 			reload_dirlist();
@@ -1203,8 +2268,14 @@ trash_files_args(char **args)
 
 PRINT_TRASHED:
 	list_ok_trashed_files(args, successfully_trashed, n);
-	print_reload_msg(SET_SUCCESS_PTR, xs_cb,
-		_("%zu file(s) trashed\n"), trashed_files);
+	if (trashed_files > 1 && secs > 0) {
+		print_reload_msg(SET_SUCCESS_PTR, xs_cb,
+			_("%zu file(s) trashed (%.0f files/s)\n"), trashed_files,
+			(double)trashed_files / secs);
+	} else {
+		print_reload_msg(SET_SUCCESS_PTR, xs_cb,
+			_("%zu file(s) trashed\n"), trashed_files);
+	}
 	print_reload_msg(NULL, NULL, _("%zu total trashed file(s)\n"),
 		trash_n + trashed_files);
 
@@ -1212,8 +2283,8 @@ PRINT_TRASHED:
 	return exit_status;
 }
 
-int
-trash_function(char **args)
+static int
+run_trash_function(char **args)
 {
 	if (!args)
 		return FUNC_FAILURE;
@@ -1237,6 +2308,21 @@ trash_function(char **args)
 
 	return trash_files_args(args);
 }
+
+int
+trash_function(char **args)
+{
+	/* While running a trash command, the in-memory index is kept in sync
+	 * with our own changes: do not reload it every time the trash
+	 * directories are modified. */
+	tindex.locked = load_trash_index();
+	begin_trash_batch();
+	const int ret = run_trash_function(args);
+	end_trash_batch();
+	tindex.locked = 0;
+	save_trash_index();
+	return ret;
+}
 #else
 void *_skip_me_trash;
 #endif /* !_NO_TRASH */
@@ -27,8 +27,10 @@
 
 __BEGIN_DECLS
 
-int trash_function(char **args);
-int untrash_function(char **args);
+void free_trash_index(void);
+int  get_trash_index_count(const struct stat *files_st, size_t *n);
+int  trash_function(char **args);
+int  untrash_function(char **args);
 
 __END_DECLS
 
@@ -0,0 +1,1670 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2016-2025, L. Abramovich <leo.clifm@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* xcp.c -- A built-in copy/move engine, used instead of cp(1) and mv(1)
+ * if cpCmd/mvCmd are set to CP_BUILTIN/MV_BUILTIN.
+ *
+ * Files are copied in three steps:
+ * 1. Source trees are walked by the current thread, which creates the
+ * destination directories, symbolic links, and special files, and builds
+ * a list of regular files to be copied.
+ * 2. Regular files are copied by up to XCP_MAX_WORKERS threads. For each
+ * file, we try a reflink (FICLONE) first, then copy_file_range(2), then
+ * sendfile(2), and finally a plain read/write loop. Sparse files are
+ * copied region by region (SEEK_DATA/SEEK_HOLE), so that holes are kept.
+ * 3. Attributes of destination directories (mode, ownership, timestamps,
+ * and extended attributes) are set once their contents have been copied.
+ *
+ * Moves are renames, unless the destination is on a different filesystem,
+ * in which case files are copied and then removed (provided they were
+ * copied without errors).
+ *
+ * Files are removed (xcp_remove) by splitting operand directories into
+ * their entries, which are then removed in parallel by workers, walking
+ * subdirectories via file descriptors (openat/unlinkat). Like rm(1), "."
+ * and ".." operands, and the root directory, are refused.
+ *
+ * Since clifm ignores SIGINT, a handler is installed while the engine runs,
+ * so that long operations can be interrupted by pressing Ctrl+c: walkers
+ * and workers stop as soon as they notice (see begin_cancelable()). */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <fcntl.h>   /* open */
+#include <pthread.h>
+#include <signal.h>  /* sigaction */
+#include <string.h>
+#include <time.h>    /* clock_gettime */
+#include <unistd.h>  /* close, read, write, readlink, symlink, sysconf, unlinkat */
+
+#if defined(__linux__) && !defined(_BE_POSIX)
+# include <sys/ioctl.h>
+# include <sys/sendfile.h>
+# include <linux/fs.h> /* FICLONE */
+# define XCP_HAVE_SENDFILE
+# if defined(__GLIBC__) && (__GLIBC__ > 2 \
+|| (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#  define XCP_HAVE_COPY_FILE_RANGE
+# endif /* __GLIBC__ >= 2.27 */
+#endif /* __linux__ && !_BE_POSIX */
+
+#ifdef LINUX_FILE_XATTRS
+# include <sys/xattr.h>
+#endif /* LINUX_FILE_XATTRS */
+
+#include "mem.h"     /* xcalloc, xnmalloc, xnrealloc */
+#include "misc.h"    /* xerror */
+#include "strings.h" /* savestring */
+#include "xcp.h"
+
+/* Maximum number of threads copying regular files in parallel. Copies are
+ * mostly I/O bound: more threads would just make the disk seek around. */
+#define XCP_MAX_WORKERS 4
+/* Size of the buffer used by the read/write copy loop (one per worker). */
+#define XCP_BUF_SIZE (1024 * 1024)
+/* Maximum amount of bytes passed to a single copy_file_range/sendfile call.
+ * Cancellation is checked between calls. */
+#define XCP_CHUNK_SIZE (64 * 1024 * 1024)
+
+#ifndef CLIFM_LEGACY
+# if defined(__NetBSD__) || defined(__APPLE__)
+#  define XCP_ATIM(s) ((s)->st_atimespec)
+#  define XCP_MTIM(s) ((s)->st_mtimespec)
+# else
+#  define XCP_ATIM(s) ((s)->st_atim)
+#  define XCP_MTIM(s) ((s)->st_mtim)
+# endif /* __NetBSD__ || __APPLE__ */
+#endif /* !CLIFM_LEGACY */
+
+/* A regular file to be copied by a worker. */
+struct xcp_file_t {
+	char *src;
+	char *dst;
+	struct stat a; /* Attributes of SRC */
+	size_t origin; /* Index of the source operand this file comes from */
+	int err;       /* errno of the failed copy, or zero */
+	int pad0;
+};
+
+/* A destination directory whose attributes are set after the copy. */
+struct xcp_dir_t {
+	char *src;
+	char *dst;
+	struct stat a;
+};
+
+struct xcp_job_t {
+	struct xcp_file_t *files;
+	struct xcp_dir_t *dirs;
+	int *src_err;     /* Per source operand: nonzero if something failed */
+	const char *cmd_name;
+	size_t files_n;
+	size_t files_cap;
+	size_t dirs_n;
+	size_t dirs_cap;
+	size_t next;      /* Next file to be taken by a worker */
+	pthread_mutex_t mutex;
+};
+
+/* Set by the SIGINT handler: stop as soon as possible. */
+static volatile sig_atomic_t xcp_canceled = 0;
+static int cancelable_depth = 0;
+static struct sigaction old_sigint;
+
+static void
+xcp_sigint_handler(int sig)
+{
+	UNUSED(sig);
+	xcp_canceled = 1;
+}
+
+/* Let the user interrupt the current operation with Ctrl+c until
+ * end_cancelable() is called. Calls may be nested (a move removes its
+ * sources once copied): only the outermost one installs the handler. */
+static void
+begin_cancelable(void)
+{
+	if (cancelable_depth++ > 0)
+		return;
+
+	xcp_canceled = 0;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sigemptyset(&sa.sa_mask);
+	sa.sa_handler = xcp_sigint_handler;
+	sigaction(SIGINT, &sa, &old_sigint);
+}
+
+static void
+end_cancelable(void)
+{
+	if (--cancelable_depth == 0)
+		sigaction(SIGINT, &old_sigint, NULL);
+}
+
+/* Store the access and modification times of A into TS. */
+static void
+get_times(const struct stat *a, struct timespec ts[2])
+{
+#ifndef CLIFM_LEGACY
+	ts[0] = XCP_ATIM(a);
+	ts[1] = XCP_MTIM(a);
+#else
+	ts[0].tv_sec = a->st_atime; ts[0].tv_nsec = 0;
+	ts[1].tv_sec = a->st_mtime; ts[1].tv_nsec = 0;
+#endif /* !CLIFM_LEGACY */
+}
+
+#ifdef LINUX_FILE_XATTRS
+/* Copy extended attributes (ACLs included) from SRC to DST, either via the
+ * file descriptors IN and OUT, if not -1, or via the paths. This is done on
+ * a best effort basis: failures (say, the destination filesystem does not
+ * support extended attributes) are silently ignored. */
+static void
+copy_xattrs(const int in, const int out, const char *src, const char *dst)
+{
+	ssize_t len = in != -1 ? flistxattr(in, NULL, 0) : listxattr(src, NULL, 0);
+	if (len <= 0)
+		return;
+
+	char *names = xnmalloc((size_t)len, sizeof(char));
+	len = in != -1 ? flistxattr(in, names, (size_t)len)
+		: listxattr(src, names, (size_t)len);
+
+	char *val = (char *)NULL;
+	size_t val_cap = 0;
+	char *name = names;
+
+	while (len > 0 && name < names + len) {
+		ssize_t vlen = in != -1 ? fgetxattr(in, name, NULL, 0)
+			: getxattr(src, name, NULL, 0);
+		if (vlen >= 0) {
+			if ((size_t)vlen + 1 > val_cap) {
+				val_cap = (size_t)vlen + 1;
+				val = xnrealloc(val, val_cap, sizeof(char));
+			}
+
+			vlen = in != -1 ? fgetxattr(in, name, val, (size_t)vlen)
+				: getxattr(src, name, val, (size_t)vlen);
+			if (vlen >= 0) {
+				if (out != -1)
+					fsetxattr(out, name, val, (size_t)vlen, 0);
+				else
+					setxattr(dst, name, val, (size_t)vlen, 0);
+			}
+		}
+
+		name += strlen(name) + 1;
+	}
+
+	free(val);
+	free(names);
+}
+#endif /* LINUX_FILE_XATTRS */
+
+static int
+write_all(const int fd, const char *buf, const size_t len)
+{
+	size_t done = 0;
+	while (done < len) {
+		const ssize_t w = write(fd, buf + done, len - done);
+		if (w == -1) {
+			if (errno != EINTR)
+				return errno;
+			if (xcp_canceled == 1)
+				return ECANCELED;
+			continue;
+		}
+		done += (size_t)w;
+	}
+
+	return 0;
+}
+
+static int
+is_zero_block(const char *buf, const size_t len)
+{
+	return (len > 0 && *buf == '\0' && memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+/* Copy LEN bytes (or up to the end of file, if LEN is negative) from IN into
+ * OUT using read/write. If SPARSE is set, blocks of zeros are not written,
+ * but skipped over, so that they become holes in OUT.
+ * Return zero on success or an errno value on error. */
+static int
+copy_rw(const int in, const int out, off_t len, char *buf, const int sparse)
+{
+	int skipped = 0;
+
+	while (len != 0) {
+		if (xcp_canceled == 1)
+			return ECANCELED;
+
+		const size_t count = (len < 0 || len > XCP_BUF_SIZE)
+			? XCP_BUF_SIZE : (size_t)len;
+		const ssize_t r = read(in, buf, count);
+		if (r == 0)
+			break;
+		if (r == -1) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		if (len > 0)
+			len -= r;
+
+		if (sparse == 1 && is_zero_block(buf, (size_t)r)) {
+			if (lseek(out, r, SEEK_CUR) == -1)
+				return errno;
+			skipped = 1;
+			continue;
+		}
+
+		skipped = 0;
+		const int ret = write_all(out, buf, (size_t)r);
+		if (ret != 0)
+			return ret;
+	}
+
+	/* The file ends with a hole: set its size. */
+	if (skipped == 1) {
+		const off_t end = lseek(out, 0, SEEK_CUR);
+		if (end == -1 || ftruncate(out, end) == -1)
+			return errno;
+	}
+
+	return 0;
+}
+
+/* Copy the data regions of the sparse file IN (SIZE bytes) into OUT,
+ * leaving holes unwritten. Return zero on success, an errno value on error,
+ * or -1 if holes cannot be located in IN. */
+static int
+copy_sparse_data(const int in, const int out, const off_t size, char *buf)
+{
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+	off_t data = 0;
+
+	while (data < size) {
+		const off_t start = lseek(in, data, SEEK_DATA);
+		if (start == -1) {
+			if (errno == ENXIO) /* Only a hole is left */
+				break;
+			return data == 0 ? -1 : errno;
+		}
+
+		const off_t end = lseek(in, start, SEEK_HOLE);
+		if (end == -1 || lseek(in, start, SEEK_SET) == -1
+		|| lseek(out, start, SEEK_SET) == -1)
+			return errno;
+
+		const int ret = copy_rw(in, out, end - start, buf, 0);
+		if (ret != 0)
+			return ret;
+
+		data = end;
+	}
+
+	return ftruncate(out, size) == -1 ? errno : 0;
+#else
+	UNUSED(in); UNUSED(out); UNUSED(size); UNUSED(buf);
+	return -1;
+#endif /* SEEK_DATA && SEEK_HOLE */
+}
+
+/* Copy the contents of IN into OUT, trying the fastest available method
+ * first. A are the attributes of IN, and BUF a buffer of XCP_BUF_SIZE bytes.
+ * Return zero on success or an errno value on error. */
+static int
+copy_data(const int in, const int out, const struct stat *a, char *buf)
+{
+	const off_t size = a->st_size;
+
+	/* Files reporting a zero size (say, in /proc) may have contents
+	 * anyway: only the read/write loop copies them. */
+	if (size > 0) {
+#ifdef FICLONE
+		/* Share the source extents (Btrfs, XFS, and others). */
+		if (ioctl(out, FICLONE, in) == 0)
+			return 0;
+#endif /* FICLONE */
+
+		/* Fewer blocks than needed for its size: the file has holes. */
+		if ((off_t)a->st_blocks * S_BLKSIZE < size) {
+			const int ret = copy_sparse_data(in, out, size, buf);
+			if (ret != -1)
+				return ret;
+			if (lseek(in, 0, SEEK_SET) == -1 || lseek(out, 0, SEEK_SET) == -1)
+				return errno;
+			return copy_rw(in, out, -1, buf, 1);
+		}
+
+#ifdef XCP_HAVE_COPY_FILE_RANGE
+		off_t copied = 0;
+		while (1) {
+			if (xcp_canceled == 1)
+				return ECANCELED;
+			const ssize_t r = copy_file_range(in, NULL, out, NULL,
+				XCP_CHUNK_SIZE, 0);
+			if (r == 0)
+				return 0;
+			if (r > 0) {
+				copied += r;
+				continue;
+			}
+			if (errno == EINTR)
+				continue;
+			/* Unsupported for these files: try something else, provided
+			 * nothing was copied yet. */
+			if (copied == 0 && (errno == EXDEV || errno == ENOSYS
+			|| errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF))
+				break;
+			return errno;
+		}
+#endif /* XCP_HAVE_COPY_FILE_RANGE */
+
+#ifdef XCP_HAVE_SENDFILE
+		off_t sent = 0;
+		while (1) {
+			if (xcp_canceled == 1)
+				return ECANCELED;
+			const ssize_t r = sendfile(out, in, NULL, XCP_CHUNK_SIZE);
+			if (r == 0)
+				return 0;
+			if (r > 0) {
+				sent += r;
+				continue;
+			}
+			if (errno == EINTR)
+				continue;
+			if (sent == 0 && (errno == ENOSYS || errno == EINVAL))
+				break;
+			return errno;
+		}
+#endif /* XCP_HAVE_SENDFILE */
+	}
+
+	return copy_rw(in, out, -1, buf, 0);
+}
+
+/* Copy the regular file F. Return zero on success or an errno value on
+ * error. */
+static int
+copy_reg_file(const struct xcp_file_t *f, char *buf)
+{
+	const int in = open(f->src, O_RDONLY | O_CLOEXEC);
+	if (in == -1)
+		return errno;
+
+	/* Keep the copy private until its contents and mode are set. */
+	const int out = open(f->dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+		S_IRUSR | S_IWUSR);
+	if (out == -1) {
+		const int err = errno;
+		close(in);
+		return err;
+	}
+
+	int ret = copy_data(in, out, &f->a, buf);
+
+	if (ret == 0) {
+		/* Ownership first: chown(2) may clear the SUID/SGID bits. Failing to
+		 * preserve ownership is not an error (cp(1) does the same). */
+		if (fchown(out, f->a.st_uid, f->a.st_gid) == -1) {/* ignore */}
+		if (fchmod(out, f->a.st_mode & 07777) == -1)
+			ret = errno;
+#ifdef LINUX_FILE_XATTRS
+		copy_xattrs(in, out, NULL, NULL);
+#endif /* LINUX_FILE_XATTRS */
+		struct timespec ts[2];
+		get_times(&f->a, ts);
+		futimens(out, ts);
+	}
+
+	close(in);
+	if (close(out) == -1 && ret == 0)
+		ret = errno;
+
+	/* Do not leave a truncated copy behind. */
+	if (ret == ECANCELED)
+		unlink(f->dst);
+
+	return ret;
+}
+
+/* Take regular files from the shared list one at a time and copy them
+ * until the list is exhausted. */
+static void *
+xcp_worker(void *arg)
+{
+	struct xcp_job_t *job = (struct xcp_job_t *)arg;
+	char *buf = malloc(XCP_BUF_SIZE);
+
+	while (xcp_canceled == 0) {
+		pthread_mutex_lock(&job->mutex);
+		const size_t i = job->next++;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (i >= job->files_n)
+			break;
+
+		job->files[i].err = buf ? copy_reg_file(&job->files[i], buf) : ENOMEM;
+	}
+
+	free(buf);
+	return (void *)NULL;
+}
+
+/* Run FUNC(ARG) in up to XCP_MAX_WORKERS threads (never more than TASKS),
+ * the current thread being worker zero, and wait for all of them. */
+static void
+run_workers(void *(*func)(void *), void *arg, const size_t tasks)
+{
+	if (tasks == 0)
+		return;
+
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t nworkers = cpus > 1 ? (size_t)cpus : 1;
+	if (nworkers > XCP_MAX_WORKERS)
+		nworkers = XCP_MAX_WORKERS;
+	if (nworkers > tasks)
+		nworkers = tasks;
+
+	pthread_t tid[XCP_MAX_WORKERS];
+	size_t i, spawned = 0;
+
+	for (i = 1; i < nworkers; i++) {
+		if (pthread_create(&tid[spawned], NULL, func, arg) != 0)
+			break;
+		spawned++;
+	}
+
+	func(arg);
+
+	for (i = 0; i < spawned; i++)
+		pthread_join(tid[i], NULL);
+}
+
+static char *
+join_path(const char *dir, const char *name)
+{
+	const size_t len = strlen(dir) + strlen(name) + 2;
+	char *p = xnmalloc(len, sizeof(char));
+	snprintf(p, len, "%s/%s", dir, name);
+	return p;
+}
+
+static void
+report_error(struct xcp_job_t *job, const size_t origin, const char *path,
+	const int errnum)
+{
+	xerror("%s: '%s': %s\n", job->cmd_name, path, strerror(errnum));
+	job->src_err[origin] = 1;
+}
+
+static void
+add_file(struct xcp_job_t *job, const char *src, const char *dst,
+	const struct stat *a, const size_t origin)
+{
+	if (job->files_n == job->files_cap) {
+		job->files_cap = job->files_cap == 0 ? 64 : job->files_cap * 2;
+		job->files = xnrealloc(job->files, job->files_cap,
+			sizeof(struct xcp_file_t));
+	}
+
+	struct xcp_file_t *f = &job->files[job->files_n];
+	f->src = savestring(src, strlen(src));
+	f->dst = savestring(dst, strlen(dst));
+	f->a = *a;
+	f->origin = origin;
+	f->err = 0;
+	job->files_n++;
+}
+
+static void
+add_dir(struct xcp_job_t *job, const char *src, const char *dst,
+	const struct stat *a)
+{
+	if (job->dirs_n == job->dirs_cap) {
+		job->dirs_cap = job->dirs_cap == 0 ? 16 : job->dirs_cap * 2;
+		job->dirs = xnrealloc(job->dirs, job->dirs_cap,
+			sizeof(struct xcp_dir_t));
+	}
+
+	struct xcp_dir_t *d = &job->dirs[job->dirs_n];
+	d->src = savestring(src, strlen(src));
+	d->dst = savestring(dst, strlen(dst));
+	d->a = *a;
+	job->dirs_n++;
+}
+
+/* Replace DST, if it exists and is not a directory, by a copy of the symbolic
+ * link or special file SRC. Return zero on success or an errno value on
+ * error. */
+static int
+copy_special_file(const char *src, const char *dst, const struct stat *a)
+{
+	if (unlink(dst) == -1 && errno != ENOENT)
+		return errno;
+
+	if (S_ISLNK(a->st_mode)) {
+		char target[PATH_MAX + 1];
+		const ssize_t len = readlink(src, target, sizeof(target) - 1);
+		if (len == -1)
+			return errno;
+		target[len] = '\0';
+
+		if (symlink(target, dst) == -1)
+			return errno;
+	} else if (S_ISFIFO(a->st_mode)) {
+		if (mkfifo(dst, a->st_mode & 07777) == -1)
+			return errno;
+	} else {
+		if (mknod(dst, a->st_mode, a->st_rdev) == -1)
+			return errno;
+	}
+
+	if (lchown(dst, a->st_uid, a->st_gid) == -1) {/* ignore */}
+	struct timespec ts[2];
+	get_times(a, ts);
+	utimensat(AT_FDCWD, dst, ts, AT_SYMLINK_NOFOLLOW);
+	return 0;
+}
+
+/* Walk SRC, copying directories and special files to DST, and adding
+ * regular files to the list of files to be copied by workers. */
+static void
+walk_source(struct xcp_job_t *job, const char *src, const char *dst,
+	const size_t origin)
+{
+	struct stat a;
+	if (lstat(src, &a) == -1) {
+		report_error(job, origin, src, errno);
+		return;
+	}
+
+	if (S_ISREG(a.st_mode)) {
+		struct stat b;
+		if (stat(dst, &b) != -1 && b.st_dev == a.st_dev
+		&& b.st_ino == a.st_ino) {
+			xerror(_("%s: '%s' and '%s' are the same file\n"),
+				job->cmd_name, src, dst);
+			job->src_err[origin] = 1;
+			return;
+		}
+
+		add_file(job, src, dst, &a, origin);
+		return;
+	}
+
+	if (!S_ISDIR(a.st_mode)) {
+		const int err = copy_special_file(src, dst, &a);
+		if (err != 0)
+			report_error(job, origin, dst, err);
+		return;
+	}
+
+	if (mkdir(dst, S_IRWXU) == -1) {
+		struct stat b;
+		if (errno != EEXIST || stat(dst, &b) == -1 || !S_ISDIR(b.st_mode)) {
+			report_error(job, origin, dst, errno == EEXIST ? ENOTDIR : errno);
+			return;
+		}
+		/* Make sure we can write into an already existing directory. */
+		chmod(dst, b.st_mode | S_IRWXU);
+	}
+
+	add_dir(job, src, dst, &a);
+
+	DIR *dir = opendir(src);
+	if (!dir) {
+		report_error(job, origin, src, errno);
+		return;
+	}
+
+	struct dirent *ent;
+	while (xcp_canceled == 0 && (ent = readdir(dir)) != NULL) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		char *s = join_path(src, ent->d_name);
+		char *d = join_path(dst, ent->d_name);
+		walk_source(job, s, d, origin);
+		free(s);
+		free(d);
+	}
+
+	closedir(dir);
+}
+
+/* Set the attributes of copied directories, deepest first, so that setting
+ * the timestamps of a directory is not undone by writing into it. */
+static void
+finalize_dirs(struct xcp_job_t *job)
+{
+	size_t i = job->dirs_n;
+	while (i-- > 0) {
+		struct xcp_dir_t *d = &job->dirs[i];
+		if (chown(d->dst, d->a.st_uid, d->a.st_gid) == -1) {/* ignore */}
+		chmod(d->dst, d->a.st_mode & 07777);
+#ifdef LINUX_FILE_XATTRS
+		copy_xattrs(-1, -1, d->src, d->dst);
+#endif /* LINUX_FILE_XATTRS */
+		struct timespec ts[2];
+		get_times(&d->a, ts);
+		utimensat(AT_FDCWD, d->dst, ts, 0);
+	}
+}
+
+/* A file to be removed by a worker: either an operand passed to
+ * xcp_remove(), or an entry of an operand directory. In the latter case,
+ * NAME is relative to DIRFD, the operand directory, opened once by
+ * xcp_remove(). Otherwise, DIRFD is AT_FDCWD and NAME is PATH. */
+struct xrm_task_t {
+	char *path;       /* Used for error messages */
+	const char *name; /* Points into PATH */
+	size_t origin;    /* Index of the operand this file comes from */
+	int dirfd;
+	int pad0;
+};
+
+/* A file that could not be removed. */
+struct xrm_err_t {
+	char *path;
+	size_t origin;
+	int err;
+	int pad0;
+};
+
+struct xrm_job_t {
+	struct xrm_task_t *tasks;
+	struct xrm_err_t *errs;
+	int *canceled;  /* Per operand: nonzero if interrupted (see xcp_canceled) */
+	size_t tasks_n;
+	size_t tasks_cap;
+	size_t errs_n;
+	size_t errs_cap;
+	size_t next;    /* Next task to be taken by a worker */
+	size_t batch;   /* Number of tasks taken by a worker at once */
+	pthread_mutex_t mutex;
+};
+
+/* Maximum number of operand directories kept open at once by
+ * xcp_remove(). Once reached, queued tasks are run and the directories
+ * closed before going on with the remaining operands. */
+#define XRM_MAX_OPEN_DIRS 128
+
+/* Maximum number of tasks taken by a worker at once. Most tasks are a
+ * single unlink(2): taking them one by one would make workers fight for
+ * the lock. Few (big) tasks are taken one by one, though. */
+#define XRM_BATCH 64
+
+/* Record that PATH could not be removed. Called by workers: errors are
+ * printed by the main thread once all workers are done. */
+static void
+add_rm_error(struct xrm_job_t *job, const char *dir, const char *name,
+	const int err, const size_t origin)
+{
+	char *path = dir ? join_path(dir, name) : savestring(name, strlen(name));
+
+	pthread_mutex_lock(&job->mutex);
+	if (job->errs_n == job->errs_cap) {
+		job->errs_cap = job->errs_cap == 0 ? 16 : job->errs_cap * 2;
+		job->errs = xnrealloc(job->errs, job->errs_cap,
+			sizeof(struct xrm_err_t));
+	}
+
+	job->errs[job->errs_n].path = path;
+	job->errs[job->errs_n].origin = origin;
+	job->errs[job->errs_n].err = err;
+	job->errs_n++;
+	pthread_mutex_unlock(&job->mutex);
+}
+
+/* Record that the removal of the operand ORIGIN was interrupted. */
+static void
+cancel_rm_origin(struct xrm_job_t *job, const size_t origin)
+{
+	pthread_mutex_lock(&job->mutex);
+	job->canceled[origin] = 1;
+	pthread_mutex_unlock(&job->mutex);
+}
+
+static int
+is_dir_entry(const int fd, const struct dirent *ent)
+{
+#ifdef _DIRENT_HAVE_D_TYPE
+	if (ent->d_type != DT_UNKNOWN)
+		return (ent->d_type == DT_DIR);
+#endif /* _DIRENT_HAVE_D_TYPE */
+
+	struct stat a;
+	return (fstatat(fd, ent->d_name, &a, AT_SYMLINK_NOFOLLOW) != -1
+		&& S_ISDIR(a.st_mode));
+}
+
+/* A directory being removed by remove_dir_contents(). */
+struct xrm_dir_t {
+	char *name;    /* Name in the parent directory (NULL for the root) */
+	size_t parent; /* Index of the parent directory in the stack */
+	dev_t dev;
+	ino_t ino;
+	int visited;   /* Entries already removed or queued */
+	int failed;    /* Some file inside could not be removed */
+};
+
+/* The state of remove_dir_contents(). Directories are walked using an
+ * explicit stack, instead of recursion, and only the root and the current
+ * directory are kept open, so that deep trees cannot exhaust file
+ * descriptors (nor the call stack). */
+struct xrm_walk_t {
+	struct xrm_dir_t *d;
+	const char *path; /* Path of the root directory */
+	size_t n;
+	size_t cap;
+	size_t cur;       /* Index of the directory open in CUR_FD */
+	int root_fd;
+	int cur_fd;
+};
+
+static void
+push_rm_dir(struct xrm_walk_t *w, const char *name, const size_t parent,
+	const struct stat *a)
+{
+	if (w->n == w->cap) {
+		w->cap = w->cap == 0 ? 32 : w->cap * 2;
+		w->d = xnrealloc(w->d, w->cap, sizeof(struct xrm_dir_t));
+	}
+
+	struct xrm_dir_t *d = &w->d[w->n];
+	d->name = name ? savestring(name, strlen(name)) : (char *)NULL;
+	d->parent = parent;
+	d->dev = a->st_dev;
+	d->ino = a->st_ino;
+	d->visited = 0;
+	d->failed = 0;
+	w->n++;
+}
+
+/* Return the path of the directory I, for error messages. */
+static char *
+get_rm_dir_path(const struct xrm_walk_t *w, size_t i)
+{
+	size_t len = strlen(w->path) + 1, j;
+	for (j = i; j != 0; j = w->d[j].parent)
+		len += strlen(w->d[j].name) + 1;
+
+	char *p = xnmalloc(len, sizeof(char));
+	p[len - 1] = '\0';
+	for (j = i; j != 0; j = w->d[j].parent) {
+		const size_t name_len = strlen(w->d[j].name);
+		len -= name_len + 1;
+		p[len - 1] = '/';
+		memcpy(p + len, w->d[j].name, name_len);
+	}
+	memcpy(p, w->path, len - 1);
+
+	return p;
+}
+
+static void
+add_rm_dir_error(struct xrm_job_t *job, const struct xrm_walk_t *w,
+	const size_t i, const char *name, const int err, const size_t origin)
+{
+	char *p = get_rm_dir_path(w, i);
+	add_rm_error(job, p, name, err, origin);
+	free(p);
+}
+
+/* Make FD (the directory I) the current directory. */
+static void
+set_rm_cur_dir(struct xrm_walk_t *w, const size_t i, const int fd)
+{
+	if (w->cur != 0)
+		close(w->cur_fd);
+	w->cur = i;
+	w->cur_fd = fd;
+}
+
+/* Return a file descriptor for the parent of the directory I, or -1 on
+ * error. Directories are visited depth first, so the current directory is
+ * always either I or its parent. When going back up, the parent is opened
+ * via "..", and checked to be the directory we came from. */
+static int
+get_rm_parent_fd(struct xrm_walk_t *w, const size_t i)
+{
+	const size_t p = w->d[i].parent;
+	if (w->cur == p)
+		return w->cur_fd;
+
+	if (p == 0) {
+		set_rm_cur_dir(w, 0, w->root_fd);
+		return w->root_fd;
+	}
+
+	const int fd = openat(w->cur_fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	struct stat a;
+	if (fstat(fd, &a) == -1 || a.st_dev != w->d[p].dev
+	|| a.st_ino != w->d[p].ino) {
+		close(fd);
+		errno = ESTALE; /* Moved while being removed */
+		return -1;
+	}
+
+	set_rm_cur_dir(w, p, fd);
+	return fd;
+}
+
+/* Remove the non-directory entries of the current directory (I), and push
+ * its subdirectories onto the stack.
+ * Return 0 on success, or -1 if some file could not be removed. */
+static int
+list_rm_dir(struct xrm_job_t *job, struct xrm_walk_t *w, const size_t i,
+	const size_t origin)
+{
+	const int fd = w->cur_fd;
+	const int dfd = dup(fd);
+	DIR *dir = dfd == -1 ? (DIR *)NULL : fdopendir(dfd);
+	if (!dir) {
+		add_rm_dir_error(job, w, i, NULL, errno, origin);
+		if (dfd != -1)
+			close(dfd);
+		return -1;
+	}
+
+	int ret = 0;
+	struct dirent *ent;
+	struct stat a;
+
+	while (xcp_canceled == 0 && (ent = readdir(dir)) != NULL) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		if (is_dir_entry(fd, ent) == 1) {
+			if (fstatat(fd, ent->d_name, &a, AT_SYMLINK_NOFOLLOW) == -1) {
+				if (errno != ENOENT) {
+					add_rm_dir_error(job, w, i, ent->d_name, errno, origin);
+					ret = -1;
+				}
+				continue;
+			}
+
+			if (S_ISDIR(a.st_mode)) {
+				push_rm_dir(w, ent->d_name, i, &a);
+				continue;
+			}
+		}
+
+		if (unlinkat(fd, ent->d_name, 0) == -1 && errno != ENOENT) {
+			add_rm_dir_error(job, w, i, ent->d_name, errno, origin);
+			ret = -1;
+		}
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+/* Remove the contents of the directory open in FD (PATH is used for error
+ * messages only), and close FD. Subdirectories are opened relative to
+ * their parents, and never via symbolic links.
+ * Return 0 if everything was removed, or -1 otherwise. */
+static int
+remove_dir_contents(struct xrm_job_t *job, const int fd, const char *path,
+	const size_t origin)
+{
+	struct stat a;
+	if (fstat(fd, &a) == -1) {
+		add_rm_error(job, NULL, path, errno, origin);
+		close(fd);
+		return -1;
+	}
+
+	struct xrm_walk_t w = {0};
+	w.path = path;
+	w.root_fd = w.cur_fd = fd;
+	push_rm_dir(&w, NULL, 0, &a);
+	w.d[0].visited = 1;
+	if (list_rm_dir(job, &w, 0, origin) == -1)
+		w.d[0].failed = 1;
+
+	while (w.n > 1) {
+		const size_t i = w.n - 1;
+		const int pfd = xcp_canceled == 1 ? -1 : get_rm_parent_fd(&w, i);
+		if (pfd == -1) {
+			/* Interrupted, or we cannot tell where we are anymore: give up. */
+			if (xcp_canceled == 1)
+				cancel_rm_origin(job, origin);
+			else
+				add_rm_dir_error(job, &w, i, NULL, errno, origin);
+			w.d[0].failed = 1;
+			for (; w.n > 1; w.n--)
+				free(w.d[w.n - 1].name);
+			break;
+		}
+
+		struct xrm_dir_t *d = &w.d[i];
+		if (d->visited == 0) {
+			d->visited = 1;
+			const int sfd = openat(pfd, d->name,
+				O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if (sfd == -1 || fstat(sfd, &a) == -1
+			|| a.st_dev != d->dev || a.st_ino != d->ino) {
+				const int saved_errno = sfd == -1 ? errno : ESTALE;
+				if (sfd != -1)
+					close(sfd);
+				if (saved_errno != ENOENT) {
+					add_rm_dir_error(job, &w, d->parent, d->name,
+						saved_errno, origin);
+					d->failed = 1;
+				}
+				continue;
+			}
+
+			set_rm_cur_dir(&w, i, sfd);
+			if (list_rm_dir(job, &w, i, origin) == -1)
+				w.d[i].failed = 1;
+			continue;
+		}
+
+		/* All entries of D are gone */
+		if (d->failed == 0 && unlinkat(pfd, d->name, AT_REMOVEDIR) == -1
+		&& errno != ENOENT) {
+			add_rm_dir_error(job, &w, d->parent, d->name, errno, origin);
+			d->failed = 1;
+		}
+
+		if (d->failed == 1)
+			w.d[d->parent].failed = 1;
+		free(d->name);
+		w.n--;
+	}
+
+	if (xcp_canceled == 1 && w.d[0].failed == 0) {
+		cancel_rm_origin(job, origin);
+		w.d[0].failed = 1;
+	}
+
+	const int ret = w.d[0].failed == 1 ? -1 : 0;
+	if (w.cur != 0)
+		close(w.cur_fd);
+	close(w.root_fd);
+	free(w.d);
+
+	return ret;
+}
+
+/* Remove the file or directory tree NAME, relative to DIRFD (PATH is used
+ * for error messages only). */
+static void
+remove_tree(struct xrm_job_t *job, const int dirfd, const char *name,
+	const char *path, const size_t origin)
+{
+	if (unlinkat(dirfd, name, 0) == 0 || errno == ENOENT)
+		return;
+
+	/* Directories make unlink(2) fail with EISDIR (or EPERM on some
+	 * systems), but on a read-only filesystem, say, we get EROFS: let's
+	 * just try to open NAME as a directory. */
+	const int unlink_err = errno;
+	const int fd = openat(dirfd, name,
+		O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1) {
+		add_rm_error(job, NULL, path, errno == ENOTDIR || errno == ELOOP
+			? unlink_err : errno, origin);
+		return;
+	}
+
+	if (remove_dir_contents(job, fd, path, origin) == 0
+	&& unlinkat(dirfd, name, AT_REMOVEDIR) == -1 && errno != ENOENT)
+		add_rm_error(job, NULL, path, errno, origin);
+}
+
+static void *
+xrm_worker(void *arg)
+{
+	struct xrm_job_t *job = (struct xrm_job_t *)arg;
+
+	while (1) {
+		pthread_mutex_lock(&job->mutex);
+		const size_t start = job->next;
+		job->next += job->batch;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (start >= job->tasks_n)
+			break;
+
+		size_t i;
+		const size_t end = start + job->batch < job->tasks_n
+			? start + job->batch : job->tasks_n;
+		for (i = start; i < end; i++) {
+			if (xcp_canceled == 1)
+				cancel_rm_origin(job, job->tasks[i].origin);
+			else
+				remove_tree(job, job->tasks[i].dirfd, job->tasks[i].name,
+					job->tasks[i].path, job->tasks[i].origin);
+		}
+	}
+
+	return (void *)NULL;
+}
+
+static void
+add_rm_task(struct xrm_job_t *job, const int dirfd, char *path,
+	const char *name, const size_t origin)
+{
+	if (job->tasks_n == job->tasks_cap) {
+		job->tasks_cap = job->tasks_cap == 0 ? 64 : job->tasks_cap * 2;
+		job->tasks = xnrealloc(job->tasks, job->tasks_cap,
+			sizeof(struct xrm_task_t));
+	}
+
+	job->tasks[job->tasks_n].path = path;
+	job->tasks[job->tasks_n].name = name;
+	job->tasks[job->tasks_n].dirfd = dirfd;
+	job->tasks[job->tasks_n].origin = origin;
+	job->tasks_n++;
+}
+
+/* Queue the entries of the directory PATH, open in FD, as tasks relative
+ * to FD, so that its subtrees are removed in parallel. FD is not closed:
+ * tasks refer to it. Return 0 on success or an errno value on error. */
+static int
+split_dir(struct xrm_job_t *job, const int fd, const char *path,
+	const size_t origin)
+{
+	const int dfd = dup(fd);
+	DIR *dir = dfd == -1 ? (DIR *)NULL : fdopendir(dfd);
+	if (!dir) {
+		const int saved_errno = errno;
+		if (dfd != -1)
+			close(dfd);
+		return saved_errno;
+	}
+
+	const size_t dir_len = strlen(path) + 1;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+		char *p = join_path(path, ent->d_name);
+		add_rm_task(job, fd, p, p + dir_len, origin);
+	}
+
+	closedir(dir);
+	return 0;
+}
+
+/* Open the operand directory PATH, making sure it still is the directory
+ * described by A (it could have been replaced, say by a symbolic link,
+ * after we lstat'ed it). Return a file descriptor, or -1 and set errno. */
+static int
+open_rm_operand(const char *path, const struct stat *a)
+{
+	const int fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	struct stat b;
+	int err = 0;
+	if (fstat(fd, &b) == -1)
+		err = errno;
+	else if (b.st_dev != a->st_dev || b.st_ino != a->st_ino)
+		err = ESTALE;
+
+	if (err != 0) {
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Return 1 if the last component of PATH is "." or "..", or 0 otherwise. */
+static int
+is_dot_operand(const char *path)
+{
+	size_t len = strlen(path);
+	while (len > 1 && path[len - 1] == '/')
+		len--;
+
+	size_t start = len;
+	while (start > 0 && path[start - 1] != '/')
+		start--;
+
+	const size_t n = len - start;
+	return ((n == 1 && path[start] == '.')
+		|| (n == 2 && path[start] == '.' && path[start + 1] == '.'));
+}
+
+/* Run the queued tasks of JOB, and free them. Tasks never taken by a
+ * worker (because we were interrupted) mark their operands as canceled. */
+static void
+run_rm_tasks(struct xrm_job_t *job)
+{
+	job->batch = job->tasks_n / (XCP_MAX_WORKERS * 8);
+	if (job->batch == 0)
+		job->batch = 1;
+	else if (job->batch > XRM_BATCH)
+		job->batch = XRM_BATCH;
+
+	job->next = 0;
+	run_workers(xrm_worker, job, job->tasks_n);
+
+	size_t i;
+	for (i = job->next; i < job->tasks_n; i++)
+		job->canceled[job->tasks[i].origin] = 1;
+
+	for (i = 0; i < job->tasks_n; i++)
+		free(job->tasks[i].path);
+	job->tasks_n = 0;
+}
+
+/* An operand of xcp_remove(), identified by device and inode number. */
+struct xrm_operand_t {
+	dev_t dev;
+	ino_t ino;
+	size_t index;
+};
+
+static int
+xrm_operand_cmp(const void *a, const void *b)
+{
+	const struct xrm_operand_t *pa = (const struct xrm_operand_t *)a;
+	const struct xrm_operand_t *pb = (const struct xrm_operand_t *)b;
+
+	if (pa->dev != pb->dev)
+		return pa->dev < pb->dev ? -1 : 1;
+	if (pa->ino != pb->ino)
+		return pa->ino < pb->ino ? -1 : 1;
+	return pa->index < pb->index ? -1 : (pa->index > pb->index);
+}
+
+/* Remove the N files in TARGETS (directories recursively), just as rm -rf
+ * would do. Subtrees are removed in parallel by up to XCP_MAX_WORKERS
+ * threads. Just like rm, operands whose last component is "." or "..",
+ * and the root directory, are refused. Errors are reported using CMD_NAME.
+ * If not NULL, FAILED (an array of N ints) is set to nonzero for each file
+ * which could not be (fully) removed.
+ * Return FUNC_SUCCESS if all files were removed, or FUNC_FAILURE otherwise. */
+int
+xcp_remove(char **targets, const size_t n, int *failed, const char *cmd_name)
+{
+	struct xrm_job_t job = {0};
+	job.canceled = xcalloc(n + 1, sizeof(int));
+	pthread_mutex_init(&job.mutex, NULL);
+	begin_cancelable();
+
+	int ret = FUNC_SUCCESS;
+	struct stat root;
+	const int have_root = (lstat("/", &root) != -1);
+
+	/* Operand directories, removed once their contents are gone. */
+	size_t *dirs = xnmalloc(n + 1, sizeof(size_t));
+	size_t dirs_n = 0;
+	size_t i;
+
+	/* The same file given twice (say, 'rm 1 1') would be removed by two
+	 * workers at once: only the first operand referring to a given file
+	 * is processed. DUP[I] is the index of that operand. */
+	struct stat *attrs = xnmalloc(n + 1, sizeof(struct stat));
+	struct xrm_operand_t *ops = xnmalloc(n + 1, sizeof(struct xrm_operand_t));
+	size_t *dup = xnmalloc(n + 1, sizeof(size_t));
+	int *refused = xcalloc(n + 1, sizeof(int));
+	size_t ops_n = 0;
+
+	for (i = 0; i < n; i++) {
+		dup[i] = i;
+		attrs[i].st_mode = 0;
+
+		if (is_dot_operand(targets[i]) == 1) {
+			xerror(_("%s: Refusing to remove '.' or '..' directory: "
+				"skipping '%s'\n"), cmd_name, targets[i]);
+			refused[i] = 1;
+			continue;
+		}
+
+		if (lstat(targets[i], &attrs[i]) == -1) {
+			attrs[i].st_mode = 0;
+			if (errno != ENOENT)
+				add_rm_error(&job, NULL, targets[i], errno, i);
+			continue;
+		}
+
+		if (have_root == 1 && attrs[i].st_dev == root.st_dev
+		&& attrs[i].st_ino == root.st_ino) {
+			xerror(_("%s: It is dangerous to operate recursively on '%s': "
+				"skipping\n"), cmd_name, targets[i]);
+			attrs[i].st_mode = 0;
+			refused[i] = 1;
+			continue;
+		}
+
+		ops[ops_n].dev = attrs[i].st_dev;
+		ops[ops_n].ino = attrs[i].st_ino;
+		ops[ops_n].index = i;
+		ops_n++;
+	}
+
+	qsort(ops, ops_n, sizeof(struct xrm_operand_t), xrm_operand_cmp);
+	for (i = 1; i < ops_n; i++) {
+		if (ops[i].dev == ops[i - 1].dev && ops[i].ino == ops[i - 1].ino)
+			dup[ops[i].index] = dup[ops[i - 1].index];
+	}
+	free(ops);
+
+	/* Operand directories are opened once, and their entries removed
+	 * relative to these file descriptors, so that swapping the operand
+	 * path after the lstat(2) above cannot redirect the removal. */
+	int dir_fds[XRM_MAX_OPEN_DIRS];
+	size_t dir_fds_n = 0;
+
+	for (i = 0; i < n; i++) {
+		if (failed)
+			failed[i] = 0;
+
+		if (refused[i] == 1) {
+			if (failed)
+				failed[i] = 1;
+			ret = FUNC_FAILURE;
+			continue;
+		}
+
+		/* Duplicates, and files which could not be stat'ed */
+		if (dup[i] != i || attrs[i].st_mode == 0)
+			continue;
+
+		if (xcp_canceled == 1) {
+			job.canceled[i] = 1;
+			continue;
+		}
+
+		if (!S_ISDIR(attrs[i].st_mode)) {
+			char *p = savestring(targets[i], strlen(targets[i]));
+			add_rm_task(&job, AT_FDCWD, p, p, i);
+			continue;
+		}
+
+		const int fd = open_rm_operand(targets[i], &attrs[i]);
+		int err = fd == -1 ? errno : 0;
+		if (fd != -1 && (err = split_dir(&job, fd, targets[i], i)) != 0)
+			close(fd);
+
+		if (err != 0) {
+			add_rm_error(&job, NULL, targets[i], err, i);
+			continue;
+		}
+
+		dirs[dirs_n++] = i;
+		dir_fds[dir_fds_n++] = fd;
+		if (dir_fds_n == XRM_MAX_OPEN_DIRS) {
+			run_rm_tasks(&job);
+			while (dir_fds_n > 0)
+				close(dir_fds[--dir_fds_n]);
+		}
+	}
+
+	run_rm_tasks(&job);
+	while (dir_fds_n > 0)
+		close(dir_fds[--dir_fds_n]);
+
+	for (i = 0; i < job.errs_n; i++) {
+		xerror("%s: '%s': %s\n", cmd_name, job.errs[i].path,
+			strerror(job.errs[i].err));
+		if (failed)
+			failed[job.errs[i].origin] = 1;
+		ret = FUNC_FAILURE;
+	}
+
+	if (xcp_canceled == 1) {
+		xerror("%s: %s\n", cmd_name, strerror(ECANCELED));
+		ret = FUNC_FAILURE;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (job.canceled[i] != 0 && failed)
+			failed[i] = 1;
+	}
+
+	for (i = 0; i < dirs_n; i++) {
+		const size_t d = dirs[i];
+		int has_errs = job.canceled[d];
+		size_t j;
+		for (j = 0; j < job.errs_n && has_errs == 0; j++)
+			has_errs = (job.errs[j].origin == d);
+
+		if (has_errs == 0 && rmdir(targets[d]) == -1 && errno != ENOENT) {
+			xerror("%s: '%s': %s\n", cmd_name, targets[d], strerror(errno));
+			if (failed)
+				failed[d] = 1;
+			ret = FUNC_FAILURE;
+		}
+	}
+
+	if (failed) {
+		for (i = 0; i < n; i++)
+			failed[i] = failed[dup[i]];
+	}
+
+	free(job.tasks);
+	for (i = 0; i < job.errs_n; i++)
+		free(job.errs[i].path);
+	free(job.errs);
+	free(dirs);
+	free(dup);
+	free(refused);
+	free(attrs);
+	free(job.canceled);
+	pthread_mutex_destroy(&job.mutex);
+	end_cancelable();
+
+	return ret;
+}
+
+/* Return 1 if the directory SRC contains (or is) the path DST, or 0
+ * otherwise. DST need not exist, but its parent directory must. */
+static int
+is_inside_dir(const char *src, const char *dst)
+{
+	char *rsrc = xrealpath(src, NULL);
+	if (!rsrc)
+		return 0;
+
+	char *p = savestring(dst, strlen(dst));
+	char *slash = strrchr(p, '/');
+	const char *parent = slash == p ? "/" : (slash ? p : ".");
+	if (slash && slash != p)
+		*slash = '\0';
+
+	char *rparent = xrealpath(parent, NULL);
+	free(p);
+
+	int ret = 0;
+	if (rparent) {
+		const size_t len = strlen(rsrc);
+		ret = strncmp(rparent, rsrc, len) == 0
+			&& (rparent[len] == '/' || rparent[len] == '\0'
+			|| (len == 1 && *rsrc == '/'));
+		free(rparent);
+	}
+
+	free(rsrc);
+	return ret;
+}
+
+/* Return the target path for the source operand SRC: DEST/basename(SRC)
+ * if DEST is a directory (DEST_IS_DIR), or DEST itself otherwise. */
+static char *
+get_target_path(char *src, const char *dest, const int dest_is_dir)
+{
+	if (dest_is_dir == 0)
+		return savestring(dest, strlen(dest));
+
+	size_t len = strlen(src);
+	while (len > 1 && src[len - 1] == '/')
+		len--;
+
+	const char *end = src + len;
+	const char *name = end;
+	while (name > src && name[-1] != '/')
+		name--;
+
+	const size_t dlen = strlen(dest);
+	const size_t nlen = (size_t)(end - name);
+	char *p = xnmalloc(dlen + nlen + 2, sizeof(char));
+	memcpy(p, dest, dlen);
+	size_t n = dlen;
+	if (n == 0 || p[n - 1] != '/')
+		p[n++] = '/';
+	memcpy(p + n, name, nlen);
+	p[n + nlen] = '\0';
+
+	return p;
+}
+
+static void
+free_job(struct xcp_job_t *job)
+{
+	size_t i;
+	for (i = 0; i < job->files_n; i++) {
+		free(job->files[i].src);
+		free(job->files[i].dst);
+	}
+	free(job->files);
+
+	for (i = 0; i < job->dirs_n; i++) {
+		free(job->dirs[i].src);
+		free(job->dirs[i].dst);
+	}
+	free(job->dirs);
+
+	free(job->src_err);
+	pthread_mutex_destroy(&job->mutex);
+}
+
+/* Copy (or move, if MOVE is set) each of the N files in SRCS to the
+ * corresponding path in TARGETS. If not NULL, FAILED (an array of N ints)
+ * is set to nonzero for each file which could not be copied/moved, and
+ * XST is updated with the amount of data copied and the time it took.
+ * Return FUNC_SUCCESS if everything went fine, or FUNC_FAILURE otherwise. */
+static int
+transfer_files(char **srcs, char **targets, const size_t n, const int move,
+	const char *cmd_name, int *failed, struct xcp_stats_t *xst)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	struct xcp_job_t job = {0};
+	job.cmd_name = cmd_name;
+	job.src_err = xcalloc(n, sizeof(int));
+	pthread_mutex_init(&job.mutex, NULL);
+	begin_cancelable();
+
+	/* Sources to be removed once copied (cross-device moves). */
+	char **copied = xnmalloc(n + 1, sizeof(char *));
+	size_t *copied_idx = xnmalloc(n + 1, sizeof(size_t));
+	size_t copied_n = 0;
+	size_t i;
+	struct stat a;
+
+	for (i = 0; i < n; i++) {
+		if (xcp_canceled == 1) {
+			job.src_err[i] = 1;
+			continue;
+		}
+
+		if (move == 1) {
+			if (rename(srcs[i], targets[i]) == 0)
+				continue;
+			if (errno != EXDEV) {
+				report_error(&job, i, srcs[i], errno);
+				continue;
+			}
+		}
+
+		if (lstat(srcs[i], &a) == -1) {
+			report_error(&job, i, srcs[i], errno);
+			continue;
+		}
+
+		if (S_ISDIR(a.st_mode) && is_inside_dir(srcs[i], targets[i]) == 1) {
+			xerror(_("%s: Cannot copy '%s' into itself\n"), cmd_name, srcs[i]);
+			job.src_err[i] = 1;
+			continue;
+		}
+
+		copied[copied_n] = srcs[i];
+		copied_idx[copied_n] = i;
+		copied_n++;
+		walk_source(&job, srcs[i], targets[i], i);
+	}
+
+	run_workers(xcp_worker, &job, job.files_n);
+
+	/* Files never taken by a worker (interrupted) */
+	for (i = job.next; i < job.files_n; i++)
+		job.files[i].err = ECANCELED;
+
+	off_t bytes = 0;
+	for (i = 0; i < job.files_n; i++) {
+		if (job.files[i].err == 0) {
+			bytes += job.files[i].a.st_size;
+			continue;
+		}
+		if (job.files[i].err == ECANCELED)
+			job.src_err[job.files[i].origin] = 1;
+		else
+			report_error(&job, job.files[i].origin, job.files[i].src,
+				job.files[i].err);
+	}
+
+	finalize_dirs(&job);
+
+	/* If interrupted, sources may have been walked only partially: they
+	 * are not considered copied (nor removed, if moving). */
+	if (xcp_canceled == 1) {
+		xerror("%s: %s\n", cmd_name, strerror(ECANCELED));
+		for (i = 0; i < copied_n; i++)
+			job.src_err[copied_idx[i]] = 1;
+	}
+
+	/* Cross-device move: remove sources copied without errors, all of
+	 * them at once. */
+	if (move == 1 && copied_n > 0) {
+		size_t j = 0;
+		for (i = 0; i < copied_n; i++) {
+			if (job.src_err[copied_idx[i]] == 0) {
+				copied[j] = copied[i];
+				copied_idx[j] = copied_idx[i];
+				j++;
+			}
+		}
+
+		int *rm_failed = xnmalloc(j + 1, sizeof(int));
+		if (j > 0 && xcp_remove(copied, j, rm_failed, cmd_name)
+		!= FUNC_SUCCESS) {
+			for (i = 0; i < j; i++) {
+				if (rm_failed[i] != 0)
+					job.src_err[copied_idx[i]] = 1;
+			}
+		}
+		free(rm_failed);
+	}
+
+	int ret = FUNC_SUCCESS;
+	for (i = 0; i < n; i++) {
+		if (failed)
+			failed[i] = job.src_err[i];
+		if (job.src_err[i] != 0)
+			ret = FUNC_FAILURE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (xst) {
+		xst->bytes = bytes;
+		xst->secs = (double)(end.tv_sec - start.tv_sec)
+			+ (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+	}
+
+	free(copied);
+	free(copied_idx);
+	free_job(&job);
+	end_cancelable();
+
+	return ret;
+}
+
+/* Copy (or move, if MOVE is set) the files in ARGS, a NULL terminated list
+ * of source operands followed by the destination, just as cp -Rp (or mv)
+ * would do. If not NULL, XST is updated with the amount of data copied
+ * and the time it took. Errors are reported as they happen.
+ * Return FUNC_SUCCESS if everything went fine, or FUNC_FAILURE otherwise. */
+static int
+run_engine(char **args, const int move, const char *cmd_name,
+	struct xcp_stats_t *xst)
+{
+	size_t n = 0;
+	while (args[n])
+		n++;
+
+	if (n < 2) {
+		xerror(_("%s: Missing destination file operand\n"), cmd_name);
+		return FUNC_FAILURE;
+	}
+
+	n--; /* Number of source operands */
+	char *dest = args[n];
+	struct stat a;
+	const int dest_is_dir = (stat(dest, &a) != -1 && S_ISDIR(a.st_mode));
+
+	if (n > 1 && dest_is_dir == 0) {
+		xerror(_("%s: '%s': %s\n"), cmd_name, dest, strerror(ENOTDIR));
+		return FUNC_FAILURE;
+	}
+
+	char **targets = xnmalloc(n, sizeof(char *));
+	size_t i;
+	for (i = 0; i < n; i++)
+		targets[i] = get_target_path(args[i], dest, dest_is_dir);
+
+	const int ret =
+		transfer_files(args, targets, n, move, cmd_name, NULL, xst);
+
+	for (i = 0; i < n; i++)
+		free(targets[i]);
+	free(targets);
+
+	return ret;
+}
+
+int
+xcp_run(char **args, const int move, struct xcp_stats_t *xst)
+{
+	return run_engine(args, move, move == 1 ? "m" : "c", xst);
+}
+
+/* Move each of the N files in SRCS to the corresponding (full) path in
+ * DSTS in a single pass, copying files in parallel if needed. If not NULL,
+ * FAILED (an array of N ints) is set to nonzero for each file which could
+ * not be moved. CMD_NAME is used for error messages. */
+int
+xcp_move_files(char **srcs, char **dsts, const size_t n, int *failed,
+	const char *cmd_name)
+{
+	return transfer_files(srcs, dsts, n, 1, cmd_name, failed, NULL);
+}
+
+/* Move SRC to DEST. Used as a fallback when rename(2) fails with EXDEV.
+ * CMD_NAME is used for error messages. */
+int
+xcp_move(char *src, char *dest, const char *cmd_name)
+{
+	char *args[] = {src, dest, NULL};
+	return run_engine(args, 1, cmd_name, NULL);
+}
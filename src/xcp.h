@@ -0,0 +1,45 @@
+/*
+ * This file is part of Clifm
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ * Copyright (C) 2016-2025, L. Abramovich <leo.clifm@outlook.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* xcp.h */
+
+#ifndef CLIFM_XCP_H
+#define CLIFM_XCP_H
+
+/* Amount of data copied by the last call to xcp_run(), and the time it took. */
+struct xcp_stats_t {
+	off_t bytes;
+	double secs;
+};
+
+__BEGIN_DECLS
+
+int xcp_move(char *src, char *dest, const char *cmd_name);
+int xcp_move_files(char **srcs, char **dsts, const size_t n, int *failed,
+	const char *cmd_name);
+int xcp_remove(char **targets, const size_t n, int *failed,
+	const char *cmd_name);
+int xcp_run(char **args, const int move, struct xcp_stats_t *xst);
+
+__END_DECLS
+
+#endif /* CLIFM_XCP_H */
@@ -25,16 +25,14 @@
 #include "helpers.h"
 
 #include <errno.h>
-#ifdef USE_DU1
-# include <string.h> /* strchr */
-# include <unistd.h> /* close, dup, dup2, unlink, unlinkat */
-#endif /* USE_DU1 */
+#include <fcntl.h>   /* open, openat */
+#include <pthread.h>
+#include <string.h>  /* strchr, strlen */
+#include <unistd.h>  /* close, dup, dup2, sysconf, unlink, unlinkat */
 
+#include "aux.h"     /* xnrealloc, open_fread, savestring, hash_devino */
 #ifdef USE_DU1
-# include "aux.h"   /* xnrealloc, open_fread */
-# include "spawn.h" /* launch_execv */
-#else
-# include "mem.h"   /* xnrealloc */
+# include "spawn.h"  /* launch_execv */
 #endif /* USE_DU1 */
 
 /* According to 'info du', the st_size member of a stat struct is meaningful
@@ -52,41 +50,418 @@ struct hlink_t {
 	ino_t ino;
 };
 
-static struct hlink_t *xdu_hardlinks = {0};
-static size_t xdu_hardlink_n = 0;
+/* An open addressing hash set of (dev, ino) pairs used to count hardlinked
+ * files only once. Slots with inode number zero are empty. The capacity
+ * is always a power of two, and doubles whenever the set is 3/4 full.
+ * The mutex is used only when walking directories in parallel. */
+struct hlink_set_t {
+	struct hlink_t *slots;
+	size_t cap;
+	size_t n;
+	pthread_mutex_t mutex;
+	int locked; /* Use the mutex */
+	int pad0;
+};
+
+#define HLINK_SET_MIN_CAP 256
+
+static void
+grow_hlink_set(struct hlink_set_t *set)
+{
+	const size_t old_cap = set->cap;
+	struct hlink_t *old = set->slots;
+
+	set->cap = old_cap == 0 ? HLINK_SET_MIN_CAP : old_cap * 2;
+	set->slots = xcalloc(set->cap, sizeof(struct hlink_t));
+
+	for (size_t i = 0; i < old_cap; i++) {
+		if (old[i].ino == 0)
+			continue;
+		size_t j = hash_devino(old[i].dev, old[i].ino) & (set->cap - 1);
+		while (set->slots[j].ino != 0)
+			j = (j + 1) & (set->cap - 1);
+		set->slots[j] = old[i];
+	}
+
+	free(old);
+}
 
-static inline int
-check_xdu_hardlinks(const dev_t dev, const ino_t ino)
+/* Return 1 if the file in the device DEV with inode INO was already
+ * counted. Otherwise, add it to the set and return 0. */
+static int
+check_xdu_hardlink(struct hlink_set_t *set, const dev_t dev, const ino_t ino)
 {
-	if (!xdu_hardlinks || xdu_hardlink_n == 0)
+	if (ino == 0) /* Not a valid inode number: just count it */
 		return 0;
 
-	size_t i;
-	for (i = 0; i < xdu_hardlink_n; i++) {
-		if (dev == xdu_hardlinks[i].dev && ino == xdu_hardlinks[i].ino)
-			return 1;
+	if (set->locked == 1)
+		pthread_mutex_lock(&set->mutex);
+
+	if ((set->n + 1) * 4 > set->cap * 3)
+		grow_hlink_set(set);
+
+	int found = 0;
+	size_t i = hash_devino(dev, ino) & (set->cap - 1);
+	while (set->slots[i].ino != 0) {
+		if (set->slots[i].ino == ino && set->slots[i].dev == dev) {
+			found = 1;
+			break;
+		}
+		i = (i + 1) & (set->cap - 1);
 	}
 
+	if (found == 0) {
+		set->slots[i].dev = dev;
+		set->slots[i].ino = ino;
+		set->n++;
+	}
+
+	if (set->locked == 1)
+		pthread_mutex_unlock(&set->mutex);
+
+	return found;
+}
+
+/* Account the file whose attributes are A (and whose dirent is ENT) in
+ * INFO. Return 1 if it is a directory (to be traversed by the caller), or
+ * zero otherwise. If STAT_ERR is not zero, stat(2) failed for this file
+ * with this error code. */
+static int
+count_xdu_file(const struct stat *a, const int stat_err,
+	const struct dirent *ent, struct dir_info_t *info,
+	struct hlink_set_t *hlinks)
+{
+	if (stat_err != 0) {
+		info->status = stat_err;
+#ifdef _DIRENT_HAVE_D_TYPE
+		/* We cannot extract the file type from st_mode. Let's fallback
+		 * to whatever d_type says. */
+		switch (ent->d_type) {
+		case DT_LNK: info->links++; break;
+		case DT_DIR: info->dirs++; break;
+		default: info->files++; break;
+		}
+#else
+		UNUSED(ent);
+		info->files++;
+#endif /* _DIRENT_HAVE_D_TYPE */
+		return 0;
+	}
+
+	if (S_ISLNK(a->st_mode)) {
+		info->links++;
+#ifdef __CYGWIN__
+	/* This is because on Cygwin systems some regular files, maybe due to
+	 * some permissions issue, are otherwise taken as directories. */
+	} else if (S_ISREG(a->st_mode)) {
+		info->files++;
+#endif /* __CYGWIN__ */
+	} else if (S_ISDIR(a->st_mode)) {
+		/* Even if a subdirectory is unreadable or we can't chdir into
+		 * it, do let its PHYSICAL size contribute to the total
+		 * (provided we're not computing apparent sizes). */
+		info->blocks += a->st_blocks;
+		info->dirs++;
+		return 1;
+	} else {
+		info->files++;
+	}
+
+	if (!USABLE_ST_SIZE(a))
+		return 0;
+
+	if (a->st_nlink > 1 && check_xdu_hardlink(hlinks, a->st_dev, a->st_ino) == 1)
+		return 0;
+
+	info->size += a->st_size;
+	info->blocks += a->st_blocks;
 	return 0;
 }
 
-static inline void
-add_xdu_hardlink(const dev_t dev, const ino_t ino)
+#ifndef CLIFM_LEGACY
+/* Maximum number of threads used to traverse the base directory in
+ * parallel. */
+# define XDU_MAX_WORKERS 8
+/* Subdirectories of the base directory are traversed in parallel only if
+ * there are more than this many of them: otherwise, starting threads costs
+ * more than it saves. */
+# define XDU_PARALLEL_MIN_DIRS 4
+
+/* Directories waiting to be traversed, shared by xdu workers. Paths are
+ * relative to the base directory (BASE_FD). Workers take directories from
+ * the list, and hand subdirectories back to it as they find them whenever
+ * another worker is idle, so that a big subtree is not left to a single
+ * thread. */
+struct xdu_work_t {
+	char **dirs;
+	struct hlink_set_t *hlinks;
+	size_t n;
+	size_t cap;
+	size_t busy;   /* Workers traversing a directory */
+	size_t idle;   /* Workers waiting for a directory */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int base_fd;
+	int shared;    /* More than one worker */
+};
+
+struct xdu_worker_t {
+	struct xdu_work_t *work;
+	struct dir_info_t info;
+	char path[PATH_MAX]; /* Current directory (relative to BASE_FD) */
+};
+
+/* If another worker is idle, hand it the subdirectory NAME of the current
+ * directory (whose path is W->PATH, LEN bytes long) and return 1.
+ * Otherwise, return 0: the subdirectory is traversed by the caller. */
+static int
+share_xdu_dir(struct xdu_worker_t *w, const size_t len, const char *name)
+{
+	struct xdu_work_t *work = w->work;
+	const size_t name_len = strlen(name);
+	if (work->shared == 0 || len == 0 || len + name_len + 2 > sizeof(w->path))
+		return 0;
+
+	pthread_mutex_lock(&work->mutex);
+	const int share = (work->idle > work->n);
+	if (share == 1) {
+		if (work->n == work->cap) {
+			work->cap = work->cap == 0 ? 16 : work->cap * 2;
+			work->dirs = xnrealloc(work->dirs, work->cap, sizeof(char *));
+		}
+
+		char *p = xnmalloc(len + name_len + 2, sizeof(char));
+		memcpy(p, w->path, len);
+		p[len] = '/';
+		memcpy(p + len + 1, name, name_len + 1);
+		work->dirs[work->n++] = p;
+		pthread_cond_signal(&work->cond);
+	}
+	pthread_mutex_unlock(&work->mutex);
+
+	return share;
+}
+
+/* Recursively count files in the directory whose file descriptor is FD.
+ * Files are accessed relative to the directory file descriptor. The path of
+ * the directory, relative to the base directory, is kept in W->PATH (LEN
+ * bytes long, or zero if too long), in case subdirectories are handed to
+ * other workers. FD is closed before returning. */
+static void
+xdu_walk(struct xdu_worker_t *w, const int fd, const size_t len)
+{
+	struct dir_info_t *info = &w->info;
+	DIR *p = fdopendir(fd);
+	if (!p) {
+		info->status = errno;
+		close(fd);
+		return;
+	}
+
+# ifdef POSIX_FADV_SEQUENTIAL
+	/* A hint to the kernel to optimize the current dir for reading. */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+# endif /* POSIX_FADV_SEQUENTIAL */
+
+	struct dirent *ent;
+	struct stat a;
+
+	while ((ent = readdir(p)) != NULL) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		const int err = fstatat(fd, ent->d_name, &a, AT_SYMLINK_NOFOLLOW) == -1
+			? errno : 0;
+		if (count_xdu_file(&a, err, ent, info, w->work->hlinks) == 0)
+			continue;
+
+		if (share_xdu_dir(w, len, ent->d_name) == 1)
+			continue;
+
+		const int sfd = openat(fd, ent->d_name,
+			O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (sfd == -1) {
+			info->status = errno;
+			continue;
+		}
+
+		const size_t name_len = strlen(ent->d_name);
+		if (len == 0 || len + name_len + 2 > sizeof(w->path)) {
+			xdu_walk(w, sfd, 0);
+			continue;
+		}
+
+		w->path[len] = '/';
+		memcpy(w->path + len + 1, ent->d_name, name_len + 1);
+		xdu_walk(w, sfd, len + name_len + 1);
+		w->path[len] = '\0';
+	}
+
+	closedir(p); /* Closes FD as well */
+}
+
+/* Take directories from the shared list and traverse them, until the list
+ * is empty and no other worker can add more. */
+static void *
+xdu_worker(void *arg)
 {
-	xdu_hardlinks = xnrealloc(xdu_hardlinks, xdu_hardlink_n + 1,
-		sizeof(struct hlink_t));
+	struct xdu_worker_t *w = (struct xdu_worker_t *)arg;
+	struct xdu_work_t *work = w->work;
+
+	pthread_mutex_lock(&work->mutex);
+	while (1) {
+		if (work->n == 0) {
+			if (work->busy == 0)
+				break;
+			work->idle++;
+			pthread_cond_wait(&work->cond, &work->mutex);
+			work->idle--;
+			continue;
+		}
+
+		char *dir = work->dirs[--work->n];
+		work->busy++;
+		pthread_mutex_unlock(&work->mutex);
 
-	xdu_hardlinks[xdu_hardlink_n].dev = dev;
-	xdu_hardlinks[xdu_hardlink_n].ino = ino;
-	xdu_hardlink_n++;
+		const int fd = openat(work->base_fd, dir,
+			O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd == -1) {
+			w->info.status = errno;
+		} else {
+			const size_t len = strlen(dir);
+			if (len < sizeof(w->path))
+				memcpy(w->path, dir, len + 1);
+			xdu_walk(w, fd, len < sizeof(w->path) ? len : 0);
+		}
+		free(dir);
+
+		pthread_mutex_lock(&work->mutex);
+		work->busy--;
+		if (work->busy == 0 && work->n == 0)
+			pthread_cond_broadcast(&work->cond);
+	}
+	pthread_mutex_unlock(&work->mutex);
+
+	return (void *)NULL;
 }
 
-static inline void
-free_xdu_hardlinks(void)
+static void
+add_dir_info(struct dir_info_t *dst, const struct dir_info_t *src)
 {
-	free(xdu_hardlinks);
-	xdu_hardlinks = (struct hlink_t *)NULL;
-	xdu_hardlink_n = 0;
+	dst->dirs += src->dirs;
+	dst->files += src->files;
+	dst->links += src->links;
+	dst->size += src->size;
+	dst->blocks += src->blocks;
+	if (src->status != 0)
+		dst->status = src->status;
+}
+
+/* Return the number of workers used to traverse N subdirectories of the
+ * base directory: one (no threads at all) if there are only a few of them,
+ * or else as many as available CPUs, up to XDU_MAX_WORKERS and N. */
+static size_t
+get_xdu_workers(const size_t n)
+{
+	static size_t cpus = 0;
+	if (cpus == 0) {
+		const long c = sysconf(_SC_NPROCESSORS_ONLN);
+		cpus = c > 1 ? (size_t)c : 1;
+	}
+
+	if (n <= XDU_PARALLEL_MIN_DIRS || cpus == 1)
+		return 1;
+
+	size_t nworkers = cpus < XDU_MAX_WORKERS ? cpus : XDU_MAX_WORKERS;
+	return nworkers < n ? nworkers : n;
+}
+
+/* Traverse the subdirectories DIRS (N entries, freed here) of the base
+ * directory, whose file descriptor is BASE_FD, in the current thread. */
+static void
+xdu_walk_serial(const int base_fd, char **dirs, const size_t n,
+	struct dir_info_t *info, struct hlink_set_t *hlinks)
+{
+	struct xdu_work_t work = {0};
+	work.hlinks = hlinks;
+	work.base_fd = base_fd;
+
+	struct xdu_worker_t *w = xnmalloc(1, sizeof(struct xdu_worker_t));
+	w->work = &work;
+	w->info = (struct dir_info_t){0};
+
+	size_t i;
+	for (i = 0; i < n; i++) {
+		const int fd = openat(base_fd, dirs[i],
+			O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd == -1)
+			w->info.status = errno;
+		else
+			xdu_walk(w, fd, 0);
+		free(dirs[i]);
+	}
+
+	add_dir_info(info, &w->info);
+	free(w);
+}
+
+/* Traverse the subdirectories DIRS (N entries, freed by workers) of the
+ * base directory, whose file descriptor is BASE_FD, using NWORKERS
+ * threads. */
+static void
+xdu_walk_parallel(const int base_fd, char **dirs, const size_t n,
+	const size_t nworkers, struct dir_info_t *info, struct hlink_set_t *hlinks)
+{
+	struct xdu_work_t work = {0};
+	work.cap = n;
+	work.dirs = xnmalloc(n, sizeof(char *));
+	memcpy(work.dirs, dirs, n * sizeof(char *));
+	work.n = n;
+	work.hlinks = hlinks;
+	work.base_fd = base_fd;
+	work.shared = nworkers > 1;
+	pthread_mutex_init(&work.mutex, NULL);
+	pthread_cond_init(&work.cond, NULL);
+
+	struct xdu_worker_t *workers = xnmalloc(nworkers, sizeof(struct xdu_worker_t));
+	pthread_t tid[XDU_MAX_WORKERS];
+	size_t i, spawned = 0;
+
+	if (nworkers > 1) {
+		hlinks->locked = 1;
+		pthread_mutex_init(&hlinks->mutex, NULL);
+	}
+
+	for (i = 0; i < nworkers; i++) {
+		workers[i].work = &work;
+		workers[i].info = (struct dir_info_t){0};
+		*workers[i].path = '\0';
+	}
+
+	/* The current thread is worker zero. */
+	for (i = 1; i < nworkers; i++) {
+		if (pthread_create(&tid[spawned], NULL, xdu_worker, &workers[i]) != 0)
+			break;
+		spawned++;
+	}
+
+	xdu_worker(&workers[0]);
+
+	for (i = 0; i < spawned; i++)
+		pthread_join(tid[i], NULL);
+
+	for (i = 0; i <= spawned; i++)
+		add_dir_info(info, &workers[i].info);
+
+	if (nworkers > 1) {
+		pthread_mutex_destroy(&hlinks->mutex);
+		hlinks->locked = 0;
+	}
+
+	pthread_cond_destroy(&work.cond);
+	pthread_mutex_destroy(&work.mutex);
+	free(work.dirs);
+	free(workers);
 }
 
 /* Trimmed down implementation of du(1) providing only those features
@@ -103,10 +478,15 @@ free_xdu_hardlinks(void)
  *
  * The number of directories, symbolic links, and other file types is stored
  * in the DIRS, LINKS, and FILES fields respectively.
- * FIRST_LEVEL must be always 1 when calling this function (this value will
- * be zero whenever the function calls itself recursively).
+ * If FIRST_LEVEL is set to 1, the physical size of DIR itself is included.
  * If a directory cannot be read, or a file cannot be stat'ed, then the
- * STATUS field of the INFO struct is set to the appropriate errno value. */
+ * STATUS field of the INFO struct is set to the appropriate errno value.
+ *
+ * Files in DIR are counted by the current thread, while subdirectories
+ * of DIR are traversed by a pool of workers (sized from the available CPUs),
+ * which share subdirectories found on the way with idle workers. If DIR has
+ * only a few subdirectories, they are traversed by the current thread. Hardlinks are tracked using a hash
+ * set shared by all workers. */
 void
 dir_info(const char *dir, const int first_level, struct dir_info_t *info)
 {
@@ -115,90 +495,110 @@ dir_info(const char *dir, const int first_level, struct dir_info_t *info)
 		return;
 	}
 
-	struct stat a;
-	DIR *p;
-
-	if ((p = opendir(dir)) == NULL) {
+	const int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	DIR *p = fd != -1 ? fdopendir(fd) : (DIR *)NULL;
+	if (!p) {
 		info->status = errno;
+		if (fd != -1)
+			close(fd);
 		return;
 	}
 
-#ifdef POSIX_FADV_SEQUENTIAL
+# ifdef POSIX_FADV_SEQUENTIAL
 	/* A hint to the kernel to optimize the current dir for reading. */
-	const int fd = dirfd(p);
 	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
-#endif /* POSIX_FADV_SEQUENTIAL */
+# endif /* POSIX_FADV_SEQUENTIAL */
+
+	struct stat a;
 
 	/* Compute the PHYSICAL size of the base directory itself. */
-	if (first_level == 1 && stat(dir, &a) != -1)
+	if (first_level == 1 && fstat(fd, &a) != -1)
 		info->blocks += a.st_blocks;
 
+	struct hlink_set_t hlinks = {0};
 	struct dirent *ent;
-	char buf[PATH_MAX + 1];
+	char **dirs = (char **)NULL;
+	size_t dirs_n = 0, dirs_cap = 0;
 
 	while ((ent = readdir(p)) != NULL) {
 		if (SELFORPARENT(ent->d_name))
 			continue;
 
-		snprintf(buf, sizeof(buf), "%s/%s", dir, ent->d_name);
-
-		if (lstat(buf, &a) == -1) {
-			info->status = errno;
-#ifdef _DIRENT_HAVE_D_TYPE
-			/* We cannot extract the file type from st_mode. Let's fallback
-			 * to whatever d_type says. */
-			switch (ent->d_type) {
-			case DT_LNK: info->links++; break;
-			case DT_DIR: info->dirs++; break;
-			default: info->files++; break;
-			}
-#else
-			info->files++;
-#endif /* _DIRENT_HAVE_D_TYPE */
+		const int err = fstatat(fd, ent->d_name, &a, AT_SYMLINK_NOFOLLOW) == -1
+			? errno : 0;
+		if (count_xdu_file(&a, err, ent, info, &hlinks) == 0)
 			continue;
+
+		if (dirs_n == dirs_cap) {
+			dirs_cap = dirs_cap == 0 ? 16 : dirs_cap * 2;
+			dirs = xnrealloc(dirs, dirs_cap, sizeof(char *));
 		}
+		dirs[dirs_n] = savestring(ent->d_name, strlen(ent->d_name));
+		dirs_n++;
+	}
 
-		if (S_ISLNK(a.st_mode)) {
-			info->links++;
-#ifdef __CYGWIN__
-		/* This is because on Cygwin systems some regular files, maybe due to
-		 * some permissions issue, are otherwise taken as directories. */
-		} else if (S_ISREG(a.st_mode)) {
-			info->files++;
-#endif /* __CYGWIN__ */
-		} else if (S_ISDIR(a.st_mode)) {
-			/* Even if a subdirectory is unreadable or we can't chdir into
-			 * it, do let its PHYSICAL size contribute to the total
-			 * (provided we're not computing apparent sizes). */
-			info->blocks += a.st_blocks;
+	if (dirs_n > 0) {
+		const size_t nworkers = get_xdu_workers(dirs_n);
+		if (nworkers > 1)
+			xdu_walk_parallel(fd, dirs, dirs_n, nworkers, info, &hlinks);
+		else
+			xdu_walk_serial(fd, dirs, dirs_n, info, &hlinks);
+	}
 
-			info->dirs++;
-			dir_info(buf, 0, info);
+	free(dirs);
 
-			continue;
-		} else {
-			info->files++;
-		}
+	closedir(p); /* Closes FD as well */
+	free(hlinks.slots);
+}
 
-		if (!USABLE_ST_SIZE(&a))
-			continue;
+#else /* CLIFM_LEGACY */
+static void
+dir_info_legacy(const char *dir, const int first_level,
+	struct dir_info_t *info, struct hlink_set_t *hlinks)
+{
+	struct stat a;
+	DIR *p;
 
-		if (a.st_nlink > 1) {
-			if (check_xdu_hardlinks(a.st_dev, a.st_ino) == 1)
-				continue;
-			else
-				add_xdu_hardlink(a.st_dev, a.st_ino);
-		}
+	if ((p = opendir(dir)) == NULL) {
+		info->status = errno;
+		return;
+	}
 
-		info->size += a.st_size;
+	/* Compute the PHYSICAL size of the base directory itself. */
+	if (first_level == 1 && stat(dir, &a) != -1)
 		info->blocks += a.st_blocks;
+
+	struct dirent *ent;
+	char buf[PATH_MAX + 1];
+
+	while ((ent = readdir(p)) != NULL) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		snprintf(buf, sizeof(buf), "%s/%s", dir, ent->d_name);
+
+		const int err = lstat(buf, &a) == -1 ? errno : 0;
+		if (count_xdu_file(&a, err, ent, info, hlinks) == 1)
+			dir_info_legacy(buf, 0, info, hlinks);
 	}
 
 	closedir(p);
+}
 
-	if (first_level == 1)
-		free_xdu_hardlinks();
+/* See the non-legacy version above. */
+void
+dir_info(const char *dir, const int first_level, struct dir_info_t *info)
+{
+	if (!dir || !*dir) {
+		info->status = ENOENT;
+		return;
+	}
+
+	struct hlink_set_t hlinks = {0};
+	dir_info_legacy(dir, first_level, info, &hlinks);
+	free(hlinks.slots);
 }
+#endif /* !CLIFM_LEGACY */
 
 #ifndef USE_DU1
 off_t
@@ -294,3 +694,392 @@ END:
 	return retval;
 }
 #endif /* !USE_DU1 */
+
+#if !defined(CLIFM_LEGACY) && !defined(USE_DU1)
+/* A cache of directory sizes used by the long view when FullDirSize and
+ * DirSizeCache are enabled.
+ *
+ * Entries are keyed by the (dev, ino) pair of a directory and hold the
+ * dir_info_t totals computed for it by dir_info(). An entry is valid as
+ * long as the modification and change times of the directory did not
+ * change, so that re-entering a directory takes no traversal at all.
+ *
+ * Changes deeper in the tree (or files modified in place) do not update
+ * these times. To catch them, whenever the current directory changes (see
+ * read_inotify() in misc.c), the entries for the current directory and all
+ * its parents are invalidated. Changes made elsewhere, say by another
+ * program, go unnoticed until then: this is why the cache is off by default.
+ *
+ * The cache is saved to disk at exit (DSC_FILE in the main configuration
+ * directory), and it takes at most DSC_MAX_BYTES: once this limit is
+ * exceeded, the least recently used entries are discarded until the cache
+ * is back to DSC_LOW_BYTES. */
+
+# define DSC_FILE "dirsize.cache"
+# define DSC_MAGIC "CLIFMDSC"
+# define DSC_VERSION 3
+# define DSC_MIN_CAP 1024
+# define DSC_MAX_BYTES (2 * 1024 * 1024)
+# define DSC_LOW_BYTES (DSC_MAX_BYTES - DSC_MAX_BYTES / 8)
+/* Bytes taken by N entries, in memory (the hash table is at most 3/4 full). */
+# define DSC_BYTES(n) ((n) * sizeof(struct dsc_ent_t) * 4 / 3)
+
+# if defined(__NetBSD__) || defined(__APPLE__)
+#  define DSC_MTIM_NSEC(s) ((long)(s)->st_mtimespec.tv_nsec)
+#  define DSC_CTIM_NSEC(s) ((long)(s)->st_ctimespec.tv_nsec)
+# else
+#  define DSC_MTIM_NSEC(s) ((long)(s)->st_mtim.tv_nsec)
+#  define DSC_CTIM_NSEC(s) ((long)(s)->st_ctim.tv_nsec)
+# endif /* __NetBSD__ || __APPLE__ */
+
+/* A cache entry, as stored on disk. */
+struct dsc_rec_t {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	time_t ctime;
+	long mtime_ns;
+	long ctime_ns;
+	struct dir_info_t info;
+};
+
+struct dsc_ent_t {
+	struct dsc_rec_t rec;
+	unsigned long stamp; /* Last time (in lookups) this entry was used */
+};
+
+/* An open addressing hash table. Slots with inode number zero are empty. */
+static struct dsc_ent_t *dsc_slots = (struct dsc_ent_t *)NULL;
+static size_t dsc_cap = 0;
+static size_t dsc_n = 0;
+static unsigned long dsc_clock = 0;
+static int dsc_loaded = 0;
+static int dsc_dirty = 0;
+
+static struct dsc_ent_t *
+find_dsc_slot(const dev_t dev, const ino_t ino)
+{
+	size_t i = hash_devino(dev, ino) & (dsc_cap - 1);
+	while (dsc_slots[i].rec.ino != 0) {
+		if (dsc_slots[i].rec.ino == ino && dsc_slots[i].rec.dev == dev)
+			break;
+		i = (i + 1) & (dsc_cap - 1);
+	}
+
+	return &dsc_slots[i];
+}
+
+static void
+resize_dsc_table(const size_t new_cap)
+{
+	struct dsc_ent_t *old = dsc_slots;
+	const size_t old_cap = dsc_cap;
+
+	dsc_cap = new_cap;
+	dsc_slots = xcalloc(dsc_cap, sizeof(struct dsc_ent_t));
+
+	for (size_t i = 0; i < old_cap; i++) {
+		if (old[i].rec.ino != 0)
+			*find_dsc_slot(old[i].rec.dev, old[i].rec.ino) = old[i];
+	}
+
+	free(old);
+}
+
+static int
+cmp_dsc_stamps(const void *a, const void *b)
+{
+	const unsigned long x = *(const unsigned long *)a;
+	const unsigned long y = *(const unsigned long *)b;
+	return (x > y) - (x < y);
+}
+
+/* Discard the least recently used entries, until the cache takes no more
+ * than DSC_LOW_BYTES. */
+static void
+evict_dsc_entries(void)
+{
+	const size_t keep = DSC_LOW_BYTES / (sizeof(struct dsc_ent_t) * 4 / 3);
+	if (dsc_n <= keep)
+		return;
+
+	unsigned long *stamps = xnmalloc(dsc_n + 1, sizeof(unsigned long));
+	size_t i, n = 0;
+
+	for (i = 0; i < dsc_cap; i++) {
+		if (dsc_slots[i].rec.ino != 0)
+			stamps[n++] = dsc_slots[i].stamp;
+	}
+
+	/* Stamps are unique: exactly N - KEEP entries are older than this. */
+	qsort(stamps, n, sizeof(unsigned long), cmp_dsc_stamps);
+	const unsigned long min_stamp = stamps[n - keep];
+	free(stamps);
+
+	for (i = 0; i < dsc_cap; i++) {
+		if (dsc_slots[i].rec.ino == 0 || dsc_slots[i].stamp >= min_stamp)
+			continue;
+		dsc_slots[i] = (struct dsc_ent_t){0};
+		dsc_n--;
+	}
+
+	/* Rehash to remove the holes left in probe sequences. */
+	size_t cap = DSC_MIN_CAP;
+	while ((dsc_n + 1) * 4 > cap * 3)
+		cap *= 2;
+	resize_dsc_table(cap);
+	dsc_dirty = 1;
+}
+
+/* Insert (or replace) the entry REC. */
+static void
+store_dsc_entry(const struct dsc_rec_t *rec)
+{
+	if (dsc_cap == 0 || (dsc_n + 1) * 4 > dsc_cap * 3)
+		resize_dsc_table(dsc_cap == 0 ? DSC_MIN_CAP : dsc_cap * 2);
+
+	struct dsc_ent_t *e = find_dsc_slot(rec->dev, rec->ino);
+	if (e->rec.ino == 0)
+		dsc_n++;
+
+	e->rec = *rec;
+	e->stamp = ++dsc_clock;
+	dsc_dirty = 1;
+
+	if (DSC_BYTES(dsc_n) > DSC_MAX_BYTES)
+		evict_dsc_entries();
+}
+
+/* Remove the entry for the directory whose device and inode number are
+ * DEV and INO, if any. */
+static void
+remove_dsc_entry(const dev_t dev, const ino_t ino)
+{
+	struct dsc_ent_t *e = find_dsc_slot(dev, ino);
+	if (e->rec.ino == 0)
+		return;
+
+	/* Reinsert the rest of the cluster, so that no probe sequence is
+	 * broken by the new empty slot. */
+	*e = (struct dsc_ent_t){0};
+	dsc_n--;
+	dsc_dirty = 1;
+
+	size_t i = (size_t)(e - dsc_slots);
+	while (dsc_slots[i = (i + 1) & (dsc_cap - 1)].rec.ino != 0) {
+		const struct dsc_ent_t tmp = dsc_slots[i];
+		dsc_slots[i] = (struct dsc_ent_t){0};
+		*find_dsc_slot(tmp.rec.dev, tmp.rec.ino) = tmp;
+	}
+}
+
+/* Return the cache entry for the directory whose attributes are A, provided
+ * it is still valid. Otherwise, return NULL. */
+static struct dsc_ent_t *
+get_dsc_entry(const struct stat *a)
+{
+	if (dsc_n == 0)
+		return (struct dsc_ent_t *)NULL;
+
+	struct dsc_ent_t *e = find_dsc_slot(a->st_dev, a->st_ino);
+	if (e->rec.ino == 0
+	|| e->rec.mtime != a->st_mtime || e->rec.ctime != a->st_ctime
+	|| e->rec.mtime_ns != DSC_MTIM_NSEC(a)
+	|| e->rec.ctime_ns != DSC_CTIM_NSEC(a))
+		return (struct dsc_ent_t *)NULL;
+
+	e->stamp = ++dsc_clock;
+	return e;
+}
+
+static void
+load_dir_size_cache(void)
+{
+	dsc_loaded = 1;
+
+	if (xargs.stealth_mode == 1 || config_ok == 0 || !config_dir_gral)
+		return;
+
+	char file[PATH_MAX + 1];
+	snprintf(file, sizeof(file), "%s/%s", config_dir_gral, DSC_FILE);
+
+	int fd = 0;
+	FILE *fp = open_fread(file, &fd);
+	if (!fp)
+		return;
+
+	char magic[sizeof(DSC_MAGIC) - 1];
+	int version = 0;
+	size_t rec_size = 0;
+
+	if (fread(magic, sizeof(magic), 1, fp) != 1
+	|| memcmp(magic, DSC_MAGIC, sizeof(magic)) != 0
+	|| fread(&version, sizeof(version), 1, fp) != 1
+	|| version != DSC_VERSION
+	|| fread(&rec_size, sizeof(rec_size), 1, fp) != 1
+	|| rec_size != sizeof(struct dsc_rec_t))
+		goto END;
+
+	/* Entries are saved from least to most recently used. */
+	struct dsc_rec_t rec;
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		if (rec.ino == 0)
+			break;
+		store_dsc_entry(&rec);
+	}
+
+END:
+	fclose(fp);
+	dsc_dirty = 0;
+}
+
+static int
+cmp_dsc_ents(const void *a, const void *b)
+{
+	const struct dsc_ent_t *x = *(struct dsc_ent_t *const *)a;
+	const struct dsc_ent_t *y = *(struct dsc_ent_t *const *)b;
+	return (x->stamp > y->stamp) - (x->stamp < y->stamp);
+}
+
+static void
+save_dir_size_cache(void)
+{
+	if (dsc_dirty == 0 || xargs.stealth_mode == 1 || config_ok == 0
+	|| !config_dir_gral)
+		return;
+
+	char file[PATH_MAX + 1];
+	snprintf(file, sizeof(file), "%s/%s", config_dir_gral, DSC_FILE);
+
+	int fd = 0;
+	FILE *fp = open_fwrite(file, &fd);
+	if (!fp)
+		return;
+
+	const int version = DSC_VERSION;
+	const size_t rec_size = sizeof(struct dsc_rec_t);
+	fwrite(DSC_MAGIC, sizeof(DSC_MAGIC) - 1, 1, fp);
+	fwrite(&version, sizeof(version), 1, fp);
+	fwrite(&rec_size, sizeof(rec_size), 1, fp);
+
+	/* Save entries in LRU order, so that recency survives a reload. */
+	struct dsc_ent_t **ents = xnmalloc(dsc_n + 1, sizeof(struct dsc_ent_t *));
+	size_t i, n = 0;
+	for (i = 0; i < dsc_cap; i++) {
+		if (dsc_slots[i].rec.ino != 0)
+			ents[n++] = &dsc_slots[i];
+	}
+
+	qsort(ents, n, sizeof(struct dsc_ent_t *), cmp_dsc_ents);
+	for (i = 0; i < n; i++)
+		fwrite(&ents[i]->rec, sizeof(struct dsc_rec_t), 1, fp);
+
+	free(ents);
+	fclose(fp);
+}
+
+/* Save the directory sizes cache to disk and free it. */
+void
+free_dir_size_cache(void)
+{
+	save_dir_size_cache();
+
+	free(dsc_slots);
+	dsc_slots = (struct dsc_ent_t *)NULL;
+	dsc_cap = dsc_n = 0;
+	dsc_dirty = 0;
+}
+
+/* Something changed in the directory DIR: drop the cached sizes of DIR and
+ * of all its parents, since all of them contain the change. */
+void
+invalidate_dir_size_cache(const char *dir)
+{
+	if (conf.dir_size_cache != 1 || !dir || *dir != '/')
+		return;
+
+	if (dsc_loaded == 0)
+		load_dir_size_cache();
+	if (dsc_n == 0)
+		return;
+
+	char path[PATH_MAX + 1];
+	xstrsncpy(path, dir, sizeof(path));
+
+	struct stat a;
+	char *p = path + strlen(path);
+	while (1) {
+		if (stat(path, &a) != -1)
+			remove_dsc_entry(a.st_dev, a.st_ino);
+
+		if (p == path + 1 || !(p = strrchr(path, '/')))
+			break;
+		if (p == path)
+			p++; /* Keep the root directory */
+		*p = '\0';
+	}
+}
+
+/* Return the full size of the directory DIR, whose attributes are A (see
+ * dir_size()), reusing the result of a previous traversal if DIR did not
+ * change since then. STATUS is updated as in dir_size(). */
+off_t
+cached_dir_size(const char *dir, const struct stat *a, int *status)
+{
+	if (conf.dir_size_cache != 1)
+		return dir_size(dir, 1, status);
+
+	if (dsc_loaded == 0)
+		load_dir_size_cache();
+
+	struct dsc_ent_t *e = get_dsc_entry(a);
+	if (e) {
+		*status = 0;
+		return (conf.apparent_size == 1 ? e->rec.info.size
+			: (e->rec.info.blocks * S_BLKSIZE));
+	}
+
+	struct dsc_rec_t rec = {0};
+	dir_info(dir, 1, &rec.info);
+	*status = rec.info.status;
+
+	/* Results including errors are not cached: the error might be gone
+	 * next time. */
+	if (rec.info.status == 0) {
+		rec.dev = a->st_dev;
+		rec.ino = a->st_ino;
+		rec.mtime = a->st_mtime;
+		rec.ctime = a->st_ctime;
+		rec.mtime_ns = DSC_MTIM_NSEC(a);
+		rec.ctime_ns = DSC_CTIM_NSEC(a);
+		store_dsc_entry(&rec);
+	}
+
+	return (conf.apparent_size == 1 ? rec.info.size
+		: (rec.info.blocks * S_BLKSIZE));
+}
+
+#else /* CLIFM_LEGACY || USE_DU1 */
+void
+free_dir_size_cache(void)
+{
+	/* Nothing to do: the cache is not used */
+}
+
+void
+invalidate_dir_size_cache(const char *dir)
+{
+	UNUSED(dir);
+}
+
+off_t
+# ifdef USE_DU1
+cached_dir_size(char *dir, const struct stat *a, int *status)
+# else
+cached_dir_size(const char *dir, const struct stat *a, int *status)
+# endif /* USE_DU1 */
+{
+	UNUSED(a);
+	return dir_size(dir, 1, status);
+}
+#endif /* !CLIFM_LEGACY && !USE_DU1 */
@@ -29,10 +29,14 @@ __BEGIN_DECLS
 
 void dir_info(const char *dir, const int first_level, struct dir_info_t *info);
 #ifdef USE_DU1
+off_t cached_dir_size(char *dir, const struct stat *a, int *status);
 off_t dir_size(char *dir, const int first_level, int *status);
 #else
+off_t cached_dir_size(const char *dir, const struct stat *a, int *status);
 off_t dir_size(const char *dir, const int first_level, int *status);
 #endif /* USE_DU1 */
+void free_dir_size_cache(void);
+void invalidate_dir_size_cache(const char *dir);
 
 __END_DECLS
 